@@ -0,0 +1,68 @@
+include(include.pri)
+
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+CONFIG(release, debug|release){
+    TARGET = RecordBench
+    DESTDIR = $$PWD/../RecordBench
+}
+
+QMAKE_CXXFLAGS += -std=c++11 -fpermissive -O3
+QMAKE_CXXFLAGS += -Wno-missing-field-initializers -Wno-unused-variable -Wno-unused-parameter
+
+# frame classes include the librealsense2 headers; nothing is linked from it
+INCLUDEPATH += /home/ssr/Documents/librealsense-2.20.0/include/
+INCLUDEPATH += /usr/include/
+
+SOURCES += \
+    recordbench.cpp \
+    depthimageframe.cpp \
+    irimageframe.cpp \
+    colimageframe.cpp \
+    recordpipeline.cpp \
+    framepool.cpp \
+    jpegencoder.cpp \
+    segmentwriter.cpp \
+    ioengine.cpp \
+    workerpool.cpp \
+    depthcodec.cpp \
+    syntheticsource.cpp \
+    latencyhistogram.cpp \
+    backpressure.cpp \
+    framering.cpp \
+    burstrecorder.cpp \
+    roicrop.cpp \
+    mjpegwriter.cpp
+
+LIBS += -L/usr/lib/x86_64-linux-gnu -lboost_system
+LIBS += -L/usr/lib/x86_64-linux-gnu -lboost_filesystem
+LIBS += -L/usr/lib/x86_64-linux-gnu -lboost_date_time
+LIBS += -L/usr/lib/x86_64-linux-gnu -lboost_thread
+LIBS += -L/usr/lib/x86_64-linux-gnu -lboost_chrono
+LIBS += -L/usr/lib/x86_64-linux-gnu -ljpeg
+LIBS += -pthread
+
+HEADERS += \
+    depthimageframe.h \
+    irimageframe.h \
+    colimageframe.h \
+    recordpipeline.h \
+    framepool.h \
+    jpegencoder.h \
+    segmentwriter.h \
+    ioengine.h \
+    workerpool.h \
+    depthcodec.h \
+    simdcpu.h \
+    streamtype.h \
+    framesource.h \
+    syntheticsource.h \
+    latencyhistogram.h \
+    backpressure.h \
+    framering.h \
+    burstrecorder.h \
+    roicrop.h \
+    mjpegwriter.h
@@ -1,6 +1,10 @@
 /* Program to view and record multiple RealSense streams for imaging purposes.
  *
  * User input: save folder extension (expects int), framerate (expects int <=30)
+ * Command line: --synthetic [fps] [--fast] runs on generated frames,
+ *               --replay <D_dir> <RGB_dir> [--fast] plays back a recorded session,
+ *               --devices N limits (live) or sets (synthetic) the number of cameras;
+ *               by default every connected camera records, each from its own thread
  * Compatable with Ubuntu 14.04 and 16.10
  * This package will only compile and run with an up-to-date librealsense package and uvcvideo kernel.
  *
@@ -12,9 +16,11 @@
 #include <iostream>
 #include <cstdio>
 #include <string>
-#include <sys/resource.h>
 #include <map>
 #include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
 
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/operations.hpp>
@@ -42,6 +48,12 @@
 #include "depthimageframe.h"
 #include "irimageframe.h"
 #include "colimageframe.h"
+#include "recordpipeline.h"
+#include "framesource.h"
+#include "realsensev1source.h"
+#include "syntheticsource.h"
+#include "replaysource.h"
+#include "multicapture.h"
 
 
 // CONSTANTS
@@ -52,6 +64,28 @@
 #define DEPTHHEIGHT 480
 #define FRAMERATE 30
 
+// recording workers (see recordpipeline.h)
+#define CONVERT_WORKERS 1
+#define ENCODE_WORKERS 2
+#define WRITE_WORKERS 1
+#define QUEUE_FRAMES 64
+#define POOL_FRAMES 32
+#define JPEG_QUALITY 95
+#define SEGMENTED_RAW true     // depth/IR into segment containers instead of one .dat per frame
+#define LOSSLESS_DEPTH true    // TZ16 compressed depth (see depthcodec.h)
+#define TILE_WORKERS 1
+#define JPEG_STRIPES true      // colour JPEGs in stripes on the tile workers as well (see jpegencoder.h)
+#define COLOUR_AVI true        // colour appended to one MJPEG AVI per session instead of a JPEG per frame (see mjpegwriter.h)
+#define BACK_PRESSURE true     // lower colour quality / shed frames under I/O stress (see backpressure.h)
+#define BURST_SECONDS 10       // key B: capture raw into RAM at the full rate, encode in the background
+#define BURST_MEMORY_MB 512    // RAM per camera for a burst, allocated at the first B (0 disables burst mode)
+#define PRETRIGGER_SECONDS 3   // a movie starts this long before M was pressed
+#define PRETRIGGER_MEMORY_MB 0 // RAM per camera for the pre-trigger history, locked while streaming (0 disables it; ~1024 holds 3 s at 1080p)
+#define MOTION_GATED false     // key G: while recording, store only framesets with movement (see motiongate.h)
+#define MOTION_POSTROLL_S 3    // gated recording goes on this long after the last movement; the pre-roll is PRETRIGGER_SECONDS
+#define PREVIEW_FPS 10         // display updates per second, also while recording (see previewstage.h)
+#define DISPLAY_ZOOM 0.6f      // on-screen size relative to full resolution
+
 namespace bfs = boost::filesystem;
 namespace bchrono = boost::chrono;
 namespace bgreg = boost::gregorian;
@@ -61,9 +95,74 @@ unsigned char g_movflag = 0x00;
 
 bfs::path cpath{"../../TermiteRecord/"};
 bfs::path dpath{"../../TermiteRecord/"};
+bfs::path g_cropFile{"../../TermiteRecord/record_roi.txt"};
+
+// per-camera capture threads and the recorder, shared with the key callback
+multiCapture* g_capture = nullptr;
+recordPipeline* g_recorder = nullptr;
+
+// camera shown in the window (D cycles)
+int g_view = 0;
+
+
+static void load_record_roi(recordPipeline& recorder)
+{
+    // recording ROI: only these regions of each stream are stored; a stream keeps its regions once it recorded
+    int kept = recorder.load_crop(g_cropFile);
+    if (kept < 0) std::cout << "No recording ROI in " << g_cropFile << ", full frames are stored" << std::endl;
+    else std::cout << "Recording ROI loaded from " << g_cropFile
+                   << (kept ? ", streams that already recorded keep their regions" : "") << std::endl;
+}
+
 
-// compression queue: not needed on hardware over 3.1GHz
-// boost::lockfree::spsc_queue<int, boost::lockfree::capacity<90000> > timestampList;
+static std::vector< std::unique_ptr<frameSource> > make_sources(int argc, char* argv[])
+{
+    /* picks the frame sources from the command line: every connected camera by default */
+    bool fast = false;
+    int devices = 0;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--fast") fast = true;
+        if (std::string(argv[i]) == "--devices" && i + 1 < argc) devices = std::stoi(argv[i + 1]);
+    }
+
+    std::vector< std::unique_ptr<frameSource> > sources;
+
+    if (argc > 1 && std::string(argv[1]) == "--synthetic") {
+        syntheticConfig scfg;
+        scfg.colWidth = COLWIDTH;
+        scfg.colHeight = COLHEIGHT;
+        scfg.depthWidth = DEPTHWIDTH;
+        scfg.depthHeight = DEPTHHEIGHT;
+        scfg.fps = (argc > 2 && argv[2][0] != '-') ? std::stof(argv[2]) : FRAMERATE;
+        scfg.realtime = !fast;
+        for (int i = 0; i < std::max(devices, 1); i++) sources.emplace_back(new syntheticSource(scfg));
+        return sources;
+    }
+    if (argc > 3 && std::string(argv[1]) == "--replay") {
+        replayConfig pcfg;
+        pcfg.depthDir = argv[2];
+        pcfg.colDir = argv[3];
+        pcfg.depthWidth = DEPTHWIDTH;
+        pcfg.depthHeight = DEPTHHEIGHT;
+        pcfg.realtime = !fast;
+        sources.emplace_back(new replaySource(pcfg));
+        return sources;
+    }
+
+    int connected = realsenseV1Source::device_count();
+    if (devices <= 0 || devices > connected) devices = connected;
+    for (int i = 0; i < devices; i++) {
+        realsenseV1Config lcfg;
+        lcfg.colWidth = COLWIDTH;
+        lcfg.colHeight = COLHEIGHT;
+        lcfg.depthWidth = DEPTHWIDTH;
+        lcfg.depthHeight = DEPTHHEIGHT;
+        lcfg.fps = FRAMERATE;
+        lcfg.deviceIndex = i;
+        sources.emplace_back(new realsenseV1Source(lcfg));
+    }
+    return sources;
+}
 
 
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -72,57 +171,47 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
     using std::cout;
     using std::endl;
 
-    static int calib_depth_num = 0;
-    static int calib_IR_num = 0;
-    static int calib_col_num = 0;
-
     const unsigned char allmov = 0x01;
     const unsigned char colmov = 0x02;
     const unsigned char depmov = 0x04;
 
-    bfs::path c_path = cpath;
-    bfs::path d_path = dpath;
-
-    rs::device * dev = static_cast<rs::device *>(glfwGetWindowUserPointer(window));
+    // colour options only exist on a live camera; they apply to the camera on display
+    realsenseV1Source * live = g_capture ? dynamic_cast<realsenseV1Source *>(g_capture->source(g_view)) : nullptr;
+    rs::device * dev = live ? live->device() : nullptr;
 
     // important: DO NOT TAKE SNAPSHOTS IF MOVIE IS RUNNING - messes with framerate
 
     switch(key) {
-    case GLFW_KEY_A: // all frame snapshot
-        if ((action == GLFW_PRESS) && (!(g_movflag & 0x01)))
+    case GLFW_KEY_A: // all frame snapshot, every camera
+        if ((action == GLFW_PRESS) && (!(g_movflag & 0x01)) && g_capture)
         {
-            std::string d_file = "DepthSnap_" + std::to_string(calib_depth_num) + ".dat";
-            std::string ir_file = "IRSnap_" + std::to_string(calib_IR_num) + ".dat";
-            std::string c_file = "ColSnap_" + std::to_string(calib_col_num) + ".jpg";
-
-            colImageFrame cfilesave(COLWIDTH, COLHEIGHT);
-            depthImageFrame dfilesave(DEPTHWIDTH, DEPTHHEIGHT);
-            irImageFrame irfilesave(DEPTHWIDTH, DEPTHHEIGHT);
-
-            typedef void (colImageFrame::*cs_fn)(rs::device*, bfs::path, std::string);
-            typedef void (depthImageFrame::*ds_fn)(rs::device*, bfs::path, std::string);
-
-            // save frames
-            boost::thread colsnapshot(boost::bind((cs_fn)&colImageFrame::save_col_frame, &cfilesave, dev, c_path, c_file));
-            boost::thread depthsnapshot(boost::bind((ds_fn)&depthImageFrame::save_d_frame, &dfilesave, dev, d_path, d_file));
-            boost::thread irsnapshot(boost::bind(&irImageFrame::save_ir_frame, &irfilesave, dev, d_path, ir_file));
-
-            colsnapshot.detach();
-            depthsnapshot.detach();
-            irsnapshot.detach();
-
-            std::cout << "Depth frame stored" << std::endl;
-            calib_depth_num++;
-
-            std::cout << "IR frame stored" << std::endl;
-            calib_IR_num++;
+            // each capture thread stores its next frameset (DepthSnap_N, IRSnap_N, ColSnap_N)
+            g_capture->request_snapshot();
+        }
+        break;
 
-            std::cout << "Color frame stored" << std::endl;
-            calib_col_num++;
+    case GLFW_KEY_B: // burst: full-rate capture into RAM, drained to disk in the background
+        if ((action == GLFW_PRESS) && (!(g_movflag & 0x01)) && g_capture)
+        {
+            if (g_capture->burst_active()) cout << "Burst still running" << endl;
+            else g_capture->request_burst();
+        }
+        break;
 
+    case GLFW_KEY_D: // show the next camera
+        if ((action == GLFW_PRESS) && g_capture && g_capture->device_count() > 1)
+        {
+            g_view = (g_view + 1) % g_capture->device_count();
+            cout << "Showing camera " << g_view << endl;
         }
         break;
 
+    case GLFW_KEY_G:    // motion-gated recording on/off
+        if ((action == GLFW_PRESS) && g_capture) {
+            g_capture->set_motion_gated(!g_capture->motion_gated());
+            cout << "Motion-gated recording " << (g_capture->motion_gated() ? "on" : "off") << endl; }
+        break;
+
     case GLFW_KEY_M:    // start synchronized movie recording
         if (action == GLFW_PRESS) { g_movflag |= allmov;
             cout << "Movie recording started (all streams) " << endl; }
@@ -130,7 +219,7 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 
     case GLFW_KEY_P:    // cycle through exposure options
 
-        if ((action == GLFW_PRESS) && (!(g_movflag & 0x01)))
+        if ((action == GLFW_PRESS) && (!(g_movflag & 0x01)) && dev)
         {
              int init_val = 40;             
              int newval;
@@ -155,8 +244,12 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
          }
         break;
 
+    case GLFW_KEY_R:    // reload the recording ROI file
+        if ((action == GLFW_PRESS) && g_recorder) load_record_roi(*g_recorder);
+        break;
+
     case GLFW_KEY_S: // change sharpness
-        if ((action == GLFW_PRESS) && (!(g_movflag & 0x01)))
+        if ((action == GLFW_PRESS) && (!(g_movflag & 0x01)) && dev)
         {
             int c_sharp = dev->get_option(rs::option::color_sharpness);
             int new_sharp;
@@ -173,7 +266,7 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 
 
     case GLFW_KEY_W: // change white balance
-        if ((action == GLFW_PRESS) && (!(g_movflag & 0x01)))
+        if ((action == GLFW_PRESS) && (!(g_movflag & 0x01)) && dev)
         {
             int white_on = dev->get_option(rs::option::color_enable_auto_white_balance);
 
@@ -201,16 +294,17 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
     // default: do nothing
     default:
         if ((action == GLFW_PRESS) && (!(g_movflag & 0x01))){  // random keypress
-            cout << "Function keys are M (start movie), E (end movie), A (take snapshots), P (exposure), S (sharpness), W (white balance)" << endl; }
+            cout << "Function keys are M (start movie), E (end movie), A (take snapshots), B (burst), D (next camera), G (motion-gated recording), R (reload recording ROI), P (exposure), S (sharpness), W (white balance)" << endl; }
 
     }
 }
 
 
-int main()
+int main(int argc, char* argv[])
 
-/* streams and records frames from one realsense device.
- * TODO: upgrade to multiple devices, asynchronous.*/
+/* streams and records frames from one or more frame sources (realsense devices, synthetic or replay).
+ * Every camera is read by its own capture thread (multicapture.h); this thread only displays and
+ * handles keys. */
 
 try
 {
@@ -219,11 +313,6 @@ try
     int runNum;
     std::string lineIn;
 
-    struct rlimit rl;
-
-    // context object for realsense devices
-    rs::context ctx;
-
     // default values
     float colframerate = 30;
     float depthframerate = 30;
@@ -232,22 +321,6 @@ try
     int x_win = 1250;
     int y_win = 1200;
 
-    // Initialize frame numbers
-    int dnum = 1000000;
-    int cnum = 1000000;
-
-    // frame rate interval handling
-    int c_incr = 0;
-    int c_interval = static_cast<int>(1000/colframerate);
-
-    // change stack size to handle file compression quickly
-
-    const rlim_t kStackSize = 16*1024*1024; // 16MB
-    rl.rlim_cur = kStackSize;
-    int result = setrlimit(RLIMIT_STACK, &rl);
-    std::cout << "Allocated static memory changed to " << kStackSize << std::endl;
-    if (result !=0) { std::cout << "Warning: stack size may be insufficient. setrlimit returned " << result << std::endl;}
-
     typedef bchrono::milliseconds ms;
 
     // GET USER INPUT
@@ -267,26 +340,50 @@ try
                 std::cerr << "Error: valid framerates are integers up to 30fps " << std::endl;
             }
 
-    // SET UP REALSENSE
+    // SET UP FRAME SOURCES
 
     depthframerate = colframerate;
 
-    printf("There are %d connected RealSense devices.\n", ctx.get_device_count());
-    if(ctx.get_device_count() == 0) return EXIT_FAILURE;
-    rs::device * dev = ctx.get_device(0);
-
-    printf("\n Using device 0, an %s\n", dev->get_name());
-    printf("    Serial number: %s\n", dev->get_serial());
-    printf("    Firmware version: %s\n", dev->get_firmware_version());
-
-    // Configure all streams to run at VGA resolution at 30 frames per second
-    dev->enable_stream(rs::stream::depth, DEPTHWIDTH, DEPTHHEIGHT, rs::format::z16, FRAMERATE);
-    dev->enable_stream(rs::stream::color, COLWIDTH, COLHEIGHT, rs::format::rgb8, FRAMERATE);
-    dev->enable_stream(rs::stream::infrared, DEPTHWIDTH, DEPTHHEIGHT, rs::format::y8, FRAMERATE);
-
-    dev->start();
+    std::vector< std::unique_ptr<frameSource> > sources = make_sources(argc, argv);
+    if (sources.empty()) {
+        std::cerr << "No frame source available" << std::endl;
+        return EXIT_FAILURE;
+    }
+    for (auto& src : sources)
+        if (!src->start()) return EXIT_FAILURE;
+
+    // Start the recording workers, shared by every camera
+    recordConfig rcfg;
+    rcfg.convertWorkers = CONVERT_WORKERS;
+    rcfg.encodeWorkers = ENCODE_WORKERS;
+    rcfg.writeWorkers = WRITE_WORKERS;
+    rcfg.queueCapacity = QUEUE_FRAMES;
+    rcfg.poolFrames = POOL_FRAMES;
+    rcfg.jpeg.quality = JPEG_QUALITY;
+    rcfg.jpeg.subsampling = jpegSubsampling::s420;
+    rcfg.raw = SEGMENTED_RAW ? rawStorage::segmented : rawStorage::perFile;
+    rcfg.depth = LOSSLESS_DEPTH ? depthFormat::tz16 : depthFormat::raw;
+    rcfg.tileWorkers = TILE_WORKERS;
+    rcfg.jpegStripes = JPEG_STRIPES;
+    rcfg.colour = COLOUR_AVI ? colourStorage::mjpegAvi : colourStorage::perFile;
+    rcfg.movie.fps = colframerate;
+    rcfg.pressure.enabled = BACK_PRESSURE;
+    rcfg.devices = static_cast<int>(sources.size());
+
+    recordPipeline recorder(rcfg);
+
+    // first frameset of each camera gives its stream geometry (replayed sessions may differ from the defaults)
+    for (size_t i = 0; i < sources.size(); i++) {
+        frameSet first;
+        if (!sources[i]->wait_for_frames(first) || !first.depth.valid()) return EXIT_FAILURE;
+        int dev = static_cast<int>(i);
+        recorder.add_stream(streamType::colour, first.colour.valid() ? first.colour.width : COLWIDTH,
+                            first.colour.valid() ? first.colour.height : COLHEIGHT, dev);
+        recorder.add_stream(streamType::depth, first.depth.width, first.depth.height, dev);
+        recorder.add_stream(streamType::infrared, first.depth.width, first.depth.height, dev);
+    }
 
-    std::cout << "All streams streaming at " << FRAMERATE << " fps" << std::endl;
+    std::cout << sources.size() << " camera(s) streaming at " << FRAMERATE << " fps from " << sources[0]->name() << std::endl;
     std::cout << "Color recording framerate " << colframerate << ", Depth recording framerate " << depthframerate << std::endl;
 
     // Create files, folders
@@ -318,97 +415,81 @@ try
 
     GLFWwindow * win = glfwCreateWindow(x_win, y_win, "Termite Scanner", nullptr, nullptr);
     glfwMakeContextCurrent(win);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);     // preview rows are tightly packed
 
     // Set up key controls
     glfwSetKeyCallback(win, key_callback);
-    glfwSetWindowUserPointer(win, dev);
-
-    std::cout << "cast completed" << std::endl;
-
-    bchrono::system_clock::time_point start = bchrono::system_clock::now();
 
-
-    while(!glfwWindowShouldClose(win))
+    if (bfs::exists(g_cropFile)) load_record_roi(recorder);
+    recorder.start();
+    g_recorder = &recorder;
+
+    // one capture thread per camera; with several cameras each records into a camN subfolder
+    captureConfig ccfg;
+    ccfg.colPath = cpath;
+    ccfg.depthPath = dpath;
+    ccfg.intervalMs = (colframerate < 28) ? 1000.0/colframerate : 0.0;     // save at lower framerates than streaming rates
+    ccfg.burst.seconds = BURST_SECONDS;
+    ccfg.burst.ring.budgetBytes = static_cast<size_t>(BURST_MEMORY_MB)*1024*1024;
+    ccfg.preTrigger.seconds = PRETRIGGER_SECONDS;
+    ccfg.preTrigger.ring.budgetBytes = static_cast<size_t>(PRETRIGGER_MEMORY_MB)*1024*1024;
+    ccfg.preview.fps = PREVIEW_FPS;
+    ccfg.motionGated = MOTION_GATED;
+    ccfg.motion.postRollMs = MOTION_POSTROLL_S*1000.0;
+
+    multiCapture capture(recorder, ccfg);
+    for (auto& src : sources) capture.add_device(src.get());
+    capture.start();
+    g_capture = &capture;
+
+    previewFrames view;
+
+    while(!glfwWindowShouldClose(win) && capture.running())
     {
         glfwPollEvents();
 
-        bfs::path c_path = cpath;
-        bfs::path d_path = dpath;
-
-        ms tickcount = bchrono::duration_cast<ms>(bchrono::system_clock::now() - start);
-        int cstamp = tickcount.count();
-        int dstamp = tickcount.count();
-        if(dev->is_streaming()) dev->wait_for_frames();
-        
-        const GLvoid* colim = dev->get_frame_data(rs::stream::color);
-        const GLvoid* depthim = dev->get_frame_data(rs::stream::depth);
-        const GLvoid* irim = dev->get_frame_data(rs::stream::infrared);
-
         // Always record with synced color/depth
-        if (g_movflag & 0x01)
-        {
-            colImageFrame cfilesave(COLWIDTH, COLHEIGHT);
-            typedef void (colImageFrame::*cfn)(const void*, bfs::path, int);
-
-            depthImageFrame dfilesave(DEPTHWIDTH, DEPTHHEIGHT);
-            typedef void (depthImageFrame::*dfn)(const void*, bfs::path, int);
-
-            if (colframerate < 28)
-            {  // to save at lower framerates than streaming rates:
-
-                if ((cstamp-c_incr) >= c_interval)
-                {
-                    // color frame handling
-                    boost::thread colorframe(boost::bind((cfn)&colImageFrame::save_col_frame, &cfilesave, static_cast<const void*>(colim), c_path, cnum));
-                    colorframe.detach();
-                    // depth frame handling
-                    boost::thread depthframe(boost::bind((dfn)&depthImageFrame::save_d_frame, &dfilesave, static_cast<const void*>(depthim), d_path, dnum));
-                    depthframe.detach();
+        capture.set_recording(g_movflag & 0x01);
 
-                    dnum++;
-                    cnum++;
-
-                    c_incr = cstamp;
-                }
-            }
-            else { // record every frame
-                
-                // color frame handling
-                boost::thread colorframe(boost::bind((cfn)&colImageFrame::save_col_frame, &cfilesave, static_cast<const void*>(colim), c_path, cnum));
-                colorframe.detach();
-                // depth frame handling
-                boost::thread depthframe(boost::bind((dfn)&depthImageFrame::save_d_frame, &dfilesave, static_cast<const void*>(depthim), d_path, dnum));
-                depthframe.detach();
-
-                cnum++;
-                dnum++;
-            }
+        // the preview thread hands over small frames at PREVIEW_FPS, recording or not
+        if (!capture.preview(g_view, view)) {
+            boost::this_thread::sleep_for(ms(5));
+            continue;
         }
 
-        else {         // if not recording, stream:
+        const sourceFrame& colf = view.frames.colour;
+        const sourceFrame& depthf = view.frames.depth;
+        const sourceFrame& irf = view.frames.ir;
 
-            glClear(GL_COLOR_BUFFER_BIT);
+        glClear(GL_COLOR_BUFFER_BIT);
 
-            // TODO: dynamic monitor sizing
-            glPixelZoom(0.6,0.6);
-            glRasterPos2f(-1, -0.4);
-            glDrawPixels(COLWIDTH, COLHEIGHT, GL_RGB, GL_UNSIGNED_BYTE, colim);
+        // TODO: dynamic monitor sizing
+        // preview frames are reduced by an integer factor; zooming by it keeps the layout
+        glPixelZoom(DISPLAY_ZOOM*view.colourFactor, DISPLAY_ZOOM*view.colourFactor);
+        glRasterPos2f(-1, -0.4);
+        if (colf.valid()) glDrawPixels(colf.width, colf.height, GL_RGB, GL_UNSIGNED_BYTE, colf.data);
 
-            // Display depth data by linearly mapping depth between 0 and 1-ish to the red channel
-            glRasterPos2f(-1, -0.9);
-            glPixelTransferf(GL_RED_SCALE, 0xFFFF * dev->get_depth_scale() / 0.25f);
-            glDrawPixels(DEPTHWIDTH, DEPTHHEIGHT, GL_RED, GL_UNSIGNED_SHORT, depthim);
-            glPixelTransferf(GL_RED_SCALE, 1.0f);
+        // Display depth colour-mapped over its auto range (near = warm, no data = black, see framevisualiser.h)
+        glPixelZoom(DISPLAY_ZOOM*view.depthFactor, DISPLAY_ZOOM*view.depthFactor);
+        glRasterPos2f(-1, -0.9);
+        if (depthf.valid() && !view.depthColour.empty())
+            glDrawPixels(depthf.width, depthf.height, GL_RGB, GL_UNSIGNED_BYTE, view.depthColour.data());
 
-            //Display infrared image by mapping IR intensity to visible luminance
-            glRasterPos2f(-0.4, -0.9);
-            glDrawPixels(640, 480, GL_LUMINANCE, GL_UNSIGNED_BYTE, irim);
-
-            glfwSwapBuffers(win);
-        }
+        //Display infrared image, contrast-stretched, as luminance
+        glPixelZoom(DISPLAY_ZOOM*view.irFactor, DISPLAY_ZOOM*view.irFactor);
+        glRasterPos2f(-0.4, -0.9);
+        if (irf.valid()) glDrawPixels(irf.width, irf.height, GL_LUMINANCE, GL_UNSIGNED_BYTE, irf.data);
 
+        glfwSwapBuffers(win);
     }
 
+    // stop the cameras first, then finish everything already queued before exiting
+    capture.stop();
+    g_capture = nullptr;
+    g_recorder = nullptr;
+    recorder.stop();
+    for (auto& src : sources) src->stop();
+
     return EXIT_SUCCESS;
 }
 
@@ -27,7 +27,33 @@ SOURCES += \
     TermiteScan.cpp \
     depthimageframe.cpp \
     irimageframe.cpp \
-    colimageframe.cpp
+    colimageframe.cpp \
+    recordpipeline.cpp \
+    framepool.cpp \
+    jpegencoder.cpp \
+    segmentwriter.cpp \
+    ioengine.cpp \
+    workerpool.cpp \
+    depthcodec.cpp \
+    jpegdecoder.cpp \
+    sessionreader.cpp \
+    syntheticsource.cpp \
+    replaysource.cpp \
+    latencyhistogram.cpp \
+    frametracker.cpp \
+    backpressure.cpp \
+    realsensev1source.cpp \
+    multicapture.cpp \
+    framering.cpp \
+    burstrecorder.cpp \
+    pretrigger.cpp \
+    motiongate.cpp \
+    roicrop.cpp \
+    mjpegwriter.cpp \
+    boxfilter.cpp \
+    previewstage.cpp \
+    framevisualiser.cpp \
+    depthaligner.cpp
 
 LIBS += -L$$DESTDIR/ -lrealsense
 LIBS += -L/usr/lib/x86_64-linux-gnu -lboost_system
@@ -44,4 +70,34 @@ LIBS += -pthread
 HEADERS += \
     depthimageframe.h \
     irimageframe.h \
-    colimageframe.h
+    colimageframe.h \
+    recordpipeline.h \
+    framepool.h \
+    jpegencoder.h \
+    segmentwriter.h \
+    ioengine.h \
+    workerpool.h \
+    depthcodec.h \
+    simdcpu.h \
+    streamtype.h \
+    jpegdecoder.h \
+    sessionreader.h \
+    framesource.h \
+    syntheticsource.h \
+    replaysource.h \
+    latencyhistogram.h \
+    frametracker.h \
+    backpressure.h \
+    realsensev1source.h \
+    multicapture.h \
+    clockaligner.h \
+    framering.h \
+    burstrecorder.h \
+    pretrigger.h \
+    motiongate.h \
+    roicrop.h \
+    mjpegwriter.h \
+    boxfilter.h \
+    previewstage.h \
+    framevisualiser.h \
+    depthaligner.h
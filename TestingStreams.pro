@@ -27,7 +27,37 @@ SOURCES += \
     irFramesTest.cpp \
     depthimageframe.cpp \
     irimageframe.cpp \
-    colimageframe.cpp
+    colimageframe.cpp \
+    recordpipeline.cpp \
+    framepool.cpp \
+    jpegencoder.cpp \
+    segmentwriter.cpp \
+    ioengine.cpp \
+    workerpool.cpp \
+    depthcodec.cpp \
+    jpegdecoder.cpp \
+    sessionreader.cpp \
+    syntheticsource.cpp \
+    replaysource.cpp \
+    latencyhistogram.cpp \
+    frametracker.cpp \
+    backpressure.cpp \
+    realsensesource.cpp \
+    boxfilter.cpp \
+    previewstage.cpp \
+    framevisualiser.cpp \
+    depthstats.cpp \
+    depthaligner.cpp \
+    sessionaligner.cpp \
+    pointcloud.cpp \
+    cloudexporter.cpp \
+    backgroundmodel.cpp \
+    bloblabeller.cpp \
+    termitedetector.cpp \
+    termitetracker.cpp \
+    motiongate.cpp \
+    roicrop.cpp \
+    mjpegwriter.cpp
 
 LIBS += -L/usr/lib/x86_64-linux-gnu -lboost_system
 LIBS += -L/usr/lib/x86_64-linux-gnu -lboost_filesystem
@@ -43,4 +73,37 @@ LIBS += -pthread
 HEADERS += \
     depthimageframe.h \
     irimageframe.h \
-    colimageframe.h
+    colimageframe.h \
+    recordpipeline.h \
+    framepool.h \
+    jpegencoder.h \
+    segmentwriter.h \
+    ioengine.h \
+    workerpool.h \
+    depthcodec.h \
+    simdcpu.h \
+    streamtype.h \
+    jpegdecoder.h \
+    sessionreader.h \
+    framesource.h \
+    syntheticsource.h \
+    replaysource.h \
+    latencyhistogram.h \
+    frametracker.h \
+    backpressure.h \
+    realsensesource.h \
+    boxfilter.h \
+    previewstage.h \
+    framevisualiser.h \
+    depthstats.h \
+    depthaligner.h \
+    sessionaligner.h \
+    pointcloud.h \
+    cloudexporter.h \
+    backgroundmodel.h \
+    bloblabeller.h \
+    termitedetector.h \
+    termitetracker.h \
+    motiongate.h \
+    roicrop.h \
+    mjpegwriter.h
@@ -0,0 +1,153 @@
+#include "backgroundmodel.h"
+
+#include <algorithm>
+
+#include "simdcpu.h"
+
+#if SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct modelParams
+{
+    float rate;
+    float fgRate;
+    float k2;                           // sigmas squared
+    float min2;                         // minDiff squared
+    float initVar;
+    bool detect;
+    bool zeroInvalid;                   // depth: 0 is no data
+};
+
+// the AVX2 kernel evaluates the same expressions in the same order, so both give the same model
+template <typename T>
+void update_scalar(const T* in, float* m, float* v, uint8_t* fg, uint8_t bit, size_t from, size_t n, const modelParams& p)
+{
+    for (size_t i = from; i < n; i++) {
+        if (p.zeroInvalid && !in[i]) continue;
+        float x = static_cast<float>(in[i]);
+        if (v[i] < 0.0f) {
+            m[i] = x;
+            v[i] = p.initVar;
+            continue;
+        }
+        float d = x - m[i];
+        float d2 = d*d;
+        bool f = p.detect && d2 > std::max(p.k2*v[i], p.min2);
+        float a = f ? p.fgRate : p.rate;
+        m[i] = m[i] + a*d;
+        v[i] = (1.0f - a)*(v[i] + a*d2);
+        if (f) fg[i] |= bit;
+    }
+}
+
+#if SIMD_X86
+SIMD_TARGET("avx2")
+inline __m256 load8(const uint16_t* p)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+}
+
+SIMD_TARGET("avx2")
+inline __m256 load8(const uint8_t* p)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+}
+
+template <typename T>
+SIMD_TARGET("avx2")
+void update_avx2(const T* in, float* m, float* v, uint8_t* fg, uint8_t bit, size_t n, const modelParams& p)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 rate = _mm256_set1_ps(p.rate);
+    const __m256 fgRate = _mm256_set1_ps(p.fgRate);
+    const __m256 k2 = _mm256_set1_ps(p.k2);
+    const __m256 min2 = _mm256_set1_ps(p.min2);
+    const __m256 initVar = _mm256_set1_ps(p.initVar);
+    const __m256 detect = _mm256_castsi256_ps(_mm256_set1_epi32(p.detect ? -1 : 0));
+    const __m128i bits = _mm_set1_epi8(static_cast<char>(bit));
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = load8(in + i);
+        __m256 vm = _mm256_loadu_ps(m + i);
+        __m256 vv = _mm256_loadu_ps(v + i);
+
+        __m256 valid = p.zeroInvalid ? _mm256_cmp_ps(x, zero, _CMP_NEQ_OQ) : _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        __m256 fresh = _mm256_cmp_ps(vv, zero, _CMP_LT_OQ);
+
+        __m256 d = _mm256_sub_ps(x, vm);
+        __m256 d2 = _mm256_mul_ps(d, d);
+        __m256 f = _mm256_cmp_ps(d2, _mm256_max_ps(_mm256_mul_ps(k2, vv), min2), _CMP_GT_OQ);
+        f = _mm256_and_ps(_mm256_and_ps(f, detect), _mm256_andnot_ps(fresh, valid));
+
+        __m256 a = _mm256_blendv_ps(rate, fgRate, f);
+        __m256 nm = _mm256_add_ps(vm, _mm256_mul_ps(a, d));
+        __m256 nv = _mm256_mul_ps(_mm256_sub_ps(one, a), _mm256_add_ps(vv, _mm256_mul_ps(a, d2)));
+        nm = _mm256_blendv_ps(nm, x, fresh);
+        nv = _mm256_blendv_ps(nv, initVar, fresh);
+        _mm256_storeu_ps(m + i, _mm256_blendv_ps(vm, nm, valid));
+        _mm256_storeu_ps(v + i, _mm256_blendv_ps(vv, nv, valid));
+
+        // 8 lane masks -> 8 mask bytes
+        __m256i fi = _mm256_castps_si256(f);
+        if (_mm256_testz_si256(fi, fi)) continue;
+        __m128i f16 = _mm_packs_epi32(_mm256_castsi256_si128(fi), _mm256_extracti128_si256(fi, 1));
+        __m128i f8 = _mm_and_si128(_mm_packs_epi16(f16, f16), bits);
+        __m128i old = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(fg + i));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(fg + i), _mm_or_si128(old, f8));
+    }
+    update_scalar(in, m, v, fg, bit, i, n, p);
+}
+#endif
+
+template <typename T>
+void update_range(const T* in, float* m, float* v, uint8_t* fg, uint8_t bit, size_t n, const modelParams& p)
+{
+#if SIMD_X86
+    if (cpu_has_avx2()) { update_avx2(in, m, v, fg, bit, n, p); return; }
+#endif
+    update_scalar(in, m, v, fg, bit, 0, n, p);
+}
+
+}
+
+backgroundModel::backgroundModel() : width(0), height(0), frames(0), rate(1.0f), fgRate(1.0f), detect(false)
+{
+}
+
+void backgroundModel::reset(int m_width, int m_height, const backgroundConfig& m_cfg)
+{
+    cfg = m_cfg;
+    width = m_width;
+    height = m_height;
+    size_t n = static_cast<size_t>(width)*height;
+    mean.assign(n, 0.0f);
+    var.assign(n, -1.0f);
+    frames = 0;
+}
+
+void backgroundModel::begin_frame()
+{
+    frames++;
+    detect = frames > cfg.warmupFrames;
+    rate = detect ? cfg.rate : std::max(cfg.rate, 1.0f/frames);
+    fgRate = detect ? cfg.foregroundRate : rate;
+}
+
+void backgroundModel::update_rows(const uint16_t* depth, uint8_t* fg, uint8_t bit, int y0, int y1)
+{
+    modelParams p = { rate, fgRate, cfg.sigmas*cfg.sigmas, cfg.minDiff*cfg.minDiff, cfg.initVar, detect, true };
+    size_t at = static_cast<size_t>(y0)*width;
+    update_range(depth + at, mean.data() + at, var.data() + at, fg + at, bit, static_cast<size_t>(y1 - y0)*width, p);
+}
+
+void backgroundModel::update_rows(const uint8_t* ir, uint8_t* fg, uint8_t bit, int y0, int y1)
+{
+    modelParams p = { rate, fgRate, cfg.sigmas*cfg.sigmas, cfg.minDiff*cfg.minDiff, cfg.initVar, detect, false };
+    size_t at = static_cast<size_t>(y0)*width;
+    update_range(ir + at, mean.data() + at, var.data() + at, fg + at, bit, static_cast<size_t>(y1 - y0)*width, p);
+}
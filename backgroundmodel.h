@@ -0,0 +1,85 @@
+/* backgroundmodel.h
+ *
+ * Description:
+ *   header file for backgroundModel class
+ *   Running per-pixel background of a depth (Z16) or IR (Y8) stream: an
+ *   exponentially weighted mean and variance, updated with every frame.
+ *   A pixel is foreground when it differs from the mean by more than `sigmas`
+ *   standard deviations and by more than minDiff (the floor keeps a
+ *   perfectly still pixel from turning every bit of sensor noise into
+ *   foreground). Foreground pixels are learnt at a slower rate, so a termite
+ *   that stops is absorbed over seconds instead of frames.
+ *   Zero depth is "no data": it neither updates the model nor counts as
+ *   foreground. A pixel's first valid sample starts its mean, with initVar
+ *   as its variance; the first warmupFrames frames only learn, with a rate
+ *   of 1/(frame+1) so the mean settles quickly.
+ *
+ *   update_rows processes 8 pixels at a time (AVX2, scalar otherwise) and
+ *   works on a row range, so a frame can be split into bands over a
+ *   workerPool. Foreground is ORed into a byte mask as `bit`, so the depth
+ *   and IR models of one viewpoint can share a mask.
+ *
+ * Functions:
+ *   reset - allocates the model for a frame size and forgets everything
+ *   begin_frame - per-frame rates; call once per frame before update_rows
+ *   update_rows - updates rows [y0, y1) and marks their foreground
+ *   learning - still in the warm-up
+ *
+ * Input:
+ *   backgroundConfig, Z16 or Y8 frames
+ *
+ * Output:
+ *   foreground mask bits
+ *
+ * Requirements:
+ *   simdcpu.h
+ *
+ * Thread safe? update_rows on disjoint row ranges YES; reset/begin_frame NO
+ *
+ * Extendable? YES
+ */
+
+#ifndef BACKGROUNDMODEL_H
+#define BACKGROUNDMODEL_H
+
+#include <cstdint>
+#include <vector>
+
+struct backgroundConfig
+{
+    float rate = 0.02f;                 // background learning rate per frame (~50 frames memory)
+    float foregroundRate = 0.002f;      // learning rate of pixels that are foreground
+    float sigmas = 3.0f;                // foreground beyond this many standard deviations
+    float minDiff = 10.0f;              // ... and beyond this difference, in stream units
+    float initVar = 100.0f;             // variance a pixel starts with
+    int warmupFrames = 30;              // frames that only learn
+};
+
+class backgroundModel
+{
+    backgroundConfig cfg;
+    int width;
+    int height;
+    std::vector<float> mean;
+    std::vector<float> var;             // negative: no valid sample yet
+    long long frames;
+
+    // this frame
+    float rate;
+    float fgRate;
+    bool detect;
+
+public:
+    backgroundModel();
+
+    void reset(int m_width, int m_height, const backgroundConfig& m_cfg);
+    void begin_frame();
+    void update_rows(const uint16_t* depth, uint8_t* fg, uint8_t bit, int y0, int y1);
+    void update_rows(const uint8_t* ir, uint8_t* fg, uint8_t bit, int y0, int y1);
+
+    bool learning() const { return frames <= cfg.warmupFrames; }
+    int model_width() const { return width; }
+    int model_height() const { return height; }
+};
+
+#endif // BACKGROUNDMODEL_H
@@ -0,0 +1,76 @@
+#include "backpressure.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "framesource.h"
+
+static const char* step_names[] = { "normal", "quality", "decimate", "drop" };
+
+backPressure::backPressure(const backPressureConfig& b_cfg) : cfg(b_cfg), current(0), hold(0), changes(0)
+{
+    if (cfg.degradeQuality) steps.push_back(pressureStep::quality);
+    if (cfg.decimateColour && cfg.colourDecimation > 1) steps.push_back(pressureStep::decimate);
+    if (cfg.dropFramesets && cfg.framesetDecimation > 1) steps.push_back(pressureStep::drop);
+}
+
+bool backPressure::open_log(const boost::filesystem::path& file)
+{
+    logFile.open(file);
+    if (!logFile) return false;
+    logFile << "host_ms,frame,level,step,fill,write_ms,reason" << std::endl;
+    return true;
+}
+
+void backPressure::log_change(int64_t framenum, float fill, double write_ms, const char* reason)
+{
+    const char* name = current ? step_names[static_cast<int>(steps[current-1]) + 1] : step_names[0];
+    changes++;
+
+    std::cout << "Recorder back-pressure: level " << current << " (" << name << ") at frame " << framenum
+              << ", " << static_cast<int>(fill*100) << "% in flight, write " << write_ms << " ms - " << reason << std::endl;
+    if (logFile.is_open())
+        logFile << static_cast<long long>(host_ms()) << ',' << framenum << ',' << current << ',' << name << ','
+                << fill << ',' << write_ms << ',' << reason << std::endl;
+}
+
+pressureDecision backPressure::decide(int64_t framenum, float fill, double write_ms, int base_quality)
+{
+    pressureDecision d = { true, true, true, base_quality };
+    if (!cfg.enabled || steps.empty()) return d;
+
+    bool slow = cfg.writeLatencyMs > 0 && write_ms > cfg.writeLatencyMs;
+    bool fast = cfg.writeLatencyMs <= 0 || write_ms < 0.5*cfg.writeLatencyMs;
+
+    if (hold > 0) hold--;
+    else if ((fill >= cfg.highWater || slow) && current < static_cast<int>(steps.size())) {
+        current++;
+        hold = cfg.holdFramesets;
+        log_change(framenum, fill, write_ms, slow ? "writes slow" : "pipeline full");
+    }
+    else if (fill <= cfg.lowWater && fast && current > 0) {
+        current--;
+        hold = cfg.holdFramesets;
+        log_change(framenum, fill, write_ms, "recovered");
+    }
+
+    // steps are cumulative; keep/drop depends only on the frame number
+    int64_t colour_period = 1, set_period = 1;
+    for (int i = 0; i < current; i++) {
+        switch (steps[i]) {
+        case pressureStep::quality:
+            d.jpegQuality = std::min(base_quality, std::max(cfg.minQuality, base_quality - cfg.qualityStep));
+            break;
+        case pressureStep::decimate:
+            colour_period *= cfg.colourDecimation;
+            break;
+        case pressureStep::drop:
+            set_period = cfg.framesetDecimation;
+            colour_period *= cfg.framesetDecimation;
+            break;
+        }
+    }
+    d.keepColour = framenum % colour_period == 0;
+    d.keepDepth = d.keepIR = framenum % set_period == 0;
+    return d;
+}
@@ -0,0 +1,96 @@
+/* backpressure.h
+ *
+ * Description:
+ *   header file for backPressure class
+ *   Load-shedding policy for the recorder. Once per frameset it looks at how
+ *   full the pipeline is (frames in flight / job capacity) and how long
+ *   writes are taking, and moves through a ladder of degradation steps:
+ *     quality   - encode colour at lower JPEG quality
+ *     decimate  - keep 1 in N colour frames, depth untouched
+ *     drop      - keep 1 in N whole framesets
+ *   Steps can be switched off individually. The level rises when the load is
+ *   above the high watermark and falls below the low watermark; a hold time
+ *   between changes stops it oscillating. Which frames are kept depends only
+ *   on the level and the frame number, so shedding is predictable. Every level
+ *   change is printed and appended to a CSV log.
+ *
+ * Functions:
+ *   decide - policy for the next frameset
+ *   level - current step (0 = normal)
+ *   open_log - CSV file for the decisions
+ *
+ * Input:
+ *   backPressureConfig, pipeline fill fraction, write latency (ms)
+ *
+ * Output:
+ *   pressureDecision
+ *
+ * Requirements:
+ *   boost/filesystem
+ *
+ * Thread safe? NO (capture thread only)
+ *
+ * Extendable? YES
+ */
+
+#ifndef BACKPRESSURE_H
+#define BACKPRESSURE_H
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct backPressureConfig
+{
+    bool enabled = true;
+    float highWater = 0.6f;         // fraction of jobs in flight that raises the level
+    float lowWater = 0.25f;         // fraction that lowers it
+    double writeLatencyMs = 0;      // average write time that also raises the level (0: ignore)
+    int holdFramesets = 15;         // minimum framesets between level changes
+
+    bool degradeQuality = true;
+    int qualityStep = 20;           // JPEG quality reduction at the quality step
+    int minQuality = 60;
+
+    bool decimateColour = true;
+    int colourDecimation = 2;       // keep 1 in N colour frames
+
+    bool dropFramesets = true;
+    int framesetDecimation = 2;     // keep 1 in N framesets
+};
+
+struct pressureDecision
+{
+    bool keepColour;
+    bool keepDepth;
+    bool keepIR;
+    int jpegQuality;
+};
+
+class backPressure
+{
+    enum class pressureStep { quality, decimate, drop };
+
+    backPressureConfig cfg;
+    std::vector<pressureStep> steps;    // enabled steps, in escalation order
+    int current;                        // number of steps applied
+    int hold;
+    long long changes;
+
+    boost::filesystem::ofstream logFile;
+
+    void log_change(int64_t framenum, float fill, double write_ms, const char* reason);
+
+public:
+    backPressure(const backPressureConfig& b_cfg);
+
+    pressureDecision decide(int64_t framenum, float fill, double write_ms, int base_quality);
+    bool open_log(const boost::filesystem::path& file);
+
+    int level() const { return current; }
+    long long level_changes() const { return changes; }
+};
+
+#endif // BACKPRESSURE_H
@@ -0,0 +1,186 @@
+#include "bloblabeller.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "simdcpu.h"
+
+#if SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+template <typename Run>
+void push_run(std::vector<Run>& out, int y, int x0, int x1)
+{
+    Run r;
+    r.y = y;
+    r.x0 = x0;
+    r.x1 = x1;
+    out.push_back(r);
+}
+
+// runs of non-zero bytes; whole empty words are skipped
+template <typename Run>
+void row_runs_scalar(const uint8_t* row, int width, int y, std::vector<Run>& out)
+{
+    int x = 0;
+    while (x < width) {
+        while (x + 8 <= width) {
+            uint64_t word;
+            std::memcpy(&word, row + x, 8);
+            if (word) break;
+            x += 8;
+        }
+        while (x < width && !row[x]) x++;
+        if (x >= width) break;
+        int start = x;
+        while (x < width && row[x]) x++;
+        push_run(out, y, start, x);
+    }
+}
+
+#if SIMD_X86
+template <typename Run>
+SIMD_TARGET("avx2")
+void row_runs_avx2(const uint8_t* row, int width, int y, std::vector<Run>& out)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    int x = 0;
+    while (x < width) {
+        // next set byte
+        while (x + 32 <= width) {
+            uint32_t set = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x)), zero)));
+            if (set) { x += __builtin_ctz(set); break; }
+            x += 32;
+        }
+        while (x < width && !row[x]) x++;
+        if (x >= width) break;
+
+        // next clear byte
+        int start = x;
+        while (x + 32 <= width) {
+            uint32_t clear = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x)), zero)));
+            if (clear) { x += __builtin_ctz(clear); break; }
+            x += 32;
+        }
+        while (x < width && row[x]) x++;
+        push_run(out, y, start, x);
+    }
+}
+#endif
+
+}
+
+int blobLabeller::find(int i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+void blobLabeller::label(const uint8_t* mask, int width, int height, const uint16_t* depth,
+                         int min_area, int max_area, std::vector<blob>& out, workerPool* pool)
+{
+    out.clear();
+    if (!mask || width <= 0 || height <= 0) return;
+
+    // 1. runs, row bands in parallel
+    int bands = pool ? std::min(height, 2*(pool->size() + 1)) : 1;
+    if (static_cast<int>(bandRuns.size()) < bands) bandRuns.resize(bands);
+    auto scan_band = [&](int b) {
+        std::vector<pixelRun>& r = bandRuns[b];
+        r.clear();
+        int y1 = static_cast<int>(static_cast<int64_t>(height)*(b + 1)/bands);
+        for (int y = static_cast<int>(static_cast<int64_t>(height)*b/bands); y < y1; y++) {
+            const uint8_t* row = mask + static_cast<size_t>(y)*width;
+#if SIMD_X86
+            if (cpu_has_avx2()) { row_runs_avx2(row, width, y, r); continue; }
+#endif
+            row_runs_scalar(row, width, y, r);
+        }
+    };
+    if (pool) pool->parallel_for(bands, scan_band);
+    else scan_band(0);
+
+    runs.clear();
+    for (int b = 0; b < bands; b++) runs.insert(runs.end(), bandRuns[b].begin(), bandRuns[b].end());
+    const int n = static_cast<int>(runs.size());
+    if (!n) return;
+
+    rowStart.assign(height + 1, 0);
+    for (const pixelRun& r : runs) rowStart[r.y + 1]++;
+    for (int y = 0; y < height; y++) rowStart[y + 1] += rowStart[y];
+
+    // 2. join runs touching a run of the row above (diagonals included); the root is the lowest index
+    parent.resize(n);
+    for (int i = 0; i < n; i++) parent[i] = i;
+    for (int y = 1; y < height; y++) {
+        int p = rowStart[y - 1], pe = rowStart[y];
+        int c = rowStart[y], ce = rowStart[y + 1];
+        while (p < pe && c < ce) {
+            const pixelRun& above = runs[p];
+            const pixelRun& cur = runs[c];
+            if (above.x0 <= cur.x1 && cur.x0 <= above.x1) {
+                int ra = find(p), rc = find(c);
+                if (ra < rc) parent[rc] = ra;
+                else if (rc < ra) parent[ra] = rc;
+            }
+            if (above.x1 <= cur.x1) p++;
+            else c++;
+        }
+    }
+
+    // 3. sums over the runs; a root comes before every run of its blob
+    sums.resize(n);
+    for (int i = 0; i < n; i++) {
+        const pixelRun& r = runs[i];
+        int64_t len = r.x1 - r.x0;
+        int64_t depthSum = 0, depthPixels = 0;
+        if (depth) {
+            const uint16_t* z = depth + static_cast<size_t>(r.y)*width;
+            for (int x = r.x0; x < r.x1; x++) {
+                depthSum += z[x];
+                depthPixels += z[x] != 0;
+            }
+        }
+
+        int root = find(i);
+        blobSums& s = sums[root];
+        if (root == i) {
+            s.area = s.sumX = s.sumY = s.sumDepth = s.depthPixels = 0;
+            s.left = r.x0;
+            s.right = r.x1 - 1;
+            s.top = s.bottom = r.y;
+        }
+        s.area += len;
+        s.sumX += len*(r.x0 + r.x1 - 1)/2;           // x0 + ... + x1-1, always exact
+        s.sumY += len*r.y;
+        s.sumDepth += depthSum;
+        s.depthPixels += depthPixels;
+        s.left = std::min(s.left, r.x0);
+        s.right = std::max(s.right, r.x1 - 1);
+        s.bottom = r.y;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (parent[i] != i) continue;
+        const blobSums& s = sums[i];
+        if (s.area < min_area || (max_area > 0 && s.area > max_area)) continue;
+        blob b;
+        b.area = static_cast<int>(s.area);
+        b.x = static_cast<float>(static_cast<double>(s.sumX)/s.area);
+        b.y = static_cast<float>(static_cast<double>(s.sumY)/s.area);
+        b.depth = s.depthPixels ? static_cast<float>(static_cast<double>(s.sumDepth)/s.depthPixels) : 0.0f;
+        b.left = s.left;
+        b.top = s.top;
+        b.right = s.right;
+        b.bottom = s.bottom;
+        out.push_back(b);
+    }
+}
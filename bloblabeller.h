@@ -0,0 +1,81 @@
+/* bloblabeller.h
+ *
+ * Description:
+ *   header file for blobLabeller class
+ *   Connected components (8-connected) of a foreground byte mask, reduced to
+ *   blobs: area, centroid, bounding box and mean depth. The mask is read
+ *   once: each row becomes a list of runs of set pixels (32 bytes at a time
+ *   with AVX2, so the empty arena costs almost nothing), row bands in
+ *   parallel on a workerPool. Runs that touch a run of the row above are
+ *   joined in a union-find over run indices, and the blob sums are taken
+ *   over the runs, not the pixels; only the mean depth reads the depth
+ *   frame, along the runs. The work grows with the foreground, not the frame.
+ *   Blobs come out in raster order of their first pixel; blobs outside
+ *   [minArea, maxArea] are left out. All buffers are kept between frames.
+ *
+ * Functions:
+ *   label - blobs of one mask
+ *
+ * Input:
+ *   foreground mask (non-zero = foreground), optional Z16 frame of the same geometry
+ *
+ * Output:
+ *   std::vector<blob>
+ *
+ * Requirements:
+ *   workerpool.h, simdcpu.h
+ *
+ * Thread safe? NO (one labeller per thread)
+ *
+ * Extendable? YES
+ */
+
+#ifndef BLOBLABELLER_H
+#define BLOBLABELLER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "workerpool.h"
+
+struct blob
+{
+    int area = 0;                       // pixels
+    float x = 0.0f;                     // centroid, pixels
+    float y = 0.0f;
+    float depth = 0.0f;                 // mean of the non-zero depth pixels, Z16 units (0: none)
+    int left = 0;                       // bounding box, inclusive
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+};
+
+class blobLabeller
+{
+    struct pixelRun
+    {
+        int y;
+        int x0;
+        int x1;                         // exclusive
+    };
+
+    struct blobSums
+    {
+        int64_t area, sumX, sumY, sumDepth, depthPixels;
+        int left, top, right, bottom;
+    };
+
+    std::vector< std::vector<pixelRun> > bandRuns;
+    std::vector<pixelRun> runs;
+    std::vector<int> rowStart;          // first run of each row, height+1 entries
+    std::vector<int> parent;
+    std::vector<blobSums> sums;
+
+    int find(int i);
+
+public:
+    void label(const uint8_t* mask, int width, int height, const uint16_t* depth,
+               int min_area, int max_area, std::vector<blob>& out, workerPool* pool = 0);
+};
+
+#endif // BLOBLABELLER_H
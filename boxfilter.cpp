@@ -0,0 +1,165 @@
+#include "boxfilter.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "simdcpu.h"
+
+#if SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+void add_row_scalar(const uint8_t* src, int n, uint16_t* acc)
+{
+    for (int i = 0; i < n; i++) acc[i] += src[i];
+}
+
+void add_row_scalar(const uint16_t* src, int n, uint32_t* acc)
+{
+    for (int i = 0; i < n; i++) acc[i] += src[i];
+}
+
+#if SIMD_X86
+// SSE2 is part of x86-64, so these need no run-time check
+void add_row_sse2(const uint8_t* src, int n, uint16_t* acc)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+        _mm_storeu_si128(a, _mm_add_epi16(_mm_loadu_si128(a), _mm_unpacklo_epi8(v, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi16(_mm_loadu_si128(a + 1), _mm_unpackhi_epi8(v, zero)));
+    }
+    add_row_scalar(src + i, n - i, acc + i);
+}
+
+void add_row_sse2(const uint16_t* src, int n, uint32_t* acc)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(v, zero)));
+    }
+    add_row_scalar(src + i, n - i, acc + i);
+}
+
+SIMD_TARGET("avx2")
+void add_row_avx2(const uint8_t* src, int n, uint16_t* acc)
+{
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 16));
+        __m256i* a = reinterpret_cast<__m256i*>(acc + i);
+        _mm256_storeu_si256(a, _mm256_add_epi16(_mm256_loadu_si256(a), _mm256_cvtepu8_epi16(lo)));
+        _mm256_storeu_si256(a + 1, _mm256_add_epi16(_mm256_loadu_si256(a + 1), _mm256_cvtepu8_epi16(hi)));
+    }
+    add_row_scalar(src + i, n - i, acc + i);
+}
+
+SIMD_TARGET("avx2")
+void add_row_avx2(const uint16_t* src, int n, uint32_t* acc)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+        __m256i* a = reinterpret_cast<__m256i*>(acc + i);
+        _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), _mm256_cvtepu16_epi32(lo)));
+        _mm256_storeu_si256(a + 1, _mm256_add_epi32(_mm256_loadu_si256(a + 1), _mm256_cvtepu16_epi32(hi)));
+    }
+    add_row_scalar(src + i, n - i, acc + i);
+}
+#endif
+
+template <typename T, typename A>
+void add_row(const T* src, int n, A* acc)
+{
+#if SIMD_X86
+    if (cpu_has_avx2()) add_row_avx2(src, n, acc);
+    else add_row_sse2(src, n, acc);
+#else
+    add_row_scalar(src, n, acc);
+#endif
+}
+
+// sums factor accumulated rows horizontally and divides by the block area;
+// the division is a multiply by a 32.32 fixed-point reciprocal (exact for these ranges)
+template <int CH, typename A, typename T>
+void reduce_row(const A* acc, int out_width, int factor, T* out)
+{
+    const uint64_t area = static_cast<uint64_t>(factor)*factor;
+    const uint64_t half = area/2;
+    const uint64_t recip = ((1ull << 32) + area - 1)/area;
+    for (int x = 0; x < out_width; x++) {
+        const A* block = acc + static_cast<size_t>(x)*factor*CH;
+        uint32_t sum[CH] = {};
+        for (int k = 0; k < factor; k++)
+            for (int c = 0; c < CH; c++) sum[c] += block[k*CH + c];
+        for (int c = 0; c < CH; c++) out[x*CH + c] = static_cast<T>(((sum[c] + half)*recip) >> 32);
+    }
+}
+
+template <typename A, typename T>
+void reduce_row(const A* acc, int out_width, int channels, int factor, T* out)
+{
+    switch (channels) {
+    case 1: reduce_row<1>(acc, out_width, factor, out); break;
+    case 2: reduce_row<2>(acc, out_width, factor, out); break;
+    case 3: reduce_row<3>(acc, out_width, factor, out); break;
+    default: reduce_row<4>(acc, out_width, factor, out); break;
+    }
+}
+
+template <typename T, typename A>
+bool box_downscale(const T* src, int width, int height, int channels, int factor,
+                   std::vector<A>& acc, std::vector<T>& out)
+{
+    if (!src || width <= 0 || height <= 0 || channels < 1 || factor < 1 || factor > boxFilter::maxFactor) return false;
+
+    int ow = width/factor;
+    int oh = height/factor;
+    if (ow == 0 || oh == 0) return false;
+    out.resize(static_cast<size_t>(ow)*oh*channels);
+
+    size_t rowLen = static_cast<size_t>(width)*channels;
+    if (factor == 1) {
+        std::memcpy(out.data(), src, out.size()*sizeof(T));
+        return true;
+    }
+
+    int used = ow*factor*channels;      // samples per row that fall into whole blocks
+    acc.resize(used);
+    for (int y = 0; y < oh; y++) {
+        std::fill(acc.begin(), acc.end(), 0);
+        const T* row = src + static_cast<size_t>(y)*factor*rowLen;
+        for (int k = 0; k < factor; k++) add_row(row + k*rowLen, used, acc.data());
+        reduce_row(acc.data(), ow, channels, factor, out.data() + static_cast<size_t>(y)*ow*channels);
+    }
+    return true;
+}
+
+}
+
+int boxFilter::factor_for(int width, int target)
+{
+    if (target <= 0 || width <= target) return 1;
+    return std::min(maxFactor, (width + target - 1)/target);
+}
+
+bool boxFilter::downscale(const uint8_t* src, int width, int height, int channels, int factor, std::vector<uint8_t>& out)
+{
+    if (channels > 4) return false;
+    return box_downscale(src, width, height, channels, factor, acc8, out);
+}
+
+bool boxFilter::downscale(const uint16_t* src, int width, int height, int factor, std::vector<uint16_t>& out)
+{
+    return box_downscale(src, width, height, 1, factor, acc16, out);
+}
@@ -0,0 +1,50 @@
+/* boxfilter.h
+ *
+ * Description:
+ *   header file for boxFilter class
+ *   Area (box) downscaling by an integer factor for preview images: every
+ *   output pixel is the rounded mean of a factor x factor block of input
+ *   pixels; right/bottom edges that do not fill a block are dropped.
+ *   Input rows are summed into a row of accumulators 16 or 32 samples at a
+ *   time (SSE2, or AVX2 when the CPU has it, see simdcpu.h), then each
+ *   output pixel adds factor accumulators and divides once.
+ *
+ * Functions:
+ *   downscale - 8-bit images with 1..4 interleaved channels (RGB, IR), or Z16 depth
+ *   factor_for - smallest factor that brings a width down to a target width
+ *
+ * Input:
+ *   image buffer, width, height, factor
+ *
+ * Output:
+ *   width/factor x height/factor image in a caller-owned vector (resized as needed)
+ *
+ * Requirements:
+ *   simdcpu.h
+ *
+ * Thread safe? NO (accumulator rows are reused; one boxFilter per thread)
+ *
+ * Extendable? YES
+ */
+
+#ifndef BOXFILTER_H
+#define BOXFILTER_H
+
+#include <cstdint>
+#include <vector>
+
+class boxFilter
+{
+    std::vector<uint16_t> acc8;         // column sums of 8-bit rows (factor <= 16 keeps them in 16 bits)
+    std::vector<uint32_t> acc16;        // column sums of 16-bit rows
+
+public:
+    static const int maxFactor = 16;
+
+    static int factor_for(int width, int target);
+
+    bool downscale(const uint8_t* src, int width, int height, int channels, int factor, std::vector<uint8_t>& out);
+    bool downscale(const uint16_t* src, int width, int height, int factor, std::vector<uint16_t>& out);
+};
+
+#endif // BOXFILTER_H
@@ -0,0 +1,152 @@
+#include "burstrecorder.h"
+
+#include <boost/chrono/chrono.hpp>
+
+#include <iostream>
+
+int submit_entry(recordPipeline& recorder, ringEntry& e, const boost::filesystem::path& col_path,
+                 const boost::filesystem::path& depth_path, int framenum, int device)
+{
+    // slots move into the recorder's jobs and return to the ring once written
+    int queued = 0;
+    if (e.fresh.colour && e.frames.colour.valid())
+        queued += recorder.submit_held(streamType::colour, e.frames.colour, std::move(e.buffers[0]), col_path, framenum, device);
+    if (e.fresh.depth && e.frames.depth.valid())
+        queued += recorder.submit_held(streamType::depth, e.frames.depth, std::move(e.buffers[1]), depth_path, framenum, device);
+    if (e.fresh.ir && e.frames.ir.valid())
+        queued += recorder.submit_held(streamType::infrared, e.frames.ir, std::move(e.buffers[2]), depth_path, framenum, device);
+    e = ringEntry();
+    return queued;
+}
+
+burstRecorder::burstRecorder(recordPipeline& r_recorder, const burstConfig& b_cfg, int r_device)
+    : cfg(b_cfg), recorder(r_recorder), ring(b_cfg.ring), device(r_device),
+      name("Burst camera " + std::to_string(r_device)), nextFrame(0), started(0.0), unusable(false),
+      capturing(false), quit(false), full(false), n_captured(0), n_drained(0)
+{
+}
+
+burstRecorder::~burstRecorder()
+{
+    capturing = false;
+    quit = true;
+    if (drainer.joinable()) drainer.join();
+}
+
+bool burstRecorder::prepare(const frameSet& frames)
+{
+    if (ring.configured()) return true;
+    if (unusable) return false;
+    if (!ring.configure(frames)) {
+        unusable = true;            // budget too small for this stream geometry, do not retry every frame
+        return false;
+    }
+
+    std::cout << name << ": " << ring.capacity() << " framesets in " << ring.bytes_reserved()/(1024*1024) << " MB" << std::endl;
+    drainer = boost::thread(&burstRecorder::drain_loop, this);
+    return true;
+}
+
+bool burstRecorder::begin(const frameSet& frames, const boost::filesystem::path& col_path, const boost::filesystem::path& depth_path, int first_frame)
+{
+    // one burst at a time: numbering and folders belong to the burst being drained
+    if (capturing || draining() || !prepare(frames)) return false;
+
+    colPath = col_path;
+    depthPath = depth_path;
+    nextFrame = first_frame;
+    full = false;
+    n_captured = 0;
+    n_drained = 0;
+    started = host_ms();
+    capturing = true;
+
+    std::cout << name << " started: up to " << ring.capacity() << " framesets";
+    if (cfg.seconds > 0) std::cout << " or " << cfg.seconds << " s";
+    std::cout << std::endl;
+    return true;
+}
+
+bool burstRecorder::push(const frameSet& frames, const frameFreshness& fresh)
+{
+    if (!capturing) return false;
+
+    if (cfg.seconds > 0 && host_ms() - started >= cfg.seconds*1000.0) {
+        end();
+        return false;
+    }
+    // counted first, so the drain thread never sees more drained than captured
+    n_captured++;
+    if (!ring.push(frames, fresh)) {
+        // never drop inside a burst: cut it short instead
+        n_captured--;
+        full = true;
+        end();
+        return false;
+    }
+    return true;
+}
+
+void burstRecorder::end()
+{
+    if (!capturing.exchange(false)) return;
+
+    double secs = (host_ms() - started)/1000.0;
+    std::cout << name << " ended" << (full ? " (memory budget full)" : "") << ": " << n_captured << " framesets in "
+              << secs << " s, " << ring.size() << " still buffered" << std::endl;
+}
+
+void burstRecorder::wait()
+{
+    while (capturing || draining())
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+}
+
+void burstRecorder::drain_loop()
+{
+    ringEntry e;
+    double lastReport = host_ms();
+    bool reported = true;
+
+    while (!quit) {
+        if (ring.pop(e, 100)) {
+            submit_entry(recorder, e, colPath, depthPath, nextFrame++, device);
+            n_drained++;
+            reported = false;
+        }
+
+        double now = host_ms();
+        if (!reported && (capturing || draining()) && now - lastReport >= 1000.0) {
+            report(false);
+            lastReport = now;
+        }
+        else if (!reported && !capturing && !draining()) {
+            report(true);
+            reported = true;
+        }
+    }
+}
+
+void burstRecorder::report(bool final)
+{
+    burstProgress p = progress();
+    if (final) {
+        std::cout << name << ": all " << p.drained << " framesets handed to the recorder" << std::endl;
+        return;
+    }
+    std::cout << name << ": " << p.captured << " captured, " << p.drained << " to recorder, " << p.buffered << " buffered, "
+              << p.bytesHeld/(1024*1024) << "/" << p.bytesReserved/(1024*1024) << " MB in use" << std::endl;
+}
+
+burstProgress burstRecorder::progress() const
+{
+    burstProgress p;
+    p.captured = n_captured;
+    p.drained = n_drained;
+    p.buffered = ring.size();
+    p.capacity = ring.capacity();
+    p.bytesHeld = ring.bytes_held();
+    p.bytesReserved = ring.bytes_reserved();
+    p.ringFull = full;
+    return p;
+}
@@ -0,0 +1,111 @@
+/* burstrecorder.h
+ *
+ * Description:
+ *   header file for burstRecorder class
+ *   Burst mode: framesets are captured raw into a frameRing at the full sensor
+ *   rate, without waiting for the encoders, and a drain thread feeds them to
+ *   the recordPipeline (submit_held, no second copy) at whatever rate the
+ *   encoders and disk allow. Encoding overlaps the burst and continues after
+ *   it; ring memory is released frame by frame as frames are written. A burst
+ *   ends after the configured duration, when the ring is full, or on end();
+ *   frames are never dropped, the burst is cut short instead. Progress and
+ *   memory use are printed about once a second while anything is pending.
+ *
+ * Functions:
+ *   begin - starts a burst; frames are numbered from firstFrame. The ring is sized from
+ *   the frameset and allocated at the first burst, so no memory is held until one is asked for
+ *   push - stores one frameset; false once the burst is over (duration reached or ring full)
+ *   end - stops capturing, the drain thread continues until the ring is empty
+ *   active/draining - burst capturing / frames still to be handed to the recorder
+ *   wait - blocks until everything captured has been handed to the recorder
+ *   progress - counters and memory use
+ *   submit_entry - hands one ring entry to the recorder (also used by preTrigger)
+ *
+ * Input:
+ *   burstConfig (ring budget, duration), recordPipeline, session folders, device index
+ *
+ * Output:
+ *   frames to the recordPipeline
+ *
+ * Requirements:
+ *   framering.h, recordpipeline.h
+ *   boost/thread
+ *
+ * Thread safe? push/begin/end from the capture thread, the rest from any thread
+ *
+ * Extendable? YES
+ */
+
+#ifndef BURSTRECORDER_H
+#define BURSTRECORDER_H
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <string>
+
+#include "framering.h"
+#include "recordpipeline.h"
+
+struct burstConfig
+{
+    frameRingConfig ring;               // memory budget of the burst
+    double seconds = 10.0;              // burst length, 0 = until end() or the ring is full
+};
+
+struct burstProgress
+{
+    long long captured;                 // framesets stored this burst
+    long long drained;                  // framesets handed to the recorder
+    int buffered;                       // framesets waiting in the ring
+    int capacity;                       // framesets the ring holds
+    size_t bytesHeld;                   // ring memory in use (buffered + being written)
+    size_t bytesReserved;
+    bool ringFull;                      // burst was cut short by the memory budget
+};
+
+int submit_entry(recordPipeline& recorder, ringEntry& e, const boost::filesystem::path& col_path,
+                 const boost::filesystem::path& depth_path, int framenum, int device);
+
+class burstRecorder
+{
+    burstConfig cfg;
+    recordPipeline& recorder;
+    frameRing ring;
+    int device;
+    std::string name;
+
+    boost::filesystem::path colPath;
+    boost::filesystem::path depthPath;
+    int nextFrame;
+    double started;
+    bool unusable;
+
+    std::atomic<bool> capturing;
+    std::atomic<bool> quit;
+    std::atomic<bool> full;
+    std::atomic<long long> n_captured;
+    std::atomic<long long> n_drained;
+
+    boost::thread drainer;
+
+    bool prepare(const frameSet& frames);
+    void drain_loop();
+    void report(bool final);
+
+public:
+    burstRecorder(recordPipeline& r_recorder, const burstConfig& b_cfg, int r_device = 0);
+    ~burstRecorder();
+
+    bool begin(const frameSet& frames, const boost::filesystem::path& col_path, const boost::filesystem::path& depth_path, int first_frame);
+    bool push(const frameSet& frames, const frameFreshness& fresh);
+    void end();
+    void wait();
+
+    bool active() const { return capturing; }
+    bool draining() const { return n_drained < n_captured; }
+    burstProgress progress() const;
+};
+
+#endif // BURSTRECORDER_H
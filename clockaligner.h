@@ -0,0 +1,63 @@
+/* clockaligner.h
+ *
+ * Description:
+ *   header file for clockAligner class
+ *   Maps a camera's hardware timestamps onto the host clock (host_ms()), so
+ *   frames from several cameras can be compared on one time axis. The offset
+ *   host - hardware is estimated from the arrival time of each frame: transport
+ *   delay only ever adds to it, so the lower envelope of (arrival - hardware)
+ *   is the best estimate. The envelope may rise slowly (maxDriftPpm) to follow
+ *   the drift between the camera oscillator and the host clock.
+ *
+ * Functions:
+ *   align - updates the estimate with one frame, returns the aligned timestamp
+ *   to_host - maps a hardware timestamp with the current estimate
+ *   offset - current host - hardware offset (ms)
+ *
+ * Input:
+ *   hardware timestamp and host arrival time (ms)
+ *
+ * Output:
+ *   timestamp on the host clock (ms)
+ *
+ * Requirements:
+ *   none
+ *
+ * Thread safe? NO (one per capture thread)
+ *
+ * Extendable? YES
+ */
+
+#ifndef CLOCKALIGNER_H
+#define CLOCKALIGNER_H
+
+class clockAligner
+{
+    double maxDrift;        // ms of upward drift allowed per ms of host time
+    double estimate;
+    double lastArrival;
+    bool valid;
+
+public:
+    explicit clockAligner(double max_drift_ppm = 100.0)
+        : maxDrift(max_drift_ppm*1e-6), estimate(0.0), lastArrival(0.0), valid(false) {}
+
+    double align(double hw_ms, double arrival_ms)
+    {
+        double d = arrival_ms - hw_ms;
+        if (!valid || d < estimate) estimate = d;
+        else {
+            double rise = maxDrift*(arrival_ms - lastArrival);
+            estimate += (d - estimate < rise) ? d - estimate : rise;
+        }
+        valid = true;
+        lastArrival = arrival_ms;
+        return hw_ms + estimate;
+    }
+
+    double to_host(double hw_ms) const { return valid ? hw_ms + estimate : 0.0; }
+    double offset() const { return estimate; }
+    void reset() { valid = false; }
+};
+
+#endif // CLOCKALIGNER_H
@@ -0,0 +1,131 @@
+#include "cloudexporter.h"
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include "depthaligner.h"
+#include "pointcloud.h"
+#include "sessionreader.h"
+
+namespace bfs = boost::filesystem;
+
+cloudExporter::cloudExporter(const cloudExportConfig& c_cfg) : cfg(c_cfg)
+{
+    if (cfg.outDir.empty()) cfg.outDir = cfg.depthDir.string() + "_cloud";
+    if (cfg.calibFile.empty()) cfg.calibFile = cfg.depthDir / "calibration.txt";
+    if (cfg.step < 1) cfg.step = 1;
+}
+
+long long cloudExporter::run(std::ostream& log)
+{
+    alignCalibration calib;
+    if (!calib.load(cfg.calibFile)) {
+        log << "Cloud: no usable calibration in " << cfg.calibFile << std::endl;
+        return -1;
+    }
+    float scale = cfg.depthScale > 0 ? cfg.depthScale : calib.depthScale;
+
+    pointCloud cloud;
+    if (!cloud.prepare(calib.depth, scale)) {
+        log << "Cloud: bad depth intrinsics or depth scale" << std::endl;
+        return -1;
+    }
+
+    sessionReader reader;
+    bfs::path colDir = cfg.colour ? cfg.colDir : bfs::path();
+    if (!reader.open(cfg.depthDir, colDir, cfg.depthWidth, cfg.depthHeight)) {
+        log << "Cloud: cannot open session " << cfg.depthDir << std::endl;
+        return -1;
+    }
+    const int n = (reader.frame_count(streamType::depth) + cfg.step - 1)/cfg.step;
+    const int colFrames = colDir.empty() ? 0 : reader.frame_count(streamType::colour);
+
+    int threads = cfg.threads > 0 ? cfg.threads : static_cast<int>(boost::thread::hardware_concurrency());
+    threads = std::max(1, std::min(threads, n));
+    reader.set_readahead(2*threads, 1);
+
+    try {
+        bfs::create_directories(cfg.outDir);
+    }
+    catch (bfs::filesystem_error &e) {
+        log << e.what() << std::endl;
+        return -1;
+    }
+
+    cloudChunkWriter chunks;
+    if (cfg.format == cloudFormat::chunked && !chunks.open(cfg.outDir / "cloud.tpc", cloud)) {
+        log << "Cloud: cannot create " << cfg.outDir / "cloud.tpc" << std::endl;
+        return -1;
+    }
+
+    const uint16_t minUnits = static_cast<uint16_t>(std::min(65535.0f, std::ceil(cfg.minDepth/scale)));
+    const uint16_t maxUnits = static_cast<uint16_t>(std::min(65535.0f, std::floor(cfg.maxDepth/scale)));
+    const int dw = cloud.width();
+    const int dh = cloud.height();
+
+    std::atomic<int> next(0);
+    std::atomic<long long> written(0), skipped(0), noColour(0);
+    std::atomic<bool> failed(false);
+
+    // chunked output: frame k is written once frames 0..k-1 are
+    boost::mutex orderMutex;
+    boost::condition_variable orderCv;
+    int turn = 0;
+
+    auto worker = [&]() {
+        cloudPoints pts;
+        std::vector<uint16_t> depth;
+        std::vector<unsigned char> rgb;
+
+        for (int k = next++; k < n; k = next++) {
+            int i = k*cfg.step;
+            int w = 0, h = 0;
+            frameView v = reader.view(streamType::depth, i);
+            bool ok = !failed && reader.depth(i, depth, w, h) && w == dw && h == dh;
+
+            const unsigned char* colour = 0;
+            if (ok && colFrames) {
+                int c = reader.find_frame(streamType::colour, v.framenum);
+                if (c < 0) c = reader.find_time(streamType::colour, v.timestamp);
+                int cw = 0, ch = 0;
+                if (c >= 0 && reader.colour(c, rgb, cw, ch) && cw == dw && ch == dh) colour = rgb.data();
+                else noColour++;
+            }
+            if (ok) cloud.deproject(depth.data(), pts, minUnits, maxUnits);
+            else skipped++;
+
+            if (cfg.format == cloudFormat::chunked) {
+                boost::unique_lock<boost::mutex> lock(orderMutex);
+                while (turn != k) orderCv.wait(lock);
+                if (ok && !chunks.append(pts, depth.data(), colour, v.framenum, v.timestamp)) failed = true;
+                else if (ok) written++;
+                turn++;
+                orderCv.notify_all();
+            }
+            else if (ok) {
+                bfs::path file = cfg.outDir / ("cloud_" + std::to_string(v.framenum) + ".ply");
+                if (write_ply(file, pts, colour, "frame " + std::to_string(v.framenum))) written++;
+                else failed = true;
+            }
+
+            if (ok && k % 300 == 0) log << "Cloud: frame " << k << " / " << n << std::endl;
+        }
+    };
+
+    boost::thread_group group;
+    for (int t = 1; t < threads; t++) group.create_thread(worker);
+    worker();
+    group.join_all();
+    chunks.close();
+
+    if (failed) log << "Cloud: write failed in " << cfg.outDir << std::endl;
+    log << "Cloud: " << written << " frames exported to " << cfg.outDir;
+    if (skipped) log << " (" << skipped << " frames of another size or unreadable skipped)";
+    if (noColour) log << " (" << noColour << " frames without matching colour)";
+    log << std::endl;
+    return failed ? -1 : written.load();
+}
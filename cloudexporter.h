@@ -0,0 +1,71 @@
+/* cloudexporter.h
+ *
+ * Description:
+ *   header file for cloudExporter class
+ *   Point clouds from a recorded session. Reads the depth (and colour) folders
+ *   of a session with sessionReader, deprojects every frame with pointCloud
+ *   and writes them out, either as one PLY per frame or as a single chunked
+ *   .tpc file (layout in pointcloud.h). Frames are handed to worker threads
+ *   through an atomic counter; each thread keeps its own buffers, so nothing
+ *   is allocated per frame after the first. Chunked output is written in
+ *   frame order: a thread that finishes early waits for its turn.
+ *   Colour is only attached when the colour frames have the depth geometry,
+ *   i.e. for a session aligned with --align-session (its calibration.txt
+ *   describes the colour camera); colour frames are matched by frame number,
+ *   by timestamp otherwise.
+ *
+ * Functions:
+ *   run - exports the whole session, returns the number of frames written (-1 on error)
+ *
+ * Input:
+ *   cloudExportConfig (session folders, calibration, depth range, format, threads)
+ *
+ * Output:
+ *   <depth folder>_cloud/cloud_<framenum>.ply or <depth folder>_cloud/cloud.tpc
+ *
+ * Requirements:
+ *   pointcloud.h, depthaligner.h, sessionreader.h
+ *   boost/filesystem, boost/thread
+ *
+ * Thread safe? NO
+ *
+ * Extendable? YES
+ */
+
+#ifndef CLOUDEXPORTER_H
+#define CLOUDEXPORTER_H
+
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+
+enum class cloudFormat {ply, chunked};
+
+struct cloudExportConfig
+{
+    boost::filesystem::path depthDir;
+    boost::filesystem::path colDir;         // empty: no colour
+    boost::filesystem::path outDir;         // empty: <depthDir>_cloud
+    boost::filesystem::path calibFile;      // empty: <depthDir>/calibration.txt
+    int depthWidth = 0;                     // only needed for headerless per-frame .dat sessions
+    int depthHeight = 0;
+    float depthScale = 0;                   // metres per unit, 0: the calibration's
+    float minDepth = 0;                     // metres, 0: no limit
+    float maxDepth = 0;
+    bool colour = true;
+    cloudFormat format = cloudFormat::ply;
+    int threads = 0;                        // 0: hardware concurrency
+    int step = 1;                           // every step-th frame
+};
+
+class cloudExporter
+{
+    cloudExportConfig cfg;
+
+public:
+    explicit cloudExporter(const cloudExportConfig& c_cfg);
+
+    long long run(std::ostream& log = std::cout);
+};
+
+#endif // CLOUDEXPORTER_H
@@ -4,14 +4,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/fstream.hpp>
-#include <boost/gil/gil_all.hpp>
-
-// image handling libraries
-#ifndef BOOST_GIL_NO_IO
-#include <boost/gil/extension/io/jpeg_io.hpp>
-#include <boost/gil/extension/io/jpeg_dynamic_io.hpp>
-#include <boost/gil/extension/io/dynamic_io.hpp>
-#endif
+#include <boost/thread/tss.hpp>
 
 #include <fstream>
 #include <iostream>
@@ -20,43 +13,71 @@
 
 #include <librealsense2/rs.hpp>
 
+// output buffer reused by save_col_frame on each thread
+static std::vector<unsigned char>& thread_jpeg_buffer()
+{
+    static boost::thread_specific_ptr< std::vector<unsigned char> > buf;
+    if (!buf.get()) buf.reset(new std::vector<unsigned char>);
+    return *buf;
+}
+
 colImageFrame::colImageFrame(int c_width, int c_height)
 {
     width = c_width;
     height = c_height;
 }
 
+colImageFrame::colImageFrame(int c_width, int c_height, const jpegSettings& c_settings)
+{
+    width = c_width;
+    height = c_height;
+    settings = c_settings;
+}
+
 int colImageFrame::col_size_calc() {return (width*height);}
 
-void colImageFrame::save_col_frame(const void* cpoint, boost::filesystem::path c_path, std::string c_file)
+bool colImageFrame::encode_col_frame(const void* cpoint, std::vector<unsigned char>& jpeg, workerPool* stripes)
 {
-    // use this for single, unsynchronised frame-grabbing
-    using namespace boost::gil;
-    int arraysize = this->col_size_calc();
-    // need pointer to frame data ...
-    //rs2::frame colframe = frames->get_color_frame();
-    //const void * cpoint = colframe.get_data();  //dev->get_frame_data(rs::stream::color);
+    // compress straight from the interleaved rgb8 buffer, stripes of it in parallel when a pool is given
+    const unsigned char* bufp = static_cast<const unsigned char*>(cpoint);
+    return jpegEncoder::for_thread().encode_striped(bufp, width, height, 3*width, settings, jpeg, stripes);
+}
+
+void colImageFrame::write_col_frame(const std::vector<unsigned char>& jpeg, boost::filesystem::path c_path, std::string c_file)
+{
+    namespace bfs = boost::filesystem;
 
     c_path /= c_file;                            // adds cfile to c_path
 
-    unsigned char colR[arraysize];
-    unsigned char colG[arraysize];
-    unsigned char colB[arraysize];
+    bfs::ofstream colfile;
+    colfile.open(c_path, std::ios::out | std::ofstream::binary);
+    colfile.write(reinterpret_cast<const char*>(jpeg.data()), jpeg.size());
+    colfile.close();
+}
 
-    const char* bufp = static_cast<const char*>(cpoint);
+void colImageFrame::write_col_frame(const std::vector<unsigned char>& jpeg, boost::filesystem::path c_path, int framenum)
+{
+    std::string c_file = "col_frame_" + std::to_string(framenum) + ".jpg";
+    write_col_frame(jpeg, c_path, c_file);
+}
 
+bool colImageFrame::append_col_frame(const std::vector<unsigned char>& jpeg, mjpegWriter& c_movie, int framenum, double timestamp)
+{
+    // Container mode: one chunk per frame in the session's MJPEG AVI
 
-    for (int j=0; j<arraysize; ++j){
-        const char* cind = bufp + 3*j;
-        colR[j] = *(cind);
-        colG[j] = *(cind+1);
-        colB[j] = *(cind+2);
-    }
+    return c_movie.append(jpeg.data(), jpeg.size(), framenum, timestamp);
+}
+
+void colImageFrame::save_col_frame(const void* cpoint, boost::filesystem::path c_path, std::string c_file)
+{
+    // use this for single, unsynchronised frame-grabbing
+    std::vector<unsigned char>& jpeg = thread_jpeg_buffer();
 
-    // in theory should be able to copy directly to an interleaved view with appropriate iterator
-    rgb8_planar_view_t colIm = planar_rgb_view(width, height, colR, colG, colB, width);
-    std::string saveLoc = c_path.string();
-    boost::gil::jpeg_write_view(saveLoc, colIm, 95);
+    if (!encode_col_frame(cpoint, jpeg)) {
+        std::cout << "Error: color frame " << c_file << " could not be encoded" << std::endl;
+        return;
+    }
+    write_col_frame(jpeg, c_path, c_file);
     std::cout << "Color frame stored" << std::endl;
 
 }
@@ -65,29 +86,12 @@ void colImageFrame::save_col_frame(const void* cpoint, boost::filesystem::path c
 void colImageFrame::save_col_frame(const void* cpoint, boost::filesystem::path c_path, int framenum)
 {
     // Overloaded: Use this when already have colour frame stored in memory
+    std::vector<unsigned char>& jpeg = thread_jpeg_buffer();
 
-    using namespace boost::gil;
-
-    int arraysize = this->col_size_calc();
-
-    std::string c_file = "col_frame_" + std::to_string(framenum) + ".jpg";
-    c_path /= c_file;           // adds cfile to c_path
-
-    unsigned char colR[arraysize];
-    unsigned char colG[arraysize];
-    unsigned char colB[arraysize];
-
-    const char* bufp = static_cast<const char*>(cpoint);
-
-    for (int j=0; j<arraysize; ++j){
-        const char* cind = bufp + 3*j;
-        colR[j] = *(cind);
-        colG[j] = *(cind+1);
-        colB[j] = *(cind+2);
+    if (!encode_col_frame(cpoint, jpeg)) {
+        std::cout << "Error: color frame " << framenum << " could not be encoded" << std::endl;
+        return;
     }
-
-    rgb8_planar_view_t colIm = planar_rgb_view(width, height, colR, colG, colB, width);
-    std::string saveLoc = c_path.string();
-    boost::gil::jpeg_write_view(saveLoc, colIm, 95);
+    write_col_frame(jpeg, c_path, framenum);
 
 }
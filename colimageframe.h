@@ -3,18 +3,24 @@
  * Description:
  *   header file for colImageFrame class
  *   Can be used to stream compressed RGB data to a JPEG file
- *   Overload methods take either a pointer to the streaming device
- *   itself, or a pointer to a stored RGB buffer.
+ *   Frames are compressed straight from the interleaved RGB8 buffer by the
+ *   calling thread's jpegEncoder (see jpegencoder.h); given a workerPool, in
+ *   restart-marker stripes on its threads.
  *
  * Functions:
  *   col_size_calc - calculates needed buffer size for rgb conversion
- *   save_col_frame - takes a frame from a RealSense library-compatible color image stream OR
- *   a pointer to such a frame buffer, saves to file
+ *   encode_col_frame - compresses a frame buffer into a reusable byte vector
+ *   write_col_frame - writes an encoded frame to file
+ *   append_col_frame - appends an encoded frame to the session's MJPEG container (see mjpegwriter.h)
+ *   save_col_frame - takes a pointer to a RealSense library-compatible color frame buffer,
+ *   encodes and saves to file
  *
  * Input:
- *   device or buffer pointer
+ *   buffer pointer
  *   path to save directory
  *   filename or enumerative
+ *   jpegSettings (quality, chroma subsampling) - defaults to 95, 4:2:0
+ *   frame number and timestamp for container frames
  *
  * Output:
  *   none
@@ -22,8 +28,7 @@
  * Requirements:
  *   librealsense
  *   boost/filesystem
- *   boost/gil
- *   boost/gil/extension
+ *   libjpeg / libjpeg-turbo
  *   fstream
  *
  * Thread safe? YES
@@ -39,17 +44,14 @@
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/date_time/gregorian/gregorian.hpp>
-#include <boost/gil/gil_all.hpp>
 #include <boost/chrono/chrono.hpp>
 
-
-#ifndef BOOST_GIL_NO_IO
-#include <boost/gil/extension/io/jpeg_io.hpp>
-#include <boost/gil/extension/io/jpeg_dynamic_io.hpp>
-#include <boost/gil/extension/io/dynamic_io.hpp>
-#endif
-
 #include <fstream>
+#include <string>
+#include <vector>
+
+#include "jpegencoder.h"
+#include "mjpegwriter.h"
 
 // Include the librealsense C++ header file
 #include <librealsense2/rs.hpp>
@@ -58,10 +60,16 @@ class colImageFrame
 {
     int width;
     int height;
+    jpegSettings settings;
 
 public:
     colImageFrame(int c_width,int c_height);
+    colImageFrame(int c_width,int c_height, const jpegSettings& c_settings);
     int col_size_calc();
+    bool encode_col_frame(const void* cpoint, std::vector<unsigned char>& jpeg, workerPool* stripes = 0);
+    void write_col_frame(const std::vector<unsigned char>& jpeg, boost::filesystem::path c_path, std::string c_file);
+    void write_col_frame(const std::vector<unsigned char>& jpeg, boost::filesystem::path c_path, int framenum);
+    bool append_col_frame(const std::vector<unsigned char>& jpeg, mjpegWriter& c_movie, int framenum, double timestamp);
     void save_col_frame(const void* cpoint, boost::filesystem::path c_path, std::string c_file);
     void save_col_frame(const void* cpoint, boost::filesystem::path c_path, int framenum);
 };
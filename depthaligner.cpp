@@ -0,0 +1,442 @@
+#include "depthaligner.h"
+
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include "simdcpu.h"
+
+#if SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace bfs = boost::filesystem;
+
+namespace {
+
+const char* model_names[] = { "none", "modified_brown_conrady", "inverse_brown_conrady", "brown_conrady" };
+
+// normalised coordinates to a colour pixel, as rs2_project_point_to_pixel; the Brown-Conrady
+// tangential terms use the undistorted coordinates, the (inverse/modified) ones the scaled ones
+struct projector
+{
+    float fx, fy, ppx, ppy;
+    float c0, c1, c2, c3, c4;
+    bool distort;
+    bool tangentialScaled;
+
+    explicit projector(const cameraIntrinsics& in)
+        : fx(in.fx), fy(in.fy), ppx(in.ppx), ppy(in.ppy),
+          c0(in.coeffs[0]), c1(in.coeffs[1]), c2(in.coeffs[2]), c3(in.coeffs[3]), c4(in.coeffs[4]),
+          distort(in.model != distortionModel::none), tangentialScaled(in.model != distortionModel::brownConrady)
+    {
+    }
+
+    void project(float x, float y, float& u, float& v) const
+    {
+        if (distort) {
+            // same evaluation order as the AVX2 path, so both give the same pixels
+            float r2 = x*x + y*y;
+            float f = 1 + r2*(c0 + r2*(c1 + r2*c4));
+            float xs = x*f, ys = y*f;
+            float tx = tangentialScaled ? xs : x;
+            float ty = tangentialScaled ? ys : y;
+            float txy2 = 2*(tx*ty);
+            x = (xs + c2*txy2) + c3*(r2 + 2*(tx*tx));
+            y = (ys + c3*txy2) + c2*(r2 + 2*(ty*ty));
+        }
+        u = x*fx + ppx;
+        v = y*fy + ppy;
+    }
+};
+
+struct rowContext
+{
+    const uint16_t* depth;              // row start
+    const float* rx0; const float* ry0; const float* rz0;   // top-left corners of the row's pixels
+    const float* rx1; const float* ry1; const float* rz1;   // bottom-right corners
+    int16_t* x0; int16_t* y0; int16_t* x1; int16_t* y1;
+    int width;
+    float scale;
+    float tx, ty, tz;
+    float colWidth, colHeight;
+};
+
+// footprint of pixels [from, width) of a row; returns the colour rows reached through top/bottom
+void project_scalar(const rowContext& r, const projector& p, int from, int& top, int& bottom)
+{
+    for (int i = from; i < r.width; i++) {
+        r.x0[i] = 1;
+        r.x1[i] = 0;
+        float z = r.depth[i]*r.scale;
+        if (!r.depth[i]) continue;
+
+        float u0, v0, u1, v1;
+        float X = z*r.rx0[i] + r.tx, Y = z*r.ry0[i] + r.ty, Z = 1/(z*r.rz0[i] + r.tz);
+        p.project(X*Z, Y*Z, u0, v0);
+        X = z*r.rx1[i] + r.tx; Y = z*r.ry1[i] + r.ty; Z = 1/(z*r.rz1[i] + r.tz);
+        p.project(X*Z, Y*Z, u1, v1);
+
+        // truncated corners must land inside the colour image, as in rs2 (NaN fails every test)
+        u0 += 0.5f; v0 += 0.5f; u1 += 0.5f; v1 += 0.5f;
+        if (!(u0 > -1.0f && v0 > -1.0f && u1 > -1.0f && v1 > -1.0f)) continue;
+        if (!(u0 < r.colWidth && v0 < r.colHeight && u1 < r.colWidth && v1 < r.colHeight)) continue;
+
+        r.x0[i] = static_cast<int16_t>(u0);
+        r.y0[i] = static_cast<int16_t>(v0);
+        r.x1[i] = static_cast<int16_t>(u1);
+        r.y1[i] = static_cast<int16_t>(v1);
+        top = std::min(top, static_cast<int>(r.y0[i]));
+        bottom = std::max(bottom, static_cast<int>(r.y1[i]));
+    }
+}
+
+#if SIMD_X86
+SIMD_TARGET("avx2")
+void project_avx2(const projector& p, __m256 x, __m256 y, __m256& u, __m256& v)
+{
+    if (p.distort) {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 two = _mm256_set1_ps(2.0f);
+        __m256 r2 = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+        // 1 + r2*(c0 + r2*(c1 + r2*c4))
+        __m256 f = _mm256_add_ps(_mm256_set1_ps(p.c1), _mm256_mul_ps(r2, _mm256_set1_ps(p.c4)));
+        f = _mm256_add_ps(_mm256_set1_ps(p.c0), _mm256_mul_ps(r2, f));
+        f = _mm256_add_ps(one, _mm256_mul_ps(r2, f));
+        __m256 xs = _mm256_mul_ps(x, f);
+        __m256 ys = _mm256_mul_ps(y, f);
+        __m256 tx = p.tangentialScaled ? xs : x;
+        __m256 ty = p.tangentialScaled ? ys : y;
+        __m256 txy2 = _mm256_mul_ps(two, _mm256_mul_ps(tx, ty));
+        x = _mm256_add_ps(_mm256_add_ps(xs, _mm256_mul_ps(_mm256_set1_ps(p.c2), txy2)),
+                          _mm256_mul_ps(_mm256_set1_ps(p.c3), _mm256_add_ps(r2, _mm256_mul_ps(two, _mm256_mul_ps(tx, tx)))));
+        y = _mm256_add_ps(_mm256_add_ps(ys, _mm256_mul_ps(_mm256_set1_ps(p.c3), txy2)),
+                          _mm256_mul_ps(_mm256_set1_ps(p.c2), _mm256_add_ps(r2, _mm256_mul_ps(two, _mm256_mul_ps(ty, ty)))));
+    }
+    u = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(p.fx)), _mm256_set1_ps(p.ppx));
+    v = _mm256_add_ps(_mm256_mul_ps(y, _mm256_set1_ps(p.fy)), _mm256_set1_ps(p.ppy));
+}
+
+SIMD_TARGET("avx2")
+void corner_avx2(const projector& p, const rowContext& r, __m256 z, const float* rx, const float* ry, const float* rz,
+                 __m256& u, __m256& v)
+{
+    __m256 X = _mm256_add_ps(_mm256_mul_ps(z, _mm256_loadu_ps(rx)), _mm256_set1_ps(r.tx));
+    __m256 Y = _mm256_add_ps(_mm256_mul_ps(z, _mm256_loadu_ps(ry)), _mm256_set1_ps(r.ty));
+    __m256 Z = _mm256_add_ps(_mm256_mul_ps(z, _mm256_loadu_ps(rz)), _mm256_set1_ps(r.tz));
+    Z = _mm256_div_ps(_mm256_set1_ps(1.0f), Z);
+    project_avx2(p, _mm256_mul_ps(X, Z), _mm256_mul_ps(Y, Z), u, v);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    u = _mm256_add_ps(u, half);
+    v = _mm256_add_ps(v, half);
+}
+
+SIMD_TARGET("avx2")
+void store_int16(int16_t* dst, __m256i v)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                     _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+SIMD_TARGET("avx2")
+void project_row_avx2(const rowContext& r, const projector& p, int& top, int& bottom)
+{
+    const __m256 scale = _mm256_set1_ps(r.scale);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 minusOne = _mm256_set1_ps(-1.0f);
+    const __m256 colW = _mm256_set1_ps(r.colWidth);
+    const __m256 colH = _mm256_set1_ps(r.colHeight);
+    __m256i vtop = _mm256_set1_epi32(INT_MAX);
+    __m256i vbottom = _mm256_set1_epi32(-1);
+
+    int i = 0;
+    for (; i + 8 <= r.width; i += 8) {
+        __m128i d16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r.depth + i));
+        __m256 z = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(d16)), scale);
+
+        __m256 u0, v0, u1, v1;
+        corner_avx2(p, r, z, r.rx0 + i, r.ry0 + i, r.rz0 + i, u0, v0);
+        corner_avx2(p, r, z, r.rx1 + i, r.ry1 + i, r.rz1 + i, u1, v1);
+
+        // ordered compares: NaN and zero depth drop out
+        __m256 ok = _mm256_cmp_ps(z, zero, _CMP_GT_OQ);
+        ok = _mm256_and_ps(ok, _mm256_and_ps(_mm256_cmp_ps(u0, minusOne, _CMP_GT_OQ), _mm256_cmp_ps(v0, minusOne, _CMP_GT_OQ)));
+        ok = _mm256_and_ps(ok, _mm256_and_ps(_mm256_cmp_ps(u1, minusOne, _CMP_GT_OQ), _mm256_cmp_ps(v1, minusOne, _CMP_GT_OQ)));
+        ok = _mm256_and_ps(ok, _mm256_and_ps(_mm256_cmp_ps(u0, colW, _CMP_LT_OQ), _mm256_cmp_ps(v0, colH, _CMP_LT_OQ)));
+        ok = _mm256_and_ps(ok, _mm256_and_ps(_mm256_cmp_ps(u1, colW, _CMP_LT_OQ), _mm256_cmp_ps(v1, colH, _CMP_LT_OQ)));
+        __m256i valid = _mm256_castps_si256(ok);
+
+        __m256i x0 = _mm256_cvttps_epi32(u0), y0 = _mm256_cvttps_epi32(v0);
+        __m256i x1 = _mm256_cvttps_epi32(u1), y1 = _mm256_cvttps_epi32(v1);
+
+        x0 = _mm256_blendv_epi8(_mm256_set1_epi32(1), x0, valid);
+        x1 = _mm256_blendv_epi8(_mm256_setzero_si256(), x1, valid);
+        vtop = _mm256_min_epi32(vtop, _mm256_blendv_epi8(_mm256_set1_epi32(INT_MAX), y0, valid));
+        vbottom = _mm256_max_epi32(vbottom, _mm256_blendv_epi8(_mm256_set1_epi32(-1), y1, valid));
+
+        store_int16(r.x0 + i, x0);
+        store_int16(r.y0 + i, y0);
+        store_int16(r.x1 + i, x1);
+        store_int16(r.y1 + i, y1);
+    }
+
+    int tops[8], bottoms[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(tops), vtop);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(bottoms), vbottom);
+    for (int k = 0; k < 8; k++) {
+        top = std::min(top, tops[k]);
+        bottom = std::max(bottom, bottoms[k]);
+    }
+    project_scalar(r, p, i, top, bottom);
+}
+#endif
+
+}
+
+// ---- deprojection ----
+
+// as rs2_deproject_pixel_to_point (a modified Brown-Conrady image cannot be deprojected;
+// rs2 refuses it, here it is left undistorted)
+void deproject_pixel(const cameraIntrinsics& in, float px, float py, float& x, float& y)
+{
+    const float* c = in.coeffs;
+    x = (px - in.ppx)/in.fx;
+    y = (py - in.ppy)/in.fy;
+
+    if (in.model == distortionModel::inverseBrownConrady) {
+        float r2 = x*x + y*y;
+        float f = 1 + c[0]*r2 + c[1]*r2*r2 + c[4]*r2*r2*r2;
+        float ux = x*f + 2*c[2]*x*y + c[3]*(r2 + 2*x*x);
+        float uy = y*f + 2*c[3]*x*y + c[2]*(r2 + 2*y*y);
+        x = ux;
+        y = uy;
+    }
+    else if (in.model == distortionModel::brownConrady) {
+        float xo = x, yo = y;
+        for (int i = 0; i < 10; i++) {
+            float r2 = x*x + y*y;
+            float icdist = 1/(1 + ((c[4]*r2 + c[1])*r2 + c[0])*r2);
+            float dx = 2*c[2]*x*y + c[3]*(r2 + 2*x*x);
+            float dy = 2*c[3]*x*y + c[2]*(r2 + 2*y*y);
+            x = (xo - dx)*icdist;
+            y = (yo - dy)*icdist;
+        }
+    }
+}
+
+// ---- calibration ----
+
+bool alignCalibration::valid() const
+{
+    return depth.width > 0 && depth.height > 0 && depth.fx > 0 && depth.fy > 0 &&
+           colour.width > 0 && colour.height > 0 && colour.fx > 0 && colour.fy > 0 &&
+           colour.width < 32768 && colour.height < 32768 && depthScale > 0;
+}
+
+static void write_intrinsics(std::ostream& os, const char* name, const cameraIntrinsics& c)
+{
+    os << name << ' ' << c.width << ' ' << c.height << ' ' << c.fx << ' ' << c.fy << ' ' << c.ppx << ' ' << c.ppy
+       << ' ' << model_names[static_cast<int>(c.model)];
+    for (int i = 0; i < 5; i++) os << ' ' << c.coeffs[i];
+    os << '\n';
+}
+
+static bool read_intrinsics(std::istream& is, cameraIntrinsics& c)
+{
+    std::string model;
+    if (!(is >> c.width >> c.height >> c.fx >> c.fy >> c.ppx >> c.ppy >> model)) return false;
+    for (int i = 0; i < 5; i++) if (!(is >> c.coeffs[i])) return false;
+    for (int m = 0; m < 4; m++) {
+        if (model == model_names[m]) {
+            c.model = static_cast<distortionModel>(m);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool alignCalibration::save(const bfs::path& file) const
+{
+    bfs::ofstream os(file);
+    if (!os) return false;
+    os << std::setprecision(9);
+    os << "# depth-to-colour alignment: intrinsics are width height fx fy ppx ppy model k1 k2 p1 p2 k3\n";
+    os << "depth_scale " << depthScale << '\n';
+    write_intrinsics(os, "depth", depth);
+    write_intrinsics(os, "colour", colour);
+    os << "rotation";
+    for (int i = 0; i < 9; i++) os << ' ' << depthToColour.rotation[i];
+    os << "\ntranslation";
+    for (int i = 0; i < 3; i++) os << ' ' << depthToColour.translation[i];
+    os << '\n';
+    return static_cast<bool>(os);
+}
+
+bool alignCalibration::load(const bfs::path& file)
+{
+    bfs::ifstream is(file);
+    if (!is) return false;
+
+    alignCalibration c;
+    int found = 0;
+    std::string line;
+    while (std::getline(is, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        if (!(fields >> key) || key[0] == '#') continue;
+
+        bool ok = true;
+        if (key == "depth_scale") ok = static_cast<bool>(fields >> c.depthScale);
+        else if (key == "depth") ok = read_intrinsics(fields, c.depth);
+        else if (key == "colour") ok = read_intrinsics(fields, c.colour);
+        else if (key == "rotation") for (int i = 0; i < 9 && ok; i++) ok = static_cast<bool>(fields >> c.depthToColour.rotation[i]);
+        else if (key == "translation") for (int i = 0; i < 3 && ok; i++) ok = static_cast<bool>(fields >> c.depthToColour.translation[i]);
+        else continue;
+        if (!ok) return false;
+        found++;
+    }
+    if (found < 5 || !c.valid()) return false;
+    *this = c;
+    return true;
+}
+
+// ---- aligner ----
+
+depthAligner::depthAligner(int workers) : pool(std::max(0, workers)), prepared(false)
+{
+}
+
+bool depthAligner::prepare(const alignCalibration& a_calib)
+{
+    prepared = false;
+    if (!a_calib.valid()) return false;
+    calib = a_calib;
+
+    const int w = calib.depth.width;
+    const int h = calib.depth.height;
+    const size_t corners = static_cast<size_t>(w + 1)*(h + 1);
+    rayX.resize(corners);
+    rayY.resize(corners);
+    rayZ.resize(corners);
+
+    // unit-depth rays of the pixel corners, rotated into the colour camera (column-major R)
+    const float* R = calib.depthToColour.rotation;
+    pool.parallel_for(h + 1, [&](int cy) {
+        for (int cx = 0; cx <= w; cx++) {
+            float x, y;
+            deproject_pixel(calib.depth, cx - 0.5f, cy - 0.5f, x, y);
+            size_t c = static_cast<size_t>(cy)*(w + 1) + cx;
+            rayX[c] = R[0]*x + R[3]*y + R[6];
+            rayY[c] = R[1]*x + R[4]*y + R[7];
+            rayZ[c] = R[2]*x + R[5]*y + R[8];
+        }
+    });
+
+    const size_t pixels = static_cast<size_t>(w)*h;
+    footX0.resize(pixels);
+    footY0.resize(pixels);
+    footX1.resize(pixels);
+    footY1.resize(pixels);
+    rowTop.resize(h);
+    rowBottom.resize(h);
+    prepared = true;
+    return true;
+}
+
+void depthAligner::project_rows(const uint16_t* depth, int y0, int y1)
+{
+    const int w = calib.depth.width;
+    const projector p(calib.colour);
+
+    rowContext r;
+    r.width = w;
+    r.scale = calib.depthScale;
+    r.tx = calib.depthToColour.translation[0];
+    r.ty = calib.depthToColour.translation[1];
+    r.tz = calib.depthToColour.translation[2];
+    r.colWidth = static_cast<float>(calib.colour.width);
+    r.colHeight = static_cast<float>(calib.colour.height);
+
+    for (int y = y0; y < y1; y++) {
+        size_t row = static_cast<size_t>(y)*w;
+        size_t top = static_cast<size_t>(y)*(w + 1);
+        size_t bottom = top + w + 1 + 1;                // corner (x+1, y+1) of pixel x
+        r.depth = depth + row;
+        r.rx0 = &rayX[top]; r.ry0 = &rayY[top]; r.rz0 = &rayZ[top];
+        r.rx1 = &rayX[bottom]; r.ry1 = &rayY[bottom]; r.rz1 = &rayZ[bottom];
+        r.x0 = &footX0[row]; r.y0 = &footY0[row]; r.x1 = &footX1[row]; r.y1 = &footY1[row];
+
+        int rtop = INT_MAX, rbottom = -1;
+#if SIMD_X86
+        if (cpu_has_avx2()) project_row_avx2(r, p, rtop, rbottom);
+        else project_scalar(r, p, 0, rtop, rbottom);
+#else
+        project_scalar(r, p, 0, rtop, rbottom);
+#endif
+        rowTop[y] = rtop;
+        rowBottom[y] = rbottom;
+    }
+}
+
+void depthAligner::splat_rows(const uint16_t* depth, uint16_t* aligned, int r0, int r1)
+{
+    const int w = calib.depth.width;
+    const int h = calib.depth.height;
+    const int cw = calib.colour.width;
+    std::memset(aligned + static_cast<size_t>(r0)*cw, 0, static_cast<size_t>(r1 - r0)*cw*sizeof(uint16_t));
+
+    for (int y = 0; y < h; y++) {
+        if (rowTop[y] >= r1 || rowBottom[y] < r0) continue;
+        size_t row = static_cast<size_t>(y)*w;
+        for (int x = 0; x < w; x++) {
+            size_t i = row + x;
+            int x0 = footX0[i], x1 = footX1[i];
+            if (x0 > x1) continue;
+            int ya = std::max<int>(footY0[i], r0);
+            int yb = std::min<int>(footY1[i], r1 - 1);
+            // the nearest surface wins where footprints overlap; subtracting 1 turns
+            // an empty (0) output pixel into 65535, so a plain min covers both cases
+            uint16_t d1 = depth[i] - 1;
+            for (int yy = ya; yy <= yb; yy++) {
+                uint16_t* o = aligned + static_cast<size_t>(yy)*cw;
+                for (int xx = x0; xx <= x1; xx++)
+                    o[xx] = std::min<uint16_t>(o[xx] - 1, d1) + 1;
+            }
+        }
+    }
+}
+
+bool depthAligner::align(const uint16_t* depth, uint16_t* aligned)
+{
+    if (!prepared || !depth || !aligned) return false;
+
+    const int h = calib.depth.height;
+    const int ch = calib.colour.height;
+    const int parts = 2*(pool.size() + 1);
+
+    pool.parallel_for(parts, [&](int part) {
+        project_rows(depth, h*part/parts, h*(part + 1)/parts);
+    });
+    pool.parallel_for(parts, [&](int part) {
+        splat_rows(depth, aligned, ch*part/parts, ch*(part + 1)/parts);
+    });
+    return true;
+}
+
+bool depthAligner::align(const sourceFrame& depth, sourceFrame& aligned)
+{
+    if (!prepared || !depth.valid() || depth.width != calib.depth.width || depth.height != calib.depth.height) return false;
+
+    out.resize(static_cast<size_t>(calib.colour.width)*calib.colour.height);
+    if (!align(static_cast<const uint16_t*>(depth.data), out.data())) return false;
+
+    aligned = depth;
+    aligned.data = out.data();
+    aligned.width = calib.colour.width;
+    aligned.height = calib.colour.height;
+    return true;
+}
@@ -0,0 +1,124 @@
+/* depthaligner.h
+ *
+ * Description:
+ *   header file for depthAligner class and alignCalibration
+ *   Depth-to-colour alignment without librealsense, the same method as
+ *   rs2::align: every depth pixel is deprojected at its depth, moved into the
+ *   colour camera and projected, and its footprint (the projections of the
+ *   pixel's two opposite corners) is filled with the depth value; where
+ *   footprints overlap the nearest depth wins.
+ *   Everything that does not depend on depth is done once in prepare(): the
+ *   deprojection rays of all pixel corners (including undistortion, which is
+ *   iterative for Brown-Conrady) already rotated into the colour camera, so a
+ *   corner costs three multiply-adds, one division and the colour distortion
+ *   polynomial per frame.
+ *   A frame is aligned in two passes on a workerPool:
+ *     1. projection, in bands of depth rows, 8 pixels at a time with AVX2
+ *        (scalar otherwise): footprint rectangles and the colour rows each
+ *        depth row reaches
+ *     2. splatting, in bands of colour rows: each band only writes its own
+ *        rows, so no two threads touch the same output pixel
+ *
+ *   alignCalibration is stored with recordings (calibration.txt in the depth
+ *   folder) so sessions can be aligned later (see sessionaligner.h).
+ *
+ * Functions:
+ *   prepare - builds the projection tables for a calibration
+ *   ready - prepare succeeded
+ *   align - depth frame to a colour-sized depth frame
+ *   alignCalibration::save/load - text calibration file
+ *   deproject_pixel - pixel position to a unit-depth ray, as rs2_deproject_pixel_to_point
+ *
+ * Input:
+ *   alignCalibration (intrinsics of both streams, depth-to-colour extrinsics, depth scale),
+ *   Z16 depth frames
+ *
+ * Output:
+ *   Z16 depth in the colour camera's geometry
+ *
+ * Requirements:
+ *   workerpool.h, framesource.h, simdcpu.h
+ *   boost/filesystem
+ *
+ * Thread safe? NO (one aligner per stream; align uses the pool's threads)
+ *
+ * Extendable? YES
+ */
+
+#ifndef DEPTHALIGNER_H
+#define DEPTHALIGNER_H
+
+#include <boost/filesystem.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "framesource.h"
+#include "workerpool.h"
+
+// librealsense distortion models (rs2_distortion) that D4xx streams use
+enum class distortionModel { none, modifiedBrownConrady, inverseBrownConrady, brownConrady };
+
+struct cameraIntrinsics
+{
+    int width = 0;
+    int height = 0;
+    float fx = 0.0f;
+    float fy = 0.0f;
+    float ppx = 0.0f;
+    float ppy = 0.0f;
+    distortionModel model = distortionModel::none;
+    float coeffs[5] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+};
+
+struct cameraExtrinsics
+{
+    float rotation[9] = { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f };   // column-major, as rs2_extrinsics
+    float translation[3] = { 0.0f, 0.0f, 0.0f };                                    // metres
+};
+
+struct alignCalibration
+{
+    cameraIntrinsics depth;
+    cameraIntrinsics colour;
+    cameraExtrinsics depthToColour;
+    float depthScale = 0.001f;          // metres per Z16 unit
+
+    bool valid() const;
+    bool save(const boost::filesystem::path& file) const;
+    bool load(const boost::filesystem::path& file);
+};
+
+void deproject_pixel(const cameraIntrinsics& in, float px, float py, float& x, float& y);
+
+class depthAligner
+{
+    alignCalibration calib;
+    workerPool pool;
+    bool prepared;
+
+    // corner (cx, cy) is pixel position (cx - 0.5, cy - 0.5); (w+1) x (h+1) of them
+    std::vector<float> rayX, rayY, rayZ;
+
+    // pass 1 output: footprint of each depth pixel in colour pixels (x0 > x1: nothing to draw)
+    std::vector<int16_t> footX0, footY0, footX1, footY1;
+    std::vector<int> rowTop, rowBottom;         // colour rows reached by each depth row
+
+    std::vector<uint16_t> out;                  // align(sourceFrame) result
+
+    void project_rows(const uint16_t* depth, int y0, int y1);
+    void splat_rows(const uint16_t* depth, uint16_t* aligned, int r0, int r1);
+
+public:
+    explicit depthAligner(int workers = 0);
+
+    bool prepare(const alignCalibration& a_calib);
+    bool ready() const { return prepared; }
+    const alignCalibration& calibration() const { return calib; }
+
+    // aligned: colour width*height; the sourceFrame overload fills out with a view of an internal buffer
+    bool align(const uint16_t* depth, uint16_t* aligned);
+    bool align(const sourceFrame& depth, sourceFrame& aligned);
+};
+
+#endif // DEPTHALIGNER_H
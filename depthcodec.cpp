@@ -0,0 +1,423 @@
+#include "depthcodec.h"
+
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "simdcpu.h"
+
+#if SIMD_X86
+#include <smmintrin.h>
+#endif
+
+static const int RICE_LIMIT = 24;       // unary prefix length that escapes to a raw 16-bit value
+
+namespace {
+
+class bitWriter
+{
+    std::vector<unsigned char>& out;
+    uint64_t acc;
+    int nbits;
+
+public:
+    explicit bitWriter(std::vector<unsigned char>& b_out) : out(b_out), acc(0), nbits(0) {}
+
+    void put(uint32_t bits, int n)          // n <= 32, MSB first
+    {
+        acc = (acc << n) | bits;
+        nbits += n;
+        while (nbits >= 8) {
+            nbits -= 8;
+            out.push_back(static_cast<unsigned char>(acc >> nbits));
+        }
+    }
+
+    void finish()
+    {
+        if (nbits > 0) out.push_back(static_cast<unsigned char>(acc << (8 - nbits)));
+        nbits = 0;
+    }
+};
+
+class bitReader
+{
+    const unsigned char* p;
+    const unsigned char* end;
+    uint64_t acc;
+    int nbits;
+
+    void refill()
+    {
+        while (nbits <= 56) {
+            acc |= static_cast<uint64_t>(p < end ? *p : 0) << (56 - nbits);
+            if (p < end) p++;
+            nbits += 8;
+        }
+    }
+
+public:
+    bitReader(const unsigned char* b_p, size_t n) : p(b_p), end(b_p + n), acc(0), nbits(0) { refill(); }
+
+    uint32_t get(int n)                     // n <= 32
+    {
+        if (n == 0) return 0;
+        if (nbits < n) refill();
+        uint32_t v = static_cast<uint32_t>(acc >> (64 - n));
+        acc <<= n;
+        nbits -= n;
+        return v;
+    }
+
+    int count_ones(int limit)               // consumes the terminating zero if found before limit
+    {
+        if (nbits < limit + 1) refill();
+        uint64_t inv = ~acc;
+        int q = inv ? __builtin_clzll(inv) : 64;
+        if (q >= limit) { get(limit); return limit; }
+        get(q + 1);
+        return q;
+    }
+
+    int count_zeros()                       // consumes the terminating one
+    {
+        if (nbits < 33) refill();
+        int z = acc ? __builtin_clzll(acc) : 64;
+        if (z > 32) z = 32;
+        get(z);
+        if (z < 32) get(1);
+        return z;
+    }
+};
+
+struct riceState
+{
+    uint32_t a;
+    uint32_t n;
+
+    riceState() : a(4), n(1) {}
+
+    int k() const
+    {
+        int k = 0;
+        while ((n << k) < a && k < 15) k++;
+        return k;
+    }
+
+    void update(uint32_t e)
+    {
+        a += e;
+        if (++n == 64) { a >>= 1; n >>= 1; }
+    }
+};
+
+inline void put_rice(bitWriter& bw, uint32_t e, int k)
+{
+    uint32_t q = e >> k;
+    if (q < static_cast<uint32_t>(RICE_LIMIT)) {
+        bw.put(((1u << q) - 1) << 1, q + 1);
+        bw.put(e & ((1u << k) - 1), k);
+    }
+    else {
+        bw.put((1u << RICE_LIMIT) - 1, RICE_LIMIT);
+        bw.put(e, 16);
+    }
+}
+
+inline uint32_t get_rice(bitReader& br, int k)
+{
+    int q = br.count_ones(RICE_LIMIT);
+    if (q == RICE_LIMIT) return br.get(16);
+    return (static_cast<uint32_t>(q) << k) | br.get(k);
+}
+
+inline void put_expgolomb(bitWriter& bw, uint32_t n)
+{
+    uint32_t v = n + 1;
+    int len = 31 - __builtin_clz(v);
+    bw.put(0, len);
+    bw.put(v, len + 1);
+}
+
+inline bool get_expgolomb(bitReader& br, uint32_t& n)
+{
+    // count_zeros has already consumed the leading one of v; 32 zeros only come from a
+    // corrupt or truncated band (the reader pads with zeros past its end)
+    int len = br.count_zeros();
+    if (len >= 32) return false;
+    n = ((1u << len) | br.get(len)) - 1;
+    return true;
+}
+
+inline uint16_t med_predict(uint16_t l, uint16_t u, uint16_t ul)
+{
+    uint16_t mn = std::min(l, u);
+    uint16_t mx = std::max(l, u);
+    if (ul >= mx) return mn;
+    if (ul <= mn) return mx;
+    return static_cast<uint16_t>(l + u - ul);
+}
+
+inline uint16_t zigzag(uint16_t x, uint16_t pred)
+{
+    int16_t r = static_cast<int16_t>(static_cast<uint16_t>(x - pred));
+    return static_cast<uint16_t>((static_cast<uint16_t>(r) << 1) ^ (r >> 15));
+}
+
+inline uint16_t unzigzag(uint16_t e, uint16_t pred)
+{
+    uint16_t r = static_cast<uint16_t>((e >> 1) ^ -(e & 1));
+    return static_cast<uint16_t>(pred + r);
+}
+
+// residuals of one row; up == 0 for the first row of a band
+void residual_row_scalar(const uint16_t* x, const uint16_t* up, int width, uint16_t* out)
+{
+    if (!up) {
+        uint16_t l = 0;
+        for (int i = 0; i < width; i++) { out[i] = zigzag(x[i], l); l = x[i]; }
+        return;
+    }
+    out[0] = zigzag(x[0], up[0]);
+    for (int i = 1; i < width; i++)
+        out[i] = zigzag(x[i], med_predict(x[i-1], up[i], up[i-1]));
+}
+
+#if SIMD_X86
+SIMD_TARGET("sse4.1")
+void residual_row_sse41(const uint16_t* x, const uint16_t* up, int width, uint16_t* out)
+{
+    int i = 1;
+    if (!up) {
+        out[0] = zigzag(x[0], 0);
+        for (; i + 8 <= width; i += 8) {
+            __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i - 1));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+            __m128i r = _mm_sub_epi16(c, l);
+            __m128i z = _mm_xor_si128(_mm_slli_epi16(r, 1), _mm_srai_epi16(r, 15));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), z);
+        }
+        for (; i < width; i++) out[i] = zigzag(x[i], x[i-1]);
+        return;
+    }
+
+    out[0] = zigzag(x[0], up[0]);
+    for (; i + 8 <= width; i += 8) {
+        __m128i l  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i - 1));
+        __m128i u  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + i));
+        __m128i ul = _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + i - 1));
+        __m128i c  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+
+        __m128i mn = _mm_min_epu16(l, u);
+        __m128i mx = _mm_max_epu16(l, u);
+        __m128i grad = _mm_sub_epi16(_mm_add_epi16(l, u), ul);
+        __m128i ge = _mm_cmpeq_epi16(_mm_max_epu16(ul, mx), ul);     // ul >= max
+        __m128i le = _mm_cmpeq_epi16(_mm_min_epu16(ul, mn), ul);     // ul <= min
+
+        __m128i pred = _mm_blendv_epi8(grad, mx, le);
+        pred = _mm_blendv_epi8(pred, mn, ge);
+
+        __m128i r = _mm_sub_epi16(c, pred);
+        __m128i z = _mm_xor_si128(_mm_slli_epi16(r, 1), _mm_srai_epi16(r, 15));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), z);
+    }
+    for (; i < width; i++) out[i] = zigzag(x[i], med_predict(x[i-1], up[i], up[i-1]));
+}
+#endif
+
+void encode_band(const uint16_t* band, int width, int rows, std::vector<uint16_t>& resid, std::vector<unsigned char>& out)
+{
+    size_t n = static_cast<size_t>(width)*rows;
+    resid.resize(n);
+
+#if SIMD_X86
+    bool sse41 = cpu_has_sse41();
+#endif
+    for (int r = 0; r < rows; r++) {
+        const uint16_t* x = band + static_cast<size_t>(r)*width;
+        const uint16_t* up = r ? x - width : 0;
+#if SIMD_X86
+        if (sse41) { residual_row_sse41(x, up, width, &resid[static_cast<size_t>(r)*width]); continue; }
+#endif
+        residual_row_scalar(x, up, width, &resid[static_cast<size_t>(r)*width]);
+    }
+
+    out.clear();
+    bitWriter bw(out);
+    riceState rs;
+    bool prevZero = false;
+
+    size_t p = 0;
+    while (p < n) {
+        if (prevZero) {
+            size_t run = 0;
+            while (p + run < n && resid[p + run] == 0) run++;
+            put_expgolomb(bw, static_cast<uint32_t>(run));
+            p += run;
+            prevZero = false;
+            if (p == n) break;
+
+            // the run stopped on a non-zero residual, so code e-1
+            uint32_t e = resid[p++];
+            put_rice(bw, e - 1, rs.k());
+            rs.update(e);
+            continue;
+        }
+
+        uint32_t e = resid[p++];
+        put_rice(bw, e, rs.k());
+        rs.update(e);
+        prevZero = (e == 0);
+    }
+    bw.finish();
+}
+
+bool decode_band(const unsigned char* data, size_t size, int width, int rows, uint16_t* band)
+{
+    bitReader br(data, size);
+    riceState rs;
+    bool prevZero = false;
+    size_t n = static_cast<size_t>(width)*rows;
+
+    // reconstruct pixel p from its residual, using the same neighbours as the encoder;
+    // pixels arrive strictly in raster order, so track the column instead of dividing
+    int col = 0;
+    bool firstRow = true;
+    auto recon = [&](size_t p, uint16_t e) {
+        uint16_t pred;
+        if (firstRow) pred = col ? band[p-1] : 0;
+        else if (col == 0) pred = band[p-width];
+        else pred = med_predict(band[p-1], band[p-width], band[p-width-1]);
+        band[p] = unzigzag(e, pred);
+        if (++col == width) { col = 0; firstRow = false; }
+    };
+
+    size_t p = 0;
+    while (p < n) {
+        if (prevZero) {
+            uint32_t run;
+            if (!get_expgolomb(br, run) || run > n - p) return false;
+            for (size_t j = 0; j < run; j++) recon(p++, 0);
+            prevZero = false;
+            if (p == n) break;
+
+            uint32_t e = get_rice(br, rs.k()) + 1;
+            recon(p++, static_cast<uint16_t>(e));
+            rs.update(e);
+            continue;
+        }
+
+        uint32_t e = get_rice(br, rs.k());
+        recon(p++, static_cast<uint16_t>(e));
+        rs.update(e);
+        prevZero = (e == 0);
+    }
+    return true;
+}
+
+} // namespace
+
+
+depthCodec::depthCodec(int tile_rows) : tileRows(tile_rows > 0 ? tile_rows : 48)
+{
+}
+
+bool depthCodec::encode(const uint16_t* depth, int width, int height, std::vector<unsigned char>& out, workerPool* pool)
+{
+    if (width <= 0 || height <= 0) return false;
+
+    int tiles = (height + tileRows - 1)/tileRows;
+    if (static_cast<int>(tileOut.size()) < tiles) {
+        tileOut.resize(tiles);
+        tileResid.resize(tiles);
+    }
+
+    std::function<void(int)> band = [&](int t) {
+        int row0 = t*tileRows;
+        int rows = std::min(tileRows, height - row0);
+        encode_band(depth + static_cast<size_t>(row0)*width, width, rows, tileResid[t], tileOut[t]);
+    };
+    if (pool) pool->parallel_for(tiles, band);
+    else for (int t = 0; t < tiles; t++) band(t);
+
+    tz16Header hdr;
+    hdr.magic = TZ16_MAGIC;
+    hdr.version = 1;
+    hdr.tileRows = static_cast<uint16_t>(tileRows);
+    hdr.width = width;
+    hdr.height = height;
+    hdr.tiles = tiles;
+
+    size_t total = sizeof(hdr) + tiles*sizeof(uint32_t);
+    for (int t = 0; t < tiles; t++) total += tileOut[t].size();
+
+    out.resize(total);
+    unsigned char* p = out.data();
+    std::memcpy(p, &hdr, sizeof(hdr));
+    p += sizeof(hdr);
+    for (int t = 0; t < tiles; t++) {
+        uint32_t len = static_cast<uint32_t>(tileOut[t].size());
+        std::memcpy(p, &len, sizeof(len));
+        p += sizeof(len);
+    }
+    for (int t = 0; t < tiles; t++) {
+        std::memcpy(p, tileOut[t].data(), tileOut[t].size());
+        p += tileOut[t].size();
+    }
+    return true;
+}
+
+bool depthCodec::frame_size(const unsigned char* data, size_t size, int& width, int& height)
+{
+    tz16Header hdr;
+    if (size < sizeof(hdr)) return false;
+    std::memcpy(&hdr, data, sizeof(hdr));
+    if (hdr.magic != TZ16_MAGIC || hdr.version != 1) return false;
+    width = hdr.width;
+    height = hdr.height;
+    return true;
+}
+
+bool depthCodec::decode(const unsigned char* data, size_t size, uint16_t* depth, int width, int height, workerPool* pool)
+{
+    tz16Header hdr;
+    if (size < sizeof(hdr)) return false;
+    std::memcpy(&hdr, data, sizeof(hdr));
+    if (hdr.magic != TZ16_MAGIC || hdr.version != 1) return false;
+    if (static_cast<int>(hdr.width) != width || static_cast<int>(hdr.height) != height || hdr.tileRows == 0) return false;
+
+    int tiles = hdr.tiles;
+    if (tiles != (height + hdr.tileRows - 1)/hdr.tileRows) return false;
+    if (size < sizeof(hdr) + tiles*sizeof(uint32_t)) return false;
+
+    // band offsets from the byte count table
+    std::vector<size_t> offsets(tiles + 1);
+    offsets[0] = sizeof(hdr) + tiles*sizeof(uint32_t);
+    for (int t = 0; t < tiles; t++) {
+        uint32_t len;
+        std::memcpy(&len, data + sizeof(hdr) + t*sizeof(uint32_t), sizeof(len));
+        offsets[t+1] = offsets[t] + len;
+    }
+    if (offsets[tiles] > size) return false;
+
+    int tile_rows = hdr.tileRows;
+    std::atomic<bool> ok(true);
+    std::function<void(int)> band = [&](int t) {
+        int row0 = t*tile_rows;
+        int rows = std::min(tile_rows, height - row0);
+        if (!decode_band(data + offsets[t], offsets[t+1] - offsets[t], width, rows, depth + static_cast<size_t>(row0)*width))
+            ok = false;
+    };
+    if (pool) pool->parallel_for(tiles, band);
+    else for (int t = 0; t < tiles; t++) band(t);
+    return ok;
+}
+
+depthCodec& depthCodec::for_thread()
+{
+    static boost::thread_specific_ptr<depthCodec> codec;
+    if (!codec.get()) codec.reset(new depthCodec);
+    return *codec;
+}
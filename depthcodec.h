@@ -0,0 +1,77 @@
+/* depthcodec.h
+ *
+ * Description:
+ *   header file for depthCodec class
+ *   Lossless codec for Z16 depth frames ("TZ16"). The frame is cut into bands
+ *   of tileRows rows that are coded independently, so bands encode and decode
+ *   in parallel on a workerPool.
+ *   Per band:
+ *     - MED (LOCO-I) prediction from the left, up and up-left neighbours,
+ *       residuals computed 8 pixels at a time with SSE4.1 when available
+ *     - zig-zag mapped residuals, adaptive Golomb-Rice coded
+ *     - after a zero residual, the run of further zero residuals is coded as
+ *       one Exp-Golomb length: static background and zero "hole" regions
+ *       collapse to a few bits per run
+ *
+ *   Frame layout:
+ *     tz16Header, uint32 band byte counts[tiles], band bitstreams
+ *
+ * Functions:
+ *   encode - compresses a frame into out (band buffers are reused between frames)
+ *   decode - decompresses into a width*height uint16 buffer; false on a corrupt or truncated stream
+ *   frame_size - reads width/height from an encoded frame
+ *   for_thread - per-thread encoder instance
+ *
+ * Input:
+ *   uint16 depth buffer, width, height, optional workerPool for band parallelism
+ *
+ * Output:
+ *   encoded byte stream / decoded depth
+ *
+ * Requirements:
+ *   boost/thread
+ *   SSE4.1 optional (checked at run time)
+ *
+ * Thread safe? encode: one instance per thread (see for_thread); decode: YES
+ *
+ * Extendable? YES
+ */
+
+#ifndef DEPTHCODEC_H
+#define DEPTHCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "workerpool.h"
+
+const uint32_t TZ16_MAGIC = 0x36315a54;     // "TZ16"
+
+struct tz16Header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t tileRows;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tiles;
+};
+
+class depthCodec
+{
+    int tileRows;
+    std::vector< std::vector<unsigned char> > tileOut;
+    std::vector< std::vector<uint16_t> > tileResid;
+
+public:
+    explicit depthCodec(int tile_rows = 48);
+
+    bool encode(const uint16_t* depth, int width, int height, std::vector<unsigned char>& out, workerPool* pool = 0);
+    static bool decode(const unsigned char* data, size_t size, uint16_t* depth, int width, int height, workerPool* pool = 0);
+    static bool frame_size(const unsigned char* data, size_t size, int& width, int& height);
+
+    static depthCodec& for_thread();
+};
+
+#endif // DEPTHCODEC_H
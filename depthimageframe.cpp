@@ -66,3 +66,45 @@ void depthImageFrame::save_d_frame(const void* d_point, boost::filesystem::path
     depthfile.write(static_cast<const char*>(d_point), arraysize);
     depthfile.close();
 }
+
+
+bool depthImageFrame::append_d_frame(const void* d_point, segmentWriter& d_segments, int framenum, double timestamp)
+{
+    // Container mode: one chunk per frame in the session's segment files
+
+    int arraysize = this->array_size_calc();
+
+    return d_segments.append(d_point, arraysize, framenum, timestamp);
+}
+
+
+bool depthImageFrame::encode_d_frame(const void* d_point, std::vector<unsigned char>& tz16, workerPool* tiles)
+{
+    // lossless TZ16, bands of the frame are coded in parallel when a pool is given
+    const uint16_t* depth = static_cast<const uint16_t*>(d_point);
+    return depthCodec::for_thread().encode(depth, width, height, tz16, tiles);
+}
+
+
+void depthImageFrame::save_d_frame(const std::vector<unsigned char>& tz16, boost::filesystem::path d_path, int framenum)
+{
+    // Overloaded: TZ16 encoded frame, one file per frame
+
+    namespace bfs = boost::filesystem;
+
+    std::string d_file = "depth_frame_" + std::to_string(framenum) + ".tz16";
+    d_path /= d_file;
+
+    bfs::ofstream depthfile;
+    depthfile.open(d_path, std::ios::out | std::ofstream::binary);
+    depthfile.write(reinterpret_cast<const char*>(tz16.data()), tz16.size());
+    depthfile.close();
+}
+
+
+bool depthImageFrame::append_d_frame(const std::vector<unsigned char>& tz16, segmentWriter& d_segments, int framenum, double timestamp)
+{
+    // Overloaded: TZ16 encoded frame into the session's segment files
+
+    return d_segments.append(tz16.data(), tz16.size(), framenum, timestamp, SEG_CODEC_TZ16);
+}
@@ -10,11 +10,14 @@
  *   depth_size_calc - calculates needed buffer size for rgb conversion
  *   save_d_frame - takes a frame from a RealSense library-compatible depth image stream OR
  *   a pointer to such a frame buffer, saves to file
+ *   append_d_frame - appends a frame buffer to a session segment container (see segmentwriter.h)
+ *   encode_d_frame - losslessly compresses a frame buffer to TZ16 (see depthcodec.h); the
+ *   save_d_frame/append_d_frame overloads taking the encoded bytes store it as .tz16 / TZ16 chunks
  *
  * Input:
  *   device or buffer pointer
- *   path to save directory
- *   filename or enumerative
+ *   path to save directory OR segment writer
+ *   filename or enumerative, timestamp
  *
  * Output:
  *   none
@@ -41,6 +44,9 @@
 
 #include <fstream>
 
+#include "segmentwriter.h"
+#include "depthcodec.h"
+
 // Include the librealsense C++ header file
 #include <librealsense2/rs.hpp>
 
@@ -55,6 +61,11 @@ class depthImageFrame {
 
     void save_d_frame(const void* cpoint, boost::filesystem::path d_path, std::string d_file);
     void save_d_frame(const void* dpoint, boost::filesystem::path d_path, int framenum);
+    bool append_d_frame(const void* dpoint, segmentWriter& d_segments, int framenum, double timestamp);
+
+    bool encode_d_frame(const void* dpoint, std::vector<unsigned char>& tz16, workerPool* tiles = 0);
+    void save_d_frame(const std::vector<unsigned char>& tz16, boost::filesystem::path d_path, int framenum);
+    bool append_d_frame(const std::vector<unsigned char>& tz16, segmentWriter& d_segments, int framenum, double timestamp);
 
 };
 
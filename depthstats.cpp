@@ -0,0 +1,477 @@
+#include "depthstats.h"
+
+#include <boost/chrono/chrono.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "simdcpu.h"
+
+#if SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace bfs = boost::filesystem;
+
+namespace {
+
+const int histogramPixels = 32768;      // above this, the median comes from a histogram
+
+// ---- one row of a ROI: sum, count, min and max of the non-zero pixels ----
+
+struct scanSums
+{
+    uint64_t sum = 0;
+    uint64_t valid = 0;
+    uint16_t lo = 0xFFFF;
+    uint16_t hi = 0;
+};
+
+// mask may be null (rectangle); a zero mask byte makes its pixel count as no data
+void scan_scalar(const uint16_t* z, const uint8_t* mask, int n, scanSums& s)
+{
+    for (int i = 0; i < n; i++) {
+        uint16_t v = (!mask || mask[i]) ? z[i] : 0;
+        if (!v) continue;
+        s.sum += v;
+        s.valid++;
+        if (v < s.lo) s.lo = v;
+        if (v > s.hi) s.hi = v;
+    }
+}
+
+#if SIMD_X86
+// per-lane counters cannot overflow for rows below 256K pixels; rows are at most a frame wide
+SIMD_TARGET("sse4.1")
+void scan_sse41(const uint16_t* z, const uint8_t* mask, int n, scanSums& s)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vmin = _mm_set1_epi16(-1);
+    __m128i vmax = zero;
+    __m128i vsum = zero;                // 4 x u32
+    __m128i vzeros = zero;              // 8 x u16, zero pixels per lane
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(z + i));
+        if (mask) {
+            __m128i m = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(mask + i)));
+            v = _mm_andnot_si128(_mm_cmpeq_epi16(m, zero), v);
+        }
+        __m128i isZero = _mm_cmpeq_epi16(v, zero);
+        vmin = _mm_min_epu16(vmin, _mm_or_si128(v, isZero));
+        vmax = _mm_max_epu16(vmax, v);
+        vzeros = _mm_sub_epi16(vzeros, isZero);
+        vsum = _mm_add_epi32(vsum, _mm_add_epi32(_mm_unpacklo_epi16(v, zero), _mm_unpackhi_epi16(v, zero)));
+    }
+
+    uint32_t sums[4];
+    uint16_t zeros[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), vsum);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(zeros), vzeros);
+    uint64_t nzero = 0;
+    for (int k = 0; k < 8; k++) nzero += zeros[k];
+    s.sum += static_cast<uint64_t>(sums[0]) + sums[1] + sums[2] + sums[3];
+    s.valid += i - nzero;
+    s.lo = std::min(s.lo, static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_minpos_epu16(vmin))));
+    s.hi = std::max(s.hi, static_cast<uint16_t>(~_mm_cvtsi128_si32(_mm_minpos_epu16(_mm_xor_si128(vmax, _mm_set1_epi16(-1))))));
+    scan_scalar(z + i, mask ? mask + i : 0, n - i, s);
+}
+
+SIMD_TARGET("avx2")
+void scan_avx2(const uint16_t* z, const uint8_t* mask, int n, scanSums& s)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i vmin = _mm256_set1_epi16(-1);
+    __m256i vmax = zero;
+    __m256i vsum = zero;
+    __m256i vzeros = zero;
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(z + i));
+        if (mask) {
+            __m256i m = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask + i)));
+            v = _mm256_andnot_si256(_mm256_cmpeq_epi16(m, zero), v);
+        }
+        __m256i isZero = _mm256_cmpeq_epi16(v, zero);
+        vmin = _mm256_min_epu16(vmin, _mm256_or_si256(v, isZero));
+        vmax = _mm256_max_epu16(vmax, v);
+        vzeros = _mm256_sub_epi16(vzeros, isZero);
+        vsum = _mm256_add_epi32(vsum, _mm256_add_epi32(_mm256_unpacklo_epi16(v, zero), _mm256_unpackhi_epi16(v, zero)));
+    }
+
+    uint32_t sums[8];
+    uint16_t zeros[16];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums), vsum);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(zeros), vzeros);
+    uint64_t nzero = 0;
+    for (int k = 0; k < 16; k++) nzero += zeros[k];
+    for (int k = 0; k < 8; k++) s.sum += sums[k];
+    s.valid += i - nzero;
+    __m128i lmin = _mm_min_epu16(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1));
+    __m128i lmax = _mm_max_epu16(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1));
+    s.lo = std::min(s.lo, static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_minpos_epu16(lmin))));
+    s.hi = std::max(s.hi, static_cast<uint16_t>(~_mm_cvtsi128_si32(_mm_minpos_epu16(_mm_xor_si128(lmax, _mm_set1_epi16(-1))))));
+    scan_scalar(z + i, mask ? mask + i : 0, n - i, s);
+}
+#endif
+
+void scan_row(const uint16_t* z, const uint8_t* mask, int n, scanSums& s)
+{
+#if SIMD_X86
+    if (cpu_has_avx2()) { scan_avx2(z, mask, n, s); return; }
+    if (cpu_has_sse41()) { scan_sse41(z, mask, n, s); return; }
+#endif
+    scan_scalar(z, mask, n, s);
+}
+
+// binary P5 with maxval < 256; non-zero samples are inside the mask
+bool read_pgm(const bfs::path& file, int& width, int& height, std::vector<uint8_t>& data)
+{
+    bfs::ifstream in(file, std::ios::binary);
+    std::string magic;
+    int maxval = 0;
+    if (!(in >> magic) || magic != "P5") return false;
+
+    int* fields[] = { &width, &height, &maxval };
+    for (int f = 0; f < 3; f++) {
+        in >> std::ws;
+        while (in.peek() == '#') { std::string skip; std::getline(in, skip); in >> std::ws; }
+        if (!(in >> *fields[f])) return false;
+    }
+    if (width <= 0 || height <= 0 || maxval <= 0 || maxval > 255) return false;
+    in.get();                           // the single whitespace before the samples
+
+    data.resize(static_cast<size_t>(width)*height);
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(data.data()), data.size()));
+}
+
+}
+
+// ---- ROIs ----
+
+depthRoi depthRoi::point(const std::string& name, int x, int y)
+{
+    depthRoi r = rect(name, x, y, 1, 1);
+    r.shape = roiShape::point;
+    return r;
+}
+
+depthRoi depthRoi::rect(const std::string& name, int x, int y, int width, int height)
+{
+    depthRoi r;
+    r.name = name;
+    r.shape = roiShape::rect;
+    r.x = x;
+    r.y = y;
+    r.width = std::max(1, width);
+    r.height = std::max(1, height);
+    r.pixels = r.width*r.height;
+    return r;
+}
+
+depthRoi depthRoi::masked(const std::string& name, int x, int y, int width, int height, const std::vector<uint8_t>& mask)
+{
+    depthRoi r = rect(name, x, y, width, height);
+    r.shape = roiShape::mask;
+    r.mask = mask;
+    r.mask.resize(static_cast<size_t>(r.width)*r.height, 0);     // a short mask leaves the rest outside
+    r.pixels = static_cast<int>(r.mask.size() - std::count(r.mask.begin(), r.mask.end(), 0));
+    return r;
+}
+
+bool load_rois(const bfs::path& file, std::vector<depthRoi>& rois)
+{
+    bfs::ifstream in(file);
+    if (!in) return false;
+
+    std::string line;
+    int lineNum = 0;
+    while (std::getline(in, line)) {
+        lineNum++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string kind, name;
+        int x, y, w, h;
+        if (!(fields >> kind)) continue;
+
+        if (kind == "point" && fields >> name >> x >> y) {
+            rois.push_back(depthRoi::point(name, x, y));
+        }
+        else if (kind == "rect" && fields >> name >> x >> y >> w >> h) {
+            rois.push_back(depthRoi::rect(name, x, y, w, h));
+        }
+        else if (kind == "mask" && fields >> name >> x >> y) {
+            std::string maskFile;
+            std::vector<uint8_t> mask;
+            std::getline(fields >> std::ws, maskFile);
+            bfs::path maskPath(maskFile);
+            if (maskPath.is_relative()) maskPath = file.parent_path() / maskPath;
+            if (!read_pgm(maskPath, w, h, mask)) {
+                std::cerr << "ROI mask " << maskPath << " is not a binary PGM" << std::endl;
+                return false;
+            }
+            rois.push_back(depthRoi::masked(name, x, y, w, h, mask));
+        }
+        else {
+            std::cerr << file << ":" << lineNum << ": bad ROI line" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// ---- statistics ----
+
+void depthStats::measure(const uint16_t* z, int width, int height, const depthRoi& roi,
+                         bool median, medianScratch& scratch, roiStats& out)
+{
+    out = roiStats();
+    out.pixels = roi.pixels;
+
+    // clip to the frame; the clipped-off part simply has no valid pixels
+    int x0 = std::max(roi.x, 0);
+    int y0 = std::max(roi.y, 0);
+    int x1 = std::min(roi.x + roi.width, width);
+    int y1 = std::min(roi.y + roi.height, height);
+    if (!z || x0 >= x1 || y0 >= y1) return;
+
+    const bool masked = roi.shape == roiShape::mask;
+    auto mask_row = [&](int y) -> const uint8_t* {
+        return masked ? roi.mask.data() + static_cast<size_t>(y - roi.y)*roi.width + (x0 - roi.x) : 0;
+    };
+
+    scanSums s;
+    for (int y = y0; y < y1; y++)
+        scan_row(z + static_cast<size_t>(y)*width + x0, mask_row(y), x1 - x0, s);
+
+    out.valid = static_cast<int>(s.valid);
+    if (!out.valid) return;
+    out.mean = static_cast<double>(s.sum)/s.valid;
+    out.min = s.lo;
+    out.max = s.hi;
+    if (!median) return;
+
+    if (s.valid > histogramPixels) {
+        // counting is linear and needs no copy; one 64K walk finds the middle
+        scratch.hist.assign(65536, 0);
+        uint32_t* hist = scratch.hist.data();
+        for (int y = y0; y < y1; y++) {
+            const uint16_t* row = z + static_cast<size_t>(y)*width + x0;
+            const uint8_t* m = mask_row(y);
+            for (int x = 0; x < x1 - x0; x++)
+                if (!m || m[x]) hist[row[x]]++;
+        }
+        // ranks of the two middle values (the same one for an odd count); bin 0 holds no data
+        uint64_t lowRank = (s.valid - 1)/2;
+        uint64_t highRank = s.valid/2;
+        uint64_t seen = 0;
+        int lower = -1;
+        for (int v = 1; v < 65536; v++) {
+            seen += hist[v];
+            if (lower < 0 && seen > lowRank) lower = v;
+            if (seen > highRank) {
+                out.median = 0.5*(lower + v);
+                break;
+            }
+        }
+        return;
+    }
+
+    std::vector<uint16_t>& values = scratch.values;
+    values.resize(s.valid);
+    uint16_t* dst = values.data();
+    for (int y = y0; y < y1; y++) {
+        const uint16_t* row = z + static_cast<size_t>(y)*width + x0;
+        const uint8_t* m = mask_row(y);
+        for (int x = 0; x < x1 - x0; x++) {
+            uint16_t v = row[x];
+            if (v && (!m || m[x])) *dst++ = v;
+        }
+    }
+
+    // middle value; for an even count, the mean of the two middle ones
+    size_t k = values.size()/2;
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    out.median = values[k];
+    if (values.size() % 2 == 0) out.median = 0.5*(out.median + *std::max_element(values.begin(), values.begin() + k));
+}
+
+// ---- engine ----
+
+depthStats::depthStats(const depthStatsConfig& s_cfg, const std::vector<depthRoi>& s_rois)
+    : cfg(s_cfg), rois(s_rois), pool(std::max(0, s_cfg.workers)), maxPixels(0), lastFlush(0.0),
+      quit(false), submitted(0), n_analysed(0), n_dropped(0)
+{
+}
+
+depthStats::~depthStats()
+{
+    stop();
+}
+
+bool depthStats::start(const bfs::path& file, size_t max_pixels)
+{
+    if (thread.joinable()) return false;
+
+    log.open(file, cfg.binary ? std::ios::out | std::ios::binary : std::ios::out);
+    if (!log) {
+        std::cerr << "Cannot open depth statistics log " << file << std::endl;
+        return false;
+    }
+    write_header();
+
+    // everything the session needs is allocated here: nothing grows per frame
+    int n = std::max(1, cfg.queueFrames);
+    maxPixels = max_pixels;
+    jobs.assign(n, statsJob());
+    freeJobs.reset(new boost::lockfree::spsc_queue<statsJob*>(n));
+    readyJobs.reset(new boost::lockfree::spsc_queue<statsJob*>(n));
+    for (statsJob& job : jobs) {
+        job.depth.resize(maxPixels);
+        freeJobs->push(&job);
+    }
+    results.assign(rois.size(), roiStats());
+    scratch.assign(rois.size(), medianScratch());
+    for (size_t i = 0; i < rois.size(); i++) {
+        if (!cfg.median) continue;
+        if (rois[i].pixels > histogramPixels) scratch[i].hist.reserve(65536);
+        else scratch[i].values.reserve(rois[i].pixels);
+    }
+
+    submitted = 0;
+    lastFlush = host_ms();
+    quit = false;
+    thread = boost::thread(&depthStats::stats_loop, this);
+    return true;
+}
+
+void depthStats::stop()
+{
+    {
+        boost::mutex::scoped_lock l(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    if (thread.joinable()) thread.join();
+    if (log.is_open()) log.close();
+}
+
+bool depthStats::submit(const sourceFrame& depth)
+{
+    if (!thread.joinable() || !depth.valid()) return false;
+
+    // frame numbers count every submitted frame, so drops show up as gaps in the log
+    int64_t frame = submitted++;
+    size_t n = static_cast<size_t>(depth.width)*depth.height;
+    statsJob* job;
+    if (n > maxPixels || !freeJobs->pop(job)) {
+        n_dropped++;
+        return false;
+    }
+
+    std::memcpy(job->depth.data(), depth.data, n*sizeof(uint16_t));
+    job->width = depth.width;
+    job->height = depth.height;
+    job->frame = frame;
+    job->sensorFrame = depth.framenum;
+    job->timestamp = depth.timestamp;
+    readyJobs->push(job);
+    wake.notify_one();
+    return true;
+}
+
+void depthStats::stats_loop()
+{
+    statsJob* job;
+    while (true) {
+        if (!readyJobs->pop(job)) {
+            boost::mutex::scoped_lock l(lock);
+            if (quit) {
+                if (readyJobs->read_available()) continue;
+                break;
+            }
+            // the timeout covers a notify that lands between the pop and the wait
+            wake.wait_for(l, boost::chrono::milliseconds(20));
+            continue;
+        }
+
+        analyse(*job);
+        write_rows(*job);
+        freeJobs->push(job);
+        n_analysed++;
+
+        double now = host_ms();
+        if (now - lastFlush >= cfg.flushSeconds*1000.0) {
+            log.flush();
+            lastFlush = now;
+        }
+    }
+    log.flush();
+}
+
+void depthStats::analyse(const statsJob& job)
+{
+    const uint16_t* z = job.depth.data();
+    pool.parallel_for(static_cast<int>(rois.size()), [&](int i) {
+        measure(z, job.width, job.height, rois[i], cfg.median, scratch[i], results[i]);
+    });
+}
+
+void depthStats::write_header()
+{
+    if (!cfg.binary) {
+        log << "frame,sensor_frame,timestamp_ms,roi,pixels,valid,valid_fraction,mean_m,median_m,min_m,max_m\n";
+        return;
+    }
+
+    log.write("TDSTATS1", 8);
+    uint32_t count = static_cast<uint32_t>(rois.size());
+    log.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const depthRoi& r : rois) {
+        uint16_t len = static_cast<uint16_t>(std::min<size_t>(r.name.size(), 0xFFFF));
+        log.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        log.write(r.name.data(), len);
+    }
+}
+
+void depthStats::write_rows(const statsJob& job)
+{
+    const float scale = cfg.depthScale;
+    for (size_t i = 0; i < rois.size(); i++) {
+        const roiStats& st = results[i];
+        float mean = static_cast<float>(st.mean*scale);
+        float median = static_cast<float>(st.median*scale);
+        float lo = st.min*scale;
+        float hi = st.max*scale;
+
+        if (cfg.binary) {
+            char rec[52];
+            int64_t frame = job.frame;
+            int64_t sensor = job.sensorFrame;
+            uint32_t fields[3] = { static_cast<uint32_t>(i), static_cast<uint32_t>(st.pixels), static_cast<uint32_t>(st.valid) };
+            float dist[4] = { mean, median, lo, hi };
+            std::memcpy(rec, &frame, 8);
+            std::memcpy(rec + 8, &sensor, 8);
+            std::memcpy(rec + 16, &job.timestamp, 8);
+            std::memcpy(rec + 24, fields, 12);
+            std::memcpy(rec + 36, dist, 16);
+            log.write(rec, sizeof(rec));
+            continue;
+        }
+
+        char line[320];
+        double fraction = st.pixels ? static_cast<double>(st.valid)/st.pixels : 0.0;
+        int len = std::snprintf(line, sizeof(line), "%lld,%lld,%.3f,%s,%d,%d,%.4f,",
+                                static_cast<long long>(job.frame), static_cast<long long>(job.sensorFrame),
+                                job.timestamp, rois[i].name.c_str(), st.pixels, st.valid, fraction);
+        if (len < 0 || len >= static_cast<int>(sizeof(line))) continue;
+        if (st.valid)
+            len += std::snprintf(line + len, sizeof(line) - len, "%.4f,%.4f,%.4f,%.4f\n", mean, median, lo, hi);
+        else
+            len += std::snprintf(line + len, sizeof(line) - len, ",,,\n");
+        log.write(line, std::min<int>(len, sizeof(line) - 1));
+    }
+}
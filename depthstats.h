@@ -0,0 +1,181 @@
+/* depthstats.h
+ *
+ * Description:
+ *   header file for depthStats class and depthRoi
+ *   Depth analytics off the capture thread. The capture thread hands a Z16
+ *   frame to submit(), which copies it into one of a few preallocated job
+ *   buffers and returns; if every buffer is still queued the frame is dropped
+ *   and counted, so capture never waits for the analysis. The stats thread
+ *   measures every region of interest on the frame (the ROIs of one frame are
+ *   shared out over a workerPool) and streams one row per ROI to a CSV or
+ *   binary log, flushed once a second. Memory stays fixed for the whole
+ *   session: the job buffers, one scratch buffer per ROI and the file buffer.
+ *
+ *   A ROI is a point, a rectangle or a rectangle with a mask (non-zero mask
+ *   bytes are inside). Zero depth is "no data": valid is the number of
+ *   non-zero pixels inside the ROI, and the parts of a ROI outside the frame
+ *   count as invalid. Mean, min and max of the valid pixels are scanned 16/8
+ *   pixels at a time (AVX2/SSE4.1, see simdcpu.h); the median is an
+ *   nth_element over the valid pixels, or a walk up a 64K-bin histogram for
+ *   ROIs with more than histogramPixels valid pixels.
+ *
+ *   ROI file (load_rois), one ROI per line, # starts a comment:
+ *     point <name> <x> <y>
+ *     rect  <name> <x> <y> <width> <height>
+ *     mask  <name> <x> <y> <file.pgm>       (binary PGM, its size is the ROI size)
+ *
+ *   CSV columns: frame, sensor_frame, timestamp_ms, roi, pixels, valid,
+ *   valid_fraction, mean_m, median_m, min_m, max_m (distances are empty if
+ *   the ROI had no valid pixel). The binary log starts with "TDSTATS1", the
+ *   ROI count and the length-prefixed ROI names, followed by 52-byte little-
+ *   endian records: int64 frame, int64 sensor_frame, double timestamp_ms,
+ *   uint32 roi, pixels, valid, float mean_m, median_m, min_m, max_m.
+ *
+ * Functions:
+ *   start - opens the log and allocates the job buffers for frames up to max_pixels
+ *   stop - analyses what is queued, closes the log
+ *   submit - copies a depth frame for analysis; false if it was dropped (never blocks)
+ *   analysed/dropped - frame counters
+ *   measure - statistics of one ROI on one frame (the kernel the stats thread uses)
+ *   load_rois - reads a ROI file
+ *
+ * Input:
+ *   depthStatsConfig (workers, queue length, depth scale, log format), ROIs, Z16 frames
+ *
+ * Output:
+ *   statistics log file
+ *
+ * Requirements:
+ *   workerpool.h, framesource.h, simdcpu.h
+ *   boost/filesystem, boost/lockfree, boost/thread
+ *
+ * Thread safe? submit from ONE capture thread; counters from any thread
+ *
+ * Extendable? YES
+ */
+
+#ifndef DEPTHSTATS_H
+#define DEPTHSTATS_H
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "framesource.h"
+#include "workerpool.h"
+
+enum class roiShape { point, rect, mask };
+
+struct depthRoi
+{
+    std::string name;
+    roiShape shape = roiShape::rect;
+    int x = 0;
+    int y = 0;
+    int width = 1;
+    int height = 1;
+    std::vector<uint8_t> mask;          // width*height, non-zero = inside (mask shape only)
+    int pixels = 1;                     // pixels inside the ROI
+
+    static depthRoi point(const std::string& name, int x, int y);
+    static depthRoi rect(const std::string& name, int x, int y, int width, int height);
+    static depthRoi masked(const std::string& name, int x, int y, int width, int height, const std::vector<uint8_t>& mask);
+};
+
+bool load_rois(const boost::filesystem::path& file, std::vector<depthRoi>& rois);
+
+struct roiStats
+{
+    int pixels = 0;                     // ROI size
+    int valid = 0;                      // non-zero pixels inside the ROI and the frame
+    double mean = 0.0;                  // of the valid pixels, Z16 units
+    double median = 0.0;                // mean of the two middle values for an even count
+    uint16_t min = 0;
+    uint16_t max = 0;
+};
+
+// per-ROI working memory for the median, kept between frames
+struct medianScratch
+{
+    std::vector<uint16_t> values;       // small ROIs: nth_element over the valid pixels
+    std::vector<uint32_t> hist;         // large ROIs: 64K-bin histogram
+};
+
+struct depthStatsConfig
+{
+    int workers = 0;                    // pool threads sharing a frame's ROIs (the stats thread works too)
+    int queueFrames = 4;                // frames waiting for analysis; more are dropped
+    float depthScale = 0.001f;          // metres per Z16 unit
+    bool binary = false;                // binary records instead of CSV
+    bool median = true;                 // the median is the one statistic that is not a single pass
+    double flushSeconds = 1.0;
+};
+
+class depthStats
+{
+    struct statsJob
+    {
+        std::vector<uint16_t> depth;
+        int width = 0;
+        int height = 0;
+        int64_t frame = 0;
+        int64_t sensorFrame = 0;
+        double timestamp = 0.0;
+    };
+
+    depthStatsConfig cfg;
+    std::vector<depthRoi> rois;
+    workerPool pool;
+
+    std::vector<statsJob> jobs;
+    std::unique_ptr<boost::lockfree::spsc_queue<statsJob*> > freeJobs;   // stats thread -> capture thread
+    std::unique_ptr<boost::lockfree::spsc_queue<statsJob*> > readyJobs;  // capture thread -> stats thread
+    size_t maxPixels;
+
+    std::vector<roiStats> results;
+    std::vector<medianScratch> scratch;
+
+    boost::filesystem::ofstream log;
+    double lastFlush;
+
+    boost::thread thread;
+    boost::mutex lock;
+    boost::condition_variable wake;
+    bool quit;
+
+    int64_t submitted;
+    std::atomic<long long> n_analysed;
+    std::atomic<long long> n_dropped;
+
+    void stats_loop();
+    void analyse(const statsJob& job);
+    void write_header();
+    void write_rows(const statsJob& job);
+
+public:
+    depthStats(const depthStatsConfig& s_cfg, const std::vector<depthRoi>& s_rois);
+    ~depthStats();
+
+    bool start(const boost::filesystem::path& file, size_t max_pixels);
+    void stop();
+
+    bool submit(const sourceFrame& depth);
+
+    long long analysed() const { return n_analysed; }
+    long long dropped() const { return n_dropped; }
+    const std::vector<depthRoi>& regions() const { return rois; }
+
+    static void measure(const uint16_t* z, int width, int height, const depthRoi& roi,
+                        bool median, medianScratch& scratch, roiStats& out);
+};
+
+#endif // DEPTHSTATS_H
@@ -0,0 +1,124 @@
+#include "framepool.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <new>
+#include <stdexcept>
+
+static const size_t HUGEPAGE_BYTES = 2*1024*1024;
+
+static size_t round_up(size_t n, size_t align) { return ((n + align - 1)/align)*align; }
+
+
+frameHandle::frameHandle(frameSlot* f_slot) : slot(f_slot)
+{
+    // a fresh slot from the pool starts at refs == 1
+}
+
+frameHandle::frameHandle(const frameHandle& other) : slot(other.slot)
+{
+    if (slot) slot->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+frameHandle::frameHandle(frameHandle&& other) : slot(other.slot)
+{
+    other.slot = 0;
+}
+
+frameHandle& frameHandle::operator=(frameHandle other)
+{
+    std::swap(slot, other.slot);
+    return *this;
+}
+
+frameHandle::~frameHandle()
+{
+    reset();
+}
+
+void frameHandle::reset()
+{
+    if (slot && slot->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        slot->pool->release(slot);
+    slot = 0;
+}
+
+
+framePool::framePool(size_t slot_bytes, int n_slots, bool hugepages, bool lock_pages)
+    : slab(0), slabBytes(0), slotBytes(0), locked(false), huge(false),
+      slots(n_slots), freeSlots(n_slots), n_exhausted(0)
+{
+    // keep every slot cache-line (and SIMD) aligned
+    slotBytes = round_up(slot_bytes, 64);
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    void* mem = MAP_FAILED;
+    if (hugepages) {
+        slabBytes = round_up(slotBytes*n_slots, HUGEPAGE_BYTES);
+        mem = mmap(0, slabBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mem != MAP_FAILED) huge = true;
+        else std::cout << "Warning: no hugepages reserved, frame pool uses normal pages" << std::endl;
+    }
+    if (mem == MAP_FAILED) {
+        slabBytes = round_up(slotBytes*n_slots, page);
+        mem = mmap(0, slabBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        if (hugepages) madvise(mem, slabBytes, MADV_HUGEPAGE);
+#endif
+    }
+    slab = static_cast<unsigned char*>(mem);
+
+    if (lock_pages) {
+        // fault every page in now so the capture thread never takes a page fault
+        locked = (mlock(slab, slabBytes) == 0);
+        if (!locked) {
+            std::cout << "Warning: could not lock frame pool (" << slabBytes/(1024*1024) << " MB), check ulimit -l" << std::endl;
+            for (size_t off = 0; off < slabBytes; off += page) slab[off] = 0;
+        }
+    }
+
+    for (int i = 0; i < n_slots; i++) {
+        slots[i].refs = 0;
+        slots[i].pool = this;
+        slots[i].index = i;
+        slots[i].data = slab + i*slotBytes;
+        slots[i].size = slot_bytes;
+        freeSlots.bounded_push(i);
+    }
+}
+
+framePool::~framePool()
+{
+    if (slab) {
+        if (locked) munlock(slab, slabBytes);
+        munmap(slab, slabBytes);
+    }
+}
+
+frameHandle framePool::acquire()
+{
+    int i;
+    if (!freeSlots.pop(i)) {
+        n_exhausted++;
+        return frameHandle();
+    }
+    slots[i].refs.store(1, std::memory_order_relaxed);
+    return frameHandle(&slots[i]);
+}
+
+void framePool::release(frameSlot* slot)
+{
+    freeSlots.bounded_push(slot->index);
+}
+
+int framePool::available() const
+{
+    // approximate while frames are in flight: counts unreferenced slots
+    int n = 0;
+    for (size_t i = 0; i < slots.size(); i++)
+        if (slots[i].refs.load(std::memory_order_relaxed) == 0) n++;
+    return n;
+}
@@ -0,0 +1,102 @@
+/* framepool.h
+ *
+ * Description:
+ *   header file for framePool class and frameHandle
+ *   Preallocated arena of fixed-size frame buffers. Device frames are copied
+ *   into a slot on the capture thread, and the slot is passed to the writers
+ *   by a ref-counted handle, so the writers never read device memory that
+ *   wait_for_frames() may have reused. The slab is mmap'd once, page-locked
+ *   (mlock) and optionally hugepage-backed; no heap allocation happens per frame.
+ *
+ * Functions:
+ *   acquire - takes a free slot, returns an empty handle (and counts it) if the pool is exhausted
+ *   available - free slots right now
+ *   exhausted - number of failed acquires since construction
+ *   frameHandle - copyable ref-counted reference to a slot; the slot returns
+ *   to its pool when the last handle is released
+ *
+ * Input:
+ *   slot size in bytes, number of slots, hugepage and page-lock flags
+ *
+ * Output:
+ *   frameHandle
+ *
+ * Requirements:
+ *   boost/lockfree
+ *   sys/mman
+ *
+ * Thread safe? YES
+ *
+ * Extendable? YES
+ */
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <boost/lockfree/stack.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+class framePool;
+
+struct frameSlot
+{
+    std::atomic<int> refs;
+    framePool* pool;
+    int index;
+    unsigned char* data;
+    size_t size;
+};
+
+class frameHandle
+{
+    frameSlot* slot;
+
+public:
+    frameHandle() : slot(0) {}
+    explicit frameHandle(frameSlot* f_slot);
+    frameHandle(const frameHandle& other);
+    frameHandle(frameHandle&& other);
+    frameHandle& operator=(frameHandle other);
+    ~frameHandle();
+
+    void reset();
+    bool valid() const { return slot != 0; }
+    unsigned char* data() const { return slot ? slot->data : 0; }
+    size_t size() const { return slot ? slot->size : 0; }
+};
+
+class framePool
+{
+    friend class frameHandle;
+
+    unsigned char* slab;
+    size_t slabBytes;
+    size_t slotBytes;
+    bool locked;
+    bool huge;
+
+    std::vector<frameSlot> slots;
+    boost::lockfree::stack<int, boost::lockfree::fixed_sized<true> > freeSlots;
+
+    std::atomic<long long> n_exhausted;
+
+    void release(frameSlot* slot);
+
+public:
+    framePool(size_t slot_bytes, int n_slots, bool hugepages = false, bool lock_pages = true);
+    ~framePool();
+
+    frameHandle acquire();
+
+    size_t slot_size() const { return slotBytes; }
+    int capacity() const { return static_cast<int>(slots.size()); }
+    int available() const;
+    long long exhausted() const { return n_exhausted; }
+    bool page_locked() const { return locked; }
+    bool hugepage_backed() const { return huge; }
+};
+
+#endif // FRAMEPOOL_H
@@ -0,0 +1,186 @@
+#include "framering.h"
+
+#include <boost/chrono/chrono.hpp>
+
+#include <cstring>
+#include <iostream>
+
+frameRing::frameRing(const frameRingConfig& r_cfg)
+    : cfg(r_cfg), framesetBytes(0), head(0), count(0), overwritten(0)
+{
+}
+
+static size_t frame_bytes(const sourceFrame& f, int bytes_per_pixel)
+{
+    return f.valid() ? static_cast<size_t>(f.width)*f.height*bytes_per_pixel : 0;
+}
+
+bool frameRing::configure(const frameSet& frames)
+{
+    if (configured()) return true;
+
+    size_t bytes[3] = { frame_bytes(frames.colour, 3), frame_bytes(frames.depth, 2), cfg.ir ? frame_bytes(frames.ir, 1) : 0 };
+    size_t total = bytes[0] + bytes[1] + bytes[2];
+    if (total == 0) return false;
+
+    int n = static_cast<int>(cfg.budgetBytes/total);
+    if (n < 2) {
+        std::cerr << "Error: frame ring budget of " << cfg.budgetBytes/(1024*1024) << " MB holds fewer than 2 framesets" << std::endl;
+        return false;
+    }
+    for (int i = 0; i < 3; i++)
+        if (bytes[i]) pools[i].reset(new framePool(bytes[i], n, cfg.hugepages, cfg.lockPages));
+
+    boost::mutex::scoped_lock guard(lock);
+    entries.resize(n);
+    head = 0;
+    count = 0;
+    framesetBytes = total;
+    return true;
+}
+
+bool frameRing::fits(const frameSet& frames) const
+{
+    const sourceFrame* in[3] = { &frames.colour, &frames.depth, &frames.ir };
+    int bpp[3] = { 3, 2, 1 };
+    for (int i = 0; i < 3; i++)
+        if (pools[i] && frame_bytes(*in[i], bpp[i]) > pools[i]->slot_size()) return false;
+    return true;
+}
+
+bool frameRing::copy_in(ringEntry& e, const frameSet& frames, const frameFreshness& fresh)
+{
+    // all slots or none: a partial frameset would break colour/depth pairing
+    const sourceFrame* in[3] = { &frames.colour, &frames.depth, &frames.ir };
+    sourceFrame* out[3] = { &e.frames.colour, &e.frames.depth, &e.frames.ir };
+    int bpp[3] = { 3, 2, 1 };
+
+    e.frames = frames;
+    e.frames.ir2 = sourceFrame();
+    e.fresh = fresh;
+    for (int i = 0; i < 3; i++) {
+        size_t bytes = frame_bytes(*in[i], bpp[i]);
+        if (!pools[i] || !bytes) {
+            *out[i] = sourceFrame();
+            continue;
+        }
+        if (bytes > pools[i]->slot_size()) return false;
+        e.buffers[i] = pools[i]->acquire();
+        if (!e.buffers[i].valid()) {
+            for (int k = 0; k <= i; k++) e.buffers[k].reset();
+            return false;
+        }
+        std::memcpy(e.buffers[i].data(), in[i]->data, bytes);
+        out[i]->data = e.buffers[i].data();
+    }
+    return true;
+}
+
+bool frameRing::push(const frameSet& frames, const frameFreshness& fresh)
+{
+    // a frame larger than its slots can never be copied; evicting history would not help
+    if (!configured() || !fits(frames)) return false;
+
+    // copy outside the lock so the consumer is never held up by a large frame;
+    // copy_in now only fails when the pools are exhausted
+    ringEntry e;
+    while (!copy_in(e, frames, fresh)) {
+        boost::mutex::scoped_lock guard(lock);
+        if (!cfg.overwrite || count == 0) return false;
+        entries[head] = ringEntry();
+        head = (head + 1) % entries.size();
+        count--;
+        overwritten++;
+    }
+
+    boost::mutex::scoped_lock guard(lock);
+    if (count == entries.size()) {
+        if (!cfg.overwrite) return false;
+        entries[head] = ringEntry();
+        head = (head + 1) % entries.size();
+        count--;
+        overwritten++;
+    }
+    entries[(head + count) % entries.size()] = std::move(e);
+    count++;
+    pushed.notify_one();
+    return true;
+}
+
+bool frameRing::pop(ringEntry& out, int timeout_ms)
+{
+    boost::mutex::scoped_lock guard(lock);
+    if (count == 0 && timeout_ms > 0)
+        pushed.wait_for(guard, boost::chrono::milliseconds(timeout_ms));
+    if (count == 0) return false;
+
+    out = std::move(entries[head]);
+    entries[head] = ringEntry();
+    head = (head + 1) % entries.size();
+    count--;
+    return true;
+}
+
+void frameRing::clear()
+{
+    boost::mutex::scoped_lock guard(lock);
+    for (size_t i = 0; i < entries.size(); i++) entries[i] = ringEntry();
+    head = 0;
+    count = 0;
+}
+
+void frameRing::set_overwrite(bool on)
+{
+    boost::mutex::scoped_lock guard(lock);
+    cfg.overwrite = on;
+}
+
+int frameRing::trim(double before_ms)
+{
+    boost::mutex::scoped_lock guard(lock);
+    int dropped = 0;
+    while (count > 0) {
+        const frameSet& f = entries[head].frames;
+        double arrival = f.depth.valid() ? f.depth.arrival : f.colour.arrival;
+        if (arrival >= before_ms) break;
+        entries[head] = ringEntry();
+        head = (head + 1) % entries.size();
+        count--;
+        dropped++;
+    }
+    return dropped;
+}
+
+int frameRing::size() const
+{
+    boost::mutex::scoped_lock guard(lock);
+    return static_cast<int>(count);
+}
+
+int frameRing::capacity() const
+{
+    boost::mutex::scoped_lock guard(lock);
+    return static_cast<int>(entries.size());
+}
+
+long long frameRing::overwritten_count() const
+{
+    boost::mutex::scoped_lock guard(lock);
+    return overwritten;
+}
+
+size_t frameRing::bytes_reserved() const
+{
+    size_t total = 0;
+    for (int i = 0; i < 3; i++)
+        if (pools[i]) total += pools[i]->slot_size()*pools[i]->capacity();
+    return total;
+}
+
+size_t frameRing::bytes_held() const
+{
+    size_t total = 0;
+    for (int i = 0; i < 3; i++)
+        if (pools[i]) total += pools[i]->slot_size()*(pools[i]->capacity() - pools[i]->available());
+    return total;
+}
@@ -0,0 +1,105 @@
+/* framering.h
+ *
+ * Description:
+ *   header file for frameRing class
+ *   Fixed-budget in-memory FIFO of raw framesets. Colour, depth and IR are
+ *   copied into preallocated framePool slots sized from the first frameset, so
+ *   the ring never allocates while capturing and its memory use is bounded by
+ *   the budget. Popped entries hand their slots on as frameHandles: a slot is
+ *   only free again once the last holder (e.g. the recorder) releases it, so
+ *   the budget also covers frames still on their way to disk.
+ *   In overwrite mode a full ring drops its oldest frameset instead of
+ *   refusing the new one (pre-trigger history).
+ *
+ * Functions:
+ *   configure - sizes the slot pools from a frameset (call once, before push)
+ *   push - copies a frameset in; false if the ring is full (and not overwriting), or if a
+ *   frame is larger than the slots sized at configure (the history is left alone)
+ *   pop - takes the oldest frameset, waits up to timeout_ms for one
+ *   set_overwrite - switches between refusing and overwriting when full
+ *   trim - drops framesets that arrived before a host time (history window)
+ *   size/capacity - framesets held / framesets the budget allows
+ *   bytes_reserved/bytes_held - memory of the ring / memory of slots in use
+ *
+ * Input:
+ *   frameRingConfig (memory budget, IR, overwrite), frameSet
+ *
+ * Output:
+ *   ringEntry (frameSet pointing into the held slots)
+ *
+ * Requirements:
+ *   framepool.h
+ *   boost/thread
+ *
+ * Thread safe? YES (one pushing and one popping thread)
+ *
+ * Extendable? YES
+ */
+
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "framepool.h"
+#include "framesource.h"
+
+struct frameRingConfig
+{
+    size_t budgetBytes = 0;             // memory for buffered framesets, all streams (0: no ring)
+    bool ir = false;                    // hold the IR stream as well
+    bool overwrite = false;             // full ring drops its oldest frameset
+    bool hugepages = false;
+    bool lockPages = true;
+};
+
+struct ringEntry
+{
+    frameSet frames;                    // data pointers refer to buffers[]
+    frameFreshness fresh;
+    frameHandle buffers[3];             // colour, depth, ir
+};
+
+class frameRing
+{
+    frameRingConfig cfg;
+    std::unique_ptr<framePool> pools[3];
+    size_t framesetBytes;
+
+    std::vector<ringEntry> entries;     // circular, capacity() slots
+    size_t head;                        // oldest
+    size_t count;
+    long long overwritten;
+
+    mutable boost::mutex lock;
+    boost::condition_variable pushed;
+
+    bool fits(const frameSet& frames) const;
+    bool copy_in(ringEntry& e, const frameSet& frames, const frameFreshness& fresh);
+
+public:
+    explicit frameRing(const frameRingConfig& r_cfg = frameRingConfig());
+
+    bool configure(const frameSet& frames);
+    bool configured() const { return framesetBytes > 0; }
+
+    bool push(const frameSet& frames, const frameFreshness& fresh);
+    bool pop(ringEntry& out, int timeout_ms = 0);
+    void clear();
+    void set_overwrite(bool on);
+    int trim(double before_ms);
+
+    int size() const;
+    int capacity() const;
+    long long overwritten_count() const;
+    size_t frameset_bytes() const { return framesetBytes; }
+    size_t bytes_reserved() const;
+    size_t bytes_held() const;
+};
+
+#endif // FRAMERING_H
@@ -0,0 +1,104 @@
+/* framesource.h
+ *
+ * Description:
+ *   header file for the frameSource interface
+ *   Everything that needs camera frames (recording, display, analysis) takes
+ *   them from a frameSource, so the same code runs on a live RealSense, on
+ *   synthetic frames, or on a recorded session.
+ *   Backends:
+ *     realsenseSource   - librealsense2 pipeline (realsensesource.h)
+ *     realsenseV1Source - legacy librealsense rs::device (realsensev1source.h)
+ *     syntheticSource   - deterministic generated frames (syntheticsource.h)
+ *     replaySource      - recorded sessions via sessionReader (replaysource.h)
+ *
+ * Functions:
+ *   start - opens the device/session, returns false on failure
+ *   wait_for_frames - blocks for the next synchronized frameset; the buffers
+ *   stay valid until the next call. Frames carry the sensor frame number and
+ *   timestamps; a live camera can return the same frame again if the caller
+ *   outruns it (see frametracker.h)
+ *   stop - closes the source
+ *   depth_scale - metres per depth unit
+ *   set_emitter - laser emitter on/off (live sources only)
+ *   set_align - align depth/IR to the colour viewpoint (where the source supports it)
+ *   calibration - stream intrinsics/extrinsics for depthAligner (where the source knows them)
+ *
+ * Thread safe? NO (one capture thread per source)
+ *
+ * Extendable? YES
+ */
+
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <boost/chrono/chrono.hpp>
+
+#include <cstdint>
+#include <string>
+
+struct alignCalibration;    // depthaligner.h
+
+// host steady clock in ms, shared by arrival/enqueue/write timestamps
+inline double host_ms()
+{
+    return boost::chrono::duration<double, boost::milli>(boost::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct sourceFrame
+{
+    const void* data;
+    int width;
+    int height;
+    int64_t framenum;           // sensor frame counter
+    double timestamp;           // ms, sensor/hardware clock where available
+    double backendTimestamp;    // ms, host clock when the driver received the frame (0 if unknown)
+    double arrival;             // host_ms() when the source handed the frame over
+    double aligned;             // hardware timestamp mapped onto host_ms() (see clockaligner.h), 0 if not aligned
+
+    sourceFrame() : data(0), width(0), height(0), framenum(-1), timestamp(0.0), backendTimestamp(0.0), arrival(0.0), aligned(0.0) {}
+    bool valid() const { return data != 0; }
+};
+
+struct frameSet
+{
+    sourceFrame colour;         // rgb8
+    sourceFrame depth;          // z16
+    sourceFrame ir;             // y8, left imager
+    sourceFrame ir2;            // y8, right imager (if the source has one)
+
+    void stamp_arrival()
+    {
+        double now = host_ms();
+        colour.arrival = depth.arrival = ir.arrival = ir2.arrival = now;
+    }
+};
+
+// which frames of a frameset are new (see frametracker.h)
+struct frameFreshness
+{
+    bool colour;
+    bool depth;
+    bool ir;
+    bool ir2;
+
+    frameFreshness() : colour(true), depth(true), ir(true), ir2(true) {}
+    bool any() const { return colour || depth || ir || ir2; }
+};
+
+class frameSource
+{
+public:
+    virtual ~frameSource() {}
+
+    virtual bool start() = 0;
+    virtual bool wait_for_frames(frameSet& frames) = 0;
+    virtual void stop() = 0;
+
+    virtual float depth_scale() const = 0;
+    virtual bool set_emitter(bool on) { return false; }
+    virtual bool set_align(bool on) { return false; }
+    virtual bool calibration(alignCalibration& out) const { return false; }
+    virtual std::string name() const = 0;
+};
+
+#endif // FRAMESOURCE_H
@@ -0,0 +1,75 @@
+#include "frametracker.h"
+
+#include <boost/filesystem/fstream.hpp>
+
+#include <cmath>
+
+static const char* track_names[4] = { "colour", "depth", "ir", "ir2" };
+
+bool frameTracker::check(streamTrack& t, const sourceFrame& f)
+{
+    if (!f.valid()) return false;
+    if (f.framenum < 0) { t.frames++; return true; }        // source has no counter
+
+    if (f.framenum == t.last) {
+        t.duplicates++;
+        return false;
+    }
+    // a lower number means the stream restarted, not a gap
+    if (t.last >= 0 && f.framenum > t.last + 1) t.missing += f.framenum - t.last - 1;
+    t.last = f.framenum;
+    t.frames++;
+    return true;
+}
+
+frameFreshness frameTracker::observe(const frameSet& frames)
+{
+    frameFreshness fresh;
+    fresh.colour = check(tracks[0], frames.colour);
+    fresh.depth = check(tracks[1], frames.depth);
+    fresh.ir = check(tracks[2], frames.ir);
+    fresh.ir2 = check(tracks[3], frames.ir2);
+
+    if (fresh.colour && fresh.depth)
+        skew.record(static_cast<uint64_t>(std::fabs(frames.colour.timestamp - frames.depth.timestamp)*1000.0));
+    return fresh;
+}
+
+long long frameTracker::duplicates() const
+{
+    long long n = 0;
+    for (int i = 0; i < 4; i++) n += tracks[i].duplicates;
+    return n;
+}
+
+long long frameTracker::missing() const
+{
+    long long n = 0;
+    for (int i = 0; i < 4; i++) n += tracks[i].missing;
+    return n;
+}
+
+void frameTracker::print(std::ostream& os) const
+{
+    for (int i = 0; i < 4; i++) {
+        if (tracks[i].frames == 0) continue;
+        os << "Frames " << track_names[i] << ": " << tracks[i].frames << " new, " << tracks[i].duplicates
+           << " duplicates skipped, " << tracks[i].missing << " missing" << std::endl;
+    }
+    if (skew.count())
+        os << "Colour/depth sync skew (us): p50 " << skew.percentile(50) << ", p99 " << skew.percentile(99)
+           << ", max " << skew.max() << std::endl;
+}
+
+bool frameTracker::write_summary(const boost::filesystem::path& file) const
+{
+    boost::filesystem::ofstream out(file);
+    if (!out) return false;
+
+    out << "stream,frames,duplicates,missing" << std::endl;
+    for (int i = 0; i < 4; i++)
+        out << track_names[i] << ',' << tracks[i].frames << ',' << tracks[i].duplicates << ',' << tracks[i].missing << std::endl;
+    out << "skew_us_p50,skew_us_p99,skew_us_max,skew_samples" << std::endl;
+    out << skew.percentile(50) << ',' << skew.percentile(99) << ',' << skew.max() << ',' << skew.count() << std::endl;
+    return true;
+}
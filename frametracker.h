@@ -0,0 +1,70 @@
+/* frametracker.h
+ *
+ * Description:
+ *   header file for frameTracker class
+ *   Watches the sensor frame numbers of every frameset taken from a
+ *   frameSource. A frame number seen again (the loop ran faster than the
+ *   camera) marks a duplicate that should not be stored again; a jump in frame
+ *   numbers counts the frames the camera or driver dropped. For framesets with
+ *   new colour and depth, the hardware timestamp difference between the two is
+ *   kept as a histogram, so the colour/depth sync of a session can be shown.
+ *
+ * Functions:
+ *   observe - checks a frameset, returns which of its frames are new
+ *   print - summary to a stream
+ *   write_summary - summary as CSV in the session folder
+ *
+ * Input:
+ *   frameSet from a frameSource
+ *
+ * Output:
+ *   frameFreshness, duplicate/missing counts, colour-depth skew percentiles
+ *
+ * Requirements:
+ *   boost/filesystem
+ *
+ * Thread safe? NO (capture thread only)
+ *
+ * Extendable? YES
+ */
+
+#ifndef FRAMETRACKER_H
+#define FRAMETRACKER_H
+
+#include <boost/filesystem.hpp>
+
+#include <cstdint>
+#include <ostream>
+
+#include "framesource.h"
+#include "latencyhistogram.h"
+
+class frameTracker
+{
+    struct streamTrack
+    {
+        int64_t last;
+        long long frames;           // new frames seen
+        long long duplicates;       // repeated frame numbers (skipped)
+        long long missing;          // frame numbers never seen
+
+        streamTrack() : last(-1), frames(0), duplicates(0), missing(0) {}
+    };
+
+    streamTrack tracks[4];          // colour, depth, ir, ir2
+    latencyHistogram skew;          // |colour - depth| hardware timestamp, us
+
+    bool check(streamTrack& t, const sourceFrame& f);
+
+public:
+    frameFreshness observe(const frameSet& frames);
+
+    long long duplicates() const;
+    long long missing() const;
+    const latencyHistogram& sync_skew() const { return skew; }
+
+    void print(std::ostream& os) const;
+    bool write_summary(const boost::filesystem::path& file) const;
+};
+
+#endif // FRAMETRACKER_H
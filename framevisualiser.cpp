@@ -0,0 +1,314 @@
+#include "framevisualiser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "simdcpu.h"
+
+#if SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// ---- min/max of the valid (non-zero) depth values ----
+
+void minmax_scalar(const uint16_t* z, size_t n, uint16_t& mn, uint16_t& mx)
+{
+    for (size_t i = 0; i < n; i++) {
+        uint16_t v = z[i];
+        if (v && v < mn) mn = v;
+        if (v > mx) mx = v;
+    }
+}
+
+#if SIMD_X86
+SIMD_TARGET("sse4.1")
+void minmax_sse41(const uint16_t* z, size_t n, uint16_t& mn, uint16_t& mx)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vmin = _mm_set1_epi16(-1);
+    __m128i vmax = zero;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(z + i));
+        // zeros become 0xFFFF so they never win the minimum
+        vmin = _mm_min_epu16(vmin, _mm_or_si128(v, _mm_cmpeq_epi16(v, zero)));
+        vmax = _mm_max_epu16(vmax, v);
+    }
+    uint16_t lo = static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_minpos_epu16(vmin)));
+    uint16_t hi = static_cast<uint16_t>(~_mm_cvtsi128_si32(_mm_minpos_epu16(_mm_xor_si128(vmax, _mm_set1_epi16(-1)))));
+    mn = std::min(mn, lo);
+    mx = std::max(mx, hi);
+    minmax_scalar(z + i, n - i, mn, mx);
+}
+
+SIMD_TARGET("avx2")
+void minmax_avx2(const uint16_t* z, size_t n, uint16_t& mn, uint16_t& mx)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i vmin = _mm256_set1_epi16(-1);
+    __m256i vmax = zero;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(z + i));
+        vmin = _mm256_min_epu16(vmin, _mm256_or_si256(v, _mm256_cmpeq_epi16(v, zero)));
+        vmax = _mm256_max_epu16(vmax, v);
+    }
+    __m128i lmin = _mm_min_epu16(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1));
+    __m128i lmax = _mm_max_epu16(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1));
+    uint16_t lo = static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_minpos_epu16(lmin)));
+    uint16_t hi = static_cast<uint16_t>(~_mm_cvtsi128_si32(_mm_minpos_epu16(_mm_xor_si128(lmax, _mm_set1_epi16(-1)))));
+    mn = std::min(mn, lo);
+    mx = std::max(mx, hi);
+    minmax_scalar(z + i, n - i, mn, mx);
+}
+#endif
+
+void depth_minmax(const uint16_t* z, size_t n, uint16_t& mn, uint16_t& mx)
+{
+    mn = 0xFFFF;
+    mx = 0;
+#if SIMD_X86
+    if (cpu_has_avx2()) { minmax_avx2(z, n, mn, mx); return; }
+    if (cpu_has_sse41()) { minmax_sse41(z, n, mn, mx); return; }
+#endif
+    minmax_scalar(z, n, mn, mx);
+}
+
+// ---- IR contrast stretch: out = min(255, (x - lo)*k >> 8) ----
+
+void stretch_scalar(const uint8_t* in, size_t n, uint8_t lo, uint16_t k, uint8_t* out)
+{
+    for (size_t i = 0; i < n; i++) {
+        uint32_t v = in[i] > lo ? in[i] - lo : 0;
+        out[i] = static_cast<uint8_t>(std::min<uint32_t>(255, (v*k) >> 8));
+    }
+}
+
+#if SIMD_X86
+// SSE2 is part of x86-64; (v << 8) * k >> 16 == v*k >> 8 with v in the high byte.
+// packus saturates signed words, so results are clamped to 255 first: a - (a -sat 255) == min(a, 255)
+void stretch_sse2(const uint8_t* in, size_t n, uint8_t lo, uint16_t k, uint8_t* out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vlo = _mm_set1_epi8(static_cast<char>(lo));
+    const __m128i vk = _mm_set1_epi16(static_cast<short>(k));
+    const __m128i v255 = _mm_set1_epi16(255);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_subs_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), vlo);
+        __m128i a = _mm_mulhi_epu16(_mm_unpacklo_epi8(zero, v), vk);
+        __m128i b = _mm_mulhi_epu16(_mm_unpackhi_epi8(zero, v), vk);
+        a = _mm_sub_epi16(a, _mm_subs_epu16(a, v255));
+        b = _mm_sub_epi16(b, _mm_subs_epu16(b, v255));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(a, b));
+    }
+    stretch_scalar(in + i, n - i, lo, k, out + i);
+}
+
+SIMD_TARGET("avx2")
+void stretch_avx2(const uint8_t* in, size_t n, uint8_t lo, uint16_t k, uint8_t* out)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i vlo = _mm256_set1_epi8(static_cast<char>(lo));
+    const __m256i vk = _mm256_set1_epi16(static_cast<short>(k));
+    const __m256i v255 = _mm256_set1_epi16(255);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        // unpack and pack both work per 128-bit lane, so the byte order comes back unchanged
+        __m256i v = _mm256_subs_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), vlo);
+        __m256i a = _mm256_min_epu16(_mm256_mulhi_epu16(_mm256_unpacklo_epi8(zero, v), vk), v255);
+        __m256i b = _mm256_min_epu16(_mm256_mulhi_epu16(_mm256_unpackhi_epi8(zero, v), vk), v255);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_packus_epi16(a, b));
+    }
+    stretch_scalar(in + i, n - i, lo, k, out + i);
+}
+#endif
+
+void stretch(const uint8_t* in, size_t n, uint8_t lo, uint16_t k, uint8_t* out)
+{
+#if SIMD_X86
+    if (cpu_has_avx2()) stretch_avx2(in, n, lo, k, out);
+    else stretch_sse2(in, n, lo, k, out);
+#else
+    stretch_scalar(in, n, lo, k, out);
+#endif
+}
+
+// first bin at which the running count reaches fraction p of total
+int percentile_bin(const uint32_t* hist, int bins, uint64_t total, float p)
+{
+    uint64_t target = static_cast<uint64_t>(std::max(0.0f, std::min(1.0f, p))*total);
+    uint64_t sum = 0;
+    for (int b = 0; b < bins; b++) {
+        sum += hist[b];
+        if (sum > target) return b;
+    }
+    return bins - 1;
+}
+
+// polynomial fit of the "turbo" colormap (Mikhailov 2019): perceptually ordered, readable in grey
+uint32_t ramp(float x)
+{
+    float r = 0.13572138f + x*(4.61539260f + x*(-42.66032258f + x*(132.13108234f + x*(-152.94239396f + x*59.28637943f))));
+    float g = 0.09140261f + x*(2.19418839f + x*(4.84296658f + x*(-14.18503333f + x*(4.27729857f + x*2.82956604f))));
+    float b = 0.10667330f + x*(12.64194608f + x*(-60.58204836f + x*(110.36276771f + x*(-89.90310912f + x*27.34824973f))));
+    auto byte = [](float c) { return static_cast<uint32_t>(std::lround(255.0f*std::max(0.0f, std::min(1.0f, c)))); };
+    return byte(r) | (byte(g) << 8) | (byte(b) << 16);
+}
+
+std::vector<uint32_t> make_palette()
+{
+    std::vector<uint32_t> p(256);
+    for (int i = 0; i < 256; i++) p[i] = ramp(i/255.0f);
+    return p;
+}
+
+}
+
+frameVisualiser::frameVisualiser(const visualConfig& v_cfg)
+    : cfg(v_cfg), lut(65536, 0), lutLo(-1), lutHi(-1)
+{
+    cfg.histogramShift = std::max(0, std::min(12, cfg.histogramShift));
+    depthHist.assign(65536 >> cfg.histogramShift, 0);
+    partHist.assign(4*depthHist.size(), 0);
+    reset();
+}
+
+void frameVisualiser::reset()
+{
+    depthLo = depthHi = -1.0f;
+    irLo = irHi = -1.0f;
+    std::memset(irHist, 0, sizeof(irHist));
+}
+
+void frameVisualiser::update_depth_range(const uint16_t* z, size_t n)
+{
+    uint16_t mn, mx;
+    depth_minmax(z, n, mn, mx);
+    if (mx == 0) return;                // no valid depth: keep the last range
+
+    // four interleaved histograms, so repeated values do not stall on one counter
+    const int shift = cfg.histogramShift;
+    const int bins = static_cast<int>(depthHist.size());
+    std::fill(partHist.begin(), partHist.end(), 0);
+    uint32_t* h = partHist.data();
+    size_t zeros = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        h[z[i] >> shift]++;
+        h[bins + (z[i+1] >> shift)]++;
+        h[2*bins + (z[i+2] >> shift)]++;
+        h[3*bins + (z[i+3] >> shift)]++;
+        zeros += (z[i] == 0) + (z[i+1] == 0) + (z[i+2] == 0) + (z[i+3] == 0);
+    }
+    for (; i < n; i++) {
+        h[z[i] >> shift]++;
+        zeros += (z[i] == 0);
+    }
+    for (int b = 0; b < bins; b++) depthHist[b] = h[b] + h[bins + b] + h[2*bins + b] + h[3*bins + b];
+    depthHist[0] -= static_cast<uint32_t>(zeros);
+
+    uint64_t valid = n - zeros;
+    float lo = static_cast<float>(percentile_bin(depthHist.data(), bins, valid, cfg.lowPercent/100.0f) << shift);
+    float hi = static_cast<float>((percentile_bin(depthHist.data(), bins, valid, cfg.highPercent/100.0f) + 1) << shift);
+    lo = std::max(lo, static_cast<float>(mn));
+    hi = std::min(hi, static_cast<float>(mx));
+    if (hi <= lo) hi = lo + 1.0f;
+
+    if (depthLo < 0.0f) {
+        depthLo = lo;
+        depthHi = hi;
+    }
+    else {
+        depthLo += cfg.smoothing*(lo - depthLo);
+        depthHi += cfg.smoothing*(hi - depthHi);
+    }
+}
+
+void frameVisualiser::build_lut(int lo, int hi)
+{
+    static const std::vector<uint32_t> palette = make_palette();
+
+    float scale = 255.0f/std::max(1, hi - lo);
+    lut[0] = 0;                         // no data
+    for (int v = 1; v < 65536; v++) {
+        int idx = static_cast<int>((std::max(lo, std::min(hi, v)) - lo)*scale + 0.5f);
+        lut[v] = palette[cfg.nearIsWarm ? 255 - idx : idx];
+    }
+    lutLo = lo;
+    lutHi = hi;
+}
+
+bool frameVisualiser::colour_depth(const uint16_t* z, int width, int height, std::vector<uint8_t>& rgb)
+{
+    if (!z || width <= 0 || height <= 0) return false;
+    size_t n = static_cast<size_t>(width)*height;
+
+    int lo, hi;
+    if (cfg.fixedMax > cfg.fixedMin) {
+        lo = cfg.fixedMin;
+        hi = cfg.fixedMax;
+    }
+    else {
+        update_depth_range(z, n);
+        if (depthLo < 0.0f) {
+            depthLo = 0.0f;
+            depthHi = 65535.0f;
+        }
+        lo = static_cast<int>(depthLo + 0.5f);
+        hi = static_cast<int>(depthHi + 0.5f);
+    }
+    // rebuilding costs a pass over 64K entries: only when the range moved by a histogram bin
+    int tolerance = (cfg.fixedMax > cfg.fixedMin) ? 0 : (1 << cfg.histogramShift) - 1;
+    if (lutLo < 0 || std::abs(lo - lutLo) > tolerance || std::abs(hi - lutHi) > tolerance) build_lut(lo, hi);
+
+    rgb.resize(n*3);
+    uint8_t* out = rgb.data();
+    const uint32_t* table = lut.data();
+    // 4-byte stores overlap the next pixel, which is written straight after
+    for (size_t i = 0; i + 1 < n; i++) std::memcpy(out + 3*i, &table[z[i]], 4);
+    std::memcpy(out + 3*(n - 1), &table[z[n - 1]], 3);
+    return true;
+}
+
+bool frameVisualiser::stretch_ir(const uint8_t* ir, int width, int height, std::vector<uint8_t>& out, bool update_range)
+{
+    if (!ir || width <= 0 || height <= 0) return false;
+    size_t n = static_cast<size_t>(width)*height;
+
+    if (update_range || irLo < 0.0f) {
+        uint32_t h[4][256];
+        std::memset(h, 0, sizeof(h));
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            h[0][ir[i]]++;
+            h[1][ir[i+1]]++;
+            h[2][ir[i+2]]++;
+            h[3][ir[i+3]]++;
+        }
+        for (; i < n; i++) h[0][ir[i]]++;
+        for (int b = 0; b < 256; b++) irHist[b] = h[0][b] + h[1][b] + h[2][b] + h[3][b];
+
+        float lo = static_cast<float>(percentile_bin(irHist, 256, n, cfg.lowPercent/100.0f));
+        float hi = static_cast<float>(percentile_bin(irHist, 256, n, cfg.highPercent/100.0f));
+        if (irLo < 0.0f) {
+            irLo = lo;
+            irHi = hi;
+        }
+        else {
+            irLo += cfg.smoothing*(lo - irLo);
+            irHi += cfg.smoothing*(hi - irHi);
+        }
+    }
+
+    int lo = static_cast<int>(irLo + 0.5f);
+    int span = std::max(1, static_cast<int>(irHi + 0.5f) - lo);
+    uint16_t k = static_cast<uint16_t>(std::min(65535, (255*256 + span/2)/span));
+
+    out.resize(n);
+    stretch(ir, n, static_cast<uint8_t>(lo), k, out.data());
+    return true;
+}
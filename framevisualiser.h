@@ -0,0 +1,86 @@
+/* framevisualiser.h
+ *
+ * Description:
+ *   header file for frameVisualiser class
+ *   Turns Z16 depth and Y8 infrared into images people can read, on the CPU:
+ *     - depth: a histogram of the valid (non-zero) depth values gives the
+ *       range between two percentiles; the range follows new frames smoothly
+ *       so the colours do not flicker. A 64K-entry lookup table maps every
+ *       Z16 value straight to RGB through a perceptual ("turbo"-like) ramp,
+ *       and is only rebuilt when the rounded range changes. No data is black.
+ *     - infrared: contrast stretch between two percentiles of a 256-bin
+ *       histogram, with the same smoothing.
+ *   Min/max scans run 16/8 pixels at a time (AVX2/SSE4.1, see simdcpu.h),
+ *   the IR stretch runs on 32/16 pixels (AVX2/SSE2); the LUT lookup itself
+ *   is scalar, as gathers are no faster than plain loads from a 256 KB table.
+ *   A visualiser keeps the range between calls: use one per image stream.
+ *
+ * Functions:
+ *   colour_depth - Z16 frame to RGB8 (updates the range unless fixed)
+ *   stretch_ir - Y8 frame to contrast-stretched Y8 (update_range false reuses the last range;
+ *                may run in place)
+ *   depth_range/ir_range - current display ranges
+ *   histogram - depth histogram of the last frame (bins of 2^histogramShift units)
+ *   reset - forgets the ranges (next frame sets them without smoothing)
+ *
+ * Input:
+ *   visualConfig (percentiles, smoothing, fixed range), frame buffers
+ *
+ * Output:
+ *   RGB8 / Y8 images in caller-owned vectors (resized as needed)
+ *
+ * Requirements:
+ *   simdcpu.h
+ *
+ * Thread safe? NO (one instance per thread and stream)
+ *
+ * Extendable? YES
+ */
+
+#ifndef FRAMEVISUALISER_H
+#define FRAMEVISUALISER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct visualConfig
+{
+    float lowPercent = 1.0f;            // auto-range between these percentiles of valid pixels
+    float highPercent = 99.0f;
+    float smoothing = 0.25f;            // fraction of the way the range moves towards a new frame's (1 = none)
+    uint16_t fixedMin = 0;              // fixed depth range in Z16 units, used if fixedMax > fixedMin
+    uint16_t fixedMax = 0;
+    int histogramShift = 4;             // depth histogram bin width, 2^shift units
+    bool nearIsWarm = true;             // near = red end of the ramp
+};
+
+class frameVisualiser
+{
+    visualConfig cfg;
+
+    std::vector<uint32_t> depthHist;    // 65536 >> shift bins
+    std::vector<uint32_t> partHist;     // four interleaved partial histograms
+    std::vector<uint32_t> lut;          // Z16 -> 0x00BBGGRR
+    float depthLo, depthHi;             // smoothed range, < 0 until the first frame
+    int lutLo, lutHi;                   // range the LUT was built for
+
+    uint32_t irHist[256];
+    float irLo, irHi;
+
+    void update_depth_range(const uint16_t* z, size_t n);
+    void build_lut(int lo, int hi);
+
+public:
+    explicit frameVisualiser(const visualConfig& v_cfg = visualConfig());
+
+    bool colour_depth(const uint16_t* z, int width, int height, std::vector<uint8_t>& rgb);
+    bool stretch_ir(const uint8_t* ir, int width, int height, std::vector<uint8_t>& out, bool update_range = true);
+
+    void depth_range(int& lo, int& hi) const { lo = lutLo; hi = lutHi; }
+    void ir_range(int& lo, int& hi) const { lo = static_cast<int>(irLo); hi = static_cast<int>(irHi); }
+    const std::vector<uint32_t>& histogram() const { return depthHist; }
+    void reset();
+};
+
+#endif // FRAMEVISUALISER_H
@@ -0,0 +1,426 @@
+#include "ioengine.h"
+
+#include <boost/bind.hpp>
+#include <boost/chrono/chrono.hpp>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static const int SUBMIT_RETRIES = 100;     // io_uring_enter attempts (~0.1 s) before writing synchronously
+
+static ssize_t pwrite_all(int fd, const unsigned char* data, size_t n, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < n) {
+        ssize_t w = ::pwrite(fd, data + done, n - done, offset + done);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return done > 0 ? static_cast<ssize_t>(done) : -errno;
+        }
+        if (w == 0) break;
+        done += static_cast<size_t>(w);
+    }
+    return static_cast<ssize_t>(done);
+}
+
+static int uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, wait, flags, static_cast<void*>(0), 0));
+}
+
+template <typename T> static T* ring_field(void* ring, uint32_t offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+// ioEngine
+
+ioEngine::ioEngine(const ioConfig& i_cfg)
+    : cfg(i_cfg), active(ioBackend::threads), ringFd(-1), sqRing(MAP_FAILED), cqRing(MAP_FAILED),
+      sqRingBytes(0), cqRingBytes(0), sqes(0), sqeBytes(0), sqEntries(0), inFlight(0), quit(false)
+{
+    if (cfg.backend == ioBackend::sync) {
+        active = ioBackend::sync;
+        return;
+    }
+    if (cfg.backend != ioBackend::threads && setup_uring()) {
+        active = ioBackend::uring;
+        reaper = boost::thread(&ioEngine::reap_loop, this);
+        return;
+    }
+    if (cfg.backend == ioBackend::uring)
+        std::cerr << "io_uring unavailable, writing from a thread pool" << std::endl;
+
+    active = ioBackend::threads;
+    for (int i = 0; i < std::max(1, cfg.threads); i++)
+        workers.create_thread(boost::bind(&ioEngine::worker_loop, this));
+}
+
+ioEngine::~ioEngine()
+{
+    if (active == ioBackend::uring) {
+        bool woken;
+        {
+            boost::mutex::scoped_lock guard(submitLock);
+            quit = true;
+            woken = push_sqe(IORING_OP_NOP, 0);     // wakes the completion thread
+        }
+        if (!woken) {
+            // the completion thread stays blocked in the kernel: leave the ring to it
+            std::cerr << "Error: could not stop the io_uring completion thread" << std::endl;
+            reaper.detach();
+            return;
+        }
+        reaper.join();
+        teardown_uring();
+    }
+    else if (active == ioBackend::threads) {
+        {
+            boost::mutex::scoped_lock guard(queueLock);
+            quit = true;
+        }
+        queued.notify_all();
+        workers.join_all();
+    }
+}
+
+const char* ioEngine::backend_name(ioBackend b)
+{
+    switch (b) {
+    case ioBackend::uring: return "io_uring";
+    case ioBackend::threads: return "threads";
+    case ioBackend::sync: return "sync";
+    default: return "automatic";
+    }
+}
+
+bool ioEngine::setup_uring()
+{
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    ringFd = static_cast<int>(syscall(__NR_io_uring_setup, std::max(4u, cfg.queueDepth), &p));
+    if (ringFd < 0) return false;
+
+    // IORING_OP_WRITE needs 5.6; FEAT_RW_CUR_POS arrived with it
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        ::close(ringFd);
+        ringFd = -1;
+        return false;
+    }
+
+    sqRingBytes = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    cqRingBytes = p.cq_off.cqes + p.cq_entries*sizeof(io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+
+    sqRing = mmap(0, sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    cqRing = single ? sqRing : mmap(0, cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    sqeBytes = p.sq_entries*sizeof(io_uring_sqe);
+    void* s = mmap(0, sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || s == MAP_FAILED) {
+        if (s != MAP_FAILED) munmap(s, sqeBytes);
+        teardown_uring();
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(s);
+
+    sqHead = ring_field<unsigned>(sqRing, p.sq_off.head);
+    sqTail = ring_field<unsigned>(sqRing, p.sq_off.tail);
+    sqMask = ring_field<unsigned>(sqRing, p.sq_off.ring_mask);
+    sqArray = ring_field<unsigned>(sqRing, p.sq_off.array);
+    sqEntries = p.sq_entries;
+    cqHead = ring_field<unsigned>(cqRing, p.cq_off.head);
+    cqTail = ring_field<unsigned>(cqRing, p.cq_off.tail);
+    cqMask = ring_field<unsigned>(cqRing, p.cq_off.ring_mask);
+    cqes = ring_field<io_uring_cqe>(cqRing, p.cq_off.cqes);
+    return true;
+}
+
+void ioEngine::teardown_uring()
+{
+    if (sqes) munmap(sqes, sqeBytes);
+    if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingBytes);
+    if (sqRing != MAP_FAILED) munmap(sqRing, sqRingBytes);
+    if (ringFd >= 0) ::close(ringFd);
+    sqes = 0;
+    sqRing = cqRing = MAP_FAILED;
+    ringFd = -1;
+}
+
+bool ioEngine::push_sqe(unsigned char opcode, ioBuffer* buf)
+{
+    // caller holds submitLock; the completion ring is as large as the submission ring,
+    // so limiting writes in flight to sqEntries also keeps completions from overflowing.
+    // false if the kernel refused the entry; a write is then finished synchronously
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = reinterpret_cast<uint64_t>(buf);
+    if (buf) {
+        sqe->fd = buf->fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buf->data);
+        sqe->len = static_cast<uint32_t>(buf->bytes);
+        sqe->off = buf->offset;
+    }
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    inFlight++;
+
+    // EAGAIN/EBUSY: the kernel wants completions reaped first. The reaper does that without
+    // submitLock, so back off instead of spinning, and give up after SUBMIT_RETRIES
+    int ret = -1;
+    int err = EAGAIN;
+    for (int attempt = 0; attempt < SUBMIT_RETRIES; attempt++) {
+        ret = uring_enter(ringFd, 1, 0, 0);
+        if (ret > 0) break;
+        err = ret < 0 ? errno : EAGAIN;             // nothing consumed counts as busy
+        if (err != EINTR && err != EAGAIN && err != EBUSY) break;
+        if (err == EINTR) continue;
+        if (attempt < 8) boost::this_thread::yield();
+        else boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    }
+    if (ret > 0 || __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) != tail) return true;
+
+    // not consumed: take the entry back so no later submit picks it up, and no completion is awaited for it
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+    inFlight--;
+    if (buf) buf->file->complete(buf, -err);
+    return false;
+}
+
+void ioEngine::submit(ioBuffer* buf)
+{
+    if (active == ioBackend::uring) {
+        boost::mutex::scoped_lock guard(submitLock);
+        while (inFlight >= sqEntries) slotFree.wait(guard);
+        push_sqe(IORING_OP_WRITE, buf);
+    }
+    else if (active == ioBackend::threads) {
+        {
+            boost::mutex::scoped_lock guard(queueLock);
+            pending.push_back(buf);
+        }
+        queued.notify_one();
+    }
+    else buf->file->complete(buf, pwrite_all(buf->fd, buf->data, buf->bytes, buf->offset));
+}
+
+void ioEngine::reap_loop()
+{
+    for (;;) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            {
+                boost::mutex::scoped_lock guard(submitLock);
+                if (quit && inFlight == 0) return;
+            }
+            uring_enter(ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+            continue;
+        }
+
+        unsigned reaped = 0;
+        for (; head != tail; head++) {
+            io_uring_cqe* cqe = &cqes[head & *cqMask];
+            ioBuffer* buf = reinterpret_cast<ioBuffer*>(cqe->user_data);
+            int res = cqe->res;
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            if (buf) buf->file->complete(buf, res);
+            reaped++;
+        }
+
+        boost::mutex::scoped_lock guard(submitLock);
+        inFlight -= reaped;
+        slotFree.notify_all();
+    }
+}
+
+void ioEngine::worker_loop()
+{
+    for (;;) {
+        ioBuffer* buf;
+        {
+            boost::mutex::scoped_lock guard(queueLock);
+            while (pending.empty() && !quit) queued.wait(guard);
+            if (pending.empty()) return;
+            buf = pending.front();
+            pending.pop_front();
+        }
+        buf->file->complete(buf, pwrite_all(buf->fd, buf->data, buf->bytes, buf->offset));
+    }
+}
+
+// ioFile
+
+ioFile::ioFile() : engine(0), fd(-1), direct(false), pending(0)
+{
+    std::memset(&counters, 0, sizeof(counters));
+}
+
+ioFile::~ioFile()
+{
+    if (fd >= 0) {
+        drain();
+        ::close(fd);
+    }
+    for (size_t i = 0; i < buffers.size(); i++) std::free(buffers[i].data);
+}
+
+bool ioFile::allocate(int count, size_t bytes)
+{
+    if (!buffers.empty()) return true;
+
+    bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    buffers.resize(std::max(2, count));
+    for (size_t i = 0; i < buffers.size(); i++) {
+        void* mem = 0;
+        if (posix_memalign(&mem, ALIGNMENT, bytes) != 0) return false;
+        buffers[i].data = static_cast<unsigned char*>(mem);
+        buffers[i].capacity = bytes;
+        buffers[i].bytes = 0;
+        buffers[i].offset = 0;
+        buffers[i].fd = -1;
+        buffers[i].file = this;
+        freeList.push_back(&buffers[i]);
+    }
+    return true;
+}
+
+bool ioFile::open(const boost::filesystem::path& file, uint64_t preallocate, bool want_direct, ioEngine* io)
+{
+    engine = (io && io->backend() != ioBackend::sync) ? io : 0;
+    direct = false;
+
+    if (want_direct) {
+        fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        direct = fd >= 0;
+    }
+    // tmpfs and some network filesystems refuse O_DIRECT
+    if (fd < 0) fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Error: could not open " << file << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // reserve the whole file up front so the filesystem keeps it contiguous
+    if (preallocate && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, preallocate) != 0)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return true;
+}
+
+ioBuffer* ioFile::acquire()
+{
+    boost::mutex::scoped_lock guard(lock);
+    while (freeList.empty()) changed.wait(guard);
+    ioBuffer* buf = freeList.back();
+    freeList.pop_back();
+    buf->bytes = 0;
+    return buf;
+}
+
+void ioFile::release(ioBuffer* buf)
+{
+    boost::mutex::scoped_lock guard(lock);
+    freeList.push_back(buf);
+    changed.notify_all();
+}
+
+void ioFile::write(ioBuffer* buf)
+{
+    if (!direct) settle_writeback(1);
+    buf->fd = fd;
+    buf->file = this;
+    {
+        boost::mutex::scoped_lock guard(lock);
+        pending++;
+        counters.writes++;
+    }
+    if (engine) engine->submit(buf);
+    else complete(buf, pwrite_all(fd, buf->data, buf->bytes, buf->offset));
+}
+
+void ioFile::complete(ioBuffer* buf, ssize_t result)
+{
+    // finish short or failed async writes synchronously before counting a failure
+    bool retried = false;
+    if (result < 0 || static_cast<size_t>(result) < buf->bytes) {
+        size_t done = result > 0 ? static_cast<size_t>(result) : 0;
+        ssize_t rest = pwrite_all(buf->fd, buf->data + done, buf->bytes - done, buf->offset + done);
+        if (rest >= 0) result = static_cast<ssize_t>(done) + rest;
+        retried = true;
+    }
+    bool ok = result >= 0 && static_cast<size_t>(result) == buf->bytes;
+
+    // buffered fallback: only start the writeback here, the writing thread waits for it later
+    if (ok && !direct) sync_file_range(buf->fd, buf->offset, buf->bytes, SYNC_FILE_RANGE_WRITE);
+    if (!ok)
+        std::cerr << "Error: write of " << buf->bytes << " bytes at " << buf->offset << " failed: "
+                  << (result < 0 ? std::strerror(static_cast<int>(-result)) : "short write") << std::endl;
+
+    boost::mutex::scoped_lock guard(lock);
+    counters.completed++;
+    if (retried) counters.retried++;
+    if (ok) counters.bytes += buf->bytes;
+    else counters.failed++;
+    pending--;
+    if (ok && !direct) writeback.push_back(std::make_pair(buf->offset, buf->bytes));
+    freeList.push_back(buf);
+    changed.notify_all();
+}
+
+void ioFile::settle_writeback(size_t keep)
+{
+    // wait for the writeback of older ranges, then drop them from the page cache;
+    // by the time the next buffer is written it has normally finished already
+    std::vector< std::pair<uint64_t, size_t> > ranges;
+    {
+        boost::mutex::scoped_lock guard(lock);
+        while (writeback.size() > keep) {
+            ranges.push_back(writeback.front());
+            writeback.pop_front();
+        }
+    }
+    for (size_t i = 0; i < ranges.size(); i++) {
+        sync_file_range(fd, ranges[i].first, ranges[i].second,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd, ranges[i].first, ranges[i].second, POSIX_FADV_DONTNEED);
+    }
+}
+
+void ioFile::drain()
+{
+    boost::mutex::scoped_lock guard(lock);
+    while (pending > 0) changed.wait(guard);
+}
+
+bool ioFile::close(uint64_t length)
+{
+    if (fd < 0) return true;
+    drain();
+    if (!direct) settle_writeback(0);
+
+    // writes are whole blocks; cut the padding of the last one
+    bool ok = ftruncate(fd, static_cast<off_t>(length)) == 0;
+    ok = (::close(fd) == 0) && ok;
+    fd = -1;
+
+    boost::mutex::scoped_lock guard(lock);
+    return ok && counters.failed == 0;
+}
+
+ioFileStats ioFile::stats() const
+{
+    boost::mutex::scoped_lock guard(lock);
+    return counters;
+}
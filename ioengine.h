@@ -0,0 +1,184 @@
+/* ioengine.h
+ *
+ * Description:
+ *   header file for ioEngine and ioFile classes
+ *   Asynchronous file writes for the raw stream containers. An ioFile owns a
+ *   few page-aligned buffers; the caller fills one, hands it to write() and
+ *   carries on filling the next while the kernel writes the first. Buffers come
+ *   back to the file when their write completes, so every write is accounted
+ *   for: completions, bytes and failures are counted per file.
+ *   Files are preallocated with fallocate and opened with O_DIRECT where the
+ *   filesystem supports it, so recorded data does not fill the page cache of
+ *   the capture process (buffered files have written ranges dropped instead:
+ *   writeback is started when a write completes and waited for by the writing
+ *   thread one buffer later, so the completion thread never blocks on it).
+ *   One ioEngine serves every open file:
+ *     uring   - io_uring through the raw syscalls, one completion thread
+ *     threads - pwrite from a small thread pool (kernels without io_uring)
+ *   With no engine an ioFile writes synchronously on the calling thread.
+ *
+ * Functions:
+ *   ioEngine::submit - queues a filled buffer (called by ioFile::write)
+ *   ioEngine::backend - backend in use after probing
+ *   ioFile::allocate - reserves the aligned buffers (once)
+ *   ioFile::open - creates, preallocates and opens a file for direct writes
+ *   ioFile::acquire - next free buffer, waits for a completion if all are in flight
+ *   ioFile::write - writes a buffer at its offset; size and offset must be ALIGNMENT multiples
+ *   ioFile::release - returns an unused buffer
+ *   ioFile::drain - waits until every write of the file has completed
+ *   ioFile::close - drains, truncates to the logical length and closes; false if a write failed
+ *   ioFile::stats - write/completion/failure counters
+ *
+ * Input:
+ *   ioConfig (backend, threads, queue depth), file path, preallocation
+ *
+ * Output:
+ *   written files, ioFileStats
+ *
+ * Requirements:
+ *   Linux (io_uring >= 5.6 for the uring backend, O_DIRECT, fallocate)
+ *   boost/thread
+ *   boost/filesystem
+ *
+ * Thread safe? YES (one writer per ioFile; completions arrive on engine threads)
+ *
+ * Extendable? YES
+ */
+
+#ifndef IOENGINE_H
+#define IOENGINE_H
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+enum class ioBackend { automatic, uring, threads, sync };
+
+struct ioConfig
+{
+    ioBackend backend = ioBackend::automatic;   // automatic: uring, else threads
+    int threads = 2;                            // threads backend
+    unsigned queueDepth = 64;                   // writes in flight across all files
+};
+
+class ioFile;
+
+struct ioBuffer
+{
+    unsigned char* data;
+    size_t capacity;
+    size_t bytes;           // to write (filled bytes while the caller owns it)
+    uint64_t offset;        // file offset of data[0]
+    int fd;
+    ioFile* file;
+};
+
+struct ioFileStats
+{
+    long long writes;
+    long long completed;
+    long long failed;       // writes that did not reach the file in full
+    long long retried;      // writes finished synchronously after a short or failed async write
+    uint64_t bytes;
+};
+
+class ioEngine
+{
+    ioConfig cfg;
+    ioBackend active;
+
+    // uring backend
+    int ringFd;
+    void* sqRing;
+    void* cqRing;
+    size_t sqRingBytes;
+    size_t cqRingBytes;
+    io_uring_sqe* sqes;
+    size_t sqeBytes;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned sqEntries;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+    unsigned inFlight;
+    boost::mutex submitLock;
+    boost::condition_variable slotFree;
+    boost::thread reaper;
+
+    // threads backend
+    std::deque<ioBuffer*> pending;
+    boost::mutex queueLock;
+    boost::condition_variable queued;
+    boost::thread_group workers;
+
+    bool quit;
+
+    bool setup_uring();
+    void teardown_uring();
+    bool push_sqe(unsigned char opcode, ioBuffer* buf);
+    void reap_loop();
+    void worker_loop();
+
+public:
+    explicit ioEngine(const ioConfig& i_cfg = ioConfig());
+    ~ioEngine();
+
+    void submit(ioBuffer* buf);
+    ioBackend backend() const { return active; }
+    static const char* backend_name(ioBackend b);
+};
+
+class ioFile
+{
+    ioEngine* engine;
+    int fd;
+    bool direct;
+
+    std::vector<ioBuffer> buffers;
+    std::vector<ioBuffer*> freeList;
+
+    mutable boost::mutex lock;
+    boost::condition_variable changed;
+    int pending;
+    ioFileStats counters;
+    std::deque< std::pair<uint64_t, size_t> > writeback;   // buffered: completed ranges not yet flushed and dropped
+
+    void settle_writeback(size_t keep);
+
+public:
+    static const size_t ALIGNMENT = 4096;
+
+    ioFile();
+    ~ioFile();
+
+    bool allocate(int count, size_t bytes);
+    bool open(const boost::filesystem::path& file, uint64_t preallocate, bool want_direct, ioEngine* io);
+    ioBuffer* acquire();
+    void write(ioBuffer* buf);
+    void release(ioBuffer* buf);
+    void drain();
+    bool close(uint64_t length);
+
+    void complete(ioBuffer* buf, ssize_t result);
+
+    bool is_open() const { return fd >= 0; }
+    bool is_direct() const { return direct; }
+    size_t buffer_bytes() const { return buffers.empty() ? 0 : buffers[0].capacity; }
+    ioFileStats stats() const;
+};
+
+#endif // IOENGINE_H
@@ -2,11 +2,11 @@
 // Copyright(c) 2019 Intel Corporation. All Rights Reserved.
 
 #include <librealsense2/rs.hpp> // Include RealSense Cross Platform API
-#include <librealsense2/rs_advanced_mode.hpp>
 
 #include <iostream>     // for cout
 #include <cstdio>
 #include <string>
+#include <memory>
 
 #include <GLFW/glfw3.h>
 
@@ -26,25 +26,127 @@
 #include "irimageframe.h"
 #include "colimageframe.h"
 #include "depthimageframe.h"
+#include "recordpipeline.h"
+#include "framesource.h"
+#include "realsensesource.h"
+#include "syntheticsource.h"
+#include "replaysource.h"
+#include "frametracker.h"
+#include "previewstage.h"
+#include "depthstats.h"
+#include "termitedetector.h"
+#include "motiongate.h"
+#include "depthaligner.h"
+#include "sessionaligner.h"
+#include "cloudexporter.h"
 
 #define DEPTHWIDTH 1280
 #define DEPTHHEIGHT 720
 #define COLWIDTH 1280
 #define COLHEIGHT 720
+#define FRAMERATE 30
+#define DEPTH_UNITS 100         // advanced mode depth table: 0.1 mm per unit
+#define DISPARITY_SHIFT 250
+
+// recording workers (see recordpipeline.h)
+#define CONVERT_WORKERS 1
+#define ENCODE_WORKERS 2
+#define WRITE_WORKERS 1
+#define QUEUE_FRAMES 64
+#define POOL_FRAMES 32
+#define JPEG_QUALITY 95
+#define SEGMENTED_RAW true     // depth/IR into segment containers instead of one .dat per frame
+#define LOSSLESS_DEPTH true    // TZ16 compressed depth (see depthcodec.h)
+#define TILE_WORKERS 1
+#define JPEG_STRIPES true      // colour JPEGs in stripes on the tile workers as well (see jpegencoder.h)
+#define COLOUR_AVI true        // colour appended to one MJPEG AVI per session instead of a JPEG per frame (see mjpegwriter.h)
+#define BACK_PRESSURE true     // lower colour quality / shed frames under I/O stress (see backpressure.h)
+#define PREVIEW_FPS 10         // display updates per second (see previewstage.h)
+#define DISPLAY_ZOOM 0.5f      // on-screen size relative to full resolution
+#define STATS_WORKERS 0        // extra threads for the ROI depth statistics (see depthstats.h)
+#define STATS_QUEUE 4          // depth frames waiting for statistics before frames are skipped
+#define STATS_BINARY false     // binary statistics log instead of CSV
+#define ALIGN_WORKERS 3        // extra threads for depth-to-colour alignment (see depthaligner.h)
+#define DETECT true            // live termite detection on depth and IR (see termitedetector.h)
+#define DETECT_WORKERS 1       // extra threads for the detection
+#define DETECT_QUEUE 3         // framesets waiting for detection before frames are skipped
+#define DETECT_DEPTH_MM 3.0f   // smallest depth change that counts as movement
+#define DETECT_IR_LEVELS 12.0f // smallest IR change (grey levels) that counts as movement
+#define TRACK true             // identities for the detections, written to a track file (see termitetracker.h)
+#define TRACK_GATE 20.0f       // largest movement between frames, pixels
+#define MOTION_GATED false     // key G: while recording, store only framesets with movement (see motiongate.h)
+#define MOTION_POSTROLL_S 3    // gated recording goes on this long after the last movement
 
 
 namespace bfs = boost::filesystem;
 namespace bchrono = boost::chrono;
 namespace bgreg = boost::gregorian;
 
-// initialise container for distance values: tuple stack of <frame, distance>
-typedef std::vector< std::tuple<int, float> >  pd_array;
-
 unsigned char g_movflag = 0x00;
 bool g_alignflag = false;
+bool g_gateflag = MOTION_GATED;
+
+// persistent recording engine, shared with the key callback
+recordPipeline* g_recorder = nullptr;
+
+// last frameset from the source; valid until the next wait_for_frames
+frameSet g_frames;
 
 bfs::path cpath{"../../IRFrameStore/"};
 bfs::path dpath{"../../IRFrameStore/"};
+bfs::path g_cropFile{"../../IRFrameStore/record_roi.txt"};
+
+
+static void load_record_roi(recordPipeline& recorder)
+{
+    // recording ROI: only these regions of each stream are stored; a stream keeps its regions once it recorded
+    int kept = recorder.load_crop(g_cropFile);
+    if (kept < 0) std::cout << "No recording ROI in " << g_cropFile << ", full frames are stored" << std::endl;
+    else std::cout << "Recording ROI loaded from " << g_cropFile
+                   << (kept ? ", streams that already recorded keep their regions" : "") << std::endl;
+}
+
+
+static frameSource* make_source(int argc, char* argv[])
+{
+    // --synthetic [fps] [--fast] | --replay <D_dir> <RGB_dir> [--fast] | live camera
+    bool fast = false;
+    for (int i = 1; i < argc; i++) if (std::string(argv[i]) == "--fast") fast = true;
+
+    if (argc > 1 && std::string(argv[1]) == "--synthetic") {
+        syntheticConfig scfg;
+        scfg.colWidth = COLWIDTH;
+        scfg.colHeight = COLHEIGHT;
+        scfg.depthWidth = DEPTHWIDTH;
+        scfg.depthHeight = DEPTHHEIGHT;
+        scfg.fps = (argc > 2 && argv[2][0] != '-') ? std::stof(argv[2]) : FRAMERATE;
+        scfg.realtime = !fast;
+        scfg.secondIR = true;
+        scfg.depthScale = DEPTH_UNITS*1e-6f;
+        return new syntheticSource(scfg);
+    }
+    if (argc > 3 && std::string(argv[1]) == "--replay") {
+        replayConfig pcfg;
+        pcfg.depthDir = argv[2];
+        pcfg.colDir = argv[3];
+        pcfg.depthWidth = DEPTHWIDTH;
+        pcfg.depthHeight = DEPTHHEIGHT;
+        pcfg.realtime = !fast;
+        pcfg.depthScale = DEPTH_UNITS*1e-6f;
+        return new replaySource(pcfg);
+    }
+
+    realsenseConfig lcfg;
+    lcfg.colWidth = COLWIDTH;
+    lcfg.colHeight = COLHEIGHT;
+    lcfg.depthWidth = DEPTHWIDTH;
+    lcfg.depthHeight = DEPTHHEIGHT;
+    lcfg.fps = FRAMERATE;
+    lcfg.secondIR = true;
+    lcfg.depthUnits = DEPTH_UNITS;
+    lcfg.disparityShift = DISPARITY_SHIFT;
+    return new realsenseSource(lcfg);
+}
 
 
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -61,62 +163,31 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 
     const unsigned char allmov = 0x01;
 
-    rs2::pipeline * pipe_select = static_cast<rs2::pipeline *>(glfwGetWindowUserPointer(window));
-    rs2::pipeline_profile current_profile = pipe_select->get_active_profile();
-    //rs2::frameset frames;
+    frameSource * src = static_cast<frameSource *>(glfwGetWindowUserPointer(window));
 
     // important: DO NOT TAKE SNAPSHOTS IF MOVIE IS RUNNING - messes with framerate
 
     switch(key) {
 
     case GLFW_KEY_A: // all frame snapshot
-        if ((action == GLFW_PRESS) )
+        if ((action == GLFW_PRESS) && g_recorder && g_frames.depth.valid())
         {
             std::string ir_file_left = "IRLeftSnap_" + std::to_string(calib_num) + ".dat";
             std::string ir_file_right = "IRRightSnap_" + std::to_string(calib_num) + ".dat";
             std::string d_file = "DepthSnap_" + std::to_string(calib_num) + ".dat";
             std::string c_file = "ColSnap_" + std::to_string(calib_num) + ".jpg";
 
-            // set up frame object to put storing frames in
-            irImageFrame* irfilesave1 = new irImageFrame(DEPTHWIDTH, DEPTHHEIGHT);
-            irImageFrame* irfilesave2 = new irImageFrame(DEPTHWIDTH, DEPTHHEIGHT);
-
-            colImageFrame* cfilesave = new colImageFrame(COLWIDTH, COLHEIGHT);
-            depthImageFrame* dfilesave = new depthImageFrame(DEPTHWIDTH, DEPTHHEIGHT);
+            // current frameset from the source; buffers are copied before the recorder returns
+            const frameSet& snap = g_frames;
 
-            typedef void (colImageFrame::*cs_fn)(const void*, bfs::path, std::string);
-            typedef void (depthImageFrame::*ds_fn)(const void*, bfs::path, std::string);
-            typedef void (irImageFrame::*ir_fn)(const void*, bfs::path, std::string);
-
-            // get current frameset from pipeline
-            rs2::frameset mono_frames = pipe_select->wait_for_frames(5000);
-
-            rs2::frame irframe1 = mono_frames.get_infrared_frame(1);
-            rs2::frame irframe2 = mono_frames.get_infrared_frame(2);
-            rs2::frame depthframe = mono_frames.get_depth_frame();
-            rs2::frame colframe = mono_frames.get_color_frame();
-
-
-            std::cout << "IRpointcheck: " << irframe1.get_data() << std::endl;
-            try{
-                boost::thread colsnapshot(boost::bind((cs_fn)&colImageFrame::save_col_frame, cfilesave, colframe.get_data(), c_path, c_file));
-                colsnapshot.detach();
-
-                boost::thread depthsnapshot(boost::bind((ds_fn)&depthImageFrame::save_d_frame, dfilesave, depthframe.get_data(), d_path, d_file));
-                depthsnapshot.detach();
-
-                boost::thread irsnapshot1(boost::bind((ir_fn)&irImageFrame::save_ir_frame, irfilesave1, irframe1.get_data(), d_path, ir_file_left));
-                irsnapshot1.detach();
-
-                boost::thread irsnapshot2(boost::bind((ir_fn)&irImageFrame::save_ir_frame, irfilesave2, irframe2.get_data(), d_path, ir_file_right));
-                irsnapshot2.detach();
-
-            }
-
-            catch(const rs2::error &e){
-                std::cerr <<"Error " << e.get_failed_function() << "(" << e.get_failed_args() <<"):\n    " << e.what() << std::endl;
-                break;
-            }
+            std::cout << "IRpointcheck: " << snap.ir.data << std::endl;
+            if (snap.colour.valid())
+                g_recorder->submit_snapshot(streamType::colour, snap.colour.data, snap.colour.width, snap.colour.height, c_path, c_file);
+            g_recorder->submit_snapshot(streamType::depth, snap.depth.data, snap.depth.width, snap.depth.height, d_path, d_file);
+            if (snap.ir.valid())
+                g_recorder->submit_snapshot(streamType::infrared, snap.ir.data, snap.ir.width, snap.ir.height, d_path, ir_file_left);
+            if (snap.ir2.valid())
+                g_recorder->submit_snapshot(streamType::infrared, snap.ir2.data, snap.ir2.width, snap.ir2.height, d_path, ir_file_right);
 
             calib_num++;
 
@@ -126,24 +197,19 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
     case GLFW_KEY_I:
         if (action == GLFW_PRESS)
         {
-            float emitter_value;
-
-            rs2::device dev = current_profile.get_device();
-            auto depth_sensor = dev.first<rs2::depth_sensor>();
-            if (emitter_toggle){
-                emitter_value = 0.0f;
-            } else{
-                emitter_value = 1.0f;
-            }
             emitter_toggle = !emitter_toggle;
-
-            if (depth_sensor.supports(RS2_OPTION_EMITTER_ENABLED)) {
-                depth_sensor.set_option(RS2_OPTION_EMITTER_ENABLED, emitter_value);
+            if (!src->set_emitter(emitter_toggle)) {
+                cout << "Emitter control not available on " << src->name() << endl;
             }
 
         }
         break;
 
+    case GLFW_KEY_G:    // motion-gated recording on/off
+        if (action == GLFW_PRESS) { g_gateflag = !g_gateflag;
+            cout << "Motion-gated recording " << (g_gateflag ? "on" : "off") << endl; }
+        break;
+
     case GLFW_KEY_M:    // start synchronized movie recording
         if (action == GLFW_PRESS){ g_movflag |= allmov;
             cout << "Movie recording started (all streams) " << endl; }
@@ -155,6 +221,10 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
             cout << "All movies stopped"  << endl;  }
         break;
 
+    case GLFW_KEY_R:    // reload the recording ROI file
+        if ((action == GLFW_PRESS) && g_recorder) load_record_roi(*g_recorder);
+        break;
+
     case GLFW_KEY_T:
         if ((action == GLFW_PRESS) ) {
             g_alignflag = !g_alignflag;
@@ -167,46 +237,40 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 }
 
 
-int main() try
+int main(int argc, char* argv[]) try
 {
 
     // default values
     float colframerate = 30;
     float depthframerate = 30;
 
-    // Create a Pipeline - this serves as a top-level API for streaming and processing frames
-    rs2::pipeline pipe;
-    rs2::config cfg;
-    rs2::error* e = 0;
-
-    cfg.enable_stream(RS2_STREAM_INFRARED, 1, DEPTHWIDTH, DEPTHHEIGHT, RS2_FORMAT_Y8, 30);
-    cfg.enable_stream(RS2_STREAM_INFRARED,2, DEPTHWIDTH, DEPTHHEIGHT, RS2_FORMAT_Y8, 30);
-    cfg.enable_stream(RS2_STREAM_COLOR, COLWIDTH, COLHEIGHT, RS2_FORMAT_RGB8, 30);
-    cfg.enable_stream(RS2_STREAM_DEPTH, COLWIDTH, COLHEIGHT, RS2_FORMAT_Z16, 30);
-
-    rs2::pipeline_profile selection = pipe.start(cfg);
-    rs2::device dev =selection.get_device();
-    
-    rs2::align align_to_color(RS2_STREAM_COLOR);
-    rs2::colorizer c;
-    float alpha = 0.5f;
-    
-    if (dev.is<rs400::advanced_mode>())
-    {
-        auto advanced_mode_dev = dev.as<rs400::advanced_mode>();
-        if (!advanced_mode_dev.is_enabled())
-        {
-            advanced_mode_dev.toggle_advanced_mode(true);
-        }
+    // --align-session <D_dir> [out_dir]: align a recorded session's depth to colour and exit
+    if (argc > 2 && std::string(argv[1]) == "--align-session") {
+        sessionAlignConfig acfg;
+        acfg.depthDir = argv[2];
+        if (argc > 3) acfg.outDir = argv[3];
+        acfg.depthWidth = DEPTHWIDTH;
+        acfg.depthHeight = DEPTHHEIGHT;
+        acfg.workers = ALIGN_WORKERS;
+        return sessionAligner(acfg).run() >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-        STDepthTableControl depth_table = advanced_mode_dev.get_depth_table();
-        int disp_shift_val = 250;
-        uint32_t depth_units = 100;
-        depth_table.disparityShift = disp_shift_val;
-        depth_table.depthUnits = depth_units;
-        advanced_mode_dev.set_depth_table(depth_table);
+    // --export-cloud <D_dir> <RGB_dir> [ply|chunked]: point clouds of a recorded session and exit
+    if (argc > 3 && std::string(argv[1]) == "--export-cloud") {
+        cloudExportConfig ccfg;
+        ccfg.depthDir = argv[2];
+        ccfg.colDir = argv[3];
+        ccfg.depthWidth = DEPTHWIDTH;
+        ccfg.depthHeight = DEPTHHEIGHT;
+        ccfg.depthScale = DEPTH_UNITS*1e-6f;
+        ccfg.maxDepth = 10.0f;
+        if (argc > 4 && std::string(argv[4]) == "chunked") ccfg.format = cloudFormat::chunked;
+        return cloudExporter(ccfg).run() >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
+    // Frame source: live camera (librealsense2 pipeline), synthetic or replayed session
+    std::unique_ptr<frameSource> src(make_source(argc, argv));
+    if (!src->start()) return EXIT_FAILURE;
 
     // Configure and start the pipeline
     int x_win = 1800;
@@ -265,6 +329,14 @@ int main() try
         std::cerr << e.what() << std::endl;
     }
 
+    // native alignment where the source knows its calibration (rs2::align otherwise); the
+    // calibration is stored with the recording, so it can also be aligned later (--align-session)
+    alignCalibration calib;
+    depthAligner aligner(ALIGN_WORKERS);
+    if (src->calibration(calib)) {
+        calib.save(dpath / "calibration.txt");
+        aligner.prepare(calib);
+    }
 
 
     glfwInit();
@@ -275,19 +347,100 @@ int main() try
     }
 
     glfwMakeContextCurrent(win);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);     // preview rows are tightly packed
 
     // Set up key controls
     glfwSetKeyCallback(win, key_callback);
-    glfwSetWindowUserPointer(win, &pipe); // window pointer used to pass pointer to pipeline
-
-    rs2::frame irframe1, irframe2;
-    int pix_x_list[] = {603, 606, 609, 612, 615, 618, 621, 624, 627, 630,};
-    int pix_y_list[] = {363, 366, 369, 372, 375, 378, 381, 384, 387, 390,};
-
-    pd_array pixel_distance;
-    int framedepthcount = 1;
+    glfwSetWindowUserPointer(win, src.get()); // window pointer used to pass pointer to frame source
+
+    // Start the recording workers
+    recordConfig rcfg;
+    rcfg.convertWorkers = CONVERT_WORKERS;
+    rcfg.encodeWorkers = ENCODE_WORKERS;
+    rcfg.writeWorkers = WRITE_WORKERS;
+    rcfg.queueCapacity = QUEUE_FRAMES;
+    rcfg.poolFrames = POOL_FRAMES;
+    rcfg.jpeg.quality = JPEG_QUALITY;
+    rcfg.jpeg.subsampling = jpegSubsampling::s420;
+    rcfg.raw = SEGMENTED_RAW ? rawStorage::segmented : rawStorage::perFile;
+    rcfg.depth = LOSSLESS_DEPTH ? depthFormat::tz16 : depthFormat::raw;
+    rcfg.tileWorkers = TILE_WORKERS;
+    rcfg.jpegStripes = JPEG_STRIPES;
+    rcfg.colour = COLOUR_AVI ? colourStorage::mjpegAvi : colourStorage::perFile;
+    rcfg.movie.fps = colframerate;
+    rcfg.pressure.enabled = BACK_PRESSURE;
+
+    recordPipeline recorder(rcfg);
+    // first frameset gives the stream geometry (replayed sessions may differ from the defaults)
+    if (!src->wait_for_frames(g_frames) || !g_frames.depth.valid()) return EXIT_FAILURE;
+
+    recorder.add_stream(streamType::colour, g_frames.colour.valid() ? g_frames.colour.width : COLWIDTH,
+                        g_frames.colour.valid() ? g_frames.colour.height : COLHEIGHT);
+    recorder.add_stream(streamType::depth, g_frames.depth.width, g_frames.depth.height);
+    recorder.add_stream(streamType::infrared, g_frames.depth.width, g_frames.depth.height);
+    if (bfs::exists(g_cropFile)) load_record_roi(recorder);
+    recorder.start();
+    g_recorder = &recorder;
+
+    // distance measurements: regions from IRFrameStore/rois.txt, else the 10x10 grid
+    // around the image centre that used to be sampled, and the square it spans
+    std::vector<depthRoi> rois;
+    bfs::path roiFile{"../../IRFrameStore/rois.txt"};
+    if (!bfs::exists(roiFile) || !load_rois(roiFile, rois) || rois.empty()) {
+        rois.clear();
+        for (int px = 603; px <= 630; px += 3)
+            for (int py = 363; py <= 390; py += 3)
+                rois.push_back(depthRoi::point("p" + std::to_string(px) + "_" + std::to_string(py), px, py));
+        rois.push_back(depthRoi::rect("centre", 603, 363, 28, 28));
+    }
 
+    depthStatsConfig scfg;
+    scfg.workers = STATS_WORKERS;
+    scfg.queueFrames = STATS_QUEUE;
+    scfg.depthScale = src->depth_scale();
+    scfg.binary = STATS_BINARY;
+    depthStats stats(scfg, rois);
+    bfs::path statsPath{"../../IRFrameStore/"};
+    statsPath /= datestring + "_" + std::to_string(runNum) + (STATS_BINARY ? ".dstats" : ".csv");
+    // aligned depth takes the colour resolution
+    size_t statsPixels = std::max(static_cast<size_t>(g_frames.depth.width)*g_frames.depth.height,
+                                  static_cast<size_t>(COLWIDTH)*COLHEIGHT);
+    if (g_frames.colour.valid())
+        statsPixels = std::max(statsPixels, static_cast<size_t>(g_frames.colour.width)*g_frames.colour.height);
+    bool statsRunning = false;
+
+    // movement in depth and IR, logged as blobs per frame; runs off the capture thread
+    detectorConfig dcfg;
+    dcfg.workers = DETECT_WORKERS;
+    dcfg.queueFrames = DETECT_QUEUE;
+    dcfg.depthScale = src->depth_scale();
+    dcfg.depthModel.minDiff = DETECT_DEPTH_MM*0.001f/src->depth_scale();
+    dcfg.irModel.minDiff = DETECT_IR_LEVELS;
+    dcfg.tracking.gate = TRACK_GATE;
+    termiteDetector detector(dcfg);
+    bfs::path detectPath{"../../IRFrameStore/"};
+    detectPath /= datestring + "_" + std::to_string(runNum) + "_detections.csv";
+    bfs::path trackPath;
+    if (TRACK) trackPath = detectPath.parent_path() / (datestring + "_" + std::to_string(runNum) + ".tracks");
+    bool detecting = DETECT && detector.start(detectPath, statsPixels, trackPath);
     
+    // motion-gated recording: framesets without movement are not stored
+    motionGateConfig mcfg;
+    mcfg.postRollMs = MOTION_POSTROLL_S*1000.0;
+    motionGate gate(mcfg);
+    long long gatedOut = 0;
+
+    // sensor frame numbers: skip repeated frames, count the ones the camera dropped
+    frameTracker tracker;
+
+    // display runs off the capture loop: small frames at PREVIEW_FPS, scaled on the preview thread
+    previewConfig vcfg;
+    vcfg.fps = PREVIEW_FPS;
+    vcfg.colourWidth = 320;
+    previewStage viewer(vcfg);
+    viewer.start();
+    previewFrames view;
+
     bchrono::system_clock::time_point start = bchrono::system_clock::now();
 
     while (!glfwWindowShouldClose(win))
@@ -302,49 +455,30 @@ int main() try
 
 
         // Block program until frames arrive
-        rs2::frameset frame_data = pipe.wait_for_frames();
+        src->set_align(g_alignflag && !aligner.ready());
+        if (!src->wait_for_frames(g_frames)) break;
+        frameFreshness fresh = tracker.observe(g_frames);
 
-        if (g_alignflag & (framedepthcount<5000))
-        {
-            frame_data = align_to_color.process(frame_data);
-            // to-do: spin off thread? need to preallocate space to make pd_array thread-safe
-            rs2::depth_frame dpframe = frame_data.get_depth_frame();
-
-            for (int pxcount=0; pxcount < 10; pxcount++){
-                for (int pycount = 0; pycount < 10; pycount++){
-                    float distproj_store = dpframe.get_distance(pix_x_list[pxcount], pix_y_list[pycount]);
-                    pixel_distance.push_back(std::make_tuple(framedepthcount, distproj_store));
-                }
-            }
-            framedepthcount++;
-
-        }
+        // detection needs depth and IR from the same viewpoint: it gets the depth before alignment
+        if (detecting && fresh.depth) detector.submit(g_frames.depth, g_frames.ir);
+        bool gated = (g_movflag & 0x01) && g_gateflag;
+        if (gated && (fresh.ir || fresh.depth)) gate.update(g_frames);
+        else if (!gated && gate.open()) gate.reset();
+        bool store = !gated || gate.open();
+        if ((g_movflag & 0x01) && !store) gatedOut++;
+        if (g_alignflag && aligner.ready()) aligner.align(g_frames.depth, g_frames.depth);
 
-        // Try to get frames from both infrared streams
-        irframe1 = frame_data.get_infrared_frame(1);
-        irframe2 = frame_data.get_infrared_frame(2);
+        // aligned depth goes to the statistics thread; a busy analysis skips frames, capture never waits
+        if (g_alignflag && !statsRunning) statsRunning = stats.start(statsPath, statsPixels);
+        if (g_alignflag && statsRunning && fresh.depth) stats.submit(g_frames.depth);
 
-        rs2::depth_frame depthframe = frame_data.get_depth_frame();
-        rs2::frame colframe = frame_data.get_color_frame();
-        
 
-        if (g_movflag & 0x01)
+        if ((g_movflag & 0x01) && store)
         {
-            colImageFrame cfilesave(COLWIDTH, COLHEIGHT);
-            typedef void (colImageFrame::*cfn)(const void*, bfs::path, int);
-
-            depthImageFrame dfilesave(DEPTHWIDTH, DEPTHHEIGHT);
-            typedef void (depthImageFrame::*dfn)(const void*, bfs::path, int);
-
-
             if ((cstamp-c_incr) >= c_interval)
             {
-                // color frame handling
-                boost::thread colorhandler(boost::bind((cfn)&colImageFrame::save_col_frame, &cfilesave, colframe.get_data(), c_path, cnum));
-                colorhandler.detach();
-                // depth frame handling
-                boost::thread depthhandler(boost::bind((dfn)&depthImageFrame::save_d_frame, &dfilesave, depthframe.get_data(), d_path, dnum));
-                depthhandler.detach();
+                // color and depth frame handling
+                recorder.submit_frameset(g_frames, fresh, c_path, d_path, cnum);
 
                 dnum++;
                 cnum++;
@@ -353,43 +487,60 @@ int main() try
             }
         }
 
+        viewer.offer(0, g_frames);
+        if (!viewer.take(0, view)) continue;
+
+            const sourceFrame& irview1 = view.frames.ir;
+            const sourceFrame& irview2 = view.frames.ir2;
+            const sourceFrame& colview = view.frames.colour;
+            const sourceFrame& depthview = view.frames.depth;
+
             glClear(GL_COLOR_BUFFER_BIT);
-            glPixelZoom(0.5, 0.5);
+            glPixelZoom(DISPLAY_ZOOM*view.irFactor, DISPLAY_ZOOM*view.irFactor);
             glRasterPos2f(-1,0);
-            glDrawPixels(DEPTHWIDTH, DEPTHHEIGHT, GL_LUMINANCE, GL_UNSIGNED_BYTE, static_cast<const GLvoid*>(irframe1.get_data()));
+            if (irview1.valid()) glDrawPixels(irview1.width, irview1.height, GL_LUMINANCE, GL_UNSIGNED_BYTE, static_cast<const GLvoid*>(irview1.data));
 
             glRasterPos2f(-0.1, 0);
-            glDrawPixels(DEPTHWIDTH,DEPTHHEIGHT, GL_LUMINANCE, GL_UNSIGNED_BYTE, static_cast<const GLvoid*>(irframe2.get_data()));
+            if (irview2.valid()) glDrawPixels(irview2.width, irview2.height, GL_LUMINANCE, GL_UNSIGNED_BYTE, static_cast<const GLvoid*>(irview2.data));
 
+            glPixelZoom(DISPLAY_ZOOM*view.colourFactor, DISPLAY_ZOOM*view.colourFactor);
             glRasterPos2f(-1, -0.8);
-            glDrawPixels(COLWIDTH, COLHEIGHT, GL_RGB, GL_UNSIGNED_BYTE,static_cast<const GLvoid*>(colframe.get_data()));
+            if (colview.valid()) glDrawPixels(colview.width, colview.height, GL_RGB, GL_UNSIGNED_BYTE,static_cast<const GLvoid*>(colview.data));
 
+            glPixelZoom(DISPLAY_ZOOM*view.depthFactor, DISPLAY_ZOOM*view.depthFactor);
             glRasterPos2f(-0.1, -0.8);
-            glDrawPixels(DEPTHWIDTH,DEPTHHEIGHT, GL_LUMINANCE, GL_UNSIGNED_SHORT, static_cast<const GLvoid*>(depthframe.get_data()));
+            if (depthview.valid() && !view.depthColour.empty())
+                glDrawPixels(depthview.width, depthview.height, GL_RGB, GL_UNSIGNED_BYTE, static_cast<const GLvoid*>(view.depthColour.data()));
 
 
         glfwSwapBuffers(win);
 
     }
-    // quick hack to write data to file at end of program
-    if (framedepthcount>1){
-        std::cout << "Saving aligned distance data ..." << std::endl;
 
-        bfs::path recPath{"../../IRFrameStore/"};
-        std::string distRun = datestring + "_" + std::to_string(runNum) + ".csv";
-        recPath /= distRun;
-        bfs::ofstream recFile;
-
-        recFile.open(recPath);
-        while (!pixel_distance.empty())
-        {
-            std::tuple<int,float> checkTup = pixel_distance.back();
-            pixel_distance.pop_back();
-            recFile << std::get<0>(checkTup) << ',' << std::get<1>(checkTup) <<std::endl;
-        }
-        recFile.close();
-
-        
+    // finish everything already queued before exiting
+    viewer.stop();
+    g_recorder = nullptr;
+    recorder.stop();
+    src->stop();
+
+    tracker.print(std::cout);
+    if (gate.openings() || gatedOut)
+        std::cout << "Motion gate opened " << gate.openings() << " times, " << gatedOut
+                  << " framesets without movement not stored" << std::endl;
+    tracker.write_summary(dpath / "frame_summary.csv");
+    if (detecting) {
+        detector.stop();
+        std::cout << "Detection: " << detector.processed() << " frames, " << detector.detections() << " blobs, "
+                  << detector.dropped() << " frames skipped, " << detector.timing().mean()/1000.0 << " ms/frame mean, "
+                  << detector.timing().percentile(99)/1000.0 << " ms p99, written to " << detectPath << std::endl;
+        if (TRACK)
+            std::cout << "Tracking: " << detector.tracker().confirmed() << " tracks confirmed of "
+                      << detector.tracker().started() << " started, written to " << trackPath << std::endl;
+    }
+    if (statsRunning) {
+        stats.stop();
+        std::cout << "Distance statistics: " << stats.analysed() << " frames analysed, "
+                  << stats.dropped() << " skipped, written to " << statsPath << std::endl;
     }
 
     return EXIT_SUCCESS;
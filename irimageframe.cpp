@@ -62,3 +62,13 @@ void irImageFrame::save_ir_frame(const void* irpoint, boost::filesystem::path ir
     irfile.write(static_cast<const char*>(irpoint), arraysize);
     irfile.close();
 }
+
+
+bool irImageFrame::append_ir_frame(const void* irpoint, segmentWriter& ir_segments, int framenum, double timestamp)
+{
+    // Container mode: one chunk per frame in the session's segment files
+
+    int arraysize = this->array_size_calc();
+
+    return ir_segments.append(irpoint, arraysize, framenum, timestamp);
+}
@@ -8,11 +8,12 @@
  *   ir_size_calc - calculates needed buffer size for rgb conversion
  *   save_ir_frame - takes a frame from a RealSense library-compatible depth image stream,
  *   saves to file
+ *   append_ir_frame - appends a frame buffer to a session segment container (see segmentwriter.h)
  *
  * Input:
  *   device pointer
- *   path to save directory
- *   filename
+ *   path to save directory OR segment writer
+ *   filename or enumerative, timestamp
  *
  * Output:
  *   none
@@ -36,6 +37,8 @@
 
 #include <fstream>
 
+#include "segmentwriter.h"
+
 // Include the librealsense C++ header file
 #include <librealsense2/rs.hpp>
 
@@ -52,6 +55,7 @@ public:
 
     void save_ir_frame(const void* irpoint, boost::filesystem::path ir_path, std::string ir_file);
     void save_ir_frame(const void* irpoint, boost::filesystem::path ir_path, int framenum);
+    bool append_ir_frame(const void* irpoint, segmentWriter& ir_segments, int framenum, double timestamp);
 
 };
 
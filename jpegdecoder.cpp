@@ -0,0 +1,80 @@
+#include "jpegdecoder.h"
+
+#include <boost/thread/tss.hpp>
+
+jpegDecoder::jpegDecoder()
+{
+    dinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = &jpegDecoder::error_exit;
+    jpeg_create_decompress(&dinfo);
+}
+
+jpegDecoder::~jpegDecoder()
+{
+    jpeg_destroy_decompress(&dinfo);
+}
+
+void jpegDecoder::error_exit(j_common_ptr cinfo)
+{
+    // libjpeg's default handler calls exit(): report and unwind to the caller instead
+    errorMgr* err = reinterpret_cast<errorMgr*>(cinfo->err);
+    (*cinfo->err->output_message)(cinfo);
+    std::longjmp(err->jump, 1);
+}
+
+bool jpegDecoder::read_size(const unsigned char* jpeg, size_t size, int& width, int& height)
+{
+    if (setjmp(jerr.jump)) {
+        jpeg_abort_decompress(&dinfo);
+        return false;
+    }
+
+    jpeg_mem_src(&dinfo, const_cast<unsigned char*>(jpeg), size);
+    jpeg_read_header(&dinfo, TRUE);
+    width = dinfo.image_width;
+    height = dinfo.image_height;
+    jpeg_abort_decompress(&dinfo);
+    return true;
+}
+
+bool jpegDecoder::decode(const unsigned char* jpeg, size_t size, std::vector<unsigned char>& rgb,
+                         int& width, int& height, int scale_denom)
+{
+    if (setjmp(jerr.jump)) {
+        jpeg_abort_decompress(&dinfo);
+        return false;
+    }
+
+    jpeg_mem_src(&dinfo, const_cast<unsigned char*>(jpeg), size);
+    jpeg_read_header(&dinfo, TRUE);
+
+    dinfo.out_color_space = JCS_RGB;
+    dinfo.scale_num = 1;
+    dinfo.scale_denom = (scale_denom == 2 || scale_denom == 4 || scale_denom == 8) ? scale_denom : 1;
+    if (dinfo.scale_denom > 1) {
+        // previews: fast integer IDCT and no fancy chroma upsampling
+        dinfo.dct_method = JDCT_IFAST;
+        dinfo.do_fancy_upsampling = FALSE;
+    }
+
+    jpeg_start_decompress(&dinfo);
+    width = dinfo.output_width;
+    height = dinfo.output_height;
+
+    size_t stride = static_cast<size_t>(width)*3;
+    rgb.resize(stride*height);
+    while (dinfo.output_scanline < dinfo.output_height) {
+        JSAMPROW row = &rgb[dinfo.output_scanline*stride];
+        jpeg_read_scanlines(&dinfo, &row, 1);
+    }
+
+    jpeg_finish_decompress(&dinfo);
+    return true;
+}
+
+jpegDecoder& jpegDecoder::for_thread()
+{
+    static boost::thread_specific_ptr<jpegDecoder> decoder;
+    if (!decoder.get()) decoder.reset(new jpegDecoder);
+    return *decoder;
+}
@@ -0,0 +1,66 @@
+/* jpegdecoder.h
+ *
+ * Description:
+ *   header file for jpegDecoder class
+ *   Reusable libjpeg(-turbo) decompressor for recorded colour frames. Decodes
+ *   from memory (e.g. a memory-mapped file) into a caller-owned RGB8 vector.
+ *   scale_denom 2/4/8 uses libjpeg's reduced-size DCT, which skips most of the
+ *   IDCT work and is the cheap path for previews and scrubbing.
+ *
+ * Functions:
+ *   decode - decompresses one JPEG into rgb (resized), reports output size
+ *   read_size - reads image dimensions from the JPEG header only
+ *   for_thread - per-thread decoder instance
+ *
+ * Input:
+ *   JPEG bytes, scale denominator (1, 2, 4 or 8)
+ *
+ * Output:
+ *   interleaved RGB8 pixels, width, height
+ *
+ * Requirements:
+ *   libjpeg / libjpeg-turbo
+ *   boost/thread
+ *
+ * Thread safe? NO (one instance per thread - see for_thread)
+ *
+ * Extendable? YES
+ */
+
+#ifndef JPEGDECODER_H
+#define JPEGDECODER_H
+
+#include <cstdio>
+#include <csetjmp>
+#include <vector>
+
+#include <jpeglib.h>
+
+class jpegDecoder
+{
+    struct errorMgr
+    {
+        jpeg_error_mgr pub;
+        std::jmp_buf jump;
+    };
+
+    jpeg_decompress_struct dinfo;
+    errorMgr jerr;
+
+    static void error_exit(j_common_ptr cinfo);
+
+    jpegDecoder(const jpegDecoder&);
+    jpegDecoder& operator=(const jpegDecoder&);
+
+public:
+    jpegDecoder();
+    ~jpegDecoder();
+
+    bool decode(const unsigned char* jpeg, size_t size, std::vector<unsigned char>& rgb,
+                int& width, int& height, int scale_denom = 1);
+    bool read_size(const unsigned char* jpeg, size_t size, int& width, int& height);
+
+    static jpegDecoder& for_thread();
+};
+
+#endif // JPEGDECODER_H
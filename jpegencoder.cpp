@@ -0,0 +1,208 @@
+#include "jpegencoder.h"
+
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+jpegEncoder::jpegEncoder()
+{
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = &jpegEncoder::error_exit;
+    jpeg_create_compress(&cinfo);
+
+    dest.pub.init_destination = &jpegEncoder::init_destination;
+    dest.pub.empty_output_buffer = &jpegEncoder::empty_output_buffer;
+    dest.pub.term_destination = &jpegEncoder::term_destination;
+    dest.out = 0;
+    cinfo.dest = &dest.pub;
+}
+
+jpegEncoder::~jpegEncoder()
+{
+    jpeg_destroy_compress(&cinfo);
+}
+
+void jpegEncoder::error_exit(j_common_ptr cinfo)
+{
+    // libjpeg's default handler calls exit(): report and unwind to encode() instead
+    errorMgr* err = reinterpret_cast<errorMgr*>(cinfo->err);
+    (*cinfo->err->output_message)(cinfo);
+    std::longjmp(err->jump, 1);
+}
+
+void jpegEncoder::init_destination(j_compress_ptr cinfo)
+{
+    destMgr* d = reinterpret_cast<destMgr*>(cinfo->dest);
+
+    // reuse whatever the vector already holds; first frame starts at ~1/4 raw size
+    size_t start = std::max(d->out->capacity(), static_cast<size_t>(cinfo->image_width*cinfo->image_height/4 + 4096));
+    d->out->resize(start);
+    d->pub.next_output_byte = d->out->data();
+    d->pub.free_in_buffer = d->out->size();
+}
+
+boolean jpegEncoder::empty_output_buffer(j_compress_ptr cinfo)
+{
+    destMgr* d = reinterpret_cast<destMgr*>(cinfo->dest);
+
+    // libjpeg only calls this with the buffer full
+    size_t used = d->out->size();
+    d->out->resize(2*used);
+    d->pub.next_output_byte = d->out->data() + used;
+    d->pub.free_in_buffer = d->out->size() - used;
+    return TRUE;
+}
+
+void jpegEncoder::term_destination(j_compress_ptr cinfo)
+{
+    destMgr* d = reinterpret_cast<destMgr*>(cinfo->dest);
+    d->out->resize(d->out->size() - d->pub.free_in_buffer);
+}
+
+bool jpegEncoder::encode(const unsigned char* rgb, int width, int height, int stride,
+                         const jpegSettings& settings, std::vector<unsigned char>& out)
+{
+    dest.out = &out;
+
+    if (setjmp(jerr.jump)) {
+        jpeg_abort_compress(&cinfo);
+        out.clear();
+        return false;
+    }
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, settings.quality, TRUE);
+
+    // luma sampling factors select the chroma subsampling
+    switch (settings.subsampling) {
+    case jpegSubsampling::s444: cinfo.comp_info[0].h_samp_factor = 1; cinfo.comp_info[0].v_samp_factor = 1; break;
+    case jpegSubsampling::s422: cinfo.comp_info[0].h_samp_factor = 2; cinfo.comp_info[0].v_samp_factor = 1; break;
+    case jpegSubsampling::s420: cinfo.comp_info[0].h_samp_factor = 2; cinfo.comp_info[0].v_samp_factor = 2; break;
+    }
+
+    jpeg_start_compress(&cinfo, TRUE);
+
+    // hand libjpeg rows of the interleaved buffer directly
+    JSAMPROW rows[16];
+    while (cinfo.next_scanline < cinfo.image_height) {
+        int n = std::min(16, static_cast<int>(cinfo.image_height - cinfo.next_scanline));
+        for (int r = 0; r < n; r++)
+            rows[r] = const_cast<JSAMPROW>(rgb + static_cast<size_t>(cinfo.next_scanline + r)*stride);
+        jpeg_write_scanlines(&cinfo, rows, n);
+    }
+
+    jpeg_finish_compress(&cinfo);
+    return true;
+}
+
+// offsets of the SOF0 and SOS markers and of the first entropy-coded byte in what encode() wrote
+static bool scan_layout(const std::vector<unsigned char>& jpeg, size_t& sof, size_t& sos, size_t& data)
+{
+    const unsigned char* j = jpeg.data();
+    size_t size = jpeg.size();
+    if (size < 6 || j[0] != 0xFF || j[1] != 0xD8 || j[size-2] != 0xFF || j[size-1] != 0xD9) return false;
+
+    sof = 0;
+    for (size_t p = 2; p + 4 <= size; ) {
+        if (j[p] != 0xFF) return false;
+        size_t len = (static_cast<size_t>(j[p+2]) << 8) | j[p+3];
+        if (j[p+1] == 0xC0) sof = p;
+        if (j[p+1] == 0xDA) {
+            sos = p;
+            data = p + 2 + len;
+            return sof != 0 && data + 2 <= size;
+        }
+        p += 2 + len;
+    }
+    return false;
+}
+
+bool jpegEncoder::encode_striped(const unsigned char* rgb, int width, int height, int stride,
+                                 const jpegSettings& settings, std::vector<unsigned char>& out, workerPool* pool)
+{
+    const int mcuHeight = settings.subsampling == jpegSubsampling::s420 ? 16 : 8;
+    const int mcuWidth = settings.subsampling == jpegSubsampling::s444 ? 8 : 16;
+    const int mcuLines = (height + mcuHeight - 1)/mcuHeight;
+    const int mcusPerLine = (width + mcuWidth - 1)/mcuWidth;
+
+    // one stripe per thread; a restart interval (one stripe) holds at most 65535 MCUs
+    int parts = pool ? std::min(pool->size() + 1, mcuLines) : 1;
+    int linesPerStripe = parts > 1 ? (mcuLines + parts - 1)/parts : mcuLines;
+    linesPerStripe = std::min(linesPerStripe, 65535/std::max(1, mcusPerLine));
+    if (parts <= 1 || linesPerStripe < 1) return encode(rgb, width, height, stride, settings, out);
+
+    const int stripeRows = linesPerStripe*mcuHeight;
+    parts = (height + stripeRows - 1)/stripeRows;
+    if (static_cast<int>(stripeOut.size()) < parts) stripeOut.resize(parts);
+
+    std::atomic<bool> ok(true);
+    pool->parallel_for(parts, [&](int t) {
+        int y0 = t*stripeRows;
+        int rows = std::min(stripeRows, height - y0);
+        if (!jpegEncoder::for_thread().encode(rgb + static_cast<size_t>(y0)*stride, width, rows, stride, settings, stripeOut[t]))
+            ok = false;
+    });
+    if (!ok || !stitch(parts, height, linesPerStripe*mcusPerLine, out)) {
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+bool jpegEncoder::stitch(int stripes, int height, int interval, std::vector<unsigned char>& out) const
+{
+    if (stripes < 1) return false;
+
+    size_t sof = 0, sos = 0, data = 0;
+    size_t total = 0;
+    for (int t = stripes - 1; t >= 0; t--) {
+        if (!scan_layout(stripeOut[t], sof, sos, data)) return false;
+        total += stripeOut[t].size() - data - 2 + 2;        // entropy-coded data + RST or EOI
+    }
+    // the loop ends on the first stripe, whose headers are kept
+    const std::vector<unsigned char>& first = stripeOut[0];
+    total += data + 6;                                      // headers, DRI
+
+    out.resize(total);
+    unsigned char* p = out.data();
+    std::memcpy(p, first.data(), sos);
+    p[sof + 5] = static_cast<unsigned char>(height >> 8);
+    p[sof + 6] = static_cast<unsigned char>(height & 0xFF);
+    p += sos;
+
+    // DRI goes after the tables, right before SOS, where libjpeg puts it
+    const unsigned char dri[6] = { 0xFF, 0xDD, 0x00, 0x04, static_cast<unsigned char>(interval >> 8), static_cast<unsigned char>(interval & 0xFF) };
+    std::memcpy(p, dri, sizeof(dri));
+    p += sizeof(dri);
+    std::memcpy(p, first.data() + sos, data - sos);
+    p += data - sos;
+
+    for (int t = 0; t < stripes; t++) {
+        const std::vector<unsigned char>& s = stripeOut[t];
+        scan_layout(s, sof, sos, data);
+        if (t > 0) {
+            *p++ = 0xFF;
+            *p++ = static_cast<unsigned char>(0xD0 + ((t - 1) & 7));
+        }
+        std::memcpy(p, s.data() + data, s.size() - data - 2);
+        p += s.size() - data - 2;
+    }
+    *p++ = 0xFF;
+    *p++ = 0xD9;
+    return true;
+}
+
+jpegEncoder& jpegEncoder::for_thread()
+{
+    static boost::thread_specific_ptr<jpegEncoder> encoder;
+    if (!encoder.get()) encoder.reset(new jpegEncoder);
+    return *encoder;
+}
@@ -0,0 +1,101 @@
+/* jpegencoder.h
+ *
+ * Description:
+ *   header file for jpegEncoder class
+ *   Reusable libjpeg(-turbo) compressor: compresses an interleaved RGB8 buffer
+ *   directly (no planar copy) into a caller-owned std::vector. The compressor
+ *   context and the output vector's capacity are kept between frames, so a
+ *   worker thread that owns one encoder does no per-frame setup or allocation.
+ *   Use for_thread() to get the calling thread's encoder.
+ *   encode_striped splits a frame into horizontal stripes of whole MCU rows
+ *   and compresses them in parallel on a workerPool, each on its thread's
+ *   encoder with the same settings and the standard Huffman tables. The
+ *   stripes are then stitched into one baseline JPEG: the first stripe's
+ *   headers with the full height in SOF0, a DRI marker giving one restart
+ *   interval per stripe, and the stripes' entropy-coded data separated by
+ *   RST0..RST7 markers (a restart resets the DC predictions, as a new encode
+ *   does). The result is byte for byte what a single libjpeg pass with that
+ *   restart interval writes, so every JPEG reader takes it.
+ *
+ * Functions:
+ *   encode - compresses one frame into out (resized to the JPEG length)
+ *   encode_striped - as encode, stripes on a workerPool (a pool of 0 threads, or none, encodes in one go)
+ *   for_thread - per-thread encoder instance (boost::thread_specific_ptr)
+ *
+ * Input:
+ *   rgb8 buffer pointer, width, height, row stride in bytes
+ *   quality (0-100), chroma subsampling
+ *
+ * Output:
+ *   JPEG byte stream
+ *
+ * Requirements:
+ *   libjpeg / libjpeg-turbo
+ *   boost/thread
+ *   workerpool.h
+ *
+ * Thread safe? NO (one instance per thread - see for_thread)
+ *
+ * Extendable? YES
+ */
+
+#ifndef JPEGENCODER_H
+#define JPEGENCODER_H
+
+#include <cstdio>
+#include <csetjmp>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "workerpool.h"
+
+enum class jpegSubsampling { s444, s422, s420 };
+
+struct jpegSettings
+{
+    int quality = 95;
+    jpegSubsampling subsampling = jpegSubsampling::s420;
+};
+
+class jpegEncoder
+{
+    struct errorMgr
+    {
+        jpeg_error_mgr pub;
+        std::jmp_buf jump;
+    };
+
+    struct destMgr
+    {
+        jpeg_destination_mgr pub;
+        std::vector<unsigned char>* out;
+    };
+
+    jpeg_compress_struct cinfo;
+    errorMgr jerr;
+    destMgr dest;
+    std::vector< std::vector<unsigned char> > stripeOut;     // per stripe, capacity reused
+
+    static void error_exit(j_common_ptr cinfo);
+    static void init_destination(j_compress_ptr cinfo);
+    static boolean empty_output_buffer(j_compress_ptr cinfo);
+    static void term_destination(j_compress_ptr cinfo);
+    bool stitch(int stripes, int height, int interval, std::vector<unsigned char>& out) const;
+
+    jpegEncoder(const jpegEncoder&);
+    jpegEncoder& operator=(const jpegEncoder&);
+
+public:
+    jpegEncoder();
+    ~jpegEncoder();
+
+    bool encode(const unsigned char* rgb, int width, int height, int stride,
+                const jpegSettings& settings, std::vector<unsigned char>& out);
+    bool encode_striped(const unsigned char* rgb, int width, int height, int stride,
+                        const jpegSettings& settings, std::vector<unsigned char>& out, workerPool* pool);
+
+    static jpegEncoder& for_thread();
+};
+
+#endif // JPEGENCODER_H
@@ -0,0 +1,71 @@
+#include "latencyhistogram.h"
+
+latencyHistogram::latencyHistogram()
+{
+    reset();
+}
+
+int latencyHistogram::bucket_of(uint64_t us)
+{
+    if (us < SUB_BUCKETS) return static_cast<int>(us);
+
+    int e = 63 - __builtin_clzll(us);                   // highest set bit, >= SUB_BITS
+    if (e > MAX_EXPONENT) return BUCKETS - 1;
+    int sub = static_cast<int>((us >> (e - SUB_BITS)) & (SUB_BUCKETS - 1));
+    return (e - SUB_BITS + 1)*SUB_BUCKETS + sub;
+}
+
+uint64_t latencyHistogram::bucket_value(int index)
+{
+    // middle of the bucket's range
+    if (index < SUB_BUCKETS) return static_cast<uint64_t>(index);
+
+    int e = index/SUB_BUCKETS + SUB_BITS - 1;
+    uint64_t sub = static_cast<uint64_t>(index % SUB_BUCKETS);
+    uint64_t low = (uint64_t(1) << e) + (sub << (e - SUB_BITS));
+    return low + (uint64_t(1) << (e - SUB_BITS))/2;
+}
+
+void latencyHistogram::record(uint64_t us)
+{
+    buckets[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+    n.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(us, std::memory_order_relaxed);
+
+    uint64_t seen = largest.load(std::memory_order_relaxed);
+    while (us > seen && !largest.compare_exchange_weak(seen, us, std::memory_order_relaxed)) {}
+}
+
+void latencyHistogram::reset()
+{
+    for (int i = 0; i < BUCKETS; i++) buckets[i].store(0, std::memory_order_relaxed);
+    n.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    largest.store(0, std::memory_order_relaxed);
+}
+
+uint64_t latencyHistogram::percentile(double p) const
+{
+    uint64_t total = count();
+    if (total == 0) return 0;
+
+    uint64_t rank = static_cast<uint64_t>(p/100.0*total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > total) rank = total;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t v = bucket_value(i);
+            return v < max() ? v : max();
+        }
+    }
+    return max();
+}
+
+double latencyHistogram::mean() const
+{
+    uint64_t total = count();
+    return total ? static_cast<double>(sum.load(std::memory_order_relaxed))/total : 0.0;
+}
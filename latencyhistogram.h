@@ -0,0 +1,64 @@
+/* latencyhistogram.h
+ *
+ * Description:
+ *   header file for latencyHistogram class
+ *   Fixed-size log-linear histogram of durations (microseconds) for timing the
+ *   recording stages. Each power of two is split into 16 linear buckets, so a
+ *   percentile is within ~6% of the true value, from 1 us up to hours.
+ *   Recording is one relaxed atomic increment, so any number of worker
+ *   threads can record into the same histogram without locks.
+ *
+ * Functions:
+ *   record - adds one duration
+ *   percentile - duration below which p% (0-100) of the samples fall
+ *   max, mean, count - summary values
+ *   reset - clears all samples
+ *
+ * Input:
+ *   durations in microseconds
+ *
+ * Output:
+ *   percentile/summary values in microseconds
+ *
+ * Requirements:
+ *   none
+ *
+ * Thread safe? YES (percentiles taken while recording are approximate)
+ *
+ * Extendable? YES
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+
+class latencyHistogram
+{
+    static const int SUB_BITS = 4;                      // 16 buckets per power of two
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int MAX_EXPONENT = 40;                 // ~12 days in us
+    static const int BUCKETS = (MAX_EXPONENT - SUB_BITS + 2)*SUB_BUCKETS;
+
+    std::atomic<uint64_t> buckets[BUCKETS];
+    std::atomic<uint64_t> n;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> largest;
+
+    static int bucket_of(uint64_t us);
+    static uint64_t bucket_value(int index);
+
+public:
+    latencyHistogram();
+
+    void record(uint64_t us);
+    void reset();
+
+    uint64_t percentile(double p) const;
+    uint64_t max() const { return largest.load(std::memory_order_relaxed); }
+    double mean() const;
+    uint64_t count() const { return n.load(std::memory_order_relaxed); }
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -0,0 +1,448 @@
+#include "mjpegwriter.h"
+
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace bfs = boost::filesystem;
+
+static uint32_t fourcc(const char* s)
+{
+    uint32_t v;
+    std::memcpy(&v, s, 4);
+    return v;
+}
+
+static void put16(std::vector<unsigned char>& b, uint16_t v) { b.insert(b.end(), reinterpret_cast<unsigned char*>(&v), reinterpret_cast<unsigned char*>(&v) + 2); }
+static void put32(std::vector<unsigned char>& b, uint32_t v) { b.insert(b.end(), reinterpret_cast<unsigned char*>(&v), reinterpret_cast<unsigned char*>(&v) + 4); }
+static void put64(std::vector<unsigned char>& b, uint64_t v) { b.insert(b.end(), reinterpret_cast<unsigned char*>(&v), reinterpret_cast<unsigned char*>(&v) + 8); }
+static void set32(std::vector<unsigned char>& b, size_t at, uint32_t v) { std::memcpy(&b[at], &v, 4); }
+
+mjpegWriter::mjpegWriter()
+    : width(0), height(0), fd(-1), fileNum(0), end(0), riffStart(0), moviList(0), firstRiff(true),
+      avihFrames(0), avihBuffer(0), strhLength(0), strhBuffer(0), indxCount(0), indxEntries(0), dmlhFrames(0),
+      superCount(0), riffFrames(0), fileFrames(0), maxChunk(0), next(-1), frames(0), late(0), fillers(0), writeErrors(0)
+{
+}
+
+mjpegWriter::~mjpegWriter()
+{
+    close();
+}
+
+std::string mjpegWriter::file_name(const std::string& m_prefix, uint32_t num)
+{
+    char n[16];
+    std::snprintf(n, sizeof(n), "%04u", num);
+    return m_prefix + "_" + n + ".avi";
+}
+
+bool mjpegWriter::open(bfs::path m_dir, std::string m_prefix, int m_width, int m_height, const mjpegConfig& m_cfg)
+{
+    boost::mutex::scoped_lock guard(lock);
+    if (fd >= 0) return true;
+
+    dir = m_dir;
+    prefix = m_prefix;
+    width = m_width;
+    height = m_height;
+    cfg = m_cfg;
+    fileNum = 0;
+    next = -1;
+    entries.reserve(index_frames());
+    return open_file();
+}
+
+int mjpegWriter::index_frames() const
+{
+    return std::max(1, static_cast<int>(std::lround(cfg.fps*cfg.indexSeconds)));
+}
+
+bool mjpegWriter::open_file()
+{
+    bfs::path file = dir / file_name(prefix, fileNum);
+    fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Error: could not create " << file << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // headers with every count zero; flush_index patches them as the file grows
+    std::vector<unsigned char> h;
+    h.reserve(1024 + 16*cfg.maxIndexChunks);
+    put32(h, AVI_RIFF); put32(h, 0); put32(h, AVI_FORM);
+
+    size_t hdrl = h.size();
+    put32(h, AVI_LIST); put32(h, 0); put32(h, fourcc("hdrl"));
+
+    put32(h, AVI_AVIH); put32(h, 56);
+    size_t avih = h.size();
+    put32(h, static_cast<uint32_t>(std::lround(1e6/cfg.fps)));  // us per frame
+    put32(h, 0);                                                // max bytes per second
+    put32(h, 0);                                                // padding granularity
+    put32(h, 0x10);                                             // AVIF_HASINDEX
+    put32(h, 0);                                                // total frames (first RIFF)
+    put32(h, 0);                                                // initial frames
+    put32(h, 1);                                                // streams
+    put32(h, 0);                                                // suggested buffer size
+    put32(h, width); put32(h, height);
+    for (int i = 0; i < 4; i++) put32(h, 0);
+
+    size_t strl = h.size();
+    put32(h, AVI_LIST); put32(h, 0); put32(h, fourcc("strl"));
+
+    put32(h, AVI_STRH); put32(h, 56);
+    size_t strh = h.size();
+    put32(h, fourcc("vids")); put32(h, fourcc("MJPG"));
+    put32(h, 0);                                                // flags
+    put16(h, 0); put16(h, 0);                                   // priority, language
+    put32(h, 0);                                                // initial frames
+    put32(h, 1000);                                             // rate/scale = fps
+    put32(h, static_cast<uint32_t>(std::lround(cfg.fps*1000)));
+    put32(h, 0);                                                // start
+    put32(h, 0);                                                // length (frames)
+    put32(h, 0);                                                // suggested buffer size
+    put32(h, 0xffffffffu);                                      // quality: default
+    put32(h, 0);                                                // sample size: variable
+    put16(h, 0); put16(h, 0); put16(h, static_cast<uint16_t>(width)); put16(h, static_cast<uint16_t>(height));
+
+    put32(h, fourcc("strf")); put32(h, 40);
+    put32(h, 40); put32(h, width); put32(h, height);
+    put16(h, 1); put16(h, 24);
+    put32(h, fourcc("MJPG"));
+    put32(h, static_cast<uint32_t>(width)*height*3);
+    for (int i = 0; i < 4; i++) put32(h, 0);
+
+    // OpenDML super index: one entry per ix00 chunk, space reserved up front
+    put32(h, AVI_INDX); put32(h, 24 + 16*cfg.maxIndexChunks);
+    size_t indx = h.size();
+    put16(h, 4);                                                // longs per entry
+    h.push_back(0);                                             // sub type
+    h.push_back(0);                                             // AVI_INDEX_OF_INDEXES
+    put32(h, 0);                                                // entries in use
+    put32(h, AVI_VIDEO);
+    for (int i = 0; i < 3; i++) put32(h, 0);
+    h.resize(h.size() + 16*cfg.maxIndexChunks, 0);
+    set32(h, strl + 4, static_cast<uint32_t>(h.size() - strl - 8));
+
+    put32(h, AVI_LIST); put32(h, 4 + 8 + 248); put32(h, fourcc("odml"));
+    put32(h, fourcc("dmlh")); put32(h, 248);
+    size_t dmlh = h.size();
+    h.resize(h.size() + 248, 0);
+    set32(h, hdrl + 4, static_cast<uint32_t>(h.size() - hdrl - 8));
+
+    size_t movi = h.size();
+    put32(h, AVI_LIST); put32(h, 4); put32(h, AVI_MOVI);
+    set32(h, 4, static_cast<uint32_t>(h.size() - 8));
+
+    avihFrames = avih + 16;
+    avihBuffer = avih + 28;
+    strhLength = strh + 32;
+    strhBuffer = strh + 36;
+    indxCount = indx + 4;
+    indxEntries = indx + 24;
+    dmlhFrames = dmlh;
+
+    end = 0;
+    riffStart = 0;
+    moviList = movi;
+    firstRiff = true;
+    superCount = 0;
+    riffFrames = 0;
+    fileFrames = 0;
+    maxChunk = 0;
+    entries.clear();
+    legacy.clear();
+
+    if (!write_all(h.data(), h.size())) {
+        close_file();
+        return false;
+    }
+    return true;
+}
+
+bool mjpegWriter::write_all(const void* data, size_t n)
+{
+    // always at the logical end, so a failed write is overwritten by the next one
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    size_t done = 0;
+    while (done < n) {
+        ssize_t w = ::pwrite(fd, p + done, n - done, end + done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            if (writeErrors++ == 0) std::cerr << "Error: colour container write failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        done += w;
+    }
+    end += n;
+    return true;
+}
+
+bool mjpegWriter::patch(uint64_t at, const void* data, size_t n)
+{
+    if (::pwrite(fd, data, n, at) == static_cast<ssize_t>(n)) return true;
+    writeErrors++;
+    return false;
+}
+
+bool mjpegWriter::write_chunk(uint32_t id, const void* data, uint32_t size)
+{
+    // header, payload and the pad byte RIFF wants after odd sizes, in one call
+    uint32_t head[2] = { id, size };
+    static unsigned char pad = 0;
+    struct iovec v[3];
+    v[0].iov_base = head;
+    v[0].iov_len = sizeof(head);
+    v[1].iov_base = const_cast<void*>(data);
+    v[1].iov_len = size;
+    v[2].iov_base = &pad;
+    v[2].iov_len = size & 1u;
+
+    const size_t total = sizeof(head) + size + (size & 1u);
+    size_t done = 0;
+    int first = 0;
+    while (done < total) {
+        ssize_t w = ::pwritev(fd, v + first, 3 - first, end + done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            if (writeErrors++ == 0) std::cerr << "Error: colour container write failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        done += w;
+        while (first < 3 && static_cast<size_t>(w) >= v[first].iov_len) { w -= v[first].iov_len; first++; }
+        if (first < 3) {
+            v[first].iov_base = static_cast<unsigned char*>(v[first].iov_base) + w;
+            v[first].iov_len -= w;
+        }
+    }
+    end += total;
+    return true;
+}
+
+bool mjpegWriter::append(const unsigned char* jpeg, size_t size, int64_t framenum, double timestamp)
+{
+    boost::mutex::scoped_lock guard(lock);
+    if (fd < 0 || size >= cfg.riffBytes/2) return false;
+
+    if (next >= 0 && framenum < next) {
+        // its place in the file has been written already
+        late++;
+        return false;
+    }
+    if (held.empty() && framenum == next) {
+        emit(framenum, jpeg, size, timestamp);
+        return true;
+    }
+
+    // out of order (or the first frames): keep a copy until the frames before it arrive
+    std::vector<unsigned char> copy;
+    if (!spare.empty()) { copy.swap(spare.back()); spare.pop_back(); }
+    copy.assign(jpeg, jpeg + size);
+    heldFrame& h = held[framenum];
+    if (!h.jpeg.empty()) {
+        spare.push_back(std::move(copy));
+        late++;
+        return false;
+    }
+    h.jpeg.swap(copy);
+    h.timestamp = timestamp;
+
+    while (!held.empty()) {
+        std::map<int64_t, heldFrame>::iterator it = held.begin();
+        int waiting = static_cast<int>(held.size());
+        if (next < 0 && waiting < std::max(1, cfg.reorderFrames)) break;
+        if (next >= 0 && it->first != next && waiting <= cfg.reorderFrames) break;
+
+        // in sequence, or waited long enough for the missing frames
+        emit(it->first, it->second.jpeg.data(), it->second.jpeg.size(), it->second.timestamp);
+        spare.push_back(std::move(it->second.jpeg));
+        held.erase(it);
+    }
+    return true;
+}
+
+void mjpegWriter::emit(int64_t framenum, const unsigned char* jpeg, size_t size, double timestamp)
+{
+    // empty chunks hold the place of missing frames, so players keep the timing
+    if (next >= 0 && framenum > next && framenum - next <= cfg.maxGapFrames) {
+        for (int64_t n = next; n < framenum; n++) {
+            put_frame(0, 0, -1, 0.0);
+            fillers++;
+        }
+    }
+    bool ok = put_frame(jpeg, static_cast<uint32_t>(size), framenum, timestamp);
+    if (ok) frames++;
+    next = framenum + 1;
+    if (emitted) emitted(framenum, ok);
+}
+
+bool mjpegWriter::put_frame(const unsigned char* jpeg, uint32_t size, int64_t framenum, double timestamp)
+{
+    if (fd < 0) return false;
+
+    // a RIFF may not outgrow riffBytes, including the indexes it still has to take
+    uint64_t indexes = 8 + 24 + 8*(entries.size() + 1) + 8 + sizeof(aviStampHeader) + sizeof(aviStampEntry)*(entries.size() + 1);
+    if (firstRiff) indexes += 8 + 16*(legacy.size()/2 + 1);
+    bool riffFull = end > moviList + 12 && end - riffStart + 9 + size + indexes > cfg.riffBytes;
+
+    // super index slots taken once the pending entries are flushed; when they run out, continue in the next file
+    uint32_t slots = superCount + (entries.empty() ? 0 : 1);
+    if (slots >= static_cast<uint32_t>(cfg.maxIndexChunks) && (riffFull || superCount >= slots)) {
+        close_file();
+        fileNum++;
+        if (!open_file()) return false;
+    }
+    else if (riffFull) next_riff();
+
+    uint64_t chunk = end;
+    if (!write_chunk(AVI_VIDEO, jpeg, size)) return false;
+
+    indexEntry e = { chunk + 8, size, framenum, timestamp };
+    entries.push_back(e);
+    if (firstRiff) {
+        legacy.push_back(static_cast<uint32_t>(chunk - (moviList + 8)));
+        legacy.push_back(size);
+        riffFrames++;
+    }
+    fileFrames++;
+    maxChunk = std::max(maxChunk, size);
+
+    if (static_cast<int>(entries.size()) >= index_frames()) flush_index();
+    return true;
+}
+
+bool mjpegWriter::flush_index()
+{
+    if (entries.empty() || fd < 0) return true;
+    const uint32_t n = static_cast<uint32_t>(entries.size());
+
+    // standard index of the chunks since the last flush, relative to this RIFF
+    std::vector<unsigned char> ix;
+    ix.reserve(24 + 8*n);
+    put16(ix, 2);                                               // longs per entry
+    ix.push_back(0);                                            // sub type
+    ix.push_back(1);                                            // AVI_INDEX_OF_CHUNKS
+    put32(ix, n);
+    put32(ix, AVI_VIDEO);
+    put64(ix, riffStart);
+    put32(ix, 0);
+    for (uint32_t i = 0; i < n; i++) {
+        put32(ix, static_cast<uint32_t>(entries[i].offset - riffStart));
+        put32(ix, entries[i].size);                             // bit 31 clear: key frame
+    }
+
+    std::vector<unsigned char> stamps;
+    stamps.reserve(sizeof(aviStampHeader) + n*sizeof(aviStampEntry));
+    stamps.insert(stamps.end(), "TSTAMP01", "TSTAMP01" + 8);
+    put32(stamps, n);
+    put32(stamps, 0);
+    for (uint32_t i = 0; i < n; i++) {
+        put64(stamps, static_cast<uint64_t>(entries[i].framenum));
+        uint64_t t;
+        std::memcpy(&t, &entries[i].timestamp, sizeof(t));
+        put64(stamps, t);
+    }
+
+    uint64_t ixPos = end;
+    bool ok = write_chunk(AVI_STD_INDEX, ix.data(), static_cast<uint32_t>(ix.size())) &&
+              write_chunk(AVI_JUNK, stamps.data(), static_cast<uint32_t>(stamps.size()));
+    entries.clear();
+    if (!ok) return false;
+
+    // the index reaches the disk before any header points at it
+    if (cfg.sync) ::fdatasync(fd);
+
+    std::vector<unsigned char> entry;
+    put64(entry, ixPos);
+    put32(entry, static_cast<uint32_t>(ix.size() + 8));
+    put32(entry, n);
+    patch(indxEntries + 16*superCount, entry.data(), entry.size());
+    superCount++;
+    patch_headers(end);
+    return true;
+}
+
+void mjpegWriter::patch_headers(uint64_t movi_end)
+{
+    uint32_t v = riffFrames;
+    patch(avihFrames, &v, 4);
+    v = fileFrames;
+    patch(strhLength, &v, 4);
+    patch(dmlhFrames, &v, 4);
+    v = maxChunk;
+    patch(avihBuffer, &v, 4);
+    patch(strhBuffer, &v, 4);
+    v = superCount;
+    patch(indxCount, &v, 4);
+    v = static_cast<uint32_t>(end - riffStart - 8);
+    patch(riffStart + 4, &v, 4);
+    v = static_cast<uint32_t>(movi_end - moviList - 8);
+    patch(moviList + 4, &v, 4);
+}
+
+void mjpegWriter::write_legacy_index()
+{
+    // AVI 1.0 index of the first RIFF, for players that do not read OpenDML
+    uint64_t moviEnd = end;
+    std::vector<unsigned char> idx;
+    idx.reserve(legacy.size()*8);
+    for (size_t i = 0; i + 1 < legacy.size(); i += 2) {
+        put32(idx, AVI_VIDEO);
+        put32(idx, legacy[i + 1] ? 0x10 : 0);                   // AVIIF_KEYFRAME
+        put32(idx, legacy[i]);
+        put32(idx, legacy[i + 1]);
+    }
+    write_chunk(AVI_IDX1, idx.data(), static_cast<uint32_t>(idx.size()));
+    legacy.clear();
+    patch_headers(moviEnd);
+}
+
+void mjpegWriter::next_riff()
+{
+    // close this RIFF and continue the movie in an AVIX extension
+    flush_index();
+    if (firstRiff) write_legacy_index();
+    else patch_headers(end);
+    firstRiff = false;
+
+    uint32_t head[6] = { AVI_RIFF, 16, AVI_FORM_EXT, AVI_LIST, 4, AVI_MOVI };
+    riffStart = end;
+    moviList = riffStart + 12;
+    write_all(head, sizeof(head));
+}
+
+void mjpegWriter::close_file()
+{
+    if (fd < 0) return;
+    flush_index();
+    if (firstRiff) write_legacy_index();
+    else patch_headers(end);
+    if (cfg.sync) ::fdatasync(fd);
+    ::close(fd);
+    fd = -1;
+}
+
+void mjpegWriter::close()
+{
+    boost::mutex::scoped_lock guard(lock);
+    if (fd < 0) return;
+
+    // frames still waiting for a predecessor go out in order
+    for (std::map<int64_t, heldFrame>::iterator it = held.begin(); it != held.end(); ++it)
+        emit(it->first, it->second.jpeg.data(), it->second.jpeg.size(), it->second.timestamp);
+    held.clear();
+    spare.clear();
+
+    close_file();
+    next = -1;
+    if (late > 0) std::cout << "Colour container: " << late << " frames arrived too late to be stored" << std::endl;
+    if (writeErrors > 0) std::cerr << "Error: " << writeErrors << " colour container writes failed" << std::endl;
+}
@@ -0,0 +1,195 @@
+/* mjpegwriter.h
+ *
+ * Description:
+ *   header file for mjpegWriter class and the colour container layout
+ *   Single-file colour stream: encoded JPEG frames are appended to one
+ *   MJPEG-in-AVI file per session instead of one .jpg per frame, so a session
+ *   is a handful of files rather than hundreds of thousands, and any video
+ *   player or ffmpeg can open and seek it directly.
+ *
+ *   The file is OpenDML (AVI 2.0) so it is not limited to 1 GB:
+ *     RIFF 'AVI '
+ *       LIST 'hdrl'  avih, LIST 'strl' (strh vids/MJPG, strf, indx), LIST 'odml' (dmlh)
+ *       LIST 'movi'  '00dc' chunks (one JPEG each), every indexSeconds:
+ *                    'ix00' standard index + 'JUNK' timestamp table
+ *       idx1         (legacy index of this RIFF, written when it is closed)
+ *     RIFF 'AVIX'
+ *       LIST 'movi'  ...                       (every riffBytes)
+ *   After each index flush the data is synced, then the super index (indx),
+ *   frame counts and RIFF/LIST sizes in the headers are patched in place, so a
+ *   crash loses at most the frames since the last flush. Players skip JUNK;
+ *   the timestamp table (TSTAMP01: count, then frame number and ms per index
+ *   entry) keeps the exact frame numbers and capture times for sessionReader.
+ *   Gaps in the frame numbering become empty '00dc' chunks so the nominal
+ *   frame rate keeps playback timing; a file whose super index is full is
+ *   continued in <prefix>_NNNN.avi.
+ *   Encode workers finish out of order: up to reorderFrames frames are held
+ *   back and written in frame-number order. Frames arriving later are dropped
+ *   and counted.
+ *
+ * Functions:
+ *   open - creates the first container file in a directory
+ *   append - adds one JPEG frame; true once it is written or held back for reordering
+ *   on_emit - handler told (under the writer lock) whether each frame reached the file
+ *   close - writes held frames, the last index and the legacy index, syncs the file
+ *   frame_count/late_frames/write_errors - counters
+ *
+ * Input:
+ *   directory, file prefix, frame size, mjpegConfig (nominal rate, index interval)
+ *   JPEG bytes, frame number, timestamp (ms)
+ *
+ * Output:
+ *   <prefix>_NNNN.avi files
+ *
+ * Requirements:
+ *   boost/filesystem
+ *   boost/thread
+ *   POSIX file I/O (pwrite, writev, fdatasync)
+ *
+ * Thread safe? YES (append is serialised internally)
+ *
+ * Extendable? YES
+ */
+
+#ifndef MJPEGWRITER_H
+#define MJPEGWRITER_H
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// chunk identifiers (little endian ASCII)
+const uint32_t AVI_RIFF = 0x46464952;           // "RIFF"
+const uint32_t AVI_LIST = 0x5453494c;           // "LIST"
+const uint32_t AVI_FORM = 0x20495641;           // "AVI "
+const uint32_t AVI_FORM_EXT = 0x58495641;       // "AVIX"
+const uint32_t AVI_MOVI = 0x69766f6d;           // "movi"
+const uint32_t AVI_AVIH = 0x68697661;           // "avih"
+const uint32_t AVI_STRH = 0x68727473;           // "strh"
+const uint32_t AVI_INDX = 0x78646e69;           // "indx"
+const uint32_t AVI_VIDEO = 0x63643030;          // "00dc"
+const uint32_t AVI_STD_INDEX = 0x30307869;      // "ix00"
+const uint32_t AVI_IDX1 = 0x31786469;           // "idx1"
+const uint32_t AVI_JUNK = 0x4b4e554a;           // "JUNK"
+
+// timestamp table at the start of the JUNK chunk after each ix00
+struct aviStampHeader
+{
+    char magic[8];              // "TSTAMP01"
+    uint32_t count;             // entries, same order as the ix00 before it
+    uint32_t reserved;
+};
+
+struct aviStampEntry
+{
+    int64_t framenum;           // -1 for gap fillers
+    double timestamp;           // ms
+};
+
+struct mjpegConfig
+{
+    double fps = 30.0;                  // nominal rate in the headers
+    double indexSeconds = 2.0;          // between index flushes: what a crash can lose
+    int maxIndexChunks = 4096;          // super index entries reserved; a new file starts when they run out
+    int reorderFrames = 8;              // frames held back to restore frame-number order
+    int maxGapFrames = 300;             // longest gap filled with empty frames
+    uint64_t riffBytes = 1ull << 30;    // RIFF size before continuing in an AVIX list
+    bool sync = true;                   // fdatasync before the headers point at a new index
+};
+
+class mjpegWriter
+{
+    struct indexEntry
+    {
+        uint64_t offset;                // of the frame data in the file
+        uint32_t size;
+        int64_t framenum;
+        double timestamp;
+    };
+
+    struct heldFrame
+    {
+        std::vector<unsigned char> jpeg;
+        double timestamp;
+    };
+
+    boost::filesystem::path dir;
+    std::string prefix;
+    mjpegConfig cfg;
+    int width;
+    int height;
+
+    int fd;
+    uint32_t fileNum;
+    uint64_t end;                       // append position
+    uint64_t riffStart;                 // current RIFF
+    uint64_t moviList;                  // current LIST 'movi'
+    bool firstRiff;                     // idx1 only covers the first RIFF
+
+    // header fields patched at every index flush
+    uint64_t avihFrames;
+    uint64_t avihBuffer;
+    uint64_t strhLength;
+    uint64_t strhBuffer;
+    uint64_t indxCount;
+    uint64_t indxEntries;
+    uint64_t dmlhFrames;
+
+    uint32_t superCount;
+    uint32_t riffFrames;                // chunks in the first RIFF
+    uint32_t fileFrames;                // chunks in this file
+    uint32_t maxChunk;
+    std::vector<indexEntry> entries;    // since the last index flush
+    std::vector<uint32_t> legacy;       // idx1 of the first RIFF: offset from 'movi', size
+
+    int64_t next;                       // frame number expected next, -1 before the first
+    std::map<int64_t, heldFrame> held;
+    std::vector< std::vector<unsigned char> > spare;
+
+    long long frames;
+    long long late;
+    long long fillers;
+    long long writeErrors;
+
+    std::function<void(int64_t, bool)> emitted;    // frame number, written
+
+    boost::mutex lock;
+
+    bool open_file();
+    void close_file();
+    bool write_all(const void* data, size_t n);
+    bool patch(uint64_t at, const void* data, size_t n);
+    bool write_chunk(uint32_t id, const void* data, uint32_t size);
+    bool put_frame(const unsigned char* jpeg, uint32_t size, int64_t framenum, double timestamp);
+    void emit(int64_t framenum, const unsigned char* jpeg, size_t size, double timestamp);
+    bool flush_index();
+    void write_legacy_index();
+    void patch_headers(uint64_t movi_end);
+    void next_riff();
+    int index_frames() const;
+
+public:
+    mjpegWriter();
+    ~mjpegWriter();
+
+    bool open(boost::filesystem::path m_dir, std::string m_prefix, int m_width, int m_height,
+              const mjpegConfig& m_cfg = mjpegConfig());
+    bool append(const unsigned char* jpeg, size_t size, int64_t framenum, double timestamp);
+    void close();
+    void on_emit(const std::function<void(int64_t, bool)>& handler) { emitted = handler; }
+
+    bool is_open() const { return fd >= 0; }
+    long long frame_count() const { return frames; }
+    long long late_frames() const { return late; }
+    long long gap_frames() const { return fillers; }
+    long long write_errors() const { return writeErrors; }
+
+    static std::string file_name(const std::string& m_prefix, uint32_t num);
+};
+
+#endif // MJPEGWRITER_H
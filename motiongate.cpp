@@ -0,0 +1,159 @@
+#include "motiongate.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+motionGate::motionGate(const motionGateConfig& m_cfg) : cfg(m_cfg), n_openings(0)
+{
+    cfg.block = std::max(16, cfg.block/16*16);
+    cfg.rowStep = std::max(1, cfg.rowStep);
+    reset();
+}
+
+void motionGate::reset()
+{
+    irWidth = irHeight = depthWidth = depthHeight = 0;
+    refTime = 0.0;
+    gateOpen = false;
+    above = 0;
+    lastActivity = 0.0;
+    activeBlocks = 0;
+}
+
+int motionGate::ir_blocks(const uint8_t* ir, int width, int height)
+{
+    const int bs = cfg.block;
+    const int cols = width/bs;
+    const uint32_t samples = static_cast<uint32_t>(bs)*((bs + cfg.rowStep - 1)/cfg.rowStep);
+    const uint32_t limit = static_cast<uint32_t>(cfg.irThreshold*samples);
+    int active = 0;
+
+    sums.resize(cols);
+    for (int by = 0; by + bs <= height; by += bs) {
+        std::fill(sums.begin(), sums.end(), 0);
+        for (int y = by; y < by + bs; y += cfg.rowStep) {
+            const uint8_t* cur = ir + static_cast<size_t>(y)*width;
+            const uint8_t* ref = refIr.data() + static_cast<size_t>(y)*width;
+            for (int bx = 0; bx < cols; bx++) {
+                const int x0 = bx*bs;
+#if defined(__SSE2__)
+                __m128i sad = _mm_setzero_si128();
+                for (int x = x0; x < x0 + bs; x += 16)
+                    sad = _mm_add_epi64(sad, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + x)),
+                                                          _mm_loadu_si128(reinterpret_cast<const __m128i*>(ref + x))));
+                sums[bx] += static_cast<uint32_t>(_mm_cvtsi128_si32(sad) + _mm_cvtsi128_si32(_mm_srli_si128(sad, 8)));
+#else
+                uint32_t sad = 0;
+                for (int x = x0; x < x0 + bs; x++) sad += cur[x] > ref[x] ? cur[x] - ref[x] : ref[x] - cur[x];
+                sums[bx] += sad;
+#endif
+            }
+        }
+        for (int bx = 0; bx < cols; bx++)
+            if (sums[bx] > limit) active++;
+    }
+    return active;
+}
+
+int motionGate::depth_blocks(const uint16_t* depth, int width, int height)
+{
+    const int bs = cfg.block;
+    const int cols = width/bs;
+    const uint32_t samples = static_cast<uint32_t>(bs)*((bs + cfg.rowStep - 1)/cfg.rowStep);
+    int active = 0;
+
+    sums.resize(cols);
+    counts.resize(cols);
+    for (int by = 0; by + bs <= height; by += bs) {
+        std::fill(sums.begin(), sums.end(), 0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (int y = by; y < by + bs; y += cfg.rowStep) {
+            const uint16_t* cur = depth + static_cast<size_t>(y)*width;
+            const uint16_t* ref = refDepth.data() + static_cast<size_t>(y)*width;
+            for (int bx = 0; bx < cols; bx++) {
+                const int x0 = bx*bs;
+#if defined(__SSE2__)
+                // |a - b| from two saturating subtractions; pixels with no data in either frame are left out
+                const __m128i zero = _mm_setzero_si128();
+                __m128i sum = zero;             // 4 x u32
+                __m128i valid = zero;           // 8 x u16, negative counts
+                for (int x = x0; x < x0 + bs; x += 8) {
+                    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur + x));
+                    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ref + x));
+                    __m128i none = _mm_or_si128(_mm_cmpeq_epi16(a, zero), _mm_cmpeq_epi16(b, zero));
+                    __m128i diff = _mm_andnot_si128(none, _mm_or_si128(_mm_subs_epu16(a, b), _mm_subs_epu16(b, a)));
+                    sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_unpacklo_epi16(diff, zero), _mm_unpackhi_epi16(diff, zero)));
+                    valid = _mm_sub_epi16(valid, _mm_andnot_si128(none, _mm_set1_epi16(-1)));
+                }
+                uint32_t s[4];
+                uint16_t c[8];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(s), sum);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(c), valid);
+                sums[bx] += s[0] + s[1] + s[2] + s[3];
+                counts[bx] += static_cast<uint32_t>(c[0]) + c[1] + c[2] + c[3] + c[4] + c[5] + c[6] + c[7];
+#else
+                for (int x = x0; x < x0 + bs; x++) {
+                    if (!cur[x] || !ref[x]) continue;
+                    sums[bx] += cur[x] > ref[x] ? cur[x] - ref[x] : ref[x] - cur[x];
+                    counts[bx]++;
+                }
+#endif
+            }
+        }
+        for (int bx = 0; bx < cols; bx++)
+            if (counts[bx]*4 >= samples && sums[bx] > cfg.depthThreshold*counts[bx]) active++;
+    }
+    return active;
+}
+
+bool motionGate::update(const frameSet& frames)
+{
+    const sourceFrame& ir = frames.ir;
+    const sourceFrame& depth = frames.depth;
+    bool useIr = cfg.useIr && ir.valid();
+    bool useDepth = cfg.useDepth && depth.valid();
+    double now = depth.valid() && depth.arrival > 0.0 ? depth.arrival : host_ms();
+
+    // a new size (or the first frame) only sets the reference
+    bool fresh = refTime <= 0.0 || (useIr && (ir.width != irWidth || ir.height != irHeight))
+                 || (useDepth && (depth.width != depthWidth || depth.height != depthHeight));
+    activeBlocks = 0;
+    if (!fresh) {
+        if (useIr) activeBlocks = ir_blocks(static_cast<const uint8_t*>(ir.data), ir.width, ir.height);
+        if (useDepth) activeBlocks = std::max(activeBlocks, depth_blocks(static_cast<const uint16_t*>(depth.data), depth.width, depth.height));
+    }
+
+    if (fresh || now - refTime >= cfg.referenceMs) {
+        if (useIr) {
+            refIr.assign(static_cast<const uint8_t*>(ir.data), static_cast<const uint8_t*>(ir.data) + static_cast<size_t>(ir.width)*ir.height);
+            irWidth = ir.width;
+            irHeight = ir.height;
+        }
+        if (useDepth) {
+            const uint16_t* z = static_cast<const uint16_t*>(depth.data);
+            refDepth.assign(z, z + static_cast<size_t>(depth.width)*depth.height);
+            depthWidth = depth.width;
+            depthHeight = depth.height;
+        }
+        refTime = now;
+    }
+
+    if (!gateOpen) {
+        above = activeBlocks >= cfg.startBlocks ? above + 1 : 0;
+        if (above >= cfg.startFrames) {
+            gateOpen = true;
+            lastActivity = now;
+            n_openings++;
+        }
+    }
+    else if (activeBlocks >= cfg.stopBlocks) lastActivity = now;
+    else if (now - lastActivity >= cfg.postRollMs) {
+        gateOpen = false;
+        above = 0;
+    }
+    return gateOpen;
+}
@@ -0,0 +1,100 @@
+/* motiongate.h
+ *
+ * Description:
+ *   header file for motionGate class
+ *   Cheap change detector for motion-gated recording: during long runs most
+ *   framesets show an empty arena, and only those with activity need to be
+ *   stored. The IR and depth frames are compared with a reference frame in
+ *   blocks of `block` x `block` pixels, reading every rowStep-th row (the
+ *   downsampling). Each block gets the mean absolute difference of its
+ *   sampled pixels. IR uses SSE2 psadbw, 16 pixels per instruction. Depth
+ *   only counts pixels valid in both frames, 8 at a time, and a block needs a
+ *   quarter of its samples valid. A block is active above irThreshold or
+ *   depthThreshold. Counting active blocks keeps one moving termite visible
+ *   even though the rest of the frame is noise; of IR and depth, the stream
+ *   with more active blocks counts.
+ *   The reference is refreshed every referenceMs, so slow drift (lighting,
+ *   auto exposure) and things that moved and stopped drop out after a while.
+ *
+ *   Hysteresis: the gate opens when startBlocks or more blocks are active in
+ *   startFrames consecutive framesets. It stays open while at least
+ *   stopBlocks are active, and closes postRollMs after the last such
+ *   frameset. Pre-roll is the pre-trigger history (pretrigger.h): opening the
+ *   gate is a recording start, so the last seconds before it are recorded too.
+ *
+ * Functions:
+ *   update - compares a frameset with the reference, returns whether the gate is open
+ *   open - gate state
+ *   active_blocks - active blocks of the last frameset
+ *   openings - how often the gate opened
+ *   reset - closes the gate and forgets the reference
+ *
+ * Input:
+ *   motionGateConfig, framesets (Y8 IR, Z16 depth)
+ *
+ * Output:
+ *   gate state
+ *
+ * Requirements:
+ *   framesource.h; SSE2 (x86 baseline, scalar elsewhere)
+ *
+ * Thread safe? NO (one per capture thread)
+ *
+ * Extendable? YES
+ */
+
+#ifndef MOTIONGATE_H
+#define MOTIONGATE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "framesource.h"
+
+struct motionGateConfig
+{
+    bool useIr = true;
+    bool useDepth = true;
+    int block = 16;                     // block size, pixels (rounded down to a multiple of 16)
+    int rowStep = 2;                    // every rowStep-th row is compared
+    float irThreshold = 6.0f;           // mean absolute IR difference of an active block, grey levels
+    float depthThreshold = 30.0f;       // mean absolute depth difference of an active block, Z16 units
+    int startBlocks = 2;                // active blocks that open the gate ...
+    int startFrames = 2;                // ... in this many framesets in a row
+    int stopBlocks = 1;                 // active blocks that keep it open
+    double postRollMs = 3000.0;         // open this long after the last activity
+    double referenceMs = 1000.0;        // reference frame refresh
+};
+
+class motionGate
+{
+    motionGateConfig cfg;
+    std::vector<uint8_t> refIr;
+    std::vector<uint16_t> refDepth;
+    int irWidth, irHeight;
+    int depthWidth, depthHeight;
+    double refTime;
+
+    bool gateOpen;
+    int above;                          // framesets in a row with startBlocks active
+    double lastActivity;
+    int activeBlocks;
+    long long n_openings;
+
+    std::vector<uint32_t> sums;         // per block column of the block row being compared
+    std::vector<uint32_t> counts;
+
+    int ir_blocks(const uint8_t* ir, int width, int height);
+    int depth_blocks(const uint16_t* depth, int width, int height);
+
+public:
+    explicit motionGate(const motionGateConfig& m_cfg = motionGateConfig());
+
+    bool update(const frameSet& frames);
+    bool open() const { return gateOpen; }
+    int active_blocks() const { return activeBlocks; }
+    long long openings() const { return n_openings; }
+    void reset();
+};
+
+#endif // MOTIONGATE_H
@@ -0,0 +1,261 @@
+#include "multicapture.h"
+
+#include <boost/filesystem/fstream.hpp>
+
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+namespace bfs = boost::filesystem;
+
+multiCapture::multiCapture(recordPipeline& r_recorder, const captureConfig& c_cfg)
+    : cfg(c_cfg), recorder(r_recorder), viewer(c_cfg.preview), quit(false), recording(false),
+      motionGated(c_cfg.motionGated), previewWanted(-1)
+{
+}
+
+multiCapture::~multiCapture()
+{
+    stop();
+}
+
+int multiCapture::add_device(frameSource* source)
+{
+    std::unique_ptr<deviceCapture> d(new deviceCapture);
+    d->index = static_cast<int>(devices.size());
+    d->source = source;
+    d->framenum = cfg.firstFrame;
+    devices.push_back(std::move(d));
+    return devices.back()->index;
+}
+
+void multiCapture::start()
+{
+    quit = false;
+    for (auto& d : devices) {
+        // one camera keeps the flat session layout
+        if (devices.size() > 1) {
+            std::string sub = "cam" + std::to_string(d->index);
+            d->colPath = cfg.colPath / sub;
+            d->depthPath = cfg.depthPath / sub;
+        }
+        else {
+            d->colPath = cfg.colPath;
+            d->depthPath = cfg.depthPath;
+        }
+        try {
+            bfs::create_directories(d->colPath);
+            bfs::create_directories(d->depthPath);
+        }
+        catch (bfs::filesystem_error& e) {
+            std::cerr << e.what() << std::endl;
+        }
+        if (cfg.burst.ring.budgetBytes > 0) d->burst.reset(new burstRecorder(recorder, cfg.burst, d->index));
+        if (cfg.preTrigger.ring.budgetBytes > 0) d->history.reset(new preTrigger(recorder, cfg.preTrigger, d->index));
+        d->gate = motionGate(cfg.motion);
+    }
+    viewer.start();
+    for (auto& d : devices)
+        d->thread = boost::thread(&multiCapture::capture_loop, this, d.get());
+}
+
+void multiCapture::stop()
+{
+    if (quit.exchange(true)) return;
+    recording = false;
+    for (auto& d : devices)
+        if (d->thread.joinable()) d->thread.join();
+    viewer.stop();
+
+    // everything a burst or a triggered recording captured goes to the recorder before it is stopped
+    for (auto& d : devices) {
+        if (d->burst) {
+            d->burst->end();
+            d->burst->wait();
+        }
+        if (d->history) {
+            d->history->release();
+            d->history->wait();
+        }
+    }
+
+    for (auto& d : devices) {
+        std::cout << "Camera " << d->index << " (" << d->source->name() << "): "
+                  << d->recorded << " framesets recorded" << std::endl;
+        if (d->gate.openings() || d->gatedOut)
+            std::cout << "Camera " << d->index << ": motion gate opened " << d->gate.openings() << " times, "
+                      << d->gatedOut << " framesets without activity not stored" << std::endl;
+        d->tracker.print(std::cout);
+        d->tracker.write_summary(d->depthPath / "frame_summary.csv");
+    }
+    if (devices.size() > 1) {
+        print(std::cout);
+        write_summary(cfg.depthPath / "device_sync.csv");
+    }
+}
+
+bool multiCapture::running() const
+{
+    for (auto& d : devices)
+        if (!d->finished) return true;
+    return false;
+}
+
+void multiCapture::request_snapshot()
+{
+    for (auto& d : devices) d->snapshot = true;
+}
+
+void multiCapture::request_burst()
+{
+    for (auto& d : devices)
+        if (d->burst) d->burstRequest = true;
+}
+
+bool multiCapture::burst_active() const
+{
+    for (auto& d : devices)
+        if (d->burst && (d->burst->active() || d->burst->draining() || d->burstRequest)) return true;
+    return false;
+}
+
+void multiCapture::capture_loop(deviceCapture* d)
+{
+    frameSet frames;
+    try {
+        while (!quit) {
+            if (!d->source->wait_for_frames(frames)) break;
+
+            frameFreshness fresh = d->tracker.observe(frames);
+            if (!fresh.any()) continue;      // loop outran the camera
+
+            // depth carries the camera clock; the other streams share its offset
+            if (frames.depth.valid() && fresh.depth)
+                d->clock.align(frames.depth.timestamp, frames.depth.arrival);
+            sourceFrame* all[4] = { &frames.colour, &frames.depth, &frames.ir, &frames.ir2 };
+            for (int i = 0; i < 4; i++)
+                if (all[i]->valid()) all[i]->aligned = d->clock.to_host(all[i]->timestamp);
+
+            if (frames.depth.valid() && fresh.depth) {
+                d->latestAligned = frames.depth.aligned;
+                double ref = devices[0]->latestAligned;
+                if (d->index > 0 && ref > 0.0) {
+                    double phase = std::fabs(frames.depth.aligned - ref);
+                    if (phase < 1000.0) d->phase.record(static_cast<uint64_t>(phase*1000.0));
+                }
+            }
+
+            // burst: raw framesets into RAM at the full rate, numbered on from the recording
+            bool bursting = false;
+            bool history = d->history && d->history->prepare(frames);
+            if (d->burst) {
+                // the burst ring is only allocated when the first burst is asked for
+                if (d->burstRequest.exchange(false) && !recording &&
+                    d->burst->begin(frames, d->colPath, d->depthPath, d->framenum) && history)
+                    d->history->discard();      // the burst records these frames itself
+                if (d->burst->active() && d->burst->push(frames, fresh)) {
+                    d->framenum++;
+                    d->recorded++;
+                    bursting = true;
+                }
+            }
+
+            // motion gate: while recording, only framesets with activity are stored
+            bool gated = recording && motionGated;
+            if (gated && (fresh.ir || fresh.depth)) d->gate.update(frames);
+            else if (!gated && d->gate.open()) d->gate.reset();
+            bool rec = recording && !bursting && (!gated || d->gate.open());
+            if (recording && !bursting && !rec) d->gatedOut++;
+
+            // pre-trigger: the buffered history is numbered ahead of the first live frame
+            if (history && rec && !d->history->triggered()) {
+                int held = d->history->trigger(d->colPath, d->depthPath, d->framenum);
+                d->framenum += held;
+                d->recorded += held;
+            }
+            else if (history && !rec && !bursting && d->history->triggered()) d->history->release();
+
+            double now = host_ms();
+            bool due = cfg.intervalMs <= 0.0 || now - d->lastRecorded >= cfg.intervalMs;
+            if (rec && due) {
+                // live frames queue behind the history until it has been handed over
+                bool queued = true;
+                if (history && d->history->handing()) queued = d->history->push(frames, fresh);
+                else recorder.submit_frameset(frames, fresh, d->colPath, d->depthPath, d->framenum, d->index);
+                if (queued) {
+                    d->framenum++;
+                    d->recorded++;
+                }
+                d->lastRecorded = now;
+            }
+            else if (!rec && !bursting) {
+                if (history && due) {
+                    d->history->push(frames, fresh);
+                    d->lastRecorded = now;
+                }
+                if (d->snapshot.exchange(false)) store_snapshot(d, frames);
+            }
+
+            if (previewWanted == d->index) viewer.offer(d->index, frames);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Camera " << d->index << " capture stopped: " << e.what() << std::endl;
+    }
+    d->finished = true;
+}
+
+void multiCapture::store_snapshot(deviceCapture* d, const frameSet& frames)
+{
+    if (!frames.depth.valid()) return;
+
+    std::string num = std::to_string(d->snapshots++);
+    if (frames.colour.valid())
+        recorder.submit_snapshot(streamType::colour, frames.colour.data, frames.colour.width, frames.colour.height,
+                                 d->colPath, "ColSnap_" + num + ".jpg", d->index);
+    recorder.submit_snapshot(streamType::depth, frames.depth.data, frames.depth.width, frames.depth.height,
+                             d->depthPath, "DepthSnap_" + num + ".dat", d->index);
+    if (frames.ir.valid())
+        recorder.submit_snapshot(streamType::infrared, frames.ir.data, frames.ir.width, frames.ir.height,
+                                 d->depthPath, "IRSnap_" + num + ".dat", d->index);
+
+    // viewable thumbnail: colour-mapped depth over this frame's own range, JPEG through the colour stream
+    if (frames.colour.valid()) {
+        d->snapshotView.reset();
+        if (d->snapshotView.colour_depth(static_cast<const uint16_t*>(frames.depth.data), frames.depth.width,
+                                         frames.depth.height, d->snapshotRgb))
+            recorder.submit_snapshot(streamType::colour, d->snapshotRgb.data(), frames.depth.width, frames.depth.height,
+                                     d->depthPath, "DepthView_" + num + ".jpg", d->index);
+    }
+
+    std::cout << "Camera " << d->index << ": snapshot " << num << " stored" << std::endl;
+}
+
+bool multiCapture::preview(int device, previewFrames& out)
+{
+    if (device < 0 || device >= device_count()) return false;
+    previewWanted = device;
+    return viewer.take(device, out);
+}
+
+void multiCapture::print(std::ostream& os) const
+{
+    for (auto& d : devices) {
+        if (d->index == 0) continue;
+        os << "Camera " << d->index << " phase to camera 0 (us): p50 " << d->phase.percentile(50)
+           << ", p99 " << d->phase.percentile(99) << ", max " << d->phase.max() << std::endl;
+    }
+}
+
+bool multiCapture::write_summary(const bfs::path& file) const
+{
+    bfs::ofstream out(file);
+    if (!out) return false;
+
+    out << "camera,source,recorded,duplicates,missing,clock_offset_ms,phase_us_p50,phase_us_p99,phase_us_max" << std::endl;
+    for (auto& d : devices)
+        out << d->index << ',' << d->source->name() << ',' << d->recorded << ',' << d->tracker.duplicates() << ','
+            << d->tracker.missing() << ',' << d->clock.offset() << ',' << d->phase.percentile(50) << ','
+            << d->phase.percentile(99) << ',' << d->phase.max() << std::endl;
+    return true;
+}
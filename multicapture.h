@@ -0,0 +1,164 @@
+/* multicapture.h
+ *
+ * Description:
+ *   header file for multiCapture class
+ *   Runs one capture thread per camera, so several cameras record at once
+ *   without sharing one blocking wait_for_frames loop. Each thread takes
+ *   framesets from its frameSource, skips repeated frames (frameTracker),
+ *   maps the hardware timestamps onto the host clock (clockAligner) and hands
+ *   new frames to a shared recordPipeline under its own device index, so every
+ *   camera has its own frame pools while encode and write workers are shared.
+ *   With more than one camera each records into a camN subfolder of the
+ *   session folders; a single camera keeps the flat D_N / RGB_N layout.
+ *   The phase between each camera and camera 0 is kept as a histogram.
+ *   The camera on display offers its framesets to a previewStage, which
+ *   downscales them on its own thread; the display takes them with preview().
+ *   With a burst budget, every camera also keeps a burstRecorder: a burst
+ *   captures raw framesets into RAM at the full rate and drains them to the
+ *   recorder in the background (burstrecorder.h).
+ *   With a pre-trigger budget, the last seconds before recording starts are
+ *   kept in RAM and recorded ahead of the live frames (pretrigger.h).
+ *   Motion-gated recording: while recording is on, a motionGate per camera
+ *   decides which framesets are stored; with the gate closed nothing is
+ *   queued for encoding. Each opening of the gate starts the recording again,
+ *   pre-trigger history (the pre-roll) first (motiongate.h).
+ *
+ * Functions:
+ *   add_device - adds a started frameSource (call before start)
+ *   start - launches the capture threads
+ *   set_recording - starts/stops storing framesets on every camera
+ *   set_motion_gated - stores only framesets with activity while recording
+ *   request_snapshot - every camera stores its next frameset as snapshot files
+ *                      (plus a colour-mapped depth JPEG, DepthView_N.jpg)
+ *   request_burst - every camera starts a burst (if not recording)
+ *   burst_active - a burst is capturing or still draining
+ *   preview - newest downscaled frameset of one camera, if there is a new one
+ *   running - false once every capture thread has ended (sources exhausted)
+ *   stop - joins the capture threads and writes the per-camera summaries
+ *
+ * Input:
+ *   captureConfig (session folders, recording interval, preview rate), frameSources, recordPipeline
+ *
+ * Output:
+ *   framesets to the recordPipeline, frame_summary.csv per camera, device_sync.csv
+ *
+ * Requirements:
+ *   boost/thread
+ *   boost/filesystem
+ *
+ * Thread safe? YES (control functions from the display thread)
+ *
+ * Extendable? YES
+ */
+
+#ifndef MULTICAPTURE_H
+#define MULTICAPTURE_H
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "framesource.h"
+#include "frametracker.h"
+#include "clockaligner.h"
+#include "latencyhistogram.h"
+#include "recordpipeline.h"
+#include "burstrecorder.h"
+#include "pretrigger.h"
+#include "motiongate.h"
+#include "previewstage.h"
+
+struct captureConfig
+{
+    boost::filesystem::path colPath;        // session folders (RGB_N, D_N)
+    boost::filesystem::path depthPath;
+    double intervalMs = 0.0;                // store at most one frameset per interval (0: every new frameset)
+    int firstFrame = 1000000;               // file numbering per camera
+    burstConfig burst;                      // per camera; budget 0 disables burst mode
+    preTriggerConfig preTrigger;            // per camera; budget 0 disables the pre-trigger history
+    motionGateConfig motion;                // per camera, used while motion-gated
+    bool motionGated = false;               // start in motion-gated mode
+    previewConfig preview;                  // display rate and size
+};
+
+class multiCapture
+{
+    struct deviceCapture
+    {
+        int index;
+        frameSource* source;
+        boost::filesystem::path colPath;
+        boost::filesystem::path depthPath;
+
+        frameTracker tracker;
+        clockAligner clock;
+        latencyHistogram phase;             // |aligned depth time - camera 0|, us
+        int framenum;
+        int snapshots;
+        frameVisualiser snapshotView;
+        std::vector<uint8_t> snapshotRgb;
+        long long recorded;
+        double lastRecorded;
+        motionGate gate;
+        long long gatedOut;                 // framesets left out by the closed gate
+
+        std::atomic<bool> snapshot;
+        std::atomic<bool> burstRequest;
+        std::unique_ptr<burstRecorder> burst;
+        std::unique_ptr<preTrigger> history;
+        std::atomic<bool> finished;
+        std::atomic<double> latestAligned;  // aligned depth timestamp of the newest frameset
+
+        boost::thread thread;
+
+        deviceCapture() : index(0), source(0), framenum(0), snapshots(0), recorded(0), lastRecorded(0.0), gatedOut(0),
+            snapshot(false), burstRequest(false), finished(false), latestAligned(0.0) {}
+    };
+
+    captureConfig cfg;
+    recordPipeline& recorder;
+    std::vector< std::unique_ptr<deviceCapture> > devices;
+    previewStage viewer;
+
+    std::atomic<bool> quit;
+    std::atomic<bool> recording;
+    std::atomic<bool> motionGated;
+    std::atomic<int> previewWanted;     // camera whose frames the display wants, -1 for none
+
+    void capture_loop(deviceCapture* d);
+    void store_snapshot(deviceCapture* d, const frameSet& frames);
+
+public:
+    multiCapture(recordPipeline& r_recorder, const captureConfig& c_cfg);
+    ~multiCapture();
+
+    int add_device(frameSource* source);
+    void start();
+    void stop();
+
+    void set_recording(bool on) { recording = on; }
+    bool is_recording() const { return recording; }
+    void set_motion_gated(bool on) { motionGated = on; }
+    bool motion_gated() const { return motionGated; }
+    void request_snapshot();
+    void request_burst();
+    bool burst_active() const;
+
+    bool preview(int device, previewFrames& out);
+    bool running() const;
+
+    int device_count() const { return static_cast<int>(devices.size()); }
+    frameSource* source(int device) { return devices[device]->source; }
+    const boost::filesystem::path& depth_path(int device) const { return devices[device]->depthPath; }
+    const boost::filesystem::path& col_path(int device) const { return devices[device]->colPath; }
+
+    void print(std::ostream& os) const;
+    bool write_summary(const boost::filesystem::path& file) const;
+};
+
+#endif // MULTICAPTURE_H
@@ -0,0 +1,227 @@
+#include "pointcloud.h"
+
+#include <cstring>
+#include <sstream>
+
+#include "simdcpu.h"
+
+#if SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace bfs = boost::filesystem;
+
+namespace {
+
+void deproject_scalar(const uint16_t* depth, const float* rx, const float* ry, size_t from, size_t n,
+                      float scale, uint16_t lo, uint16_t hi, cloudPoints& out, size_t& count)
+{
+    for (size_t i = from; i < n; i++) {
+        uint16_t d = depth[i];
+        if (d < lo || d > hi) continue;
+        float z = d*scale;
+        out.x[count] = z*rx[i];
+        out.y[count] = z*ry[i];
+        out.z[count] = z;
+        out.pixel[count] = static_cast<uint32_t>(i);
+        count++;
+    }
+}
+
+#if SIMD_X86
+// lane permutation that moves the lanes set in an 8-bit mask to the front
+std::vector<int32_t> make_pack_table()
+{
+    std::vector<int32_t> t(256*8, 0);
+    for (int m = 0; m < 256; m++) {
+        int k = 0;
+        for (int lane = 0; lane < 8; lane++)
+            if (m & (1 << lane)) t[m*8 + k++] = lane;
+    }
+    return t;
+}
+
+const int32_t* pack_table()
+{
+    static const std::vector<int32_t> table = make_pack_table();
+    return table.data();
+}
+
+SIMD_TARGET("avx2,popcnt")
+void deproject_avx2(const uint16_t* depth, const float* rx, const float* ry, size_t n,
+                    float scale, uint16_t lo, uint16_t hi, cloudPoints& out, size_t& count)
+{
+    const int32_t* table = pack_table();
+    const __m256i above = _mm256_set1_epi32(static_cast<int>(lo) - 1);
+    const __m256i below = _mm256_set1_epi32(static_cast<int>(hi) + 1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 vscale = _mm256_set1_ps(scale);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i d = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + i)));
+        __m256i inside = _mm256_and_si256(_mm256_cmpgt_epi32(d, above), _mm256_cmpgt_epi32(below, d));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(inside));
+        if (!mask) continue;
+
+        __m256 z = _mm256_mul_ps(_mm256_cvtepi32_ps(d), vscale);
+        __m256 x = _mm256_mul_ps(z, _mm256_loadu_ps(rx + i));
+        __m256 y = _mm256_mul_ps(z, _mm256_loadu_ps(ry + i));
+        __m256i pix = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)), lanes);
+
+        // all 8 lanes are stored; the next group overwrites the ones that were not kept
+        __m256i perm = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(table + mask*8));
+        _mm256_storeu_ps(&out.x[count], _mm256_permutevar8x32_ps(x, perm));
+        _mm256_storeu_ps(&out.y[count], _mm256_permutevar8x32_ps(y, perm));
+        _mm256_storeu_ps(&out.z[count], _mm256_permutevar8x32_ps(z, perm));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out.pixel[count]), _mm256_permutevar8x32_epi32(pix, perm));
+        count += _mm_popcnt_u32(mask);
+    }
+    deproject_scalar(depth, rx, ry, i, n, scale, lo, hi, out, count);
+}
+#endif
+
+void pad4(std::vector<unsigned char>& buf)
+{
+    while (buf.size() % 4) buf.push_back(0);
+}
+
+template <typename T>
+void put(std::vector<unsigned char>& buf, const T& v)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(&v);
+    buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+}
+
+pointCloud::pointCloud() : scale(0.001f)
+{
+}
+
+bool pointCloud::prepare(const cameraIntrinsics& depth_intrin, float depth_scale)
+{
+    if (depth_intrin.width <= 0 || depth_intrin.height <= 0 || depth_intrin.fx <= 0 || depth_intrin.fy <= 0 || depth_scale <= 0)
+        return false;
+    intrin = depth_intrin;
+    scale = depth_scale;
+
+    size_t n = static_cast<size_t>(intrin.width)*intrin.height;
+    rayX.resize(n);
+    rayY.resize(n);
+    for (int v = 0; v < intrin.height; v++) {
+        for (int u = 0; u < intrin.width; u++) {
+            size_t i = static_cast<size_t>(v)*intrin.width + u;
+            deproject_pixel(intrin, static_cast<float>(u), static_cast<float>(v), rayX[i], rayY[i]);
+        }
+    }
+    return true;
+}
+
+size_t pointCloud::deproject(const uint16_t* depth, cloudPoints& out, uint16_t min_units, uint16_t max_units) const
+{
+    out.size = 0;
+    if (!depth || rayX.empty()) return 0;
+
+    const size_t n = rayX.size();
+    uint16_t lo = std::max<uint16_t>(min_units, 1);
+    uint16_t hi = max_units ? max_units : 0xFFFF;
+
+    // room for a whole group past the last point, for the vector stores
+    out.x.resize(n + 8);
+    out.y.resize(n + 8);
+    out.z.resize(n + 8);
+    out.pixel.resize(n + 8);
+
+    size_t count = 0;
+#if SIMD_X86
+    if (cpu_has_avx2()) deproject_avx2(depth, rayX.data(), rayY.data(), n, scale, lo, hi, out, count);
+    else deproject_scalar(depth, rayX.data(), rayY.data(), 0, n, scale, lo, hi, out, count);
+#else
+    deproject_scalar(depth, rayX.data(), rayY.data(), 0, n, scale, lo, hi, out, count);
+#endif
+    out.size = count;
+    return count;
+}
+
+// ---- writers ----
+
+bool write_ply(const bfs::path& file, const cloudPoints& pts, const unsigned char* rgb, const std::string& comment)
+{
+    std::ostringstream header;
+    header << "ply\nformat binary_little_endian 1.0\n";
+    if (!comment.empty()) header << "comment " << comment << "\n";
+    header << "element vertex " << pts.size << "\n"
+           << "property float x\nproperty float y\nproperty float z\n";
+    if (rgb) header << "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+    header << "end_header\n";
+
+    const size_t stride = rgb ? 15 : 12;
+    std::vector<unsigned char> body(pts.size*stride);
+    unsigned char* p = body.data();
+    for (size_t i = 0; i < pts.size; i++, p += stride) {
+        std::memcpy(p, &pts.x[i], 4);
+        std::memcpy(p + 4, &pts.y[i], 4);
+        std::memcpy(p + 8, &pts.z[i], 4);
+        if (rgb) std::memcpy(p + 12, rgb + static_cast<size_t>(pts.pixel[i])*3, 3);
+    }
+
+    bfs::ofstream out(file, std::ios::binary);
+    std::string h = header.str();
+    out.write(h.data(), h.size());
+    out.write(reinterpret_cast<const char*>(body.data()), body.size());
+    return static_cast<bool>(out);
+}
+
+bool cloudChunkWriter::open(const bfs::path& f_path, const pointCloud& cloud)
+{
+    file.open(f_path, std::ios::binary);
+    if (!file) return false;
+
+    const cameraIntrinsics& in = cloud.intrinsics();
+    buf.assign("TPCLOUD1", "TPCLOUD1" + 8);
+    put(buf, static_cast<uint32_t>(in.width));
+    put(buf, static_cast<uint32_t>(in.height));
+    put(buf, static_cast<uint32_t>(in.model));
+    put(buf, in.fx);
+    put(buf, in.fy);
+    put(buf, in.ppx);
+    put(buf, in.ppy);
+    for (int i = 0; i < 5; i++) put(buf, in.coeffs[i]);
+    put(buf, cloud.depth_scale());
+    file.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+    return static_cast<bool>(file);
+}
+
+bool cloudChunkWriter::append(const cloudPoints& pts, const uint16_t* depth, const unsigned char* rgb,
+                              int64_t framenum, double timestamp)
+{
+    if (!file.is_open()) return false;
+
+    buf.clear();
+    put(buf, static_cast<uint32_t>(0x52464350));            // "PCFR"
+    put(buf, static_cast<uint32_t>(rgb ? 1 : 0));
+    put(buf, framenum);
+    put(buf, timestamp);
+    put(buf, static_cast<uint32_t>(pts.size));
+    put(buf, static_cast<uint32_t>(0));
+
+    const unsigned char* pix = reinterpret_cast<const unsigned char*>(pts.pixel.data());
+    buf.insert(buf.end(), pix, pix + pts.size*sizeof(uint32_t));
+    for (size_t i = 0; i < pts.size; i++) put(buf, depth[pts.pixel[i]]);
+    pad4(buf);
+    if (rgb) {
+        for (size_t i = 0; i < pts.size; i++) {
+            const unsigned char* c = rgb + static_cast<size_t>(pts.pixel[i])*3;
+            buf.insert(buf.end(), c, c + 3);
+        }
+        pad4(buf);
+    }
+    file.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+    return static_cast<bool>(file);
+}
+
+void cloudChunkWriter::close()
+{
+    if (file.is_open()) file.close();
+}
@@ -0,0 +1,104 @@
+/* pointcloud.h
+ *
+ * Description:
+ *   header file for pointCloud class and the point-cloud file writers
+ *   Turns Z16 depth frames into 3D points (metres, camera coordinates: x
+ *   right, y down, z forward, as librealsense). The unit-depth ray of every
+ *   pixel centre, undistorted through the stream intrinsics, is worked out
+ *   once in prepare(); a point is then ray*depth*scale. deproject scans 8
+ *   pixels at a time (AVX2, scalar otherwise), drops zero depth and depths
+ *   outside the configured range, and packs the surviving points densely
+ *   (left-packing with a permutation table) with their pixel indices, so
+ *   colour can be looked up in a colour frame of the same geometry.
+ *   The depth scale is the session's (DEPTH_UNITS micrometres per unit,
+ *   e.g. 100 for 0.1 mm), not a fixed millimetre.
+ *
+ *   Writers:
+ *     write_ply - binary little-endian PLY, float x y z [uchar red green blue]
+ *     cloudChunkWriter - all frames of a session in one file. Header:
+ *       "TPCLOUD1", uint32 width, height, model, float fx, fy, ppx, ppy,
+ *       coeffs[5], depth scale (enough to rebuild the ray table). One chunk per
+ *       frame: uint32 "PCFR", uint32 flags (1 = colour), int64 frame number,
+ *       double timestamp (ms), uint32 points, uint32 0, then uint32 pixel
+ *       index[points], uint16 depth[points], padded to 4 bytes, and with
+ *       colour uchar rgb[3*points], padded to 4 bytes. A point takes 6 bytes
+ *       instead of 12 and is exact.
+ *
+ * Functions:
+ *   prepare - builds the ray table for a depth stream
+ *   deproject - valid points of a frame (thread safe: one cloudPoints per thread)
+ *   write_ply - one frame as a PLY file
+ *   cloudChunkWriter::open/append/close - chunked session file (append takes the frame the
+ *   points came from, for the raw depth values)
+ *
+ * Input:
+ *   cameraIntrinsics of the depth stream, depth scale, depth range, Z16 frames, RGB8 frames
+ *
+ * Output:
+ *   cloudPoints, .ply / .tpc files
+ *
+ * Requirements:
+ *   depthaligner.h (intrinsics, deprojection), simdcpu.h
+ *   boost/filesystem
+ *
+ * Thread safe? deproject YES (const); cloudChunkWriter NO
+ *
+ * Extendable? YES
+ */
+
+#ifndef POINTCLOUD_H
+#define POINTCLOUD_H
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "depthaligner.h"
+
+// valid points of one frame, structure of arrays; the vectors keep their capacity between frames
+struct cloudPoints
+{
+    std::vector<float> x, y, z;
+    std::vector<uint32_t> pixel;        // y*width + x of the depth pixel
+    size_t size = 0;
+};
+
+class pointCloud
+{
+    cameraIntrinsics intrin;
+    float scale;
+    std::vector<float> rayX, rayY;      // unit-depth ray of each pixel centre
+
+public:
+    pointCloud();
+
+    bool prepare(const cameraIntrinsics& depth_intrin, float depth_scale);
+    int width() const { return intrin.width; }
+    int height() const { return intrin.height; }
+    float depth_scale() const { return scale; }
+    const cameraIntrinsics& intrinsics() const { return intrin; }
+
+    // min/max in Z16 units (max 0: no limit); returns the number of points
+    size_t deproject(const uint16_t* depth, cloudPoints& out, uint16_t min_units = 1, uint16_t max_units = 0) const;
+};
+
+// rgb: RGB8 frame of the depth geometry, or null for no colour
+bool write_ply(const boost::filesystem::path& file, const cloudPoints& pts, const unsigned char* rgb,
+               const std::string& comment = std::string());
+
+class cloudChunkWriter
+{
+    boost::filesystem::ofstream file;
+    std::vector<unsigned char> buf;
+
+public:
+    bool open(const boost::filesystem::path& f_path, const pointCloud& cloud);
+    bool append(const cloudPoints& pts, const uint16_t* depth, const unsigned char* rgb, int64_t framenum, double timestamp);
+    void close();
+    bool is_open() const { return file.is_open(); }
+};
+
+#endif // POINTCLOUD_H
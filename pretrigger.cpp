@@ -0,0 +1,144 @@
+#include "pretrigger.h"
+
+#include <boost/chrono/chrono.hpp>
+
+#include <iostream>
+
+preTrigger::preTrigger(recordPipeline& r_recorder, const preTriggerConfig& p_cfg, int r_device)
+    : cfg(p_cfg), recorder(r_recorder), ring(p_cfg.ring), device(r_device),
+      name("Pre-trigger camera " + std::to_string(r_device)), unusable(false), nextFrame(0),
+      state(triggerState::buffering), quit(false), n_queued(0), n_drained(0), n_dropped(0)
+{
+    ring.set_overwrite(true);
+}
+
+preTrigger::~preTrigger()
+{
+    quit = true;
+    if (drainer.joinable()) drainer.join();
+}
+
+bool preTrigger::prepare(const frameSet& frames)
+{
+    if (ring.configured()) return true;
+    if (unusable) return false;
+    if (!ring.configure(frames)) {
+        unusable = true;
+        return false;
+    }
+
+    std::cout << name << ": up to " << ring.capacity() << " framesets";
+    if (cfg.seconds > 0) std::cout << " / " << cfg.seconds << " s";
+    std::cout << " in " << ring.bytes_reserved()/(1024*1024) << " MB" << std::endl;
+    drainer = boost::thread(&preTrigger::drain_loop, this);
+    return true;
+}
+
+bool preTrigger::push(const frameSet& frames, const frameFreshness& fresh)
+{
+    if (!ring.configured()) return false;
+
+    switch (state.load()) {
+    case triggerState::buffering:
+        ring.push(frames, fresh);
+        if (cfg.seconds > 0) ring.trim(host_ms() - cfg.seconds*1000.0);
+        return true;
+
+    case triggerState::handing:
+        // lossless now: a full ring means the recorder is behind, the frame is lost
+        if (!ring.push(frames, fresh)) {
+            n_dropped++;
+            return false;
+        }
+        n_queued++;
+        return true;
+
+    case triggerState::finishing:
+        // the ring still holds recorded frames; overwriting them would lose them
+        if (!drained()) return false;
+        resume_buffering();
+        return push(frames, fresh);
+
+    case triggerState::live:
+        break;
+    }
+    return false;
+}
+
+int preTrigger::trigger(const boost::filesystem::path& col_path, const boost::filesystem::path& depth_path, int first_frame)
+{
+    if (!ring.configured() || triggered()) return 0;
+    if (state == triggerState::finishing) {
+        // the previous recording is still draining and keeps its frames: never wait for it on the
+        // capture thread. Live frames go to the recorder directly and a later frameset retries.
+        if (!drained()) return 0;
+        resume_buffering();
+    }
+
+    if (cfg.seconds > 0) ring.trim(host_ms() - cfg.seconds*1000.0);
+    boost::mutex::scoped_lock guard(stateLock);
+    ring.set_overwrite(false);
+    colPath = col_path;
+    depthPath = depth_path;
+    nextFrame = first_frame;
+    n_dropped = 0;
+    n_drained = 0;
+    int history = ring.size();
+    n_queued = history;
+    state = triggerState::handing;
+
+    std::cout << name << ": " << history << " framesets from before the trigger" << std::endl;
+    return history;
+}
+
+bool preTrigger::handing()
+{
+    if (state == triggerState::handing && drained()) state = triggerState::live;
+    return state == triggerState::handing;
+}
+
+void preTrigger::release()
+{
+    if (!triggered()) return;
+    if (n_dropped)
+        std::cout << name << ": " << n_dropped << " framesets lost with the ring full" << std::endl;
+    if (state == triggerState::live) resume_buffering();
+    else state = triggerState::finishing;
+}
+
+void preTrigger::discard()
+{
+    if (state == triggerState::buffering) ring.clear();
+}
+
+void preTrigger::resume_buffering()
+{
+    boost::mutex::scoped_lock guard(stateLock);
+    ring.set_overwrite(true);
+    state = triggerState::buffering;
+}
+
+void preTrigger::wait()
+{
+    while (!drained() && (state == triggerState::handing || state == triggerState::finishing))
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+}
+
+void preTrigger::drain_loop()
+{
+    ringEntry e;
+    while (!quit) {
+        bool popped = false;
+        {
+            boost::mutex::scoped_lock guard(stateLock);
+            triggerState s = state;
+            if (s == triggerState::handing || s == triggerState::finishing) popped = ring.pop(e);
+        }
+        if (!popped) {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(2));
+            continue;
+        }
+        submit_entry(recorder, e, colPath, depthPath, nextFrame++, device);
+        n_drained++;
+    }
+}
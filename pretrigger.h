@@ -0,0 +1,102 @@
+/* pretrigger.h
+ *
+ * Description:
+ *   header file for preTrigger class
+ *   Keeps the last few seconds of raw framesets in a frameRing in overwrite
+ *   mode while nothing is being recorded, so a recording can start before the
+ *   record key was pressed. Nothing is encoded while buffering; frames that
+ *   fall out of the window are simply overwritten. On trigger() the history
+ *   becomes the start of the recording: the ring switches to lossless mode,
+ *   live frames queue up behind the history, and a drain thread hands them to
+ *   the recordPipeline (submit_held) with contiguous numbering. Once the ring
+ *   has caught up, live frames go to the recorder directly again (handing()
+ *   turns false) until the recording is released and buffering resumes.
+ *
+ * Functions:
+ *   prepare - sizes the ring from a frameset and starts buffering (capture thread)
+ *   push - buffers a frameset, or queues it behind the history while handing()
+ *   trigger - recording starts: history is numbered from firstFrame, returns its length
+ *   (not triggered yet while the previous recording drains; call again on a later frameset)
+ *   handing - live frames still have to go through the ring (history not drained yet)
+ *   release - recording stopped: buffering resumes once the ring is drained
+ *   discard - forgets the buffered history (frames recorded another way)
+ *   wait - blocks until everything triggered has been handed to the recorder
+ *
+ * Input:
+ *   preTriggerConfig (window length, memory budget), recordPipeline, session folders
+ *
+ * Output:
+ *   frames to the recordPipeline
+ *
+ * Requirements:
+ *   framering.h, burstrecorder.h (submit_entry), recordpipeline.h
+ *   boost/thread
+ *
+ * Thread safe? push/trigger/handing/release from the capture thread, wait from any thread
+ *
+ * Extendable? YES
+ */
+
+#ifndef PRETRIGGER_H
+#define PRETRIGGER_H
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+#include <string>
+
+#include "framering.h"
+#include "burstrecorder.h"
+#include "recordpipeline.h"
+
+struct preTriggerConfig
+{
+    frameRingConfig ring;               // memory budget of the history (overwrite is set here)
+    double seconds = 5.0;               // history kept ahead of the trigger, 0 = as much as the budget holds
+};
+
+class preTrigger
+{
+    enum class triggerState { buffering, handing, live, finishing };
+
+    preTriggerConfig cfg;
+    recordPipeline& recorder;
+    frameRing ring;
+    int device;
+    std::string name;
+    bool unusable;
+
+    boost::filesystem::path colPath;
+    boost::filesystem::path depthPath;
+    int nextFrame;
+
+    boost::mutex stateLock;             // the drain thread only pops in handing/finishing
+    std::atomic<triggerState> state;
+    std::atomic<bool> quit;
+    std::atomic<long long> n_queued;    // framesets triggered (history + live through the ring)
+    std::atomic<long long> n_drained;
+    long long n_dropped;                // live framesets refused by a full ring
+
+    boost::thread drainer;
+
+    void drain_loop();
+    bool drained() const { return n_drained == n_queued; }
+    void resume_buffering();
+
+public:
+    preTrigger(recordPipeline& r_recorder, const preTriggerConfig& p_cfg, int r_device = 0);
+    ~preTrigger();
+
+    bool prepare(const frameSet& frames);
+    bool push(const frameSet& frames, const frameFreshness& fresh);
+    int trigger(const boost::filesystem::path& col_path, const boost::filesystem::path& depth_path, int first_frame);
+    bool handing();
+    bool triggered() const { return state == triggerState::handing || state == triggerState::live; }
+    void release();
+    void discard();
+    void wait();
+};
+
+#endif // PRETRIGGER_H
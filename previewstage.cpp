@@ -0,0 +1,150 @@
+#include "previewstage.h"
+
+#include <boost/chrono/chrono.hpp>
+
+#include <cstring>
+#include <utility>
+
+previewStage::previewStage(const previewConfig& p_cfg)
+    : cfg(p_cfg), depthView(p_cfg.visual), irView(p_cfg.visual), incomingDevice(-1), pending(false), readyDevice(-1), readyNew(false), lastOffer(0.0), quit(false)
+{
+}
+
+previewStage::~previewStage()
+{
+    stop();
+}
+
+void previewStage::start()
+{
+    quit = false;
+    if (!thread.joinable()) thread = boost::thread(&previewStage::preview_loop, this);
+}
+
+void previewStage::stop()
+{
+    {
+        boost::mutex::scoped_lock lock(inLock);
+        quit = true;
+    }
+    offered.notify_all();
+    if (thread.joinable()) thread.join();
+}
+
+bool previewStage::due() const
+{
+    return cfg.fps <= 0.0 || host_ms() - lastOffer >= 1000.0/cfg.fps;
+}
+
+template <typename T>
+static void copy_frame(const sourceFrame& in, sourceFrame& out, std::vector<T>& buf, int channels)
+{
+    out = in;
+    if (!in.valid()) return;
+    buf.resize(static_cast<size_t>(in.width)*in.height*channels);
+    std::memcpy(buf.data(), in.data, buf.size()*sizeof(T));
+    out.data = buf.data();
+}
+
+bool previewStage::offer(int device, const frameSet& frames)
+{
+    if (!due()) return false;
+
+    // the capture thread never waits for the preview: a busy slot skips this frameset
+    boost::mutex::scoped_lock lock(inLock, boost::try_to_lock);
+    if (!lock.owns_lock() || pending) return false;
+
+    copy_frame(frames.colour, incoming.frames.colour, incoming.colour, 3);
+    copy_frame(frames.depth, incoming.frames.depth, incoming.depth, 1);
+    copy_frame(frames.ir, incoming.frames.ir, incoming.ir, 1);
+    copy_frame(frames.ir2, incoming.frames.ir2, incoming.ir2, 1);
+    incomingDevice = device;
+    pending = true;
+    lastOffer = host_ms();
+    lock.unlock();
+    offered.notify_one();
+    return true;
+}
+
+bool previewStage::take(int device, previewFrames& out)
+{
+    boost::mutex::scoped_lock lock(outLock);
+    if (!readyNew || readyDevice != device) return false;
+
+    // swapping keeps both buffer sets allocated, so steady-state preview does not allocate
+    std::swap(out, ready);
+    readyNew = false;
+    return true;
+}
+
+static bool box(boxFilter& filter, const sourceFrame& in, int factor, int channels, std::vector<uint8_t>& buf)
+{
+    return filter.downscale(static_cast<const uint8_t*>(in.data), in.width, in.height, channels, factor, buf);
+}
+
+static bool box(boxFilter& filter, const sourceFrame& in, int factor, int, std::vector<uint16_t>& buf)
+{
+    return filter.downscale(static_cast<const uint16_t*>(in.data), in.width, in.height, factor, buf);
+}
+
+template <typename T>
+static void scale_frame(boxFilter& filter, const sourceFrame& in, int factor, int channels,
+                        sourceFrame& out, std::vector<T>& buf)
+{
+    out = in;
+    if (!in.valid()) return;
+
+    if (!box(filter, in, factor, channels, buf)) {
+        out = sourceFrame();
+        return;
+    }
+    out.width = in.width/factor;
+    out.height = in.height/factor;
+    out.data = buf.data();
+}
+
+void previewStage::scale(const previewFrames& in, previewFrames& out)
+{
+    const frameSet& f = in.frames;
+    out.colourFactor = boxFilter::factor_for(f.colour.width, cfg.colourWidth);
+    out.depthFactor = boxFilter::factor_for(f.depth.width, cfg.depthWidth);
+    out.irFactor = boxFilter::factor_for(f.ir.width, cfg.depthWidth);
+
+    scale_frame(filter, f.colour, out.colourFactor, 3, out.frames.colour, out.colour);
+    scale_frame(filter, f.depth, out.depthFactor, 1, out.frames.depth, out.depth);
+    scale_frame(filter, f.ir, out.irFactor, 1, out.frames.ir, out.ir);
+    scale_frame(filter, f.ir2, out.irFactor, 1, out.frames.ir2, out.ir2);
+
+    out.depthColour.clear();
+    if (!cfg.visualise) return;
+    const sourceFrame& d = out.frames.depth;
+    if (d.valid()) depthView.colour_depth(out.depth.data(), d.width, d.height, out.depthColour);
+    // both imagers share the left one's range, so they stay comparable; the stretch works in place
+    if (out.frames.ir.valid()) irView.stretch_ir(out.ir.data(), out.frames.ir.width, out.frames.ir.height, out.ir);
+    if (out.frames.ir2.valid()) irView.stretch_ir(out.ir2.data(), out.frames.ir2.width, out.frames.ir2.height, out.ir2, !out.frames.ir.valid());
+}
+
+void previewStage::preview_loop()
+{
+    previewFrames full;                 // full-size copy, swapped out of the input slot
+    previewFrames small;
+    int device;
+
+    while (true) {
+        {
+            boost::mutex::scoped_lock lock(inLock);
+            while (!pending && !quit) offered.wait(lock);
+            if (quit) return;
+            std::swap(full, incoming);
+            device = incomingDevice;
+            pending = false;
+        }
+
+        scale(full, small);
+
+        boost::mutex::scoped_lock lock(outLock);
+        std::swap(ready, small);
+        readyDevice = device;
+        readyNew = true;
+    }
+}
@@ -0,0 +1,114 @@
+/* previewstage.h
+ *
+ * Description:
+ *   header file for previewStage class
+ *   Live preview that never holds up capture. A capture thread offers its
+ *   framesets; at most fps times a second one is copied into the stage's
+ *   input slot, and only if the slot is free (try_lock, so a busy preview
+ *   thread makes the capture thread skip the frame instead of waiting).
+ *   The preview thread box-filters the copy down to display size
+ *   (boxFilter, SIMD) and publishes it; the display thread takes the newest
+ *   small frameset with take(). Capture pays one copy per preview update and
+ *   nothing for display or scaling. With visualise set, the preview thread
+ *   also colour-maps depth into depthColour and contrast-stretches IR
+ *   (frameVisualiser).
+ *
+ * Functions:
+ *   start/stop - launch/join the preview thread
+ *   due - a new preview is wanted (cheap check for the capture thread)
+ *   offer - copies a frameset into the input slot if due and free; never blocks
+ *   take - newest downscaled frameset of a camera, if there is a new one
+ *
+ * Input:
+ *   previewConfig (update rate, display widths), framesets
+ *
+ * Output:
+ *   previewFrames (small frames, data pointing into the buffers, with their scale factors;
+ *                  depthColour RGB8 at the depth preview size)
+ *
+ * Requirements:
+ *   boxfilter.h, framevisualiser.h
+ *   boost/thread
+ *
+ * Thread safe? YES (offer from capture threads, take from the display thread)
+ *
+ * Extendable? YES
+ */
+
+#ifndef PREVIEWSTAGE_H
+#define PREVIEWSTAGE_H
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <atomic>
+#include <vector>
+
+#include "framesource.h"
+#include "boxfilter.h"
+#include "framevisualiser.h"
+
+struct previewConfig
+{
+    double fps = 10.0;                  // preview updates per second, 0 = every frameset offered
+    int colourWidth = 640;              // colour is reduced by an integer factor to at most this width
+    int depthWidth = 320;               // depth and IR
+    bool visualise = true;              // colour-mapped depth, stretched IR
+    visualConfig visual;
+};
+
+// frames for display; data pointers point into the buffers
+struct previewFrames
+{
+    frameSet frames;
+    std::vector<unsigned char> colour;
+    std::vector<uint16_t> depth;
+    std::vector<unsigned char> ir;
+    std::vector<unsigned char> ir2;
+    std::vector<unsigned char> depthColour; // RGB8, frames.depth.width x height (empty without visualise)
+    int colourFactor;                   // full size = preview size * factor
+    int depthFactor;
+    int irFactor;
+
+    previewFrames() : colourFactor(1), depthFactor(1), irFactor(1) {}
+};
+
+class previewStage
+{
+    previewConfig cfg;
+    boxFilter filter;
+    frameVisualiser depthView;
+    frameVisualiser irView;
+
+    boost::mutex inLock;                // input slot, filled by a capture thread
+    boost::condition_variable offered;
+    previewFrames incoming;
+    int incomingDevice;
+    bool pending;
+
+    boost::mutex outLock;               // newest downscaled frameset
+    previewFrames ready;
+    int readyDevice;
+    bool readyNew;
+
+    std::atomic<double> lastOffer;
+    std::atomic<bool> quit;
+    boost::thread thread;
+
+    void preview_loop();
+    void scale(const previewFrames& in, previewFrames& out);
+
+public:
+    explicit previewStage(const previewConfig& p_cfg = previewConfig());
+    ~previewStage();
+
+    void start();
+    void stop();
+
+    bool due() const;
+    bool offer(int device, const frameSet& frames);
+    bool take(int device, previewFrames& out);
+};
+
+#endif // PREVIEWSTAGE_H
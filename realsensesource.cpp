@@ -0,0 +1,129 @@
+#include "realsensesource.h"
+
+#include <librealsense2/rs_advanced_mode.hpp>
+
+#include <iostream>
+
+#include "depthaligner.h"
+
+static void fill_frame(const rs2::frame& f, sourceFrame& out)
+{
+    if (!f) return;
+    rs2::video_frame vf = f.as<rs2::video_frame>();
+    out.data = vf.get_data();
+    out.width = vf.get_width();
+    out.height = vf.get_height();
+    out.framenum = static_cast<int64_t>(vf.get_frame_number());
+    out.timestamp = vf.get_timestamp();
+    if (vf.supports_frame_metadata(RS2_FRAME_METADATA_BACKEND_TIMESTAMP))
+        out.backendTimestamp = static_cast<double>(vf.get_frame_metadata(RS2_FRAME_METADATA_BACKEND_TIMESTAMP));
+}
+
+realsenseSource::realsenseSource(const realsenseConfig& r_cfg)
+    : cfg(r_cfg), aligner(RS2_STREAM_COLOR), scale(0.001f), align(r_cfg.alignToColour)
+{
+}
+
+void realsenseSource::apply_depth_table(rs2::device& dev)
+{
+    if (cfg.depthUnits <= 0 && cfg.disparityShift < 0) return;
+    if (!dev.is<rs400::advanced_mode>()) return;
+
+    auto advanced_mode_dev = dev.as<rs400::advanced_mode>();
+    if (!advanced_mode_dev.is_enabled()) advanced_mode_dev.toggle_advanced_mode(true);
+
+    STDepthTableControl depth_table = advanced_mode_dev.get_depth_table();
+    if (cfg.disparityShift >= 0) depth_table.disparityShift = cfg.disparityShift;
+    if (cfg.depthUnits > 0) depth_table.depthUnits = cfg.depthUnits;
+    advanced_mode_dev.set_depth_table(depth_table);
+}
+
+bool realsenseSource::start()
+{
+    rs2::config rcfg;
+    rcfg.enable_stream(RS2_STREAM_INFRARED, 1, cfg.depthWidth, cfg.depthHeight, RS2_FORMAT_Y8, cfg.fps);
+    if (cfg.secondIR)
+        rcfg.enable_stream(RS2_STREAM_INFRARED, 2, cfg.depthWidth, cfg.depthHeight, RS2_FORMAT_Y8, cfg.fps);
+    rcfg.enable_stream(RS2_STREAM_COLOR, cfg.colWidth, cfg.colHeight, RS2_FORMAT_RGB8, cfg.fps);
+    rcfg.enable_stream(RS2_STREAM_DEPTH, cfg.depthWidth, cfg.depthHeight, RS2_FORMAT_Z16, cfg.fps);
+
+    try {
+        profile = pipe.start(rcfg);
+        rs2::device dev = profile.get_device();
+        apply_depth_table(dev);
+        scale = dev.first<rs2::depth_sensor>().get_depth_scale();
+    }
+    catch (const rs2::error& e) {
+        std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool realsenseSource::wait_for_frames(frameSet& frames)
+{
+    frames = frameSet();
+
+    current = pipe.wait_for_frames();
+    if (align) current = aligner.process(current);
+
+    fill_frame(current.get_color_frame(), frames.colour);
+    fill_frame(current.get_depth_frame(), frames.depth);
+    fill_frame(current.get_infrared_frame(1), frames.ir);
+    if (cfg.secondIR) fill_frame(current.get_infrared_frame(2), frames.ir2);
+    frames.stamp_arrival();
+    return true;
+}
+
+void realsenseSource::stop()
+{
+    current = rs2::frameset();
+    pipe.stop();
+}
+
+bool realsenseSource::set_emitter(bool on)
+{
+    auto depth_sensor = profile.get_device().first<rs2::depth_sensor>();
+    if (!depth_sensor.supports(RS2_OPTION_EMITTER_ENABLED)) return false;
+    depth_sensor.set_option(RS2_OPTION_EMITTER_ENABLED, on ? 1.0f : 0.0f);
+    return true;
+}
+
+static cameraIntrinsics to_intrinsics(const rs2_intrinsics& in)
+{
+    cameraIntrinsics c;
+    c.width = in.width;
+    c.height = in.height;
+    c.fx = in.fx;
+    c.fy = in.fy;
+    c.ppx = in.ppx;
+    c.ppy = in.ppy;
+    switch (in.model) {
+    case RS2_DISTORTION_MODIFIED_BROWN_CONRADY: c.model = distortionModel::modifiedBrownConrady; break;
+    case RS2_DISTORTION_INVERSE_BROWN_CONRADY: c.model = distortionModel::inverseBrownConrady; break;
+    case RS2_DISTORTION_BROWN_CONRADY: c.model = distortionModel::brownConrady; break;
+    default: c.model = distortionModel::none; break;
+    }
+    for (int i = 0; i < 5; i++) c.coeffs[i] = in.coeffs[i];
+    return c;
+}
+
+bool realsenseSource::calibration(alignCalibration& out) const
+{
+    try {
+        rs2::video_stream_profile depth = profile.get_stream(RS2_STREAM_DEPTH).as<rs2::video_stream_profile>();
+        rs2::video_stream_profile colour = profile.get_stream(RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
+        rs2_extrinsics ex = depth.get_extrinsics_to(colour);
+
+        out.depth = to_intrinsics(depth.get_intrinsics());
+        out.colour = to_intrinsics(colour.get_intrinsics());
+        for (int i = 0; i < 9; i++) out.depthToColour.rotation[i] = ex.rotation[i];
+        for (int i = 0; i < 3; i++) out.depthToColour.translation[i] = ex.translation[i];
+        out.depthScale = scale;
+    }
+    catch (const rs2::error& e) {
+        std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
+        return false;
+    }
+    return out.valid();
+}
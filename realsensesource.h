@@ -0,0 +1,84 @@
+/* realsensesource.h
+ *
+ * Description:
+ *   header file for realsenseSource class
+ *   frameSource for a live RealSense D4xx through the librealsense2 pipeline.
+ *   Colour (rgb8), depth (z16) and one or both IR imagers (y8) are streamed at
+ *   the configured sizes. The depth table (depth units, disparity shift) is set
+ *   through advanced mode when requested, and depth can be aligned to colour.
+ *   The frameset is held until the next call, so the frame buffers are never
+ *   copied here.
+ *
+ * Functions:
+ *   see framesource.h
+ *   set_align - align depth/IR to the colour viewpoint (rs2::align)
+ *   calibration - depth/colour intrinsics and extrinsics of the running streams
+ *   device - the rs2 device, for sensor options
+ *
+ * Input:
+ *   realsenseConfig
+ *
+ * Output:
+ *   frameSet
+ *
+ * Requirements:
+ *   depthaligner.h
+ *   librealsense2
+ *
+ * Thread safe? NO
+ *
+ * Extendable? YES
+ */
+
+#ifndef REALSENSESOURCE_H
+#define REALSENSESOURCE_H
+
+#include <librealsense2/rs.hpp>
+
+#include <cstdint>
+
+#include "framesource.h"
+
+struct realsenseConfig
+{
+    int colWidth = 1280;
+    int colHeight = 720;
+    int depthWidth = 1280;
+    int depthHeight = 720;
+    int fps = 30;
+    bool secondIR = true;
+    bool alignToColour = false;
+    int depthUnits = 0;         // advanced mode depth table, micrometres per unit (0: leave as is)
+    int disparityShift = -1;    // advanced mode depth table (-1: leave as is)
+};
+
+class realsenseSource : public frameSource
+{
+    realsenseConfig cfg;
+
+    rs2::pipeline pipe;
+    rs2::pipeline_profile profile;
+    rs2::align aligner;
+    rs2::frameset current;      // keeps the frame buffers alive until the next call
+    float scale;
+    bool align;
+
+    void apply_depth_table(rs2::device& dev);
+
+public:
+    explicit realsenseSource(const realsenseConfig& r_cfg = realsenseConfig());
+
+    bool start();
+    bool wait_for_frames(frameSet& frames);
+    void stop();
+
+    float depth_scale() const { return scale; }
+    bool set_emitter(bool on);
+    bool set_align(bool on) { align = on; return true; }
+    bool calibration(alignCalibration& out) const;
+    std::string name() const { return "realsense2"; }
+
+    rs2::device device() { return profile.get_device(); }
+};
+
+#endif // REALSENSESOURCE_H
@@ -0,0 +1,74 @@
+#include "realsensev1source.h"
+
+#include <cstdio>
+
+realsenseV1Source::realsenseV1Source(const realsenseV1Config& r_cfg) : cfg(r_cfg), dev(0)
+{
+}
+
+rs::context& realsenseV1Source::shared_context()
+{
+    static rs::context ctx;
+    return ctx;
+}
+
+bool realsenseV1Source::start()
+{
+    rs::context& ctx = shared_context();
+    printf("There are %d connected RealSense devices.\n", ctx.get_device_count());
+    if (ctx.get_device_count() <= cfg.deviceIndex) return false;
+    dev = ctx.get_device(cfg.deviceIndex);
+
+    printf("\n Using device %d, an %s\n", cfg.deviceIndex, dev->get_name());
+    printf("    Serial number: %s\n", dev->get_serial());
+    printf("    Firmware version: %s\n", dev->get_firmware_version());
+
+    dev->enable_stream(rs::stream::depth, cfg.depthWidth, cfg.depthHeight, rs::format::z16, cfg.fps);
+    dev->enable_stream(rs::stream::color, cfg.colWidth, cfg.colHeight, rs::format::rgb8, cfg.fps);
+    dev->enable_stream(rs::stream::infrared, cfg.depthWidth, cfg.depthHeight, rs::format::y8, cfg.fps);
+
+    dev->start();
+    return true;
+}
+
+bool realsenseV1Source::wait_for_frames(frameSet& frames)
+{
+    frames = frameSet();
+    if (!dev || !dev->is_streaming()) return false;
+
+    dev->wait_for_frames();
+
+    frames.colour.data = dev->get_frame_data(rs::stream::color);
+    frames.colour.width = cfg.colWidth;
+    frames.colour.height = cfg.colHeight;
+    frames.colour.timestamp = dev->get_frame_timestamp(rs::stream::color);
+
+    frames.depth.data = dev->get_frame_data(rs::stream::depth);
+    frames.depth.width = cfg.depthWidth;
+    frames.depth.height = cfg.depthHeight;
+    frames.depth.timestamp = dev->get_frame_timestamp(rs::stream::depth);
+
+    frames.ir.data = dev->get_frame_data(rs::stream::infrared);
+    frames.ir.width = cfg.depthWidth;
+    frames.ir.height = cfg.depthHeight;
+    frames.ir.timestamp = dev->get_frame_timestamp(rs::stream::infrared);
+
+    // the device keeps the last frame when none is new, so the counter repeats on duplicates
+    frames.colour.framenum = dev->get_frame_number(rs::stream::color);
+    frames.depth.framenum = dev->get_frame_number(rs::stream::depth);
+    frames.ir.framenum = dev->get_frame_number(rs::stream::infrared);
+    frames.stamp_arrival();
+    return true;
+}
+
+void realsenseV1Source::stop()
+{
+    if (dev && dev->is_streaming()) dev->stop();
+}
+
+bool realsenseV1Source::set_emitter(bool on)
+{
+    if (!dev || !dev->supports_option(rs::option::r200_emitter_enabled)) return false;
+    dev->set_option(rs::option::r200_emitter_enabled, on ? 1 : 0);
+    return true;
+}
@@ -0,0 +1,71 @@
+/* realsensev1source.h
+ *
+ * Description:
+ *   header file for realsenseV1Source class
+ *   frameSource for a live camera through the legacy librealsense (v1)
+ *   rs::device API (F200/R200/SR300). Colour, depth and IR are enabled at the
+ *   configured sizes and read straight from the device buffers, which stay
+ *   valid until the next wait_for_frames.
+ *   librealsense v1 allows one rs::context per process, so every source shares
+ *   one; several sources with different deviceIndex run several cameras.
+ *
+ * Functions:
+ *   see framesource.h
+ *   device - the rs::device, for colour options (exposure, white balance...)
+ *   device_count - number of connected cameras
+ *
+ * Input:
+ *   realsenseV1Config
+ *
+ * Output:
+ *   frameSet
+ *
+ * Requirements:
+ *   librealsense (v1)
+ *
+ * Thread safe? NO
+ *
+ * Extendable? YES
+ */
+
+#ifndef REALSENSEV1SOURCE_H
+#define REALSENSEV1SOURCE_H
+
+#include <librealsense/rs.hpp>
+
+#include "framesource.h"
+
+struct realsenseV1Config
+{
+    int colWidth = 1920;
+    int colHeight = 1080;
+    int depthWidth = 640;
+    int depthHeight = 480;
+    int fps = 30;
+    int deviceIndex = 0;
+};
+
+class realsenseV1Source : public frameSource
+{
+    realsenseV1Config cfg;
+
+    rs::device* dev;
+
+    static rs::context& shared_context();
+
+public:
+    explicit realsenseV1Source(const realsenseV1Config& r_cfg = realsenseV1Config());
+
+    bool start();
+    bool wait_for_frames(frameSet& frames);
+    void stop();
+
+    float depth_scale() const { return dev ? dev->get_depth_scale() : 0.001f; }
+    bool set_emitter(bool on);
+    std::string name() const { return "realsense"; }
+
+    rs::device* device() { return dev; }
+    static int device_count() { return shared_context().get_device_count(); }
+};
+
+#endif // REALSENSEV1SOURCE_H
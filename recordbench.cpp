@@ -0,0 +1,377 @@
+/* Recording benchmark: drives recordPipeline with synthetic frames (no camera needed)
+ * and reports throughput, bytes written, dropped frames and p50/p99/max latency of
+ * each recording stage (copy, convert, encode, write, total).
+ *
+ * Usage: RecordBench [options]
+ *   --col WxH --depth WxH     stream sizes (default 1920x1080, 640x480)
+ *   --fps F --seconds S       offered frame rate and run length (default 30, 10)
+ *   --ir                      record the IR stream as well
+ *   --quality Q --subsampling 444|422|420
+ *   --depth-codec raw|tz16 --storage perfile|segmented
+ *   --colour-storage perfile|avi   one JPEG per frame, or one MJPEG AVI per run (see mjpegwriter.h)
+ *   --io uring|threads|sync --buffered   segment writes: backend, page cache instead of O_DIRECT
+ *   --convert-workers N --encode-workers N --write-workers N --tile-workers N
+ *   --jpeg-stripes            code colour JPEGs in stripes on the tile workers
+ *   --queue N --pool N        queue capacity / frame pool size per stream
+ *   --no-backpressure         disable load shedding (see backpressure.h)
+ *   --burst MB                capture into a RAM ring of MB megabytes and drain it in the background
+ *                             (burst mode, see burstrecorder.h); a run passes if no frame was lost
+ *   --sweep [MAXFPS]          raise fps until frames drop or writing falls behind, report the sustained rate
+ *   --out DIR                 scratch folder (emptied per run, default /tmp/termite_bench)
+ *   --json FILE               machine-readable results
+ *   --label NAME              free text stored with the results
+ *
+ * See Readme.md for details
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <unistd.h>
+
+#include "recordpipeline.h"
+#include "syntheticsource.h"
+#include "burstrecorder.h"
+
+namespace bfs = boost::filesystem;
+namespace bchrono = boost::chrono;
+
+#define BENCH_FORMAT_VERSION 1
+
+struct benchConfig
+{
+    int colWidth = 1920;
+    int colHeight = 1080;
+    int depthWidth = 640;
+    int depthHeight = 480;
+    float fps = 30;
+    float seconds = 10;
+    bool ir = false;
+    bool sweep = false;
+    float maxFps = 240;
+    size_t burstMB = 0;         // 0: frames go straight to the recorder
+    bfs::path out = "/tmp/termite_bench";
+    std::string json;
+    std::string label;
+    recordConfig rec;
+};
+
+struct stageResult
+{
+    uint64_t count, p50, p99, max;
+    double mean;
+};
+
+struct benchResult
+{
+    float fps;                  // offered
+    double elapsed;             // s, first submit to recorder drained
+    long long submitted;
+    long long written;
+    long long dropped;
+    long long shed;             // left out by the back-pressure policy
+    long long payloadBytes;     // handed to the writers
+    long long offered;          // framesets produced by the source
+    long long burstCaptured;    // framesets taken into the burst ring (burst mode)
+    size_t burstPeakBytes;      // ring memory in use at most
+    bool burst;
+    long long diskBytes;        // on disk after the run (includes container overhead)
+    stageResult stages[RECORD_STAGES];
+
+    double written_fps(int streams) const { return elapsed > 0 ? written/(double)streams/elapsed : 0.0; }
+    double mb_per_s() const { return elapsed > 0 ? diskBytes/1e6/elapsed : 0.0; }
+
+    // sustained: nothing dropped AND the writers kept pace (queues can hide a short overload);
+    // a burst only has to take every frame, the ring absorbs the writers falling behind
+    bool sustained(int streams) const
+    {
+        if (burst) return dropped == 0 && burstCaptured == offered;
+        return dropped == 0 && shed == 0 && written_fps(streams) >= 0.95*fps;
+    }
+};
+
+static const char* stage_names[RECORD_STAGES] = { "copy", "convert", "encode", "write", "total" };
+
+static bool parse_size(const char* arg, int& w, int& h)
+{
+    return std::sscanf(arg, "%dx%d", &w, &h) == 2 && w > 0 && h > 0;
+}
+
+static long long folder_bytes(const bfs::path& dir)
+{
+    long long total = 0;
+    boost::system::error_code ec;
+    for (bfs::recursive_directory_iterator it(dir, ec), end; it != end; it.increment(ec))
+        if (bfs::is_regular_file(it->status())) total += bfs::file_size(it->path(), ec);
+    return total;
+}
+
+static int stream_count(const benchConfig& cfg)
+{
+    return cfg.ir ? 3 : 2;
+}
+
+static benchResult run_once(const benchConfig& cfg, float fps)
+{
+    bfs::path cpath = cfg.out / "RGB";
+    bfs::path dpath = cfg.out / "D";
+    bfs::remove_all(cfg.out);
+    bfs::create_directories(cpath);
+    bfs::create_directories(dpath);
+
+    syntheticConfig scfg;
+    scfg.colWidth = cfg.colWidth;
+    scfg.colHeight = cfg.colHeight;
+    scfg.depthWidth = cfg.depthWidth;
+    scfg.depthHeight = cfg.depthHeight;
+    scfg.fps = fps;
+    scfg.realtime = true;
+    syntheticSource src(scfg);
+    src.start();
+
+    recordConfig rc = cfg.rec;
+    rc.framesetIR = cfg.ir;
+    recordPipeline recorder(rc);
+    recorder.add_stream(streamType::colour, cfg.colWidth, cfg.colHeight);
+    recorder.add_stream(streamType::depth, cfg.depthWidth, cfg.depthHeight);
+    if (cfg.ir) recorder.add_stream(streamType::infrared, cfg.depthWidth, cfg.depthHeight);
+    recorder.start();
+
+    int frames = static_cast<int>(fps*cfg.seconds);
+    frameSet fs;
+    long long offered = 0;
+    size_t peak = 0;
+    bchrono::steady_clock::time_point t0 = bchrono::steady_clock::now();
+
+    std::unique_ptr<burstRecorder> burst;
+    if (cfg.burstMB) {
+        burstConfig bcfg;
+        bcfg.ring.budgetBytes = cfg.burstMB << 20;
+        bcfg.ring.ir = cfg.ir;
+        bcfg.seconds = 0;
+        burst.reset(new burstRecorder(recorder, bcfg));
+    }
+
+    for (int i = 0; i < frames && src.wait_for_frames(fs); i++) {
+        int num = 1000000 + i;
+        offered++;
+        if (!burst) {
+            recorder.submit_frameset(fs, frameFreshness(), cpath, dpath, num);
+            continue;
+        }
+        if (i == 0 && !burst->begin(fs, cpath, dpath, num)) break;
+        burst->push(fs, frameFreshness());
+        peak = std::max(peak, burst->progress().bytesHeld);
+    }
+    burstProgress bp = burstProgress();
+    if (burst) {
+        burst->end();
+        burst->wait();
+        bp = burst->progress();
+    }
+    recorder.stop();
+    src.stop();
+
+    benchResult r;
+    r.fps = fps;
+    r.elapsed = bchrono::duration<double>(bchrono::steady_clock::now() - t0).count();
+    r.offered = offered;
+    r.burst = cfg.burstMB > 0;
+    r.burstCaptured = bp.captured;
+    r.burstPeakBytes = peak;
+
+    recordStats s = recorder.stats();
+    r.submitted = s.submitted;
+    r.written = s.written;
+    r.dropped = s.dropped;
+    r.shed = s.shed;
+    r.payloadBytes = s.bytes;
+    r.diskBytes = folder_bytes(cfg.out);
+
+    for (int i = 0; i < RECORD_STAGES; i++) {
+        const latencyHistogram& h = recorder.latency(static_cast<recordStage>(i));
+        r.stages[i].count = h.count();
+        r.stages[i].p50 = h.percentile(50);
+        r.stages[i].p99 = h.percentile(99);
+        r.stages[i].max = h.max();
+        r.stages[i].mean = h.mean();
+    }
+
+    bfs::remove_all(cfg.out);
+    return r;
+}
+
+static void print_result(const benchConfig& cfg, const benchResult& r)
+{
+    std::cout << std::fixed << std::setprecision(1)
+              << "fps " << r.fps << ": " << r.written << "/" << r.submitted << " frames written, "
+              << r.dropped << " dropped, " << r.shed << " shed, " << r.written_fps(stream_count(cfg)) << " framesets/s, "
+              << r.mb_per_s() << " MB/s" << std::endl;
+    if (r.burst)
+        std::cout << "    burst: " << r.burstCaptured << "/" << r.offered << " framesets captured into the ring, peak "
+                  << r.burstPeakBytes/(1024*1024) << " MB in use, drained in " << r.elapsed << " s" << std::endl;
+    std::cout << "    stage      count      p50 us      p99 us      max us" << std::endl;
+    for (int i = 0; i < RECORD_STAGES; i++)
+        std::cout << "    " << std::left << std::setw(8) << stage_names[i] << std::right
+                  << std::setw(8) << r.stages[i].count << std::setw(12) << r.stages[i].p50
+                  << std::setw(12) << r.stages[i].p99 << std::setw(12) << r.stages[i].max << std::endl;
+}
+
+static std::string json_escape(const std::string& in)
+{
+    std::string out;
+    for (char c : in) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+    return out;
+}
+
+static void write_json(std::ostream& os, const benchConfig& cfg, const std::vector<benchResult>& runs, float sustained)
+{
+    const recordConfig& rc = cfg.rec;
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+
+    os << std::fixed << std::setprecision(3);
+    os << "{\n  \"benchmark\": \"record\",\n  \"format\": " << BENCH_FORMAT_VERSION << ",\n";
+    os << "  \"label\": \"" << json_escape(cfg.label) << "\",\n";
+    os << "  \"date\": \"" << boost::posix_time::to_iso_extended_string(boost::posix_time::second_clock::universal_time()) << "Z\",\n";
+    os << "  \"machine\": { \"host\": \"" << json_escape(host) << "\", \"cpus\": " << boost::thread::hardware_concurrency() << " },\n";
+    os << "  \"config\": { \"colour\": [" << cfg.colWidth << ", " << cfg.colHeight << "], \"depth\": ["
+       << cfg.depthWidth << ", " << cfg.depthHeight << "], \"ir\": " << (cfg.ir ? "true" : "false")
+       << ", \"seconds\": " << cfg.seconds
+       << ", \"jpeg_quality\": " << rc.jpeg.quality
+       << ", \"subsampling\": \"" << (rc.jpeg.subsampling == jpegSubsampling::s444 ? "444" : rc.jpeg.subsampling == jpegSubsampling::s422 ? "422" : "420") << "\""
+       << ", \"depth_codec\": \"" << (rc.depth == depthFormat::tz16 ? "tz16" : "raw") << "\""
+       << ", \"storage\": \"" << (rc.raw == rawStorage::segmented ? "segmented" : "perfile") << "\""
+       << ", \"colour_storage\": \"" << (rc.colour == colourStorage::mjpegAvi ? "avi" : "perfile") << "\""
+       << ", \"io\": \"" << ioEngine::backend_name(rc.io.backend) << "\", \"direct_io\": " << (rc.segments.directIO ? "true" : "false")
+       << ", \"convert_workers\": " << rc.convertWorkers << ", \"encode_workers\": " << rc.encodeWorkers
+       << ", \"write_workers\": " << rc.writeWorkers << ", \"tile_workers\": " << rc.tileWorkers
+       << ", \"jpeg_stripes\": " << (rc.jpegStripes ? "true" : "false")
+       << ", \"queue\": " << rc.queueCapacity << ", \"pool\": " << rc.poolFrames
+       << ", \"backpressure\": " << (rc.pressure.enabled ? "true" : "false")
+       << ", \"burst_mb\": " << cfg.burstMB << " },\n";
+
+    os << "  \"runs\": [\n";
+    for (size_t k = 0; k < runs.size(); k++) {
+        const benchResult& r = runs[k];
+        os << "    { \"fps\": " << r.fps << ", \"elapsed_s\": " << r.elapsed
+           << ", \"submitted\": " << r.submitted << ", \"written\": " << r.written << ", \"dropped\": " << r.dropped << ", \"shed\": " << r.shed
+           << ", \"written_fps\": " << r.written_fps(stream_count(cfg))
+           << ", \"payload_bytes\": " << r.payloadBytes << ", \"disk_bytes\": " << r.diskBytes
+           << ", \"mb_per_s\": " << r.mb_per_s()
+           << ", \"offered\": " << r.offered << ", \"burst_captured\": " << r.burstCaptured << ", \"burst_peak_bytes\": " << r.burstPeakBytes << ", \"sustained\": " << (r.sustained(stream_count(cfg)) ? "true" : "false")
+           << ",\n      \"latency_us\": {";
+        for (int i = 0; i < RECORD_STAGES; i++) {
+            const stageResult& st = r.stages[i];
+            os << (i ? ", " : " ") << "\"" << stage_names[i] << "\": { \"count\": " << st.count
+               << ", \"p50\": " << st.p50 << ", \"p99\": " << st.p99 << ", \"max\": " << st.max
+               << ", \"mean\": " << st.mean << " }";
+        }
+        os << " } }" << (k + 1 < runs.size() ? "," : "") << "\n";
+    }
+    os << "  ],\n  \"sustained_fps\": " << sustained << "\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+    benchConfig cfg;
+    recordConfig& rc = cfg.rec;
+    rc.raw = rawStorage::segmented;
+    rc.depth = depthFormat::tz16;
+    rc.tileWorkers = 1;
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        bool more = i + 1 < argc;
+        if (a == "--col" && more) { if (!parse_size(argv[++i], cfg.colWidth, cfg.colHeight)) return EXIT_FAILURE; }
+        else if (a == "--depth" && more) { if (!parse_size(argv[++i], cfg.depthWidth, cfg.depthHeight)) return EXIT_FAILURE; }
+        else if (a == "--fps" && more) cfg.fps = std::stof(argv[++i]);
+        else if (a == "--seconds" && more) cfg.seconds = std::stof(argv[++i]);
+        else if (a == "--ir") cfg.ir = true;
+        else if (a == "--quality" && more) rc.jpeg.quality = std::stoi(argv[++i]);
+        else if (a == "--subsampling" && more) {
+            std::string ss = argv[++i];
+            rc.jpeg.subsampling = ss == "444" ? jpegSubsampling::s444 : ss == "422" ? jpegSubsampling::s422 : jpegSubsampling::s420;
+        }
+        else if (a == "--depth-codec" && more) rc.depth = std::string(argv[++i]) == "raw" ? depthFormat::raw : depthFormat::tz16;
+        else if (a == "--storage" && more) rc.raw = std::string(argv[++i]) == "perfile" ? rawStorage::perFile : rawStorage::segmented;
+        else if (a == "--colour-storage" && more) rc.colour = std::string(argv[++i]) == "avi" ? colourStorage::mjpegAvi : colourStorage::perFile;
+        else if (a == "--io" && more) {
+            std::string io = argv[++i];
+            rc.io.backend = io == "uring" ? ioBackend::uring : io == "threads" ? ioBackend::threads : io == "sync" ? ioBackend::sync : ioBackend::automatic;
+        }
+        else if (a == "--buffered") rc.segments.directIO = false;
+        else if (a == "--convert-workers" && more) rc.convertWorkers = std::stoi(argv[++i]);
+        else if (a == "--encode-workers" && more) rc.encodeWorkers = std::stoi(argv[++i]);
+        else if (a == "--write-workers" && more) rc.writeWorkers = std::stoi(argv[++i]);
+        else if (a == "--tile-workers" && more) rc.tileWorkers = std::stoi(argv[++i]);
+        else if (a == "--jpeg-stripes") rc.jpegStripes = true;
+        else if (a == "--queue" && more) rc.queueCapacity = std::stoi(argv[++i]);
+        else if (a == "--pool" && more) rc.poolFrames = std::stoi(argv[++i]);
+        else if (a == "--no-backpressure") rc.pressure.enabled = false;
+        else if (a == "--burst" && more) cfg.burstMB = std::stoul(argv[++i]);
+        else if (a == "--sweep") {
+            cfg.sweep = true;
+            if (more && argv[i+1][0] != '-') cfg.maxFps = std::stof(argv[++i]);
+        }
+        else if (a == "--out" && more) cfg.out = argv[++i];
+        else if (a == "--json" && more) cfg.json = argv[++i];
+        else if (a == "--label" && more) cfg.label = argv[++i];
+        else {
+            std::cerr << "Unknown option " << a << " (see recordbench.cpp for usage)" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    rc.movie.fps = cfg.fps;
+
+    std::vector<benchResult> runs;
+    float sustained = 0;
+
+    if (!cfg.sweep) {
+        runs.push_back(run_once(cfg, cfg.fps));
+        print_result(cfg, runs.back());
+        if (runs.back().sustained(stream_count(cfg))) sustained = cfg.fps;
+    }
+    else {
+        // ramp up by 25% until the recorder falls behind, then bisect between the last clean and first lossy rate
+        float good = 0, bad = 0;
+        for (float fps = cfg.fps; fps <= cfg.maxFps; fps *= 1.25f) {
+            runs.push_back(run_once(cfg, fps));
+            print_result(cfg, runs.back());
+            if (!runs.back().sustained(stream_count(cfg))) { bad = fps; break; }
+            good = fps;
+        }
+        for (int k = 0; k < 3 && bad > 0 && bad - good > 1.0f; k++) {
+            float fps = 0.5f*(good + bad);
+            runs.push_back(run_once(cfg, fps));
+            print_result(cfg, runs.back());
+            if (!runs.back().sustained(stream_count(cfg))) bad = fps;
+            else good = fps;
+        }
+        sustained = good;
+    }
+
+    std::cout << "Sustained fps (no drops, writers keeping pace): " << sustained << std::endl;
+
+    if (!cfg.json.empty()) {
+        std::ofstream jf(cfg.json.c_str());
+        write_json(jf, cfg, runs, sustained);
+    }
+    return EXIT_SUCCESS;
+}
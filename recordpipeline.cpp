@@ -0,0 +1,627 @@
+#include "recordpipeline.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "colimageframe.h"
+#include "depthimageframe.h"
+#include "irimageframe.h"
+
+namespace bfs = boost::filesystem;
+namespace bchrono = boost::chrono;
+
+static inline uint64_t now_us()
+{
+    return bchrono::duration_cast<bchrono::microseconds>(bchrono::steady_clock::now().time_since_epoch()).count();
+}
+
+recordPipeline::deviceStreams::deviceStreams(const backPressureConfig& p_cfg)
+    : movieFailed(false), pressure(new backPressure(p_cfg)), pressureLog(false), pressureLevel(0)
+{
+    for (int i = 0; i < 3; i++) {
+        pools[i] = 0;
+        segmentFailed[i] = false;
+        cropFixed[i] = false;
+    }
+}
+
+recordPipeline::deviceStreams::~deviceStreams()
+{
+    for (int i = 0; i < 3; i++) delete pools[i];
+}
+
+recordPipeline::recordPipeline(const recordConfig& r_cfg)
+    : cfg(r_cfg),
+      jobs(3*r_cfg.poolFrames*std::max(1, r_cfg.devices)),
+      freeJobs(3*r_cfg.poolFrames*std::max(1, r_cfg.devices)),
+      tilePool(r_cfg.tileWorkers),
+      convertQ(r_cfg.queueCapacity),
+      encodeQ(r_cfg.queueCapacity),
+      writeQ(r_cfg.queueCapacity),
+      running(false),
+      accepting(false),
+      captureDone(false),
+      convertDone(false),
+      encodeDone(false),
+      n_submitted(0),
+      n_dropped(0),
+      n_written(0),
+      n_bytes(0),
+      n_shed(0),
+      inFlight(0),
+      writeAverage(0)
+{
+    cfg.devices = std::max(1, cfg.devices);
+    if (cfg.raw == rawStorage::segmented) io.reset(new ioEngine(cfg.io));
+    for (int d = 0; d < cfg.devices; d++) {
+        devices.emplace_back(new deviceStreams(cfg.pressure));
+        devices[d]->movie.on_emit([this, d](int64_t framenum, bool stored) { movie_emitted(d, framenum, stored); });
+    }
+    for (size_t i = 0; i < jobs.size(); i++) freeJobs.bounded_push(&jobs[i]);
+}
+
+recordPipeline::~recordPipeline()
+{
+    stop();
+}
+
+void recordPipeline::add_stream(streamType stream, int width, int height, int device)
+{
+    if (device < 0 || device >= cfg.devices) return;
+    framePool*& pool = devices[device]->pools[static_cast<int>(stream)];
+    delete pool;
+    pool = new framePool(width*height*bytes_per_pixel(stream), cfg.poolFrames, cfg.hugepages, cfg.lockPages);
+}
+
+bool recordPipeline::set_crop(streamType stream, const std::vector<cropRect>& rects, int device)
+{
+    // the stored frame size must not change within a session (segment files, readers)
+    if (device < 0 || device >= cfg.devices) return false;
+    deviceStreams& dev = *devices[device];
+    int s = static_cast<int>(stream);
+
+    boost::mutex::scoped_lock guard(cropLock);
+    if (dev.cropFixed[s]) return false;
+    dev.cropRects[s] = rects;
+    return true;
+}
+
+int recordPipeline::load_crop(const bfs::path& file)
+{
+    // every stream of every camera takes the rectangles listed for it, none if it is not listed
+    std::vector<cropRequest> requests;
+    if (!load_crop_rects(file, requests)) return -1;
+
+    int kept = 0;
+    for (int d = 0; d < cfg.devices; d++) {
+        for (int s = 0; s < 3; s++) {
+            std::vector<cropRect> rects;
+            for (const cropRequest& r : requests)
+                if (r.device == d && static_cast<int>(r.stream) == s) rects.push_back(r.rect);
+            if (!set_crop(static_cast<streamType>(s), rects, d)) kept++;
+        }
+    }
+    return kept;
+}
+
+const roiCrop* recordPipeline::crop_for(streamType stream, int device, int width, int height, const bfs::path& r_path)
+{
+    deviceStreams& dev = *devices[device];
+    int s = static_cast<int>(stream);
+
+    if (!dev.cropFixed[s].load(std::memory_order_acquire)) {
+        boost::mutex::scoped_lock guard(cropLock);
+        if (!dev.cropFixed[s]) {
+            roiCrop& crop = dev.crops[s];
+            if (!dev.cropRects[s].empty()) {
+                const char* names[3] = { "colour_roi.txt", "depth_roi.txt", "ir_roi.txt" };
+                if (!crop.set(dev.cropRects[s], width, height, bytes_per_pixel(stream))
+                    || !dev.pools[s] || crop.bytes() > dev.pools[s]->slot_size()) {
+                    std::cout << "Error: ROI of " << names[s] << " does not fit the " << width << "x" << height
+                              << " frame, stored uncropped" << std::endl;
+                    crop = roiCrop();
+                }
+                else if (!crop.save(r_path / names[s]))
+                    std::cout << "Error: could not write " << r_path / names[s] << std::endl;
+                else
+                    std::cout << "Recording " << crop.width() << "x" << crop.height() << " of the " << width << "x" << height
+                              << " frame (" << names[s] << ")" << std::endl;
+            }
+            dev.cropFixed[s].store(true, std::memory_order_release);
+        }
+    }
+    return dev.crops[s].empty() ? 0 : &dev.crops[s];
+}
+
+void recordPipeline::start()
+{
+    if (running) return;
+
+    captureDone = false;
+    convertDone = false;
+    encodeDone = false;
+
+    for (int i = 0; i < cfg.convertWorkers; i++)
+        convertWorkers.create_thread(boost::bind(&recordPipeline::stage_loop, this, &convertQ, &encodeQ, &captureDone, recordStage::convert, &recordPipeline::convert_frame));
+    for (int i = 0; i < cfg.encodeWorkers; i++)
+        encodeWorkers.create_thread(boost::bind(&recordPipeline::stage_loop, this, &encodeQ, &writeQ, &convertDone, recordStage::encode, &recordPipeline::encode_frame));
+    for (int i = 0; i < cfg.writeWorkers; i++)
+        writeWorkers.create_thread(boost::bind(&recordPipeline::stage_loop, this, &writeQ, (jobQueue*)0, &encodeDone, recordStage::write, &recordPipeline::write_frame));
+
+    running = true;
+    accepting = true;
+}
+
+void recordPipeline::stop()
+{
+    // drain: each stage exits once its upstream has finished and its queue is empty
+    if (!running) return;
+    accepting = false;
+
+    captureDone = true;
+    convertWorkers.join_all();
+    convertDone = true;
+    encodeWorkers.join_all();
+    encodeDone = true;
+    writeWorkers.join_all();
+
+    // segment close waits for the outstanding writes of each file
+    ioFileStats io_total;
+    std::memset(&io_total, 0, sizeof(io_total));
+    bool direct = false;
+    for (size_t d = 0; d < devices.size(); d++) {
+        for (int i = 0; i < 3; i++) {
+            segmentWriter& seg = devices[d]->segments[i];
+            direct = direct || seg.is_direct();
+            seg.close();
+            ioFileStats st = seg.io_stats();
+            io_total.writes += st.writes;
+            io_total.completed += st.completed;
+            io_total.failed += st.failed;
+            io_total.retried += st.retried;
+            io_total.bytes += st.bytes;
+        }
+        devices[d]->movie.close();
+        devices[d]->movieFailed = false;
+        {
+            // frames the container never wrote (it could not be written to)
+            boost::mutex::scoped_lock guard(metaLock);
+            devices[d]->movieRows.clear();
+        }
+        for (int i = 0; i < 3; i++) devices[d]->segmentFailed[i] = false;
+        for (int i = 0; i < 3; i++) devices[d]->metaFiles[i].reset();
+    }
+
+    running = false;
+
+    recordStats s = stats();
+    std::cout << "Recorder drained: " << s.written << " frames written, " << s.dropped << " dropped ("
+              << s.poolExhausted << " with frame pool exhausted), " << s.shed << " shed under back-pressure" << std::endl;
+    if (io_total.writes > 0)
+        std::cout << "Segment I/O (" << ioEngine::backend_name(io_backend()) << (direct ? ", direct" : ", buffered") << "): "
+                  << io_total.completed << "/" << io_total.writes << " writes complete, " << io_total.bytes/(1024*1024) << " MB, "
+                  << io_total.failed << " failed" << std::endl;
+}
+
+bool recordPipeline::enqueue(recordJob* job)
+{
+    if (!convertQ.push(job)) {
+        // never block the capture thread: a full queue means the frame is lost
+        n_dropped++;
+        release_job(job);
+        return false;
+    }
+    return true;
+}
+
+recordJob* recordPipeline::capture(streamType stream, int device, const void* data, int width, int height, const roiCrop* crop)
+{
+    // capture stage: copy out of device memory before the next wait_for_frames()
+    uint64_t t0 = now_us();
+    framePool* pool = (device >= 0 && device < cfg.devices) ? devices[device]->pools[static_cast<int>(stream)] : 0;
+    size_t bytes = width*height*bytes_per_pixel(stream);
+    n_submitted++;
+
+    if (!pool || bytes > pool->slot_size()) {
+        std::cout << "Error: stream not configured for " << width << "x" << height << " frames" << std::endl;
+        n_dropped++;
+        return 0;
+    }
+
+    recordJob* job;
+    frameHandle frame = pool->acquire();
+    if (!frame.valid() || !freeJobs.pop(job)) {
+        n_dropped++;
+        return 0;
+    }
+
+    // with a ROI only the regions are copied, and the job takes the cropped size
+    if (crop) crop->crop(data, frame.data());
+    else std::memcpy(frame.data(), data, bytes);
+    job->frame = std::move(frame);
+    job->stream = stream;
+    job->device = device;
+    job->width = crop ? crop->width() : width;
+    job->height = crop ? crop->height() : height;
+    job->submitted = t0;
+    job->quality = cfg.jpeg.quality;
+    job->crop = 0;
+    inFlight++;
+    stageLatency[static_cast<int>(recordStage::copy)].record(now_us() - t0);
+    return job;
+}
+
+void recordPipeline::release_job(recordJob* job)
+{
+    // keep string and vector capacity for the next frame
+    job->frame.reset();
+    job->encoded.clear();
+    job->file.clear();
+    job->crop = 0;
+    inFlight--;
+    freeJobs.bounded_push(job);
+}
+
+void recordPipeline::fill_job(recordJob* job, const sourceFrame& frame, const bfs::path& r_path, int framenum)
+{
+    job->framenum = framenum;
+    job->sensorFrame = frame.framenum;
+    job->timestamp = frame.timestamp;
+    job->backendTimestamp = frame.backendTimestamp;
+    job->arrival = frame.arrival;
+    job->aligned = frame.aligned;
+    job->path = r_path;
+}
+
+bool recordPipeline::submit(streamType stream, const void* data, int width, int height, bfs::path r_path, int framenum, double timestamp, int device)
+{
+    sourceFrame frame;
+    frame.data = data;
+    frame.width = width;
+    frame.height = height;
+    frame.timestamp = timestamp;
+    return submit(stream, frame, r_path, framenum, device);
+}
+
+bool recordPipeline::submit(streamType stream, const sourceFrame& frame, bfs::path r_path, int framenum, int device)
+{
+    if (!accepting || device < 0 || device >= cfg.devices) return false;
+
+    const roiCrop* crop = crop_for(stream, device, frame.width, frame.height, r_path);
+    recordJob* job = capture(stream, device, frame.data, frame.width, frame.height, crop);
+    if (!job) return false;
+    fill_job(job, frame, r_path, framenum);
+
+    return enqueue(job);
+}
+
+int recordPipeline::submit_frameset(const frameSet& frames, const frameFreshness& fresh, bfs::path col_path, bfs::path depth_path, int framenum, int device)
+{
+    if (!accepting || device < 0 || device >= cfg.devices) return 0;
+    deviceStreams& dev = *devices[device];
+
+    if (!dev.pressureLog && cfg.pressure.enabled) {
+        dev.pressureLog = true;
+        dev.pressure->open_log(depth_path / "backpressure_log.csv");
+    }
+
+    // load: the fuller of this device's frame pools and the shared stage queues
+    float fill = cfg.queueCapacity > 0 ? static_cast<float>(inFlight.load())/cfg.queueCapacity : 0.0f;
+    for (int i = 0; i < 3; i++)
+        if (dev.pools[i] && dev.pools[i]->capacity())
+            fill = std::max(fill, 1.0f - static_cast<float>(dev.pools[i]->available())/dev.pools[i]->capacity());
+    double write_ms = writeAverage.load(std::memory_order_relaxed)/1000.0;
+    pressureDecision d = dev.pressure->decide(framenum, fill, write_ms, cfg.jpeg.quality);
+    dev.pressureLevel = dev.pressure->level();
+
+    bool want_colour = fresh.colour && frames.colour.valid();
+    bool want_depth = fresh.depth && frames.depth.valid();
+    bool want_ir = cfg.framesetIR && fresh.ir && frames.ir.valid();
+    n_shed += (want_colour && !d.keepColour) + (want_depth && !d.keepDepth) + (want_ir && !d.keepIR);
+
+    int queued = 0;
+    if (want_colour && d.keepColour) {
+        const roiCrop* crop = crop_for(streamType::colour, device, frames.colour.width, frames.colour.height, col_path);
+        recordJob* job = capture(streamType::colour, device, frames.colour.data, frames.colour.width, frames.colour.height, crop);
+        if (job) {
+            fill_job(job, frames.colour, col_path, framenum);
+            job->quality = d.jpegQuality;
+            queued += enqueue(job);
+        }
+    }
+    if (want_depth && d.keepDepth) queued += submit(streamType::depth, frames.depth, depth_path, framenum, device);
+    if (want_ir && d.keepIR) queued += submit(streamType::infrared, frames.ir, depth_path, framenum, device);
+    return queued;
+}
+
+bool recordPipeline::submit_snapshot(streamType stream, const void* data, int width, int height, bfs::path r_path, std::string r_file, int device)
+{
+    if (!accepting) return false;
+
+    recordJob* job = capture(stream, device, data, width, height);
+    if (!job) return false;
+    fill_job(job, sourceFrame(), r_path, -1);
+    job->file = r_file;
+
+    return enqueue(job);
+}
+
+bool recordPipeline::submit_held(streamType stream, const sourceFrame& frame, frameHandle buffer, bfs::path r_path, int framenum, int device)
+{
+    // the frame already sits in memory nobody else reuses: no copy, and wait rather than drop
+    if (!accepting || !buffer.valid() || device < 0 || device >= cfg.devices) return false;
+
+    uint64_t t0 = now_us();
+    recordJob* job;
+    while (!freeJobs.pop(job)) {
+        if (!accepting) return false;
+        boost::this_thread::sleep_for(boost::chrono::microseconds(200));
+    }
+    n_submitted++;
+    inFlight++;
+
+    job->frame = std::move(buffer);
+    job->stream = stream;
+    job->device = device;
+    job->width = frame.width;
+    job->height = frame.height;
+    job->submitted = t0;
+    job->quality = cfg.jpeg.quality;
+    job->crop = crop_for(stream, device, frame.width, frame.height, r_path);
+    fill_job(job, frame, r_path, framenum);
+
+    push_blocking(&convertQ, job);
+    return true;
+}
+
+void recordPipeline::push_blocking(jobQueue* q, recordJob* job)
+{
+    // inter-stage hand-off: workers wait for room, only the capture stage drops
+    while (!q->push(job))
+        boost::this_thread::sleep_for(boost::chrono::microseconds(200));
+}
+
+void recordPipeline::stage_loop(jobQueue* in, jobQueue* out, std::atomic<bool>* done, recordStage stage, void (recordPipeline::*fn)(recordJob*))
+{
+    recordJob* job;
+    latencyHistogram& timing = stageLatency[static_cast<int>(stage)];
+    latencyHistogram& total = stageLatency[static_cast<int>(recordStage::total)];
+
+    for (;;) {
+        // read the flag BEFORE popping: everything upstream pushed is then visible
+        bool finished = done->load();
+
+        if (in->pop(job)) {
+            uint64_t t0 = now_us();
+            (this->*fn)(job);
+            uint64_t t1 = now_us();
+            timing.record(t1 - t0);
+            if (stage == recordStage::write) {
+                // cheap moving average for the back-pressure policy; lost updates do not matter
+                uint64_t avg = writeAverage.load(std::memory_order_relaxed);
+                writeAverage.store(avg ? (7*avg + (t1 - t0))/8 : (t1 - t0), std::memory_order_relaxed);
+            }
+
+            if (out) push_blocking(out, job);
+            else {
+                total.record(t1 - job->submitted);
+                release_job(job);
+            }
+            continue;
+        }
+
+        if (finished) break;
+        boost::this_thread::sleep_for(boost::chrono::microseconds(200));
+    }
+}
+
+void recordPipeline::convert_frame(recordJob* job)
+{
+    // per-stream pixel format conversion goes here; device formats are stored as-is
+
+    // held frames (burst, pre-trigger) arrive whole: crop them through a per-thread scratch buffer
+    if (job->crop) {
+        static boost::thread_specific_ptr< std::vector<unsigned char> > scratch;
+        if (!scratch.get()) scratch.reset(new std::vector<unsigned char>);
+        scratch->resize(job->crop->bytes());
+        job->crop->crop(job->frame.data(), scratch->data());
+        std::memcpy(job->frame.data(), scratch->data(), scratch->size());
+        job->width = job->crop->width();
+        job->height = job->crop->height();
+        job->crop = 0;
+    }
+}
+
+void recordPipeline::encode_frame(recordJob* job)
+{
+    if (job->stream == streamType::colour) {
+        // each encode worker keeps its own compressor (jpegEncoder::for_thread)
+        jpegSettings settings = cfg.jpeg;
+        settings.quality = job->quality;
+        colImageFrame cfilesave(job->width, job->height, settings);
+        if (!cfilesave.encode_col_frame(job->frame.data(), job->encoded, cfg.jpegStripes ? &tilePool : 0))
+            std::cout << "Error: color frame " << job->framenum << " could not be encoded" << std::endl;
+    }
+    else if (job->stream == streamType::depth && cfg.depth == depthFormat::tz16 && job->file.empty()) {
+        depthImageFrame dfilesave(job->width, job->height);
+        if (!dfilesave.encode_d_frame(job->frame.data(), job->encoded, &tilePool))
+            job->encoded.clear();
+    }
+    // IR (and raw depth) are stored as captured
+}
+
+void recordPipeline::write_frame(recordJob* job)
+{
+    // only frames a container accepted count (late or failed appends are lost)
+    bool stored = true;
+    if (job->stream == streamType::colour) {
+        if (job->encoded.empty()) return;
+        colImageFrame cfilesave(job->width, job->height, cfg.jpeg);
+        mjpegWriter* movie = movie_for(job);
+        if (movie) {
+            // counted when the container writes it, which may be after later frames (movie_emitted)
+            deviceStreams& dev = *devices[job->device];
+            {
+                boost::mutex::scoped_lock guard(metaLock);
+                dev.movieRows[job->framenum] = meta_row(job);
+            }
+            if (!cfilesave.append_col_frame(job->encoded, *movie, job->framenum, job->timestamp)) {
+                boost::mutex::scoped_lock guard(metaLock);
+                dev.movieRows.erase(job->framenum);
+            }
+            return;
+        }
+        if (job->file.empty()) cfilesave.write_col_frame(job->encoded, job->path, job->framenum);
+        else cfilesave.write_col_frame(job->encoded, job->path, job->file);
+    }
+    else if (job->stream == streamType::depth) {
+        depthImageFrame dfilesave(job->width, job->height);
+        segmentWriter* seg = segments_for(job);
+        bool tz16 = !job->encoded.empty();
+        if (seg && tz16) stored = dfilesave.append_d_frame(job->encoded, *seg, job->framenum, job->timestamp);
+        else if (seg) stored = dfilesave.append_d_frame(job->frame.data(), *seg, job->framenum, job->timestamp);
+        else if (tz16) dfilesave.save_d_frame(job->encoded, job->path, job->framenum);
+        else if (job->file.empty()) dfilesave.save_d_frame(job->frame.data(), job->path, job->framenum);
+        else dfilesave.save_d_frame(job->frame.data(), job->path, job->file);
+    }
+    else if (job->stream == streamType::infrared) {
+        irImageFrame irfilesave(job->width, job->height);
+        segmentWriter* seg = segments_for(job);
+        if (seg) stored = irfilesave.append_ir_frame(job->frame.data(), *seg, job->framenum, job->timestamp);
+        else if (job->file.empty()) irfilesave.save_ir_frame(job->frame.data(), job->path, job->framenum);
+        else irfilesave.save_ir_frame(job->frame.data(), job->path, job->file);
+    }
+    if (!stored) return;
+    metaRow row = meta_row(job);
+    if (cfg.metadata && job->file.empty()) write_meta(job->device, job->stream, row);
+    n_bytes += row.bytes;
+    n_written++;
+}
+
+void recordPipeline::movie_emitted(int device, int64_t framenum, bool stored)
+{
+    // called by the colour container, under its lock, as a frame reaches the file
+    metaRow row;
+    {
+        boost::mutex::scoped_lock guard(metaLock);
+        std::map<int64_t, metaRow>& rows = devices[device]->movieRows;
+        std::map<int64_t, metaRow>::iterator it = rows.find(framenum);
+        if (it == rows.end()) return;
+        row = std::move(it->second);
+        rows.erase(it);
+    }
+    if (!stored) return;
+    if (cfg.metadata) write_meta(device, streamType::colour, row);
+    n_bytes += row.bytes;
+    n_written++;
+}
+
+segmentWriter* recordPipeline::segments_for(recordJob* job)
+{
+    // snapshots always go to their own named file
+    if (cfg.raw != rawStorage::segmented || !job->file.empty()) return 0;
+
+    deviceStreams& dev = *devices[job->device];
+    int s = static_cast<int>(job->stream);
+    segmentWriter& seg = dev.segments[s];
+    boost::mutex::scoped_lock guard(segmentLock);
+    if (dev.segmentFailed[s]) return 0;
+    if (!seg.is_open()) {
+        const char* prefix = (job->stream == streamType::depth) ? "depth" : "ir";
+        if (!seg.open(job->path, prefix, job->width, job->height, bytes_per_pixel(job->stream), cfg.segments, io.get())) {
+            // reported and latched once, like the colour container
+            std::cout << "Error: " << prefix << " segments for camera " << job->device << " could not be opened in "
+                      << job->path << ", writing single files" << std::endl;
+            dev.segmentFailed[s] = true;
+            return 0;
+        }
+    }
+    return &seg;
+}
+
+mjpegWriter* recordPipeline::movie_for(recordJob* job)
+{
+    // snapshots stay single JPEG files
+    if (cfg.colour != colourStorage::mjpegAvi || !job->file.empty()) return 0;
+
+    deviceStreams& dev = *devices[job->device];
+    boost::mutex::scoped_lock guard(segmentLock);
+    if (dev.movieFailed) return 0;
+    if (!dev.movie.is_open() && !dev.movie.open(job->path, "colour", job->width, job->height, cfg.movie)) {
+        // reported and latched once: the rest of the session is stored as single JPEG files
+        std::cout << "Error: colour container for camera " << job->device << " could not be opened in "
+                  << job->path << ", writing single JPEG files" << std::endl;
+        dev.movieFailed = true;
+        return 0;
+    }
+    return &dev.movie;
+}
+
+recordPipeline::metaRow recordPipeline::meta_row(const recordJob* job) const
+{
+    metaRow row;
+    row.framenum = job->framenum;
+    row.sensorFrame = job->sensorFrame;
+    row.timestamp = job->timestamp;
+    row.backendTimestamp = job->backendTimestamp;
+    row.aligned = job->aligned;
+    row.arrival = job->arrival;
+    row.enqueued = job->submitted/1000.0;
+    row.bytes = job->encoded.empty() ? job->width*job->height*bytes_per_pixel(job->stream) : job->encoded.size();
+    row.path = job->path;
+    return row;
+}
+
+void recordPipeline::write_meta(int device, streamType stream, const metaRow& row)
+{
+    // one row per stored frame; rows follow write completion, sort by frame to replay
+    double written = host_ms();
+    int s = static_cast<int>(stream);
+    std::unique_ptr<bfs::ofstream>& meta = devices[device]->metaFiles[s];
+
+    boost::mutex::scoped_lock guard(metaLock);
+    if (!meta) {
+        const char* names[3] = { "colour_meta.csv", "depth_meta.csv", "ir_meta.csv" };
+        meta.reset(new bfs::ofstream(row.path / names[s]));
+        *meta << "frame,sensor_frame,hw_timestamp_ms,backend_timestamp_ms,aligned_ms,arrival_ms,enqueue_ms,written_ms,bytes\n";
+        meta->precision(15);
+    }
+    *meta << row.framenum << ',' << row.sensorFrame << ',' << row.timestamp << ','
+          << row.backendTimestamp << ',' << row.aligned << ',' << row.arrival << ','
+          << row.enqueued << ',' << written << ',' << row.bytes << '\n';
+}
+
+recordStats recordPipeline::stats() const
+{
+    recordStats s;
+    s.submitted = n_submitted;
+    s.dropped = n_dropped;
+    s.written = n_written;
+    s.shed = n_shed;
+    s.bytes = n_bytes;
+    s.poolExhausted = 0;
+    s.pressureLevel = 0;
+    s.writeErrors = 0;
+    for (size_t d = 0; d < devices.size(); d++) {
+        for (int i = 0; i < 3; i++) {
+            if (devices[d]->pools[i]) s.poolExhausted += devices[d]->pools[i]->exhausted();
+            s.writeErrors += devices[d]->segments[i].io_stats().failed;
+        }
+        s.writeErrors += devices[d]->movie.write_errors();
+        s.pressureLevel = std::max(s.pressureLevel, devices[d]->pressureLevel.load());
+    }
+    return s;
+}
+
+void recordPipeline::reset_latency()
+{
+    for (int i = 0; i < RECORD_STAGES; i++) stageLatency[i].reset();
+}
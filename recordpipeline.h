@@ -0,0 +1,284 @@
+/* recordpipeline.h
+ *
+ * Description:
+ *   header file for recordPipeline class
+ *   Persistent recording engine: replaces the detached boost::thread that was
+ *   spawned for every stored frame with a fixed set of workers fed by bounded
+ *   lock-free queues. Frames move through four stages:
+ *     capture (caller thread) -> convert -> encode -> write
+ *   If a queue is full the frame is dropped and counted, so the capture loop
+ *   never blocks on slow disks.
+ *   Each stream has its own framePool sized for its format; jobs are recycled
+ *   from a preallocated list, so steady-state recording does not allocate.
+ *   Several cameras can record into one pipeline: every device has its own
+ *   frame pools, segment files, metadata and back-pressure state, and may be
+ *   fed from its own capture thread, while encode and write workers are shared.
+ *   Depth and IR are stored either as one .dat file per frame (perFile) or
+ *   appended to per-session segment containers (segmented, see segmentwriter.h).
+ *   Colour is stored as one JPEG per frame (perFile) or appended to a single
+ *   MJPEG AVI per session (mjpegAvi, see mjpegwriter.h).
+ *   Segment files are written asynchronously through one shared ioEngine
+ *   (io_uring, or a thread pool where unavailable) with O_DIRECT, so raw
+ *   streams bypass the page cache and every write completion is checked.
+ *   Depth can be losslessly compressed in the encode stage (depthFormat::tz16).
+ *   Both TZ16 bands and, with jpegStripes, JPEG stripes of one frame are coded
+ *   in parallel on the tile workers.
+ *   Each stored frame gets a metadata row (<stream>_meta.csv next to the
+ *   frames): file frame number, sensor frame number, hardware and backend
+ *   timestamps, arrival, enqueue and write-complete times. Colour frames the
+ *   MJPEG container holds back for reordering get their row, and are counted
+ *   as written, only once the container has written them.
+ *   submit_frameset applies the back-pressure policy (backpressure.h): under
+ *   load, colour quality is lowered, colour decimated or whole framesets shed
+ *   before the queues overflow.
+ *   Every stage is timed into a latencyHistogram (copy, convert, encode, write,
+ *   and total from submit to written) for benchmarking.
+ *   With ROI rectangles set for a stream (set_crop), recorded frames shrink
+ *   to those regions (roicrop.h): copied frames are cropped by the capture
+ *   copy itself, held frames in the convert stage. The layout is fixed at the
+ *   stream's first stored frame and saved as <stream>_roi.txt with the
+ *   frames. Snapshots are always stored whole.
+ *
+ * Functions:
+ *   add_stream - preallocates the frame pool for a stream (call before start)
+ *   set_crop - ROI rectangles of a stream; false once the stream has stored frames
+ *   load_crop - set_crop for every stream from a recording ROI file; returns the streams that keep
+ *   their layout because they already stored frames, -1 if the file cannot be read
+ *   start - launches the worker threads
+ *   add_stream and the submit functions take an optional device index (0 .. recordConfig::devices-1)
+ *   submit - copies a frame buffer (or a sourceFrame with its metadata) into a job and queues it (capture stage)
+ *   submit_frameset - submits the new frames of a synchronized frameset, subject to back-pressure
+ *   submit_snapshot - as submit, but saves to a named file
+ *   submit_held - queues a frame already held in a framePool slot (e.g. a frameRing) without
+ *   copying; waits for room instead of dropping, so buffered frames are never lost
+ *   stop - stops accepting frames, drains every stage in order, joins workers
+ *   stats - frame and byte counters, failed segment and colour container writes
+ *   latency - per-stage latency histogram (us); reset_latency clears them
+ *
+ * Input:
+ *   recordConfig (worker counts, queue capacity, frame pools, JPEG settings)
+ *   frame buffer pointer, stream type, dimensions, save directory, frame number or filename,
+ *   frame timestamp (ms)
+ *
+ * Output:
+ *   none (frames are written by the frame classes)
+ *
+ * Requirements:
+ *   boost/lockfree
+ *   boost/thread
+ *   boost/filesystem
+ *
+ * Thread safe? submit/submit_frameset/submit_snapshot from ONE capture thread per device, submit_held from
+ *   one more thread per device; stats from any thread
+ *
+ * Extendable? YES
+ */
+
+#ifndef RECORDPIPELINE_H
+#define RECORDPIPELINE_H
+
+#include <boost/filesystem.hpp>
+#include <boost/lockfree/queue.hpp>
+#include <boost/lockfree/stack.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "framepool.h"
+#include "streamtype.h"
+#include "jpegencoder.h"
+#include "segmentwriter.h"
+#include "mjpegwriter.h"
+#include "workerpool.h"
+#include "latencyhistogram.h"
+#include "framesource.h"
+#include "backpressure.h"
+#include "ioengine.h"
+#include "roicrop.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class rawStorage { perFile, segmented };
+
+enum class depthFormat { raw, tz16 };
+
+enum class colourStorage { perFile, mjpegAvi };
+
+enum class recordStage { copy, convert, encode, write, total };
+const int RECORD_STAGES = 5;
+
+struct recordConfig
+{
+    int convertWorkers = 1;
+    int encodeWorkers = 2;
+    int writeWorkers = 1;
+    int queueCapacity = 64;     // per stage, frames (must be < 65535)
+    int poolFrames = 32;        // buffered frames per stream
+    bool hugepages = false;     // back frame pools with 2MB pages (needs vm.nr_hugepages)
+    bool lockPages = true;      // mlock frame pools
+    jpegSettings jpeg;          // colour quality / chroma subsampling
+    rawStorage raw = rawStorage::perFile;   // depth/IR layout on disk
+    segmentConfig segments;                 // used when raw == segmented
+    ioConfig io;                            // async writes of the segment files
+    colourStorage colour = colourStorage::perFile;  // colour layout on disk
+    mjpegConfig movie;                              // used when colour == mjpegAvi
+    depthFormat depth = depthFormat::raw;   // tz16: lossless compressed depth
+    int tileWorkers = 0;                    // extra threads coding bands of one frame
+    bool jpegStripes = false;               // colour frames coded in restart-marker stripes on the tile workers
+    bool metadata = true;                   // write <stream>_meta.csv per stream
+    bool framesetIR = false;                // submit_frameset stores IR as well
+    backPressureConfig pressure;            // load shedding in submit_frameset
+    int devices = 1;                        // cameras recording into this pipeline
+};
+
+struct recordJob
+{
+    streamType stream;
+    int device;
+    int width;
+    int height;
+    int framenum;                           // file numbering
+    int64_t sensorFrame;                    // camera frame counter, -1 if unknown
+    double timestamp;                       // ms, as reported with the frame
+    double backendTimestamp;                // ms, driver receive time (0 if unknown)
+    double arrival;                         // host_ms() when the source returned the frame
+    double aligned;                         // ms, hardware time on the host clock (multi-device), 0 if unknown
+    int quality;                            // JPEG quality for this frame (back-pressure may lower it)
+    const roiCrop* crop;                    // held frame still to be cropped in the convert stage, else 0
+    std::string file;                       // snapshot filename, empty for numbered frames
+    boost::filesystem::path path;
+    frameHandle frame;                      // captured copy of the device buffer
+    std::vector<unsigned char> encoded;     // output of the encode stage (capacity reused)
+    uint64_t submitted;                     // us, steady clock, when capture started
+};
+
+struct recordStats
+{
+    long long submitted;
+    long long dropped;
+    long long written;
+    long long bytes;            // frame payload bytes handed to the writers
+    long long poolExhausted;    // frames lost because no buffer was free
+    long long shed;             // frames left out by the back-pressure policy
+    int pressureLevel;          // current back-pressure step (0 = normal)
+    long long writeErrors;      // segment and colour container writes that did not complete in full
+};
+
+class recordPipeline
+{
+    typedef boost::lockfree::queue<recordJob*, boost::lockfree::fixed_sized<true> > jobQueue;
+
+    // metadata of a stored frame, kept while the colour container holds the frame back
+    struct metaRow
+    {
+        int framenum;
+        int64_t sensorFrame;
+        double timestamp;
+        double backendTimestamp;
+        double aligned;
+        double arrival;
+        double enqueued;                                            // ms, steady clock
+        size_t bytes;
+        boost::filesystem::path path;
+    };
+
+    // per-camera state; arrays indexed by streamType
+    struct deviceStreams
+    {
+        framePool* pools[3];
+        segmentWriter segments[3];                                  // opened on first frame
+        bool segmentFailed[3];                                      // open failed: single files until stop() (segmentLock)
+        mjpegWriter movie;                                          // colour container, opened on first frame
+        bool movieFailed;                                           // open failed: single JPEGs until stop() (segmentLock)
+        std::map<int64_t, metaRow> movieRows;                       // handed to the container, not written yet (metaLock)
+        std::unique_ptr<boost::filesystem::ofstream> metaFiles[3];
+        std::unique_ptr<backPressure> pressure;                     // capture thread of the device only
+        bool pressureLog;
+        std::atomic<int> pressureLevel;
+        std::vector<cropRect> cropRects[3];                         // requested (cropLock)
+        roiCrop crops[3];                                           // layout in use, fixed at the first stored frame
+        std::atomic<bool> cropFixed[3];
+
+        deviceStreams(const backPressureConfig& p_cfg);
+        ~deviceStreams();
+    };
+
+    recordConfig cfg;
+
+    std::unique_ptr<ioEngine> io;           // outlives the segment writers that use it
+    std::vector< std::unique_ptr<deviceStreams> > devices;
+    std::vector<recordJob> jobs;
+    boost::lockfree::stack<recordJob*, boost::lockfree::fixed_sized<true> > freeJobs;
+
+    workerPool tilePool;                    // intra-frame parallelism for the encoders
+    boost::mutex segmentLock;
+    boost::mutex metaLock;
+    boost::mutex cropLock;
+
+    jobQueue convertQ;
+    jobQueue encodeQ;
+    jobQueue writeQ;
+
+    boost::thread_group convertWorkers;
+    boost::thread_group encodeWorkers;
+    boost::thread_group writeWorkers;
+
+    std::atomic<bool> running;
+    std::atomic<bool> accepting;
+    std::atomic<bool> captureDone;      // upstream-finished flags, one per stage input
+    std::atomic<bool> convertDone;
+    std::atomic<bool> encodeDone;
+
+    std::atomic<long long> n_submitted;
+    std::atomic<long long> n_dropped;
+    std::atomic<long long> n_written;
+    std::atomic<long long> n_bytes;
+    std::atomic<long long> n_shed;
+
+    std::atomic<int> inFlight;                  // jobs between capture and release
+    std::atomic<uint64_t> writeAverage;         // us, moving average of the write stage
+
+    latencyHistogram stageLatency[RECORD_STAGES];   // indexed by recordStage
+
+    recordJob* capture(streamType stream, int device, const void* data, int width, int height, const roiCrop* crop = 0);
+    const roiCrop* crop_for(streamType stream, int device, int width, int height, const boost::filesystem::path& r_path);
+    void fill_job(recordJob* job, const sourceFrame& frame, const boost::filesystem::path& r_path, int framenum);
+    void release_job(recordJob* job);
+    bool enqueue(recordJob* job);
+    void stage_loop(jobQueue* in, jobQueue* out, std::atomic<bool>* done, recordStage stage, void (recordPipeline::*fn)(recordJob*));
+    void push_blocking(jobQueue* q, recordJob* job);
+
+    void convert_frame(recordJob* job);
+    void encode_frame(recordJob* job);
+    void write_frame(recordJob* job);
+    segmentWriter* segments_for(recordJob* job);
+    mjpegWriter* movie_for(recordJob* job);
+    metaRow meta_row(const recordJob* job) const;
+    void write_meta(int device, streamType stream, const metaRow& row);
+    void movie_emitted(int device, int64_t framenum, bool stored);
+
+public:
+    recordPipeline(const recordConfig& r_cfg);
+    ~recordPipeline();
+
+    void add_stream(streamType stream, int width, int height, int device = 0);
+    bool set_crop(streamType stream, const std::vector<cropRect>& rects, int device = 0);
+    int load_crop(const boost::filesystem::path& file);
+    void start();
+    bool submit(streamType stream, const void* data, int width, int height, boost::filesystem::path r_path, int framenum, double timestamp = 0.0, int device = 0);
+    bool submit(streamType stream, const sourceFrame& frame, boost::filesystem::path r_path, int framenum, int device = 0);
+    int submit_frameset(const frameSet& frames, const frameFreshness& fresh, boost::filesystem::path col_path, boost::filesystem::path depth_path, int framenum, int device = 0);
+    bool submit_snapshot(streamType stream, const void* data, int width, int height, boost::filesystem::path r_path, std::string r_file, int device = 0);
+    bool submit_held(streamType stream, const sourceFrame& frame, frameHandle buffer, boost::filesystem::path r_path, int framenum, int device = 0);
+    void stop();
+
+    recordStats stats() const;
+    ioBackend io_backend() const { return io ? io->backend() : ioBackend::sync; }
+    const latencyHistogram& latency(recordStage stage) const { return stageLatency[static_cast<int>(stage)]; }
+    void reset_latency();
+};
+
+#endif // RECORDPIPELINE_H
@@ -0,0 +1,116 @@
+#include "replaysource.h"
+
+#include <boost/thread/thread.hpp>
+
+#include <iostream>
+
+#include "segmentwriter.h"
+#include "depthaligner.h"
+
+namespace bchrono = boost::chrono;
+
+replaySource::replaySource(const replayConfig& r_cfg) : cfg(r_cfg), cursor(0), played(0), firstStamp(-1.0)
+{
+}
+
+bool replaySource::start()
+{
+    if (!reader.open(cfg.depthDir, cfg.colDir, cfg.depthWidth, cfg.depthHeight)) {
+        std::cerr << "Replay: cannot open session " << cfg.depthDir << std::endl;
+        return false;
+    }
+    if (reader.frame_count(streamType::depth) == 0) {
+        std::cerr << "Replay: no depth frames in " << cfg.depthDir << std::endl;
+        return false;
+    }
+    reader.set_readahead(cfg.readahead, 1);
+
+    // per-file sessions carry no timestamps: pace by fps instead
+    int n = reader.frame_count(streamType::depth);
+    if (reader.view(streamType::depth, n - 1).timestamp <= reader.view(streamType::depth, 0).timestamp)
+        firstStamp = -1.0;
+    else
+        firstStamp = reader.view(streamType::depth, 0).timestamp;
+
+    std::cout << "Replay: " << n << " depth, " << reader.frame_count(streamType::colour) << " colour, "
+              << reader.frame_count(streamType::infrared) << " IR frames" << std::endl;
+
+    cursor = 0;
+    played = 0;
+    startTime = bchrono::steady_clock::now();
+    return true;
+}
+
+void replaySource::pace(double stamp)
+{
+    if (!cfg.realtime) return;
+
+    double due_ms;
+    if (firstStamp >= 0.0) due_ms = (stamp - firstStamp)/cfg.speed;
+    else due_ms = cfg.fps > 0 ? played*1000.0/(cfg.fps*cfg.speed) : 0.0;
+
+    boost::this_thread::sleep_until(startTime + bchrono::microseconds(static_cast<int64_t>(due_ms*1000.0)));
+}
+
+bool replaySource::wait_for_frames(frameSet& frames)
+{
+    frames = frameSet();
+
+    if (cursor >= reader.frame_count(streamType::depth)) {
+        if (!cfg.loop) return false;
+        cursor = 0;
+        played = 0;
+        startTime = bchrono::steady_clock::now();
+    }
+    int index = cursor++;
+
+    frameView dv = reader.view(streamType::depth, index);
+    int w = 0, h = 0;
+    if (!dv.valid() || !reader.depth(index, depthBuf, w, h)) return false;
+
+    pace(dv.timestamp);
+    played++;
+
+    frames.depth.data = depthBuf.data();
+    frames.depth.width = w;
+    frames.depth.height = h;
+    frames.depth.framenum = dv.framenum;
+    frames.depth.timestamp = dv.timestamp;
+
+    int ii = reader.find_frame(streamType::infrared, dv.framenum);
+    if (ii < 0 && firstStamp >= 0.0) ii = reader.find_time(streamType::infrared, dv.timestamp);
+    irView = ii >= 0 ? reader.view(streamType::infrared, ii) : frameView();
+    const roiCrop& irCrop = reader.crop(streamType::infrared);
+    if (irView.valid() && irView.codec == SEG_CODEC_RAW && !irCrop.empty()) {
+        // cropped IR goes back into a sensor-size frame, like depth and colour
+        irBuf.resize(static_cast<size_t>(irCrop.sensor_width())*irCrop.sensor_height());
+        if (irView.size >= irCrop.bytes()) irCrop.uncrop(irView.data, irBuf.data());
+        else irView = frameView();
+    }
+    if (irView.valid() && irView.codec == SEG_CODEC_RAW) {
+        frames.ir.data = irCrop.empty() ? irView.data : irBuf.data();
+        frames.ir.width = irCrop.empty() ? irView.width : irCrop.sensor_width();
+        frames.ir.height = irCrop.empty() ? irView.height : irCrop.sensor_height();
+        frames.ir.framenum = irView.framenum;
+        frames.ir.timestamp = irView.timestamp;
+    }
+
+    int ci = reader.find_frame(streamType::colour, dv.framenum);
+    if (ci < 0 && firstStamp >= 0.0) ci = reader.find_time(streamType::colour, dv.timestamp);
+    int cw = 0, ch = 0;
+    if (ci >= 0 && reader.colour(ci, colBuf, cw, ch, cfg.colScale)) {
+        frameView cv = reader.view(streamType::colour, ci);
+        frames.colour.data = colBuf.data();
+        frames.colour.width = cw;
+        frames.colour.height = ch;
+        frames.colour.framenum = cv.framenum;
+        frames.colour.timestamp = cv.timestamp;
+    }
+    frames.stamp_arrival();
+    return true;
+}
+
+bool replaySource::calibration(alignCalibration& out) const
+{
+    return out.load(cfg.depthDir / "calibration.txt");
+}
@@ -0,0 +1,89 @@
+/* replaysource.h
+ *
+ * Description:
+ *   header file for replaySource class
+ *   frameSource that plays a recorded session (D_N / RGB_N folders) back
+ *   through sessionReader, so recording and analysis code can be run again on
+ *   real data. Depth drives playback; colour and IR are matched to each depth
+ *   frame by frame number, or by nearest timestamp if the numbers differ.
+ *   Playback follows the recorded timestamps (scaled by speed), or runs as fast
+ *   as the consumer takes frames.
+ *   Sessions recorded with a ROI play back at the sensor size, with zero
+ *   outside the recorded regions.
+ *
+ * Functions:
+ *   see framesource.h
+ *   calibration - read from calibration.txt in the depth folder, if it was recorded
+ *
+ * Input:
+ *   replayConfig (session folders, pacing, looping)
+ *
+ * Output:
+ *   frameSet
+ *
+ * Requirements:
+ *   sessionreader.h, depthaligner.h
+ *   boost/chrono, boost/thread
+ *
+ * Thread safe? NO
+ *
+ * Extendable? YES
+ */
+
+#ifndef REPLAYSOURCE_H
+#define REPLAYSOURCE_H
+
+#include <boost/filesystem.hpp>
+#include <boost/chrono/chrono.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "framesource.h"
+#include "sessionreader.h"
+
+struct replayConfig
+{
+    boost::filesystem::path depthDir;
+    boost::filesystem::path colDir;
+    int depthWidth = 0;         // only needed for headerless per-frame .dat sessions
+    int depthHeight = 0;
+    bool realtime = true;       // false: as fast as wait_for_frames is called
+    float speed = 1.0f;         // playback rate in realtime mode
+    float fps = 30;             // pacing when the session has no timestamps
+    bool loop = false;
+    int colScale = 1;           // 1, 2, 4, 8: decode colour at reduced size
+    float depthScale = 0.001f;  // metres per unit the session was recorded with
+    int readahead = 8;
+};
+
+class replaySource : public frameSource
+{
+    replayConfig cfg;
+    sessionReader reader;
+
+    int cursor;
+    int64_t played;
+    double firstStamp;
+    boost::chrono::steady_clock::time_point startTime;
+
+    std::vector<uint16_t> depthBuf;
+    std::vector<unsigned char> colBuf;
+    std::vector<unsigned char> irBuf;           // cropped sessions only
+    frameView irView;           // keeps the IR mapping alive until the next call
+
+    void pace(double stamp);
+
+public:
+    explicit replaySource(const replayConfig& r_cfg);
+
+    bool start();
+    bool wait_for_frames(frameSet& frames);
+    void stop() {}
+
+    float depth_scale() const { return cfg.depthScale; }
+    bool calibration(alignCalibration& out) const;
+    std::string name() const { return "replay"; }
+};
+
+#endif // REPLAYSOURCE_H
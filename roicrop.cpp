@@ -0,0 +1,175 @@
+#include "roicrop.h"
+
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace bfs = boost::filesystem;
+
+roiCrop::roiCrop() : sensorWidth(0), sensorHeight(0), canvasWidth(0), canvasHeight(0), bpp(1)
+{
+}
+
+bool roiCrop::set(const std::vector<cropRect>& c_rects, int s_width, int s_height, int c_bpp)
+{
+    rects.clear();
+    rows.clear();
+    sensorWidth = s_width;
+    sensorHeight = s_height;
+    canvasWidth = canvasHeight = 0;
+    bpp = c_bpp;
+
+    for (const cropRect& r : c_rects) {
+        cropRect c;
+        c.x = std::max(r.x, 0);
+        c.y = std::max(r.y, 0);
+        c.width = std::min(r.x + r.width, s_width) - c.x;
+        c.height = std::min(r.y + r.height, s_height) - c.y;
+        if (c.width <= 0 || c.height <= 0) continue;
+
+        rects.push_back(c);
+        rows.push_back(canvasHeight);
+        canvasWidth = std::max(canvasWidth, c.width);
+        canvasHeight += c.height;
+    }
+    if (rects.empty()) canvasWidth = canvasHeight = 0;
+    return !rects.empty();
+}
+
+void roiCrop::crop(const void* sensor, void* canvas) const
+{
+    const unsigned char* src = static_cast<const unsigned char*>(sensor);
+    unsigned char* dst = static_cast<unsigned char*>(canvas);
+    const size_t srcStride = static_cast<size_t>(sensorWidth)*bpp;
+    const size_t dstStride = static_cast<size_t>(canvasWidth)*bpp;
+
+    for (size_t i = 0; i < rects.size(); i++) {
+        const cropRect& r = rects[i];
+        const unsigned char* s = src + r.y*srcStride + static_cast<size_t>(r.x)*bpp;
+        unsigned char* d = dst + rows[i]*dstStride;
+        const size_t len = static_cast<size_t>(r.width)*bpp;
+
+        // full-width bands are contiguous on both sides
+        if (len == srcStride && len == dstStride) {
+            std::memcpy(d, s, len*r.height);
+            continue;
+        }
+        for (int y = 0; y < r.height; y++, s += srcStride, d += dstStride) {
+            std::memcpy(d, s, len);
+            if (len < dstStride) std::memset(d + len, 0, dstStride - len);
+        }
+    }
+}
+
+void roiCrop::uncrop(const void* canvas, void* sensor, int scale_denom) const
+{
+    // at 1/n scale (reduced JPEG decode) both images are rounded up, positions down
+    const int n = std::max(1, scale_denom);
+    const int sw = (sensorWidth + n - 1)/n;
+    const int sh = (sensorHeight + n - 1)/n;
+    const int cw = (canvasWidth + n - 1)/n;
+    const int ch = (canvasHeight + n - 1)/n;
+    const unsigned char* src = static_cast<const unsigned char*>(canvas);
+    unsigned char* dst = static_cast<unsigned char*>(sensor);
+
+    std::memset(dst, 0, static_cast<size_t>(sw)*sh*bpp);
+    for (size_t i = 0; i < rects.size(); i++) {
+        const cropRect& r = rects[i];
+        int x0 = r.x/n;
+        int y0 = r.y/n;
+        int row0 = rows[i]/n;
+        int w = std::min((r.width + n - 1)/n, std::min(cw, sw - x0));
+        int h = std::min((r.height + n - 1)/n, std::min(ch - row0, sh - y0));
+        for (int y = 0; y < h; y++)
+            std::memcpy(dst + (static_cast<size_t>(y0 + y)*sw + x0)*bpp,
+                        src + static_cast<size_t>(row0 + y)*cw*bpp, static_cast<size_t>(w)*bpp);
+    }
+}
+
+bool roiCrop::to_sensor(int cx, int cy, int& sx, int& sy) const
+{
+    for (size_t i = 0; i < rects.size(); i++) {
+        const cropRect& r = rects[i];
+        if (cy < rows[i] || cy >= rows[i] + r.height) continue;
+        if (cx < 0 || cx >= r.width) return false;      // padding
+        sx = r.x + cx;
+        sy = r.y + cy - rows[i];
+        return true;
+    }
+    return false;
+}
+
+bool roiCrop::save(const bfs::path& file) const
+{
+    bfs::ofstream out(file);
+    if (!out) return false;
+
+    out << "# ROI crop: the rectangles of the sensor frame, stacked top to bottom into the stored frames\n";
+    out << "sensor " << sensorWidth << " " << sensorHeight << "\n";
+    out << "canvas " << canvasWidth << " " << canvasHeight << "\n";
+    out << "bytes_per_pixel " << bpp << "\n";
+    for (size_t i = 0; i < rects.size(); i++)
+        out << "rect " << rects[i].x << " " << rects[i].y << " " << rects[i].width << " " << rects[i].height << " " << rows[i] << "\n";
+    return static_cast<bool>(out);
+}
+
+bool roiCrop::load(const bfs::path& file)
+{
+    bfs::ifstream in(file);
+    if (!in) return false;
+
+    std::vector<cropRect> found;
+    int sw = 0, sh = 0, pixel = 1;
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string kind;
+        if (!(fields >> kind)) continue;
+
+        cropRect r;
+        int row;
+        if (kind == "sensor") fields >> sw >> sh;
+        else if (kind == "bytes_per_pixel") fields >> pixel;
+        else if (kind == "rect" && fields >> r.x >> r.y >> r.width >> r.height >> row) found.push_back(r);
+    }
+    // the canvas rows follow from the rectangles
+    return sw > 0 && sh > 0 && set(found, sw, sh, pixel);
+}
+
+bool load_crop_rects(const bfs::path& file, std::vector<cropRequest>& out)
+{
+    bfs::ifstream in(file);
+    if (!in) return false;
+
+    std::string line;
+    int lineNum = 0;
+    while (std::getline(in, line)) {
+        lineNum++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string kind;
+        if (!(fields >> kind)) continue;
+
+        cropRequest req;
+        req.device = 0;
+        if (kind == "colour" || kind == "color") req.stream = streamType::colour;
+        else if (kind == "depth") req.stream = streamType::depth;
+        else if (kind == "ir") req.stream = streamType::infrared;
+        else {
+            std::cerr << file << ":" << lineNum << ": unknown stream " << kind << std::endl;
+            return false;
+        }
+        if (!(fields >> req.rect.x >> req.rect.y >> req.rect.width >> req.rect.height)) {
+            std::cerr << file << ":" << lineNum << ": bad ROI line" << std::endl;
+            return false;
+        }
+        fields >> req.device;
+        out.push_back(req);
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+/* roicrop.h
+ *
+ * Description:
+ *   header file for roiCrop class
+ *   Region-of-interest cropping for recording: the arena covers only part of
+ *   each sensor's view, so only the rectangles that matter are copied,
+ *   encoded and stored. The rectangles of a stream are clipped to the sensor
+ *   frame and stacked top to bottom, left-aligned, into one smaller frame (the
+ *   canvas); narrower rectangles are padded with zero bytes on the right.
+ *   A single rectangle is simply the cropped frame. Stored frames keep their
+ *   usual formats (JPEG, raw, TZ16, segments), only with the canvas size.
+ *
+ *   The geometry goes with the session as <stream>_roi.txt next to the
+ *   stream's frames, so readers can put pixels back where the sensor saw them
+ *   (uncrop, to_sensor). Layout, # starts a comment:
+ *     sensor <width> <height>
+ *     canvas <width> <height>
+ *     bytes_per_pixel <n>
+ *     rect <x> <y> <width> <height> <canvas_y>      (one per rectangle)
+ *
+ *   Recording ROI file (load_crop_rects), one rectangle per line:
+ *     <colour|depth|ir> <x> <y> <width> <height> [camera]
+ *
+ * Functions:
+ *   set - lays out rectangles for a sensor frame size; false if nothing is left after clipping
+ *   crop - copies the rectangles of a sensor frame into a canvas
+ *   uncrop - puts a canvas back into a sensor frame (zero outside the rectangles), optionally
+ *   at 1/2, 1/4 or 1/8 scale for reduced-scale JPEG decodes
+ *   to_sensor - sensor coordinates of a canvas pixel
+ *   save/load - the session geometry file
+ *   load_crop_rects - reads a recording ROI file
+ *
+ * Input:
+ *   rectangles, sensor frame size, bytes per pixel
+ *
+ * Output:
+ *   canvas frames, geometry file
+ *
+ * Requirements:
+ *   streamtype.h
+ *   boost/filesystem
+ *
+ * Thread safe? crop/uncrop/to_sensor YES once set; set/load NO
+ *
+ * Extendable? YES
+ */
+
+#ifndef ROICROP_H
+#define ROICROP_H
+
+#include <boost/filesystem.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include "streamtype.h"
+
+struct cropRect
+{
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// one line of a recording ROI file
+struct cropRequest
+{
+    streamType stream;
+    int device;
+    cropRect rect;
+};
+
+class roiCrop
+{
+    std::vector<cropRect> rects;        // clipped to the sensor frame
+    std::vector<int> rows;              // first canvas row of each rectangle
+    int sensorWidth;
+    int sensorHeight;
+    int canvasWidth;
+    int canvasHeight;
+    int bpp;
+
+public:
+    roiCrop();
+
+    bool set(const std::vector<cropRect>& c_rects, int s_width, int s_height, int c_bpp);
+    bool empty() const { return rects.empty(); }
+    int width() const { return canvasWidth; }
+    int height() const { return canvasHeight; }
+    int sensor_width() const { return sensorWidth; }
+    int sensor_height() const { return sensorHeight; }
+    size_t bytes() const { return static_cast<size_t>(canvasWidth)*canvasHeight*bpp; }
+    const std::vector<cropRect>& regions() const { return rects; }
+
+    void crop(const void* sensor, void* canvas) const;
+    void uncrop(const void* canvas, void* sensor, int scale_denom = 1) const;
+    bool to_sensor(int cx, int cy, int& sx, int& sy) const;
+
+    bool save(const boost::filesystem::path& file) const;
+    bool load(const boost::filesystem::path& file);
+};
+
+bool load_crop_rects(const boost::filesystem::path& file, std::vector<cropRequest>& out);
+
+#endif // ROICROP_H
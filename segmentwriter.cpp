@@ -0,0 +1,211 @@
+#include "segmentwriter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace bfs = boost::filesystem;
+
+static uint64_t pad8(uint64_t n) { return (n + 7) & ~static_cast<uint64_t>(7); }
+
+segmentWriter::segmentWriter()
+    : io(0), current(0), bufferStart(0), tailInFlight(false), segment(0), offset(0), lastIndex(0), frames(0)
+{
+    std::memset(&header, 0, sizeof(header));
+}
+
+segmentWriter::~segmentWriter()
+{
+    close();
+}
+
+std::string segmentWriter::segment_name(const std::string& s_prefix, uint32_t seg)
+{
+    char num[16];
+    std::snprintf(num, sizeof(num), "%04u", seg);
+    return s_prefix + "_seg_" + num + ".tsc";
+}
+
+bool segmentWriter::open(bfs::path s_dir, std::string s_prefix, int width, int height, int bytes_per_pixel,
+                         const segmentConfig& s_cfg, ioEngine* s_io)
+{
+    boost::mutex::scoped_lock guard(lock);
+    if (file.is_open()) return true;
+
+    dir = s_dir;
+    prefix = s_prefix;
+    cfg = s_cfg;
+    io = s_io;
+
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "TSCSEG01", 8);
+    header.version = 1;
+    header.width = width;
+    header.height = height;
+    header.bytesPerPixel = bytes_per_pixel;
+    std::strncpy(header.stream, prefix.c_str(), sizeof(header.stream) - 1);
+
+    // synchronous writes only need the buffer being filled and the one being written
+    if (!file.allocate(io ? cfg.ioBuffers : 2, cfg.writeBufferBytes)) {
+        std::cerr << "Error: could not allocate segment write buffers" << std::endl;
+        return false;
+    }
+    pending.reserve(cfg.indexInterval);
+    segment = 0;
+    frames = 0;
+
+    return open_segment();
+}
+
+bool segmentWriter::open_segment()
+{
+    bfs::path seg_path = dir / segment_name(prefix, segment);
+
+    // preallocated so the filesystem keeps it contiguous
+    if (!file.open(seg_path, cfg.segmentBytes, cfg.directIO, io)) return false;
+
+    current = file.acquire();
+    bufferStart = 0;
+    tailInFlight = false;
+    offset = 0;
+    lastIndex = 0;
+    header.segment = segment;
+    put(&header, sizeof(header));
+    return true;
+}
+
+void segmentWriter::close_segment()
+{
+    if (!file.is_open()) return;
+
+    write_index();
+    write_chunk(SEG_CHUNK_END, 0, frames, 0.0, &lastIndex, sizeof(lastIndex));
+    flush();
+
+    file.release(current);
+    current = 0;
+    if (!file.close(offset)) {
+        ioFileStats st = file.stats();
+        std::cerr << "Error: " << st.failed << " of " << st.writes << " writes to "
+                  << segment_name(prefix, segment) << " failed, frames may be missing" << std::endl;
+    }
+}
+
+void segmentWriter::put(const void* data, size_t n)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+
+    while (n > 0) {
+        size_t take = std::min(n, current->capacity - current->bytes);
+        std::memcpy(current->data + current->bytes, p, take);
+        current->bytes += take;
+        offset += take;
+        p += take;
+        n -= take;
+        if (current->bytes == current->capacity) flush();
+    }
+}
+
+void segmentWriter::flush()
+{
+    // writes are whole 4 KiB blocks at block offsets (O_DIRECT). A partly filled
+    // last block is written padded and carried into the next buffer, which
+    // rewrites it once more data has arrived.
+    size_t used = current->bytes;
+    if (used == 0) return;
+
+    const size_t block = ioFile::ALIGNMENT;
+    size_t whole = used & ~(block - 1);
+    size_t tail = used - whole;
+    size_t out = tail ? whole + block : whole;
+    if (tail) std::memset(current->data + used, 0, out - used);
+
+    // an older write of the carried block must not land after this one
+    if (tailInFlight) file.drain();
+
+    ioBuffer* next = file.acquire();
+    std::memcpy(next->data, current->data + whole, tail);
+    next->bytes = tail;
+
+    current->bytes = out;
+    current->offset = bufferStart;
+    file.write(current);
+
+    bufferStart += whole;
+    current = next;
+    tailInFlight = tail != 0;
+}
+
+void segmentWriter::write_chunk(uint32_t magic, uint32_t codec, int64_t framenum, double timestamp, const void* payload, uint64_t size)
+{
+    static const unsigned char zeros[8] = {0};
+
+    segChunkHeader chunk;
+    chunk.magic = magic;
+    chunk.codec = codec;
+    chunk.framenum = framenum;
+    chunk.timestamp = timestamp;
+    chunk.size = size;
+
+    put(&chunk, sizeof(chunk));
+    put(payload, size);
+    put(zeros, pad8(size) - size);
+}
+
+void segmentWriter::write_index()
+{
+    // checkpoint: entries since the last INDX, chained backwards through prev
+    uint64_t here = offset;
+    uint64_t prev = lastIndex;
+    uint64_t size = sizeof(prev) + pending.size()*sizeof(segIndexEntry);
+
+    segChunkHeader chunk;
+    chunk.magic = SEG_CHUNK_INDEX;
+    chunk.codec = 0;
+    chunk.framenum = static_cast<int64_t>(pending.size());
+    chunk.timestamp = 0.0;
+    chunk.size = size;
+
+    put(&chunk, sizeof(chunk));
+    put(&prev, sizeof(prev));
+    if (!pending.empty()) put(pending.data(), pending.size()*sizeof(segIndexEntry));
+
+    lastIndex = here;
+    pending.clear();
+
+    // an index on disk is only useful if the frames it points at are there too
+    flush();
+}
+
+bool segmentWriter::append(const void* data, uint64_t size, int64_t framenum, double timestamp, uint32_t codec)
+{
+    boost::mutex::scoped_lock guard(lock);
+    if (!file.is_open()) return false;
+
+    uint64_t chunk_bytes = sizeof(segChunkHeader) + pad8(size);
+    if (offset + chunk_bytes > cfg.segmentBytes && offset > sizeof(segFileHeader)) {
+        close_segment();
+        segment++;
+        if (!open_segment()) return false;
+    }
+
+    segIndexEntry entry;
+    entry.framenum = framenum;
+    entry.timestamp = timestamp;
+    entry.offset = offset;
+    entry.size = size;
+
+    write_chunk(SEG_CHUNK_FRAME, codec, framenum, timestamp, data, size);
+    pending.push_back(entry);
+    frames++;
+
+    if (static_cast<int>(pending.size()) >= cfg.indexInterval) write_index();
+    return true;
+}
+
+void segmentWriter::close()
+{
+    boost::mutex::scoped_lock guard(lock);
+    close_segment();
+}
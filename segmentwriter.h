@@ -0,0 +1,148 @@
+/* segmentwriter.h
+ *
+ * Description:
+ *   header file for segmentWriter class and the segment container layout
+ *   Append-only container for raw stream frames: all frames of a session are
+ *   streamed into a few large, preallocated segment files instead of one small
+ *   .dat file per frame. Frames are coalesced in page-aligned write buffers and
+ *   written with large sequential writes, asynchronously and with O_DIRECT when
+ *   an ioEngine is given (see ioengine.h). Every write is checked on completion;
+ *   close reports writes that did not reach the file.
+ *
+ *   Segment file <prefix>_seg_NNNN.tsc:
+ *     segFileHeader
+ *     FRAM chunk: segChunkHeader + payload           (one per frame)
+ *     INDX chunk: segChunkHeader + prev INDX offset + segIndexEntry[]
+ *                 (every indexInterval frames, and at close)
+ *     TEND chunk: segChunkHeader + offset of last INDX (only on clean close)
+ *   All chunks start on 8-byte boundaries. A segment without TEND (crash) can
+ *   be recovered by scanning FRAM chunks from the header.
+ *
+ * Functions:
+ *   open - creates the first segment in a directory
+ *   append - adds one frame; rolls over to a new segment when full
+ *   close - writes the final index and trailer of the open segment, waits for its writes
+ *   io_stats - write/completion/failure counters of all segments so far
+ *
+ * Input:
+ *   directory, file prefix, frame geometry, segment size, index interval
+ *   frame payload, frame number, timestamp, codec id
+ *
+ * Output:
+ *   segment files
+ *
+ * Requirements:
+ *   boost/filesystem
+ *   boost/thread
+ *   ioengine.h (POSIX file I/O, fallocate, O_DIRECT, io_uring)
+ *
+ * Thread safe? YES (append is serialised internally)
+ *
+ * Extendable? YES
+ */
+
+#ifndef SEGMENTWRITER_H
+#define SEGMENTWRITER_H
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ioengine.h"
+
+// chunk identifiers (little endian ASCII)
+const uint32_t SEG_CHUNK_FRAME = 0x4d415246;    // "FRAM"
+const uint32_t SEG_CHUNK_INDEX = 0x58444e49;    // "INDX"
+const uint32_t SEG_CHUNK_END   = 0x444e4554;    // "TEND"
+
+// payload codecs
+const uint32_t SEG_CODEC_RAW = 0;
+const uint32_t SEG_CODEC_TZ16 = 1;      // lossless depth, see depthcodec.h
+
+struct segFileHeader
+{
+    char magic[8];              // "TSCSEG01"
+    uint32_t version;
+    uint32_t segment;           // position within the session
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerPixel;
+    uint32_t reserved0;
+    char stream[16];            // e.g. "depth", "ir"
+    uint64_t reserved[2];
+};
+
+struct segChunkHeader
+{
+    uint32_t magic;
+    uint32_t codec;
+    int64_t framenum;           // INDX: number of entries
+    double timestamp;           // ms
+    uint64_t size;              // payload bytes, excluding padding
+};
+
+struct segIndexEntry
+{
+    int64_t framenum;
+    double timestamp;
+    uint64_t offset;            // of the FRAM chunk header
+    uint64_t size;              // payload bytes
+};
+
+struct segmentConfig
+{
+    uint64_t segmentBytes = 1ull << 30;     // preallocated size of each segment file
+    int indexInterval = 300;                // frames between index checkpoints
+    size_t writeBufferBytes = 8u << 20;     // sequential write coalescing (rounded up to 4 KiB)
+    int ioBuffers = 4;                      // write buffers in flight per stream with an ioEngine
+    bool directIO = true;                   // O_DIRECT where the filesystem supports it
+};
+
+class segmentWriter
+{
+    boost::filesystem::path dir;
+    std::string prefix;
+    segmentConfig cfg;
+    segFileHeader header;
+
+    ioEngine* io;
+    ioFile file;
+    ioBuffer* current;              // being filled; starts at file offset bufferStart
+    uint64_t bufferStart;
+    bool tailInFlight;              // last write ended mid-block; the next one rewrites that block
+    uint32_t segment;
+    uint64_t offset;                // logical end of segment, including buffered bytes
+    uint64_t lastIndex;             // offset of previous INDX chunk (0 = none)
+    std::vector<segIndexEntry> pending;
+    long long frames;
+
+    boost::mutex lock;
+
+    bool open_segment();
+    void close_segment();
+    void put(const void* data, size_t n);
+    void flush();
+    void write_index();
+    void write_chunk(uint32_t magic, uint32_t codec, int64_t framenum, double timestamp, const void* payload, uint64_t size);
+
+public:
+    segmentWriter();
+    ~segmentWriter();
+
+    bool open(boost::filesystem::path s_dir, std::string s_prefix, int width, int height, int bytes_per_pixel,
+              const segmentConfig& s_cfg = segmentConfig(), ioEngine* s_io = 0);
+    bool append(const void* data, uint64_t size, int64_t framenum, double timestamp, uint32_t codec = SEG_CODEC_RAW);
+    void close();
+
+    bool is_open() const { return file.is_open(); }
+    long long frame_count() const { return frames; }
+    ioFileStats io_stats() const { return file.stats(); }
+    bool is_direct() const { return file.is_direct(); }
+
+    static std::string segment_name(const std::string& s_prefix, uint32_t seg);
+};
+
+#endif // SEGMENTWRITER_H
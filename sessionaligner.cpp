@@ -0,0 +1,94 @@
+#include "sessionaligner.h"
+
+#include <vector>
+
+#include "depthaligner.h"
+#include "depthcodec.h"
+#include "segmentwriter.h"
+#include "sessionreader.h"
+#include "workerpool.h"
+
+namespace bfs = boost::filesystem;
+
+sessionAligner::sessionAligner(const sessionAlignConfig& s_cfg) : cfg(s_cfg)
+{
+    if (cfg.outDir.empty()) cfg.outDir = cfg.depthDir.string() + "_aligned";
+    if (cfg.calibFile.empty()) cfg.calibFile = cfg.depthDir / "calibration.txt";
+}
+
+long long sessionAligner::run(std::ostream& log)
+{
+    alignCalibration calib;
+    if (!calib.load(cfg.calibFile)) {
+        log << "Align: no usable calibration in " << cfg.calibFile << std::endl;
+        return -1;
+    }
+
+    sessionReader reader;
+    if (!reader.open(cfg.depthDir, bfs::path(), cfg.depthWidth, cfg.depthHeight)) {
+        log << "Align: cannot open session " << cfg.depthDir << std::endl;
+        return -1;
+    }
+    int n = reader.frame_count(streamType::depth);
+    reader.set_readahead(8, 1);
+
+    depthAligner aligner(cfg.workers);
+    if (!aligner.prepare(calib)) return -1;
+    workerPool encodePool(cfg.workers);
+
+    try {
+        bfs::create_directories(cfg.outDir);
+    }
+    catch (bfs::filesystem_error &e) {
+        log << e.what() << std::endl;
+        return -1;
+    }
+
+    const int cw = calib.colour.width;
+    const int ch = calib.colour.height;
+    // the aligned depth lives in the colour camera: same intrinsics, no extrinsic offset
+    alignCalibration alignedCalib = calib;
+    alignedCalib.depth = calib.colour;
+    alignedCalib.depthToColour = cameraExtrinsics();
+    alignedCalib.save(cfg.outDir / "calibration.txt");
+
+    segmentWriter out;
+    if (!out.open(cfg.outDir, "depth", cw, ch, 2)) {
+        log << "Align: cannot create segments in " << cfg.outDir << std::endl;
+        return -1;
+    }
+
+    std::vector<uint16_t> depth;
+    std::vector<uint16_t> aligned(static_cast<size_t>(cw)*ch);
+    std::vector<unsigned char> encoded;
+    long long written = 0;
+    long long skipped = 0;
+
+    for (int i = 0; i < n; i++) {
+        int w, h;
+        frameView v = reader.view(streamType::depth, i);
+        if (!reader.depth(i, depth, w, h) || w != calib.depth.width || h != calib.depth.height) {
+            skipped++;
+            continue;
+        }
+        aligner.align(depth.data(), aligned.data());
+
+        bool ok;
+        if (cfg.compress && depthCodec::for_thread().encode(aligned.data(), cw, ch, encoded, &encodePool))
+            ok = out.append(encoded.data(), encoded.size(), v.framenum, v.timestamp, SEG_CODEC_TZ16);
+        else
+            ok = out.append(aligned.data(), aligned.size()*sizeof(uint16_t), v.framenum, v.timestamp);
+        if (!ok) {
+            log << "Align: write failed at frame " << v.framenum << std::endl;
+            break;
+        }
+        written++;
+        if (written % 300 == 0) log << "Align: " << written << " / " << n << " frames" << std::endl;
+    }
+    out.close();
+
+    log << "Align: " << written << " frames aligned to " << cw << "x" << ch << " in " << cfg.outDir;
+    if (skipped) log << " (" << skipped << " frames of another size or unreadable skipped)";
+    log << std::endl;
+    return written;
+}
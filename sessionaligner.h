@@ -0,0 +1,60 @@
+/* sessionaligner.h
+ *
+ * Description:
+ *   header file for sessionAligner class
+ *   Deferred depth-to-colour alignment: records unaligned depth at full
+ *   speed, aligns afterwards. Reads a recorded session's depth (segment
+ *   containers or per-frame files, see sessionreader.h) and the calibration
+ *   written with it (calibration.txt in the depth folder), aligns every frame
+ *   with depthAligner and writes the result as a new depth folder in segment
+ *   containers, TZ16-compressed by default. Frame numbers and timestamps are
+ *   kept, so the aligned folder replays with the session's colour folder.
+ *
+ * Functions:
+ *   run - aligns the whole session, returns the number of frames written (-1 on error)
+ *
+ * Input:
+ *   sessionAlignConfig (session depth folder, output folder, calibration file, workers)
+ *
+ * Output:
+ *   <depth folder>_aligned/depth_seg_NNNN.tsc, and a calibration.txt whose depth camera is
+ *   the colour camera (for point clouds, see cloudexporter.h)
+ *
+ * Requirements:
+ *   depthaligner.h, sessionreader.h, segmentwriter.h, depthcodec.h
+ *   boost/filesystem
+ *
+ * Thread safe? NO
+ *
+ * Extendable? YES
+ */
+
+#ifndef SESSIONALIGNER_H
+#define SESSIONALIGNER_H
+
+#include <boost/filesystem.hpp>
+
+#include <iostream>
+
+struct sessionAlignConfig
+{
+    boost::filesystem::path depthDir;
+    boost::filesystem::path outDir;         // empty: <depthDir>_aligned
+    boost::filesystem::path calibFile;      // empty: <depthDir>/calibration.txt
+    int depthWidth = 0;                     // only needed for headerless per-frame .dat sessions
+    int depthHeight = 0;
+    int workers = 0;                        // threads besides the caller for aligning and encoding
+    bool compress = true;                   // TZ16 chunks instead of raw Z16
+};
+
+class sessionAligner
+{
+    sessionAlignConfig cfg;
+
+public:
+    explicit sessionAligner(const sessionAlignConfig& s_cfg);
+
+    long long run(std::ostream& log = std::cout);
+};
+
+#endif // SESSIONALIGNER_H
@@ -0,0 +1,585 @@
+#include "sessionreader.h"
+
+#include <boost/bind.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "segmentwriter.h"
+#include "mjpegwriter.h"
+#include "depthcodec.h"
+#include "jpegdecoder.h"
+
+namespace bfs = boost::filesystem;
+
+mappedFile::~mappedFile()
+{
+    if (base) munmap(const_cast<unsigned char*>(base), size);
+}
+
+std::shared_ptr<mappedFile> mappedFile::map(const bfs::path& m_path, bool sequential)
+{
+    std::shared_ptr<mappedFile> m(new mappedFile);
+
+    int fd = ::open(m_path.c_str(), O_RDONLY);
+    if (fd < 0) return std::shared_ptr<mappedFile>();
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return std::shared_ptr<mappedFile>();
+    }
+
+    void* mem = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) return std::shared_ptr<mappedFile>();
+
+    if (sequential) madvise(mem, st.st_size, MADV_SEQUENTIAL);
+    m->base = static_cast<const unsigned char*>(mem);
+    m->size = st.st_size;
+    return m;
+}
+
+// frame number from names like depth_frame_1000042.dat; -1 if the name does not match
+static int64_t frame_number(const std::string& name, const std::string& prefix, const std::string& ext)
+{
+    if (name.size() <= prefix.size() + ext.size()) return -1;
+    if (name.compare(0, prefix.size(), prefix) != 0) return -1;
+    if (name.compare(name.size() - ext.size(), ext.size(), ext) != 0) return -1;
+
+    std::string num = name.substr(prefix.size(), name.size() - prefix.size() - ext.size());
+    if (num.empty() || num.find_first_not_of("0123456789") != std::string::npos) return -1;
+    return std::stoll(num);
+}
+
+static bool infer_geometry(size_t bytes, int bpp, int& width, int& height)
+{
+    // RealSense depth/IR modes, for headerless .dat files
+    static const int modes[][2] = { {1280,720}, {848,480}, {640,480}, {640,360}, {480,270}, {424,240}, {1920,1080} };
+    for (size_t i = 0; i < sizeof(modes)/sizeof(modes[0]); i++) {
+        if (static_cast<size_t>(modes[i][0])*modes[i][1]*bpp == bytes) {
+            width = modes[i][0];
+            height = modes[i][1];
+            return true;
+        }
+    }
+    return false;
+}
+
+
+sessionReader::sessionReader() : readaheadQ(1024), quit(false), readaheadFrames(0)
+{
+    for (int i = 0; i < 3; i++) {
+        streams[i].width = 0;
+        streams[i].height = 0;
+        streams[i].segmented = false;
+        streams[i].movie = false;
+        streams[i].last = -2;
+        streams[i].aheadUntil = -1;
+    }
+}
+
+sessionReader::~sessionReader()
+{
+    quit = true;
+    readaheadThreads.join_all();
+}
+
+bool sessionReader::index_segments(streamIndex& s, const std::vector<bfs::path>& segs)
+{
+    for (size_t f = 0; f < segs.size(); f++) {
+        std::shared_ptr<mappedFile> m = mappedFile::map(segs[f], true);
+        if (!m || m->size < sizeof(segFileHeader)) continue;
+
+        segFileHeader hdr;
+        std::memcpy(&hdr, m->base, sizeof(hdr));
+        if (std::memcmp(hdr.magic, "TSCSEG01", 8) != 0) {
+            std::cerr << "Warning: " << segs[f] << " is not a segment file" << std::endl;
+            continue;
+        }
+        s.width = hdr.width;
+        s.height = hdr.height;
+
+        int file = static_cast<int>(s.maps.size());
+        s.maps.push_back(m);
+        s.files.push_back(segs[f]);
+
+        // clean close: follow the INDX chain back from the TEND trailer
+        const size_t tail = sizeof(segChunkHeader) + sizeof(uint64_t);
+        segChunkHeader end;
+        bool indexed = false;
+        if (m->size >= sizeof(hdr) + tail) {
+            std::memcpy(&end, m->base + m->size - tail, sizeof(end));
+            if (end.magic == SEG_CHUNK_END) {
+                uint64_t at;
+                std::memcpy(&at, m->base + m->size - sizeof(uint64_t), sizeof(at));
+                indexed = true;
+                size_t first = s.frames.size();
+
+                // sizes come from a file that may be torn: compare against the space left, never add them up
+                while (at != 0 && at <= m->size - sizeof(segChunkHeader) - sizeof(uint64_t)) {
+                    segChunkHeader idx;
+                    std::memcpy(&idx, m->base + at, sizeof(idx));
+                    uint64_t prev = 0;
+                    if (idx.magic == SEG_CHUNK_INDEX && idx.size >= sizeof(prev) && idx.size <= m->size - at - sizeof(idx))
+                        std::memcpy(&prev, m->base + at + sizeof(idx), sizeof(prev));
+                    if (idx.magic != SEG_CHUNK_INDEX || idx.size < sizeof(prev) || idx.size > m->size - at - sizeof(idx) ||
+                        idx.framenum < 0 || static_cast<uint64_t>(idx.framenum) > (idx.size - sizeof(prev))/sizeof(segIndexEntry) ||
+                        prev >= at) {
+                        // the scan below rebuilds the whole index
+                        s.frames.resize(first);
+                        indexed = false;
+                        break;
+                    }
+
+                    const unsigned char* e = m->base + at + sizeof(idx) + sizeof(prev);
+                    for (int64_t i = 0; i < idx.framenum; i++) {
+                        segIndexEntry entry;
+                        std::memcpy(&entry, e + i*sizeof(segIndexEntry), sizeof(entry));
+                        if (entry.offset > m->size - sizeof(segChunkHeader) ||
+                            entry.size > m->size - entry.offset - sizeof(segChunkHeader)) continue;
+                        frameEntry fe = { entry.framenum, entry.timestamp, entry.offset, entry.size, file };
+                        s.frames.push_back(fe);
+                    }
+                    at = prev;
+                }
+                if (at != 0) {
+                    // chain points outside the file
+                    s.frames.resize(first);
+                    indexed = false;
+                }
+            }
+        }
+        if (indexed) continue;
+
+        // no trailer (recording crashed): scan the FRAM chunks instead
+        std::cout << "Recovering index of " << segs[f] << std::endl;
+        uint64_t at = sizeof(hdr);
+        while (at + sizeof(segChunkHeader) <= m->size) {
+            segChunkHeader chunk;
+            std::memcpy(&chunk, m->base + at, sizeof(chunk));
+            if (chunk.size > m->size - at - sizeof(chunk)) break;
+            if (chunk.magic == SEG_CHUNK_FRAME) {
+                frameEntry fe = { chunk.framenum, chunk.timestamp, at, chunk.size, file };
+                s.frames.push_back(fe);
+            }
+            else if (chunk.magic != SEG_CHUNK_INDEX) break;
+            at += sizeof(chunk) + ((chunk.size + 7) & ~static_cast<uint64_t>(7));
+        }
+    }
+    s.segmented = !s.maps.empty();
+    return s.segmented;
+}
+
+static uint32_t read32(const unsigned char* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// chunk ids are printable ASCII; anything else is the unwritten end of a crashed file
+static bool is_fourcc(uint32_t id)
+{
+    for (int i = 0; i < 4; i++, id >>= 8)
+        if ((id & 0xff) < 0x20 || (id & 0xff) > 0x7e) return false;
+    return true;
+}
+
+bool sessionReader::index_movies(streamIndex& s, const std::vector<bfs::path>& movies)
+{
+    for (size_t f = 0; f < movies.size(); f++) {
+        std::shared_ptr<mappedFile> m = mappedFile::map(movies[f], true);
+        if (!m || m->size < 12 || read32(m->base) != AVI_RIFF || read32(m->base + 8) != AVI_FORM) {
+            std::cerr << "Warning: " << movies[f] << " is not an AVI file" << std::endl;
+            continue;
+        }
+        const unsigned char* b = m->base;
+        int file = static_cast<int>(s.maps.size());
+        s.maps.push_back(m);
+        s.files.push_back(movies[f]);
+
+        // headers up to the first movi list: frame size, nominal rate, super index
+        uint64_t at = 12, movi = 0, indx = 0;
+        uint32_t indxSlots = 0;
+        double period = 1000.0/30;
+        while (at + 12 <= m->size) {
+            uint32_t id = read32(b + at);
+            uint32_t size = read32(b + at + 4);
+            if (id == AVI_LIST) {
+                if (read32(b + at + 8) == AVI_MOVI) { movi = at; break; }
+                at += 12;
+                continue;
+            }
+            if (at + 8 + size > m->size) break;
+            if (id == AVI_AVIH && size >= 40) {
+                period = read32(b + at + 8)/1000.0;
+                s.width = read32(b + at + 8 + 32);
+                s.height = read32(b + at + 8 + 36);
+            }
+            else if (id == AVI_INDX && size >= 24) { indx = at + 8; indxSlots = (size - 24)/16; }
+            at += 8 + size + (size & 1);
+        }
+        if (!movi) continue;
+
+        // frames without a timestamp table (after the last index flush) continue the numbering at the nominal rate
+        int64_t lastFrame = -1;
+        double lastTime = -period;
+        auto take = [&](const unsigned char* stamp, uint64_t offset, uint32_t size) {
+            aviStampEntry st = { lastFrame + 1, lastTime + period };
+            if (stamp) std::memcpy(&st, stamp, sizeof(st));
+            if (st.framenum < 0) return;                            // gap filler
+            lastFrame = st.framenum;
+            lastTime = st.timestamp;
+            if (size == 0 || offset > m->size || size > m->size - offset) return;
+            frameEntry fe = { st.framenum, st.timestamp, offset, size, file };
+            s.frames.push_back(fe);
+        };
+
+        // OpenDML index: super index -> ix00 chunks, each followed by its timestamp table
+        uint64_t resume = movi + 12;
+        uint32_t chunks = indx ? std::min(read32(b + indx + 4), indxSlots) : 0;
+        for (uint32_t k = 0; k < chunks && indx + 24 + 16*(k + 1) <= m->size; k++) {
+            uint64_t ix;
+            std::memcpy(&ix, b + indx + 24 + 16*k, sizeof(ix));
+            if (ix > m->size - 32 || read32(b + ix) != AVI_STD_INDEX) break;
+            uint32_t ixSize = read32(b + ix + 4);
+            uint32_t n = read32(b + ix + 12);
+            uint64_t base;
+            std::memcpy(&base, b + ix + 20, sizeof(base));
+            if (8ull*n > m->size - ix - 32) break;
+
+            uint64_t junk = ix + 8 + ixSize + (ixSize & 1);
+            const unsigned char* stamps = 0;
+            uint64_t tableSize = sizeof(aviStampHeader) + static_cast<uint64_t>(n)*sizeof(aviStampEntry);
+            if (junk + 8 + tableSize <= m->size && read32(b + junk) == AVI_JUNK &&
+                std::memcmp(b + junk + 8, "TSTAMP01", 8) == 0 && read32(b + junk + 16) == n)
+                stamps = b + junk + 8 + sizeof(aviStampHeader);
+
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t size = read32(b + ix + 36 + 8*i) & 0x7fffffffu;
+                take(stamps ? stamps + i*sizeof(aviStampEntry) : 0,
+                     base + read32(b + ix + 32 + 8*i), size);
+            }
+            resume = stamps ? junk + 8 + tableSize + (tableSize & 1) : junk;
+        }
+
+        // the rest of the file: nothing after a clean close, the unindexed tail after a crash
+        size_t indexed = s.frames.size();
+        std::vector< std::pair<uint64_t, uint32_t> > pending;      // frame chunks since the last table
+        at = resume;
+        while (at + 8 <= m->size) {
+            uint32_t id = read32(b + at);
+            uint32_t size = read32(b + at + 4);
+            if (!is_fourcc(id)) break;
+            if (id == AVI_RIFF || id == AVI_LIST) {
+                at += 12;
+                continue;
+            }
+            if (at + 8 + size > m->size) break;
+            if (id == AVI_VIDEO) pending.push_back(std::make_pair(at + 8, size));
+            else if (id == AVI_JUNK && size >= sizeof(aviStampHeader) && std::memcmp(b + at + 8, "TSTAMP01", 8) == 0) {
+                uint32_t n = read32(b + at + 16);
+                bool match = n == pending.size() && sizeof(aviStampHeader) + static_cast<uint64_t>(n)*sizeof(aviStampEntry) <= size;
+                for (size_t i = 0; i < pending.size(); i++)
+                    take(match ? b + at + 8 + sizeof(aviStampHeader) + i*sizeof(aviStampEntry) : 0,
+                         pending[i].first, pending[i].second);
+                pending.clear();
+            }
+            at += 8 + size + (size & 1);
+        }
+        for (size_t i = 0; i < pending.size(); i++) take(0, pending[i].first, pending[i].second);
+
+        if (s.frames.size() > indexed)
+            std::cout << "Recovered " << s.frames.size() - indexed << " unindexed frames of " << movies[f] << std::endl;
+    }
+    s.movie = s.segmented = !s.maps.empty();
+    return s.movie;
+}
+
+bool sessionReader::open(bfs::path depth_dir, bfs::path col_dir, int depth_width, int depth_height)
+{
+    std::vector<bfs::path> depth_segs, ir_segs, col_movies;
+    std::vector< std::pair<int64_t, bfs::path> > depth_files, ir_files, col_files;
+
+    try {
+        if (bfs::is_directory(depth_dir)) {
+            for (bfs::directory_iterator it(depth_dir), end; it != end; ++it) {
+                std::string name = it->path().filename().string();
+                int64_t n;
+                if (name.compare(0, 10, "depth_seg_") == 0) depth_segs.push_back(it->path());
+                else if (name.compare(0, 7, "ir_seg_") == 0) ir_segs.push_back(it->path());
+                else if ((n = frame_number(name, "depth_frame_", ".dat")) >= 0) depth_files.push_back(std::make_pair(n, it->path()));
+                else if ((n = frame_number(name, "depth_frame_", ".tz16")) >= 0) depth_files.push_back(std::make_pair(n, it->path()));
+                else if ((n = frame_number(name, "ir_frame_", ".dat")) >= 0) ir_files.push_back(std::make_pair(n, it->path()));
+            }
+        }
+        if (bfs::is_directory(col_dir)) {
+            for (bfs::directory_iterator it(col_dir), end; it != end; ++it) {
+                std::string name = it->path().filename().string();
+                int64_t n = frame_number(name, "col_frame_", ".jpg");
+                if (n >= 0) col_files.push_back(std::make_pair(n, it->path()));
+                else if (frame_number(name, "colour_", ".avi") >= 0) col_movies.push_back(it->path());
+            }
+        }
+    }
+    catch (bfs::filesystem_error &e) {
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
+
+    // ROI-cropped streams: stored frames are the canvas, depth() and colour() give back the sensor frame
+    crops[static_cast<int>(streamType::colour)].load(col_dir / "colour_roi.txt");
+    crops[static_cast<int>(streamType::depth)].load(depth_dir / "depth_roi.txt");
+    crops[static_cast<int>(streamType::infrared)].load(depth_dir / "ir_roi.txt");
+
+    std::sort(depth_segs.begin(), depth_segs.end());
+    std::sort(ir_segs.begin(), ir_segs.end());
+    std::sort(col_movies.begin(), col_movies.end());
+
+    streamIndex* per_file[3] = { &streams[static_cast<int>(streamType::colour)],
+                                 &streams[static_cast<int>(streamType::depth)],
+                                 &streams[static_cast<int>(streamType::infrared)] };
+    std::vector< std::pair<int64_t, bfs::path> >* lists[3] = { &col_files, &depth_files, &ir_files };
+
+    if (!depth_segs.empty()) { index_segments(streams[static_cast<int>(streamType::depth)], depth_segs); depth_files.clear(); }
+    if (!ir_segs.empty()) { index_segments(streams[static_cast<int>(streamType::infrared)], ir_segs); ir_files.clear(); }
+    if (!col_movies.empty()) { index_movies(streams[static_cast<int>(streamType::colour)], col_movies); col_files.clear(); }
+
+    for (int k = 0; k < 3; k++) {
+        streamIndex& s = *per_file[k];
+        std::vector< std::pair<int64_t, bfs::path> >& list = *lists[k];
+        std::sort(list.begin(), list.end());
+        for (size_t i = 0; i < list.size(); i++) {
+            // per-file sessions carry no timestamps; order by frame number
+            frameEntry fe = { list[i].first, 0.0, 0, 0, static_cast<int>(s.files.size()) };
+            s.files.push_back(list[i].second);
+            s.frames.push_back(fe);
+        }
+    }
+
+    // geometry of per-file streams: from the first file
+    for (int k = 0; k < 3; k++) {
+        streamIndex& s = *per_file[k];
+        if (s.segmented || s.files.empty()) continue;
+        std::shared_ptr<mappedFile> m = mappedFile::map(s.files[0], false);
+        if (!m) continue;
+
+        if (k == 0) jpegDecoder::for_thread().read_size(m->base, m->size, s.width, s.height);
+        else if (!depthCodec::frame_size(m->base, m->size, s.width, s.height)) {
+            int bpp = (k == 1) ? 2 : 1;
+            const roiCrop& crop = crops[k == 1 ? static_cast<int>(streamType::depth) : static_cast<int>(streamType::infrared)];
+            if (!crop.empty()) { s.width = crop.width(); s.height = crop.height(); }
+            else if (depth_width > 0 && depth_height > 0) { s.width = depth_width; s.height = depth_height; }
+            else infer_geometry(m->size, bpp, s.width, s.height);
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        std::sort(streams[i].frames.begin(), streams[i].frames.end(),
+                  [](const frameEntry& a, const frameEntry& b) { return a.framenum < b.framenum; });
+    }
+
+    std::cout << "Session indexed: " << frame_count(streamType::colour) << " colour, "
+              << frame_count(streamType::depth) << " depth, "
+              << frame_count(streamType::infrared) << " IR frames" << std::endl;
+    return frame_count(streamType::colour) + frame_count(streamType::depth) + frame_count(streamType::infrared) > 0;
+}
+
+int sessionReader::frame_count(streamType stream) const
+{
+    return static_cast<int>(streams[static_cast<int>(stream)].frames.size());
+}
+
+int sessionReader::find_frame(streamType stream, int64_t framenum) const
+{
+    const std::vector<frameEntry>& f = streams[static_cast<int>(stream)].frames;
+    std::vector<frameEntry>::const_iterator it = std::lower_bound(f.begin(), f.end(), framenum,
+        [](const frameEntry& e, int64_t n) { return e.framenum < n; });
+    if (it == f.end() || it->framenum != framenum) return -1;
+    return static_cast<int>(it - f.begin());
+}
+
+int sessionReader::find_time(streamType stream, double ms) const
+{
+    // frames are sorted by frame number, which is also capture order
+    const std::vector<frameEntry>& f = streams[static_cast<int>(stream)].frames;
+    if (f.empty()) return -1;
+    std::vector<frameEntry>::const_iterator it = std::lower_bound(f.begin(), f.end(), ms,
+        [](const frameEntry& e, double t) { return e.timestamp < t; });
+    if (it == f.end()) return static_cast<int>(f.size()) - 1;
+    if (it != f.begin() && std::fabs((it-1)->timestamp - ms) <= std::fabs(it->timestamp - ms)) --it;
+    return static_cast<int>(it - f.begin());
+}
+
+frameView sessionReader::view(streamType stream, int index)
+{
+    streamIndex& s = streams[static_cast<int>(stream)];
+    frameView v;
+    if (index < 0 || index >= static_cast<int>(s.frames.size())) return v;
+
+    const frameEntry& e = s.frames[index];
+    v.width = s.width;
+    v.height = s.height;
+    v.framenum = e.framenum;
+    v.timestamp = e.timestamp;
+
+    if (s.movie) {
+        // AVI frames are indexed by payload: the JPEG bytes themselves
+        v.keep = s.maps[e.file];
+        v.codec = SEG_CODEC_RAW;
+        v.data = v.keep->base + e.offset;
+        v.size = e.size;
+    }
+    else if (s.segmented) {
+        v.keep = s.maps[e.file];
+        segChunkHeader chunk;
+        std::memcpy(&chunk, v.keep->base + e.offset, sizeof(chunk));
+        v.codec = chunk.codec;
+        v.data = v.keep->base + e.offset + sizeof(chunk);
+        v.size = e.size;
+    }
+    else {
+        v.keep = mappedFile::map(s.files[e.file], false);
+        if (!v.keep) return frameView();
+        v.data = v.keep->base;
+        v.size = v.keep->size;
+        v.codec = depthCodec::frame_size(v.data, v.size, v.width, v.height) ? SEG_CODEC_TZ16 : SEG_CODEC_RAW;
+    }
+
+    schedule_readahead(stream, index);
+    return v;
+}
+
+bool sessionReader::depth(int index, std::vector<uint16_t>& out, int& width, int& height)
+{
+    frameView v = view(streamType::depth, index);
+    if (!v.valid()) return false;
+
+    const roiCrop& crop = crops[static_cast<int>(streamType::depth)];
+    static boost::thread_specific_ptr< std::vector<uint16_t> > canvas;
+    if (!crop.empty() && !canvas.get()) canvas.reset(new std::vector<uint16_t>);
+    std::vector<uint16_t>& frame = crop.empty() ? out : *canvas;
+
+    width = v.width;
+    height = v.height;
+    frame.resize(static_cast<size_t>(width)*height);
+
+    if (v.codec == SEG_CODEC_TZ16) {
+        if (!depthCodec::decode(v.data, v.size, frame.data(), width, height)) return false;
+    }
+    else {
+        if (v.size < frame.size()*sizeof(uint16_t)) return false;
+        std::memcpy(frame.data(), v.data, frame.size()*sizeof(uint16_t));
+    }
+    if (crop.empty()) return true;
+
+    if (width != crop.width() || height != crop.height()) return false;
+    width = crop.sensor_width();
+    height = crop.sensor_height();
+    out.resize(static_cast<size_t>(width)*height);
+    crop.uncrop(frame.data(), out.data());
+    return true;
+}
+
+bool sessionReader::colour(int index, std::vector<unsigned char>& rgb, int& width, int& height, int scale_denom)
+{
+    frameView v = view(streamType::colour, index);
+    if (!v.valid()) return false;
+
+    const roiCrop& crop = crops[static_cast<int>(streamType::colour)];
+    if (crop.empty()) return jpegDecoder::for_thread().decode(v.data, v.size, rgb, width, height, scale_denom);
+
+    static boost::thread_specific_ptr< std::vector<unsigned char> > canvas;
+    if (!canvas.get()) canvas.reset(new std::vector<unsigned char>);
+    if (!jpegDecoder::for_thread().decode(v.data, v.size, *canvas, width, height, scale_denom)) return false;
+
+    // the decoder rounds reduced sizes up, as uncrop does
+    int n = (scale_denom == 2 || scale_denom == 4 || scale_denom == 8) ? scale_denom : 1;
+    if (width != (crop.width() + n - 1)/n || height != (crop.height() + n - 1)/n) return false;
+    width = (crop.sensor_width() + n - 1)/n;
+    height = (crop.sensor_height() + n - 1)/n;
+    rgb.resize(static_cast<size_t>(width)*height*3);
+    crop.uncrop(canvas->data(), rgb.data(), n);
+    return true;
+}
+
+void sessionReader::set_readahead(int frames, int threads)
+{
+    quit = true;
+    readaheadThreads.join_all();
+    quit = false;
+
+    readaheadFrames = frames;
+    if (frames <= 0) return;
+    for (int i = 0; i < threads; i++)
+        readaheadThreads.create_thread(boost::bind(&sessionReader::readahead_loop, this));
+}
+
+void sessionReader::schedule_readahead(streamType stream, int index)
+{
+    if (readaheadFrames <= 0) return;
+    streamIndex& s = streams[static_cast<int>(stream)];
+
+    // only sequential playback (forwards, frame by frame) triggers readahead
+    int prev = s.last.exchange(index);
+    if (index != prev + 1) {
+        s.aheadUntil = index;
+        return;
+    }
+
+    int until = std::min(index + readaheadFrames, static_cast<int>(s.frames.size()) - 1);
+    for (int i = std::max(s.aheadUntil.load() + 1, index + 1); i <= until; i++) {
+        uint64_t req = (static_cast<uint64_t>(stream) << 32) | static_cast<uint32_t>(i);
+        if (!readaheadQ.push(req)) break;
+        s.aheadUntil = i;
+    }
+}
+
+void sessionReader::prefetch(streamType stream, int index)
+{
+    streamIndex& s = streams[static_cast<int>(stream)];
+    if (index < 0 || index >= static_cast<int>(s.frames.size())) return;
+    const frameEntry& e = s.frames[index];
+
+    if (s.segmented) {
+        // fault the frame's pages in so the reader thread never waits on the disk
+        const mappedFile& m = *s.maps[e.file];
+        long page = sysconf(_SC_PAGESIZE);
+        uint64_t start = e.offset & ~static_cast<uint64_t>(page - 1);
+        uint64_t stop = std::min<uint64_t>(e.offset + sizeof(segChunkHeader) + e.size, m.size);
+        madvise(const_cast<unsigned char*>(m.base) + start, stop - start, MADV_WILLNEED);
+
+        volatile unsigned char sink = 0;
+        for (uint64_t off = start; off < stop; off += page) sink ^= m.base[off];
+        (void)sink;
+    }
+    else {
+        int fd = ::open(s.files[e.file].c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0) readahead(fd, 0, st.st_size);
+        ::close(fd);
+    }
+}
+
+void sessionReader::readahead_loop()
+{
+    uint64_t req;
+    while (!quit) {
+        if (readaheadQ.pop(req)) {
+            prefetch(static_cast<streamType>(req >> 32), static_cast<int>(req & 0xffffffffu));
+            continue;
+        }
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    }
+}
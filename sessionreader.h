@@ -0,0 +1,149 @@
+/* sessionreader.h
+ *
+ * Description:
+ *   header file for sessionReader class
+ *   Random-access reader for recorded sessions, for playback and analysis
+ *   tools. Opens a session's depth folder (D_N) and colour folder (RGB_N) and
+ *   builds a frame index per stream by frame number and timestamp. Both depth
+ *   layouts are supported: segment containers (*.tsc, see segmentwriter.h) and
+ *   one file per frame (.dat / .tz16). Colour is read from one JPEG per frame
+ *   or from the session's MJPEG AVI (colour_NNNN.avi, see mjpegwriter.h),
+ *   indexed through its OpenDML index and timestamp tables; frames written
+ *   after the last index flush of a crashed recording are recovered by
+ *   scanning the chunks behind it.
+ *   Segment and AVI files are memory-mapped once, so raw depth and IR come back as
+ *   zero-copy views into the mapping. TZ16 depth is decoded on request, and
+ *   colour JPEGs are decoded lazily, at reduced DCT scale for previews.
+ *   Sequential access triggers readahead of the next frames on background
+ *   threads (madvise/readahead + page touch), so scrubbing is not I/O bound.
+ *   Streams recorded with a ROI (<stream>_roi.txt, see roicrop.h) are stored
+ *   cropped: view() returns the stored frame, while depth() and colour() put
+ *   it back into a sensor-size frame, zero outside the regions.
+ *
+ * Functions:
+ *   open - indexes a session
+ *   frame_count - frames of a stream
+ *   find_frame - index of a frame number, -1 if absent
+ *   find_time - index of the frame nearest a timestamp (ms)
+ *   view - zero-copy view of a stored frame (raw pixels or encoded bytes)
+ *   depth - depth frame as uint16 pixels (decodes TZ16)
+ *   colour - colour frame as RGB8, optionally at 1/2, 1/4 or 1/8 scale
+ *   crop - ROI layout of a stream (empty if it was stored whole)
+ *   set_readahead - frames to prefetch ahead of sequential access, and thread count
+ *
+ * Input:
+ *   session depth and colour folders, depth/IR geometry for headerless .dat files (optional)
+ *
+ * Output:
+ *   frameView / decoded frames
+ *
+ * Requirements:
+ *   boost/filesystem
+ *   boost/thread
+ *   boost/lockfree
+ *   libjpeg / libjpeg-turbo
+ *
+ * Thread safe? view/depth/colour from several threads YES; open/set_readahead NO
+ *
+ * Extendable? YES
+ */
+
+#ifndef SESSIONREADER_H
+#define SESSIONREADER_H
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/lockfree/queue.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "streamtype.h"
+#include "roicrop.h"
+
+struct mappedFile
+{
+    const unsigned char* base;
+    size_t size;
+
+    mappedFile() : base(0), size(0) {}
+    ~mappedFile();
+
+    static std::shared_ptr<mappedFile> map(const boost::filesystem::path& m_path, bool sequential);
+};
+
+struct frameView
+{
+    const unsigned char* data;
+    size_t size;
+    int width;
+    int height;
+    int64_t framenum;
+    double timestamp;
+    uint32_t codec;                         // SEG_CODEC_* (colour: JPEG bytes)
+    std::shared_ptr<mappedFile> keep;       // the mapping stays valid while the view exists
+
+    frameView() : data(0), size(0), width(0), height(0), framenum(-1), timestamp(0.0), codec(0) {}
+    bool valid() const { return data != 0; }
+};
+
+class sessionReader
+{
+    struct frameEntry
+    {
+        int64_t framenum;
+        double timestamp;
+        uint64_t offset;                    // chunk header offset within the segment (segmented), payload offset (AVI)
+        uint64_t size;
+        int file;                           // segment map or per-frame file
+    };
+
+    struct streamIndex
+    {
+        int width;
+        int height;
+        bool segmented;
+        bool movie;                         // segmented, in MJPEG AVI files
+        std::vector<frameEntry> frames;
+        std::vector<boost::filesystem::path> files;
+        std::vector< std::shared_ptr<mappedFile> > maps;
+        std::atomic<int> last;              // last index viewed, for sequential detection
+        std::atomic<int> aheadUntil;        // highest index already queued for readahead
+    };
+
+    streamIndex streams[3];
+    roiCrop crops[3];
+
+    boost::thread_group readaheadThreads;
+    boost::lockfree::queue<uint64_t, boost::lockfree::fixed_sized<true> > readaheadQ;
+    std::atomic<bool> quit;
+    int readaheadFrames;
+
+    bool index_segments(streamIndex& s, const std::vector<boost::filesystem::path>& segs);
+    bool index_movies(streamIndex& s, const std::vector<boost::filesystem::path>& movies);
+    void readahead_loop();
+    void prefetch(streamType stream, int index);
+    void schedule_readahead(streamType stream, int index);
+
+public:
+    sessionReader();
+    ~sessionReader();
+
+    bool open(boost::filesystem::path depth_dir, boost::filesystem::path col_dir, int depth_width = 0, int depth_height = 0);
+
+    int frame_count(streamType stream) const;
+    int find_frame(streamType stream, int64_t framenum) const;
+    int find_time(streamType stream, double ms) const;
+
+    frameView view(streamType stream, int index);
+    bool depth(int index, std::vector<uint16_t>& out, int& width, int& height);
+    bool colour(int index, std::vector<unsigned char>& rgb, int& width, int& height, int scale_denom = 1);
+    const roiCrop& crop(streamType stream) const { return crops[static_cast<int>(stream)]; }
+
+    void set_readahead(int frames, int threads);
+};
+
+#endif // SESSIONREADER_H
@@ -0,0 +1,52 @@
+/* simdcpu.h
+ *
+ * Description:
+ *   Runtime CPU feature checks for the SIMD kernels.
+ *   The project is built without -msse4.1/-mavx2 so the executable still runs on
+ *   older field laptops; kernels that need newer instructions are compiled with
+ *   a per-function target attribute (SIMD_TARGET) and selected at run time.
+ *
+ * Functions:
+ *   cpu_has_sse41 - SSE4.1 available
+ *   cpu_has_avx2 - AVX2 available
+ *
+ * Requirements:
+ *   gcc/clang on x86-64
+ *
+ * Thread safe? YES
+ *
+ * Extendable? YES
+ */
+
+#ifndef SIMDCPU_H
+#define SIMDCPU_H
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_X86 0
+#define SIMD_TARGET(isa)
+#endif
+
+inline bool cpu_has_sse41()
+{
+#if SIMD_X86
+    static const bool has = __builtin_cpu_supports("sse4.1");
+    return has;
+#else
+    return false;
+#endif
+}
+
+inline bool cpu_has_avx2()
+{
+#if SIMD_X86
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+#else
+    return false;
+#endif
+}
+
+#endif // SIMDCPU_H
@@ -0,0 +1,27 @@
+/* streamtype.h
+ *
+ * Description:
+ *   Stream identifiers shared by the recorder and the session reader, and the
+ *   stored pixel size of each stream (rgb8 colour, z16 depth, y8 infrared).
+ *
+ * Thread safe? YES
+ *
+ * Extendable? YES
+ */
+
+#ifndef STREAMTYPE_H
+#define STREAMTYPE_H
+
+enum class streamType { colour, depth, infrared };
+
+inline int bytes_per_pixel(streamType stream)
+{
+    switch (stream) {
+    case streamType::colour:   return 3;   // rgb8
+    case streamType::depth:    return 2;   // z16
+    case streamType::infrared: return 1;   // y8
+    }
+    return 1;
+}
+
+#endif // STREAMTYPE_H
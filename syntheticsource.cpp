@@ -0,0 +1,168 @@
+#include "syntheticsource.h"
+
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "depthaligner.h"
+
+namespace bchrono = boost::chrono;
+
+syntheticSource::syntheticSource(const syntheticConfig& s_cfg) : cfg(s_cfg), frameCount(0)
+{
+}
+
+void syntheticSource::make_backgrounds()
+{
+    int cw = cfg.colWidth, ch = cfg.colHeight;
+    int dw = cfg.depthWidth, dh = cfg.depthHeight;
+
+    colBackground.resize(static_cast<size_t>(cw)*ch*3);
+    for (int y = 0; y < ch; y++) {
+        unsigned char* row = &colBackground[static_cast<size_t>(y)*cw*3];
+        for (int x = 0; x < cw; x++) {
+            row[3*x]   = static_cast<unsigned char>(x*255/cw);
+            row[3*x+1] = static_cast<unsigned char>(y*255/ch);
+            row[3*x+2] = 128;
+        }
+    }
+
+    // tilted arena floor ~0.6 m away, fixed pseudo-noise, and a few holes
+    float units_per_m = 1.0f/cfg.depthScale;
+    depthBackground.resize(static_cast<size_t>(dw)*dh);
+    irBackground.resize(static_cast<size_t>(dw)*dh);
+    for (int y = 0; y < dh; y++) {
+        for (int x = 0; x < dw; x++) {
+            float metres = 0.6f + 0.1f*y/dh + 0.05f*x/dw;
+            int noise = static_cast<int>((x*7 + y*13) % 5) - 2;
+            depthBackground[static_cast<size_t>(y)*dw + x] = static_cast<uint16_t>(metres*units_per_m + noise);
+            irBackground[static_cast<size_t>(y)*dw + x] = static_cast<unsigned char>(80 + ((x ^ y) & 63));
+        }
+    }
+    for (int h = 0; h < 4; h++) {
+        int x0 = (h*dw)/4 + dw/16, y0 = dh/8 + (h%2)*dh/2;
+        for (int y = y0; y < std::min(dh, y0 + dh/20); y++)
+            for (int x = x0; x < std::min(dw, x0 + dw/24); x++)
+                depthBackground[static_cast<size_t>(y)*dw + x] = 0;
+    }
+
+    for (int b = 0; b < 2; b++) {
+        colOut[b].resize(colBackground.size());
+        depthOut[b].resize(depthBackground.size());
+        irOut[b].resize(irBackground.size());
+        if (cfg.secondIR) ir2Out[b].resize(irBackground.size());
+    }
+}
+
+void syntheticSource::draw_movers(int64_t n, unsigned char* col, uint16_t* depth, unsigned char* ir)
+{
+    int cw = cfg.colWidth, ch = cfg.colHeight;
+    int dw = cfg.depthWidth, dh = cfg.depthHeight;
+    int r = std::max(2, dw/160);
+    int cr = std::max(2, r*cw/dw);
+    uint16_t raise = static_cast<uint16_t>(0.004f/cfg.depthScale);     // 4 mm above the floor
+
+    for (int k = 0; k < cfg.movers; k++) {
+        // fixed Lissajous path per mover: frame n always looks the same
+        double t = n*0.02*(1 + k%5);
+        double fx = 0.5 + 0.42*std::sin(t + k*1.7);
+        double fy = 0.5 + 0.42*std::sin(0.7*t + k*2.3);
+
+        int cx = static_cast<int>(fx*dw), cy = static_cast<int>(fy*dh);
+        for (int y = std::max(0, cy - r); y <= std::min(dh - 1, cy + r); y++) {
+            for (int x = std::max(0, cx - r); x <= std::min(dw - 1, cx + r); x++) {
+                if ((x-cx)*(x-cx) + (y-cy)*(y-cy) > r*r) continue;
+                size_t i = static_cast<size_t>(y)*dw + x;
+                if (depth[i] > raise) depth[i] -= raise;
+                ir[i] = 230;
+            }
+        }
+
+        int ccx = static_cast<int>(fx*cw), ccy = static_cast<int>(fy*ch);
+        for (int y = std::max(0, ccy - cr); y <= std::min(ch - 1, ccy + cr); y++) {
+            for (int x = std::max(0, ccx - cr); x <= std::min(cw - 1, ccx + cr); x++) {
+                if ((x-ccx)*(x-ccx) + (y-ccy)*(y-ccy) > cr*cr) continue;
+                unsigned char* p = col + (static_cast<size_t>(y)*cw + x)*3;
+                p[0] = 60; p[1] = 40; p[2] = 20;
+            }
+        }
+    }
+}
+
+bool syntheticSource::start()
+{
+    make_backgrounds();
+    frameCount = 0;
+    startTime = bchrono::steady_clock::now();
+    return true;
+}
+
+bool syntheticSource::wait_for_frames(frameSet& frames)
+{
+    int64_t n = frameCount++;
+
+    if (cfg.realtime && cfg.fps > 0) {
+        bchrono::steady_clock::time_point due = startTime + bchrono::microseconds(static_cast<int64_t>(n*1e6/cfg.fps));
+        boost::this_thread::sleep_until(due);
+    }
+
+    int b = static_cast<int>(n & 1);
+    std::memcpy(colOut[b].data(), colBackground.data(), colBackground.size());
+    std::memcpy(depthOut[b].data(), depthBackground.data(), depthBackground.size()*sizeof(uint16_t));
+    std::memcpy(irOut[b].data(), irBackground.data(), irBackground.size());
+    draw_movers(n, colOut[b].data(), depthOut[b].data(), irOut[b].data());
+    if (cfg.secondIR) std::memcpy(ir2Out[b].data(), irOut[b].data(), irOut[b].size());
+
+    double stamp = cfg.fps > 0 ? n*1000.0/cfg.fps : 0.0;
+
+    frames.colour.data = colOut[b].data();
+    frames.colour.width = cfg.colWidth;
+    frames.colour.height = cfg.colHeight;
+
+    frames.depth.data = depthOut[b].data();
+    frames.depth.width = cfg.depthWidth;
+    frames.depth.height = cfg.depthHeight;
+
+    frames.ir.data = irOut[b].data();
+    frames.ir.width = cfg.depthWidth;
+    frames.ir.height = cfg.depthHeight;
+
+    frames.ir2 = sourceFrame();
+    if (cfg.secondIR) {
+        frames.ir2 = frames.ir;
+        frames.ir2.data = ir2Out[b].data();
+    }
+
+    sourceFrame* all[] = { &frames.colour, &frames.depth, &frames.ir, &frames.ir2 };
+    for (int i = 0; i < 4; i++) {
+        if (!all[i]->valid()) continue;
+        all[i]->framenum = n;
+        all[i]->timestamp = stamp;
+    }
+    frames.stamp_arrival();
+    return true;
+}
+
+bool syntheticSource::calibration(alignCalibration& out) const
+{
+    // roughly a D415: 65 degree horizontal field of view on both cameras
+    const float f = 0.78f;
+    out.depth = cameraIntrinsics();
+    out.depth.width = cfg.depthWidth;
+    out.depth.height = cfg.depthHeight;
+    out.depth.fx = out.depth.fy = f*cfg.depthWidth;
+    out.depth.ppx = 0.5f*cfg.depthWidth;
+    out.depth.ppy = 0.5f*cfg.depthHeight;
+    out.colour = cameraIntrinsics();
+    out.colour.width = cfg.colWidth;
+    out.colour.height = cfg.colHeight;
+    out.colour.fx = out.colour.fy = f*cfg.colWidth;
+    out.colour.ppx = 0.5f*cfg.colWidth;
+    out.colour.ppy = 0.5f*cfg.colHeight;
+    out.depthToColour = cameraExtrinsics();
+    out.depthToColour.translation[0] = 0.015f;
+    out.depthScale = cfg.depthScale;
+    return true;
+}
@@ -0,0 +1,86 @@
+/* syntheticsource.h
+ *
+ * Description:
+ *   header file for syntheticSource class
+ *   frameSource that generates deterministic frames at any resolution and
+ *   frame rate, for benchmarking and testing without a camera. Each stream has
+ *   a fixed background (tilted arena floor with a few depth holes, textured IR,
+ *   colour gradient) with small "termites" moving along fixed Lissajous paths,
+ *   so frame N is always identical. Frames are paced to fps in realtime mode,
+ *   or produced as fast as the consumer takes them.
+ *
+ * Functions:
+ *   see framesource.h
+ *   calibration - ideal pinhole pair: colour field of view as depth, 15 mm to the side
+ *
+ * Input:
+ *   syntheticConfig (stream sizes, fps, realtime, number of movers)
+ *
+ * Output:
+ *   frameSet
+ *
+ * Requirements:
+ *   depthaligner.h
+ *   boost/thread, boost/chrono
+ *
+ * Thread safe? NO
+ *
+ * Extendable? YES
+ */
+
+#ifndef SYNTHETICSOURCE_H
+#define SYNTHETICSOURCE_H
+
+#include <boost/chrono/chrono.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "framesource.h"
+
+struct syntheticConfig
+{
+    int colWidth = 1920;
+    int colHeight = 1080;
+    int depthWidth = 640;
+    int depthHeight = 480;
+    float fps = 30;
+    bool realtime = true;       // false: as fast as wait_for_frames is called
+    bool secondIR = false;
+    int movers = 40;            // simulated termites
+    float depthScale = 0.001f;
+};
+
+class syntheticSource : public frameSource
+{
+    syntheticConfig cfg;
+
+    std::vector<unsigned char> colBackground;
+    std::vector<uint16_t> depthBackground;
+    std::vector<unsigned char> irBackground;
+
+    // double-buffered output, so the previous frameset stays valid for one more call
+    std::vector<unsigned char> colOut[2];
+    std::vector<uint16_t> depthOut[2];
+    std::vector<unsigned char> irOut[2];
+    std::vector<unsigned char> ir2Out[2];
+
+    int64_t frameCount;
+    boost::chrono::steady_clock::time_point startTime;
+
+    void make_backgrounds();
+    void draw_movers(int64_t n, unsigned char* col, uint16_t* depth, unsigned char* ir);
+
+public:
+    explicit syntheticSource(const syntheticConfig& s_cfg = syntheticConfig());
+
+    bool start();
+    bool wait_for_frames(frameSet& frames);
+    void stop() {}
+
+    float depth_scale() const { return cfg.depthScale; }
+    bool calibration(alignCalibration& out) const;
+    std::string name() const { return "synthetic"; }
+};
+
+#endif // SYNTHETICSOURCE_H
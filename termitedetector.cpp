@@ -0,0 +1,188 @@
+#include "termitedetector.h"
+
+#include <boost/chrono/chrono.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace bfs = boost::filesystem;
+
+namespace {
+
+const uint8_t depthBit = 1;
+const uint8_t irBit = 2;
+
+}
+
+termiteDetector::termiteDetector(const detectorConfig& d_cfg)
+    : cfg(d_cfg), pool(std::max(0, d_cfg.workers)), maxPixels(0), tracks(d_cfg.tracking), tracking(false), lastFlush(0.0),
+      quit(false), submitted(0), n_processed(0), n_dropped(0), n_detections(0)
+{
+}
+
+termiteDetector::~termiteDetector()
+{
+    stop();
+}
+
+bool termiteDetector::start(const bfs::path& file, size_t max_pixels, const bfs::path& track_file)
+{
+    if (thread.joinable()) return false;
+
+    log.open(file);
+    if (!log) {
+        std::cerr << "Cannot open detection log " << file << std::endl;
+        return false;
+    }
+    log << "frame,sensor_frame,timestamp_ms,blob,x,y,area,depth_m,left,top,right,bottom\n";
+
+    // everything the session needs is allocated here: nothing grows per frame but the blob list
+    int n = std::max(1, cfg.queueFrames);
+    maxPixels = max_pixels;
+    jobs.assign(n, detectJob());
+    freeJobs.reset(new boost::lockfree::spsc_queue<detectJob*>(n));
+    readyJobs.reset(new boost::lockfree::spsc_queue<detectJob*>(n));
+    for (detectJob& job : jobs) {
+        if (cfg.useDepth) job.depth.resize(maxPixels);
+        if (cfg.useIr) job.ir.resize(maxPixels);
+        freeJobs->push(&job);
+    }
+    mask.assign(maxPixels, 0);
+    depthBackground = backgroundModel();
+    irBackground = backgroundModel();
+    // the track file is opened with the first frame, which gives the frame size
+    trackPath = track_file;
+    tracking = false;
+
+    submitted = 0;
+    lastFlush = host_ms();
+    quit = false;
+    thread = boost::thread(&termiteDetector::detect_loop, this);
+    return true;
+}
+
+void termiteDetector::stop()
+{
+    {
+        boost::mutex::scoped_lock l(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    if (thread.joinable()) thread.join();
+    if (log.is_open()) log.close();
+    tracks.close();
+}
+
+bool termiteDetector::submit(const sourceFrame& depth, const sourceFrame& ir)
+{
+    if (!thread.joinable()) return false;
+
+    bool useDepth = cfg.useDepth && depth.valid();
+    const sourceFrame& geometry = useDepth ? depth : ir;
+    bool useIr = cfg.useIr && ir.valid() && (!useDepth || (ir.width == depth.width && ir.height == depth.height));
+    if (!useDepth && !useIr) return false;
+
+    // frame numbers count every submitted frame, so drops show up as gaps in the log
+    int64_t frame = submitted++;
+    size_t n = static_cast<size_t>(geometry.width)*geometry.height;
+    detectJob* job;
+    if (n > maxPixels || !freeJobs->pop(job)) {
+        n_dropped++;
+        return false;
+    }
+
+    if (useDepth) std::memcpy(job->depth.data(), depth.data, n*sizeof(uint16_t));
+    if (useIr) std::memcpy(job->ir.data(), ir.data, n);
+    job->hasDepth = useDepth;
+    job->hasIr = useIr;
+    job->width = geometry.width;
+    job->height = geometry.height;
+    job->frame = frame;
+    job->sensorFrame = geometry.framenum;
+    job->timestamp = geometry.timestamp;
+    readyJobs->push(job);
+    wake.notify_one();
+    return true;
+}
+
+void termiteDetector::detect_loop()
+{
+    detectJob* job;
+    while (true) {
+        if (!readyJobs->pop(job)) {
+            boost::mutex::scoped_lock l(lock);
+            if (quit) {
+                if (readyJobs->read_available()) continue;
+                break;
+            }
+            // the timeout covers a notify that lands between the pop and the wait
+            wake.wait_for(l, boost::chrono::milliseconds(20));
+            continue;
+        }
+
+        double t0 = host_ms();
+        detect(*job);
+        detectTime.record(static_cast<uint64_t>((host_ms() - t0)*1000.0));
+        write_rows(*job);
+        freeJobs->push(job);
+        n_processed++;
+
+        double now = host_ms();
+        if (now - lastFlush >= cfg.flushSeconds*1000.0) {
+            log.flush();
+            lastFlush = now;
+        }
+    }
+    log.flush();
+}
+
+void termiteDetector::detect(const detectJob& job)
+{
+    const int w = job.width;
+    const int h = job.height;
+    if (job.hasDepth && (depthBackground.model_width() != w || depthBackground.model_height() != h))
+        depthBackground.reset(w, h, cfg.depthModel);
+    if (job.hasIr && (irBackground.model_width() != w || irBackground.model_height() != h))
+        irBackground.reset(w, h, cfg.irModel);
+    if (job.hasDepth) depthBackground.begin_frame();
+    if (job.hasIr) irBackground.begin_frame();
+
+    uint8_t* fg = mask.data();
+    std::memset(fg, 0, static_cast<size_t>(w)*h);
+    const int bands = std::min(h, 2*(pool.size() + 1));
+    pool.parallel_for(bands, [&](int b) {
+        int y0 = static_cast<int>(static_cast<int64_t>(h)*b/bands);
+        int y1 = static_cast<int>(static_cast<int64_t>(h)*(b + 1)/bands);
+        if (job.hasDepth) depthBackground.update_rows(job.depth.data(), fg, depthBit, y0, y1);
+        if (job.hasIr) irBackground.update_rows(job.ir.data(), fg, irBit, y0, y1);
+    });
+
+    labeller.label(fg, w, h, job.hasDepth ? job.depth.data() : 0, cfg.minArea, cfg.maxArea, blobs, &pool);
+    n_detections += blobs.size();
+
+    if (!trackPath.empty() && !tracking) {
+        tracking = tracks.open(trackPath, w, h);
+        if (!tracking) {
+            std::cerr << "Cannot open track file " << trackPath << std::endl;
+            trackPath.clear();
+        }
+    }
+    if (tracking) tracks.update(blobs, job.sensorFrame, job.timestamp);
+}
+
+void termiteDetector::write_rows(const detectJob& job)
+{
+    for (size_t i = 0; i < blobs.size(); i++) {
+        const blob& b = blobs[i];
+        char line[256];
+        int len = std::snprintf(line, sizeof(line), "%lld,%lld,%.3f,%d,%.2f,%.2f,%d,",
+                                static_cast<long long>(job.frame), static_cast<long long>(job.sensorFrame),
+                                job.timestamp, static_cast<int>(i), b.x, b.y, b.area);
+        if (len < 0 || len >= static_cast<int>(sizeof(line))) continue;
+        if (b.depth > 0.0f) len += std::snprintf(line + len, sizeof(line) - len, "%.4f", b.depth*cfg.depthScale);
+        len += std::snprintf(line + len, sizeof(line) - len, ",%d,%d,%d,%d\n", b.left, b.top, b.right, b.bottom);
+        log.write(line, std::min<int>(len, sizeof(line) - 1));
+    }
+}
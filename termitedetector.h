@@ -0,0 +1,154 @@
+/* termitedetector.h
+ *
+ * Description:
+ *   header file for termiteDetector class
+ *   Live detection stage: finds moving things (termites) in the depth and
+ *   left IR streams while they are captured. Like depthStats, submit() copies
+ *   the frames into one of a few preallocated job buffers and returns at
+ *   once; with every buffer queued the frame is dropped and counted, so the
+ *   capture loop and the recorder never wait for detection.
+ *
+ *   Per frame, on the detection thread:
+ *     1. the depth and IR background models (backgroundmodel.h) are updated
+ *        and mark their foreground into one mask (depth bit 1, IR bit 2),
+ *        row bands in parallel on a workerPool
+ *     2. the mask is labelled into blobs (bloblabeller.h)
+ *     3. every blob is written to the detection log, flushed once a second
+ *     4. with tracking on, the blobs update a termiteTracker (termitetracker.h),
+ *        which gives them identities and writes the track file
+ *   Depth and IR must share a viewpoint, so submit the depth before it is
+ *   aligned to colour. IR of another size than the depth is ignored; a change
+ *   of frame size restarts the models.
+ *
+ *   CSV columns: frame, sensor_frame, timestamp_ms, blob, x, y, area,
+ *   depth_m, left, top, right, bottom (pixels; depth_m empty without depth).
+ *
+ * Functions:
+ *   start - opens the log (and the track file, if given) and allocates the jobs, mask and
+ *   models for frames up to max_pixels
+ *   stop - detects what is queued, closes the log
+ *   submit - copies a depth/IR pair for detection; false if it was dropped (never blocks)
+ *   processed/dropped/detections - counters
+ *   timing - detection (and tracking) time per frame
+ *   tracker - the tracks; read after stop()
+ *
+ * Input:
+ *   detectorConfig, Z16 depth and Y8 IR frames
+ *
+ * Output:
+ *   detection log, track file
+ *
+ * Requirements:
+ *   backgroundmodel.h, bloblabeller.h, termitetracker.h, workerpool.h, latencyhistogram.h, framesource.h
+ *   boost/filesystem, boost/lockfree, boost/thread
+ *
+ * Thread safe? submit from ONE capture thread; counters from any thread
+ *
+ * Extendable? YES
+ */
+
+#ifndef TERMITEDETECTOR_H
+#define TERMITEDETECTOR_H
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "backgroundmodel.h"
+#include "bloblabeller.h"
+#include "framesource.h"
+#include "latencyhistogram.h"
+#include "termitetracker.h"
+#include "workerpool.h"
+
+struct detectorConfig
+{
+    int workers = 1;                    // pool threads for the models and the labelling (the detection thread works too)
+    int queueFrames = 3;                // frames waiting for detection; more are dropped
+    float depthScale = 0.001f;          // metres per Z16 unit, for the log
+    bool useDepth = true;
+    bool useIr = true;
+    backgroundConfig depthModel;        // minDiff in Z16 units
+    backgroundConfig irModel;           // minDiff in grey levels
+    int minArea = 6;                    // blob size limits, pixels (maxArea 0: none)
+    int maxArea = 20000;
+    trackerConfig tracking;             // used when start() is given a track file
+    double flushSeconds = 1.0;
+};
+
+class termiteDetector
+{
+    struct detectJob
+    {
+        std::vector<uint16_t> depth;
+        std::vector<uint8_t> ir;
+        bool hasDepth = false;
+        bool hasIr = false;
+        int width = 0;
+        int height = 0;
+        int64_t frame = 0;
+        int64_t sensorFrame = 0;
+        double timestamp = 0.0;
+    };
+
+    detectorConfig cfg;
+    workerPool pool;
+
+    std::vector<detectJob> jobs;
+    std::unique_ptr<boost::lockfree::spsc_queue<detectJob*> > freeJobs;   // detection thread -> capture thread
+    std::unique_ptr<boost::lockfree::spsc_queue<detectJob*> > readyJobs;  // capture thread -> detection thread
+    size_t maxPixels;
+
+    backgroundModel depthBackground;
+    backgroundModel irBackground;
+    std::vector<uint8_t> mask;
+    blobLabeller labeller;
+    std::vector<blob> blobs;
+    termiteTracker tracks;
+    boost::filesystem::path trackPath;
+    bool tracking;
+
+    boost::filesystem::ofstream log;
+    double lastFlush;
+
+    boost::thread thread;
+    boost::mutex lock;
+    boost::condition_variable wake;
+    bool quit;
+
+    int64_t submitted;
+    std::atomic<long long> n_processed;
+    std::atomic<long long> n_dropped;
+    std::atomic<long long> n_detections;
+    latencyHistogram detectTime;
+
+    void detect_loop();
+    void detect(const detectJob& job);
+    void write_rows(const detectJob& job);
+
+public:
+    explicit termiteDetector(const detectorConfig& d_cfg);
+    ~termiteDetector();
+
+    bool start(const boost::filesystem::path& file, size_t max_pixels,
+               const boost::filesystem::path& track_file = boost::filesystem::path());
+    void stop();
+
+    bool submit(const sourceFrame& depth, const sourceFrame& ir);
+
+    long long processed() const { return n_processed; }
+    long long dropped() const { return n_dropped; }
+    long long detections() const { return n_detections; }
+    const latencyHistogram& timing() const { return detectTime; }
+    const termiteTracker& tracker() const { return tracks; }
+};
+
+#endif // TERMITEDETECTOR_H
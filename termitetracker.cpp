@@ -0,0 +1,287 @@
+#include "termitetracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "framesource.h"
+
+namespace bfs = boost::filesystem;
+
+namespace {
+
+template <typename T>
+void put(std::vector<unsigned char>& buf, const T& v)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(&v);
+    buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+void put_column(std::vector<unsigned char>& buf, const std::vector<T>& col, const std::vector<int>& rows)
+{
+    for (int r : rows) put(buf, col[r]);
+}
+
+}
+
+// ---- track store ----
+
+void trackStore::reserve(size_t n)
+{
+    id.reserve(n);
+    x.reserve(n);
+    y.reserve(n);
+    vx.reserve(n);
+    vy.reserve(n);
+    p00.reserve(n);
+    p01.reserve(n);
+    p11.reserve(n);
+    depth.reserve(n);
+    area.reserve(n);
+    hits.reserve(n);
+    misses.reserve(n);
+}
+
+void trackStore::push(uint32_t t_id, const blob& b, float var0, float speedVar)
+{
+    id.push_back(t_id);
+    x.push_back(b.x);
+    y.push_back(b.y);
+    vx.push_back(0.0f);
+    vy.push_back(0.0f);
+    p00.push_back(var0);
+    p01.push_back(0.0f);
+    p11.push_back(speedVar);
+    depth.push_back(b.depth);
+    area.push_back(static_cast<uint32_t>(b.area));
+    hits.push_back(1);
+    misses.push_back(0);
+}
+
+void trackStore::remove(size_t i)
+{
+    size_t last = size() - 1;
+    if (i != last) {
+        id[i] = id[last];
+        x[i] = x[last];
+        y[i] = y[last];
+        vx[i] = vx[last];
+        vy[i] = vy[last];
+        p00[i] = p00[last];
+        p01[i] = p01[last];
+        p11[i] = p11[last];
+        depth[i] = depth[last];
+        area[i] = area[last];
+        hits[i] = hits[last];
+        misses[i] = misses[last];
+    }
+    id.pop_back();
+    x.pop_back();
+    y.pop_back();
+    vx.pop_back();
+    vy.pop_back();
+    p00.pop_back();
+    p01.pop_back();
+    p11.pop_back();
+    depth.pop_back();
+    area.pop_back();
+    hits.pop_back();
+    misses.pop_back();
+}
+
+// ---- tracker ----
+
+termiteTracker::termiteTracker(const trackerConfig& t_cfg)
+    : cfg(t_cfg), width(0), height(0), nextId(1), lastTime(0.0), n_started(0), n_confirmed(0),
+      gridW(0), gridH(0), lastFlush(0.0)
+{
+    if (cfg.gate < 1.0f) cfg.gate = 1.0f;
+    store.reserve(cfg.maxTracks);
+}
+
+bool termiteTracker::open(const bfs::path& f_path, int f_width, int f_height)
+{
+    width = f_width;
+    height = f_height;
+    gridW = static_cast<int>(std::ceil(width/cfg.gate)) + 1;
+    gridH = static_cast<int>(std::ceil(height/cfg.gate)) + 1;
+    cellStart.assign(static_cast<size_t>(gridW)*gridH + 1, 0);
+    lastTime = 0.0;
+    lastFlush = host_ms();
+    if (f_path.empty()) return true;
+
+    file.open(f_path, std::ios::binary);
+    if (!file) return false;
+    buf.assign("TTRACKS1", "TTRACKS1" + 8);
+    put(buf, static_cast<uint32_t>(width));
+    put(buf, static_cast<uint32_t>(height));
+    file.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+    return static_cast<bool>(file);
+}
+
+void termiteTracker::close()
+{
+    if (file.is_open()) file.close();
+}
+
+void termiteTracker::predict(float dt)
+{
+    const float q = cfg.accelNoise*cfg.accelNoise;
+    const float dt2 = dt*dt;
+    const size_t n = store.size();
+    float* x = store.x.data();
+    float* y = store.y.data();
+    const float* vx = store.vx.data();
+    const float* vy = store.vy.data();
+    float* p00 = store.p00.data();
+    float* p01 = store.p01.data();
+    float* p11 = store.p11.data();
+
+    // x' = x + v dt, P' = F P F^T + Q (white acceleration)
+    for (size_t i = 0; i < n; i++) {
+        x[i] += vx[i]*dt;
+        y[i] += vy[i]*dt;
+        p00[i] += 2.0f*dt*p01[i] + dt2*p11[i] + 0.25f*q*dt2*dt2;
+        p01[i] += dt*p11[i] + 0.5f*q*dt2*dt;
+        p11[i] += q*dt2;
+    }
+}
+
+void termiteTracker::build_grid()
+{
+    // counting sort of the tracks by cell
+    const int n = static_cast<int>(store.size());
+    const float inv = 1.0f/cfg.gate;
+    trackCell.resize(n);
+    cellTracks.resize(n);
+    std::fill(cellStart.begin(), cellStart.end(), 0);
+    for (int i = 0; i < n; i++) {
+        int cx = std::min(gridW - 1, std::max(0, static_cast<int>(store.x[i]*inv)));
+        int cy = std::min(gridH - 1, std::max(0, static_cast<int>(store.y[i]*inv)));
+        trackCell[i] = cy*gridW + cx;
+        cellStart[trackCell[i] + 1]++;
+    }
+    for (size_t c = 1; c < cellStart.size(); c++) cellStart[c] += cellStart[c - 1];
+    std::vector<int>& fill = trackMatch;         // scratch: next free slot per cell
+    fill.assign(cellStart.begin(), cellStart.end() - 1);
+    for (int i = 0; i < n; i++) cellTracks[fill[trackCell[i]]++] = i;
+}
+
+void termiteTracker::associate(const std::vector<blob>& dets)
+{
+    const float gate2 = cfg.gate*cfg.gate;
+    const float inv = 1.0f/cfg.gate;
+    candidates.clear();
+    for (int d = 0; d < static_cast<int>(dets.size()); d++) {
+        const float bx = dets[d].x;
+        const float by = dets[d].y;
+        int cx = std::min(gridW - 1, std::max(0, static_cast<int>(bx*inv)));
+        int cy = std::min(gridH - 1, std::max(0, static_cast<int>(by*inv)));
+        for (int gy = std::max(0, cy - 1); gy <= std::min(gridH - 1, cy + 1); gy++) {
+            for (int gx = std::max(0, cx - 1); gx <= std::min(gridW - 1, cx + 1); gx++) {
+                int cell = gy*gridW + gx;
+                for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+                    int t = cellTracks[k];
+                    float dx = store.x[t] - bx;
+                    float dy = store.y[t] - by;
+                    float d2 = dx*dx + dy*dy;
+                    if (d2 <= gate2) candidates.push_back(candidate{d2, t, d});
+                }
+            }
+        }
+    }
+
+    // nearest pairs first; each track and each detection is used once
+    std::sort(candidates.begin(), candidates.end());
+    trackMatch.assign(store.size(), -1);
+    detTaken.assign(dets.size(), 0);
+    for (const candidate& c : candidates) {
+        if (trackMatch[c.track] >= 0 || detTaken[c.det]) continue;
+        trackMatch[c.track] = c.det;
+        detTaken[c.det] = 1;
+    }
+}
+
+void termiteTracker::update(const std::vector<blob>& dets, int64_t frame, double timestamp)
+{
+    float dt = lastTime > 0.0 ? static_cast<float>((timestamp - lastTime)/1000.0) : 0.0f;
+    if (dt <= 0.0f || dt > 1.0f) dt = 1.0f/30.0f;
+    lastTime = timestamp;
+
+    predict(dt);
+    build_grid();
+    associate(dets);
+
+    // correct the matched tracks (H = [1 0], same gain on both axes)
+    const float r = cfg.measurementNoise*cfg.measurementNoise;
+    for (size_t t = 0; t < store.size(); t++) {
+        int d = trackMatch[t];
+        if (d < 0) {
+            store.misses[t]++;
+            continue;
+        }
+        const blob& b = dets[d];
+        float s = store.p00[t] + r;
+        float k0 = store.p00[t]/s;
+        float k1 = store.p01[t]/s;
+        float ex = b.x - store.x[t];
+        float ey = b.y - store.y[t];
+        store.x[t] += k0*ex;
+        store.y[t] += k0*ey;
+        store.vx[t] += k1*ex;
+        store.vy[t] += k1*ey;
+        store.p11[t] -= k1*store.p01[t];
+        store.p01[t] *= 1.0f - k0;
+        store.p00[t] *= 1.0f - k0;
+        store.depth[t] = b.depth;
+        store.area[t] = static_cast<uint32_t>(b.area);
+        store.misses[t] = 0;
+        if (++store.hits[t] == cfg.confirmHits) n_confirmed++;
+    }
+
+    // deaths: tentative tracks at their first miss, confirmed ones after maxMisses
+    for (size_t t = store.size(); t-- > 0;) {
+        bool tentative = store.hits[t] < cfg.confirmHits;
+        if ((tentative && store.misses[t] > 0) || store.misses[t] > cfg.maxMisses) store.remove(t);
+    }
+
+    // births
+    const float speedVar = cfg.initialSpeed*cfg.initialSpeed;
+    for (size_t d = 0; d < dets.size(); d++) {
+        if (detTaken[d] || static_cast<int>(store.size()) >= cfg.maxTracks) continue;
+        store.push(nextId++, dets[d], r, speedVar);
+        n_started++;
+        if (cfg.confirmHits <= 1) n_confirmed++;
+    }
+
+    if (file.is_open()) write_frame(frame, timestamp);
+}
+
+void termiteTracker::write_frame(int64_t frame, double timestamp)
+{
+    std::vector<int>& rows = trackMatch;        // scratch: the confirmed tracks
+    rows.clear();
+    for (size_t t = 0; t < store.size(); t++)
+        if (store.hits[t] >= cfg.confirmHits) rows.push_back(static_cast<int>(t));
+
+    buf.clear();
+    put(buf, static_cast<uint32_t>(0x52465254));            // "TRFR"
+    put(buf, static_cast<uint32_t>(rows.size()));
+    put(buf, frame);
+    put(buf, timestamp);
+    put_column(buf, store.id, rows);
+    put_column(buf, store.x, rows);
+    put_column(buf, store.y, rows);
+    put_column(buf, store.vx, rows);
+    put_column(buf, store.vy, rows);
+    put_column(buf, store.depth, rows);
+    put_column(buf, store.area, rows);
+    file.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+
+    double now = host_ms();
+    if (now - lastFlush >= cfg.flushSeconds*1000.0) {
+        file.flush();
+        lastFlush = now;
+    }
+}
@@ -0,0 +1,138 @@
+/* termitetracker.h
+ *
+ * Description:
+ *   header file for termiteTracker class and trackStore
+ *   Keeps identities of detected termites (blobs, see bloblabeller.h) from
+ *   frame to frame. Every track has a constant-velocity Kalman filter on x
+ *   and y. Both axes have the same noise, so they share one 2x2 covariance:
+ *   three floats per track. Each frame:
+ *     1. tracks are predicted to the frame time
+ *     2. predicted positions go into a uniform grid (spatial hash) with cells
+ *        the size of the gate, so a detection is only compared with the
+ *        tracks of its 3x3 cells instead of every track
+ *     3. pairs within the gate are assigned greedily, nearest first
+ *     4. matched tracks are corrected; a track is confirmed after confirmHits
+ *        matches, a tentative track dies at its first miss and a confirmed
+ *        one after maxMisses; unmatched detections start tentative tracks
+ *   Tracks live in a struct of arrays (trackStore); a dead track's slot is
+ *   refilled with the last track, so the arrays stay dense.
+ *
+ *   Track file (little-endian): "TTRACKS1", uint32 width, height. Then one
+ *   chunk per frame: uint32 "TRFR", uint32 tracks, int64 frame, double
+ *   timestamp (ms), then the confirmed tracks as columns: uint32 id[tracks],
+ *   float x[], y[] (pixels), vx[], vy[] (pixels/s), depth[] (Z16 units, 0 if
+ *   unknown), uint32 area[] (pixels). Identifiers are never reused.
+ *
+ * Functions:
+ *   open - sets the frame size and creates the track file (none for an empty path)
+ *   update - one frame of detections
+ *   close - flushes and closes the track file
+ *   tracks - the live tracks
+ *   confirmed/started - counters
+ *
+ * Input:
+ *   trackerConfig, blobs per frame with frame number and timestamp
+ *
+ * Output:
+ *   track file
+ *
+ * Requirements:
+ *   bloblabeller.h
+ *   boost/filesystem
+ *
+ * Thread safe? NO (update from one thread, the detection thread)
+ *
+ * Extendable? YES
+ */
+
+#ifndef TERMITETRACKER_H
+#define TERMITETRACKER_H
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "bloblabeller.h"
+
+struct trackerConfig
+{
+    float gate = 20.0f;                 // largest detection-to-prediction distance, pixels (also the grid cell)
+    int confirmHits = 3;                // matches before a track is reported
+    int maxMisses = 10;                 // frames a confirmed track survives without a match
+    float accelNoise = 400.0f;          // process noise, pixels/s^2
+    float measurementNoise = 1.0f;      // centroid noise, pixels
+    float initialSpeed = 100.0f;        // velocity uncertainty of a new track, pixels/s
+    int maxTracks = 4096;
+    double flushSeconds = 1.0;
+};
+
+// live tracks, one column per field
+struct trackStore
+{
+    std::vector<uint32_t> id;
+    std::vector<float> x, y, vx, vy;
+    std::vector<float> p00, p01, p11;   // shared position/velocity covariance of both axes
+    std::vector<float> depth;
+    std::vector<uint32_t> area;
+    std::vector<int> hits;
+    std::vector<int> misses;
+
+    size_t size() const { return id.size(); }
+    void reserve(size_t n);
+    void push(uint32_t t_id, const blob& b, float var0, float speedVar);
+    void remove(size_t i);              // moves the last track into slot i
+};
+
+class termiteTracker
+{
+    trackerConfig cfg;
+    trackStore store;
+    int width;
+    int height;
+    uint32_t nextId;
+    double lastTime;
+    long long n_started;
+    long long n_confirmed;
+
+    // spatial hash of the predicted positions, rebuilt every frame
+    int gridW;
+    int gridH;
+    std::vector<int> cellStart;         // gridW*gridH + 1
+    std::vector<int> cellTracks;
+    std::vector<int> trackCell;
+
+    struct candidate
+    {
+        float d2;
+        int track;
+        int det;
+        bool operator<(const candidate& o) const { return d2 < o.d2; }
+    };
+    std::vector<candidate> candidates;
+    std::vector<int> trackMatch;
+    std::vector<char> detTaken;
+
+    boost::filesystem::ofstream file;
+    std::vector<unsigned char> buf;
+    double lastFlush;
+
+    void predict(float dt);
+    void build_grid();
+    void associate(const std::vector<blob>& dets);
+    void write_frame(int64_t frame, double timestamp);
+
+public:
+    explicit termiteTracker(const trackerConfig& t_cfg = trackerConfig());
+
+    bool open(const boost::filesystem::path& f_path, int f_width, int f_height);
+    void update(const std::vector<blob>& dets, int64_t frame, double timestamp);
+    void close();
+
+    const trackStore& tracks() const { return store; }
+    long long started() const { return n_started; }
+    long long confirmed() const { return n_confirmed; }
+};
+
+#endif // TERMITETRACKER_H
@@ -0,0 +1,85 @@
+#include "workerpool.h"
+
+#include <boost/bind.hpp>
+
+workerPool::workerPool(int n_threads)
+    : nthreads(n_threads > 0 ? n_threads : 0),
+      job(0), jobParts(0), nextPart(0), done(0), generation(0), quit(false)
+{
+    for (int i = 0; i < nthreads; i++)
+        threads.create_thread(boost::bind(&workerPool::worker_loop, this));
+}
+
+workerPool::~workerPool()
+{
+    {
+        boost::mutex::scoped_lock guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    threads.join_all();
+}
+
+void workerPool::run_parts(const std::function<void(int)>* fn, int parts)
+{
+    // parts are claimed one at a time so uneven parts still balance
+    int part;
+    while ((part = nextPart.fetch_add(1)) < parts)
+        (*fn)(part);
+}
+
+void workerPool::worker_loop()
+{
+    long long seen = 0;
+
+    for (;;) {
+        const std::function<void(int)>* fn;
+        int parts;
+        {
+            boost::mutex::scoped_lock guard(lock);
+            while (!quit && generation == seen) wake.wait(guard);
+            if (quit) return;
+            seen = generation;
+            fn = job;
+            parts = jobParts;
+        }
+
+        run_parts(fn, parts);
+
+        // every worker checks in once per generation, so none can outlive the call
+        boost::mutex::scoped_lock guard(lock);
+        if (++done == nthreads) finished.notify_all();
+    }
+}
+
+void workerPool::parallel_for(int n, const std::function<void(int)>& fn)
+{
+    if (n <= 0) return;
+    if (nthreads == 0 || n == 1) {
+        for (int i = 0; i < n; i++) fn(i);
+        return;
+    }
+
+    // pool already busy with another caller's frame: do this one on the caller
+    boost::mutex::scoped_lock call(callLock, boost::try_to_lock);
+    if (!call.owns_lock()) {
+        for (int i = 0; i < n; i++) fn(i);
+        return;
+    }
+
+    {
+        boost::mutex::scoped_lock guard(lock);
+        job = &fn;
+        jobParts = n;
+        nextPart = 0;
+        done = 0;
+        generation++;
+    }
+    wake.notify_all();
+
+    run_parts(&fn, n);
+
+    boost::mutex::scoped_lock guard(lock);
+    while (done < nthreads) finished.wait(guard);
+    job = 0;
+}
@@ -0,0 +1,66 @@
+/* workerpool.h
+ *
+ * Description:
+ *   header file for workerPool class
+ *   Small persistent thread pool for splitting ONE frame into parts (tiles,
+ *   stripes, row bands) and processing the parts in parallel. The calling
+ *   thread takes part in the work, so a pool of 0 threads just runs the parts
+ *   in order on the caller. Threads are created once, never per frame.
+ *
+ * Functions:
+ *   parallel_for - runs fn(0) .. fn(n-1) across the pool and returns when all are done
+ *   size - number of pool threads (excluding the caller)
+ *
+ * Input:
+ *   number of threads
+ *
+ * Output:
+ *   none
+ *
+ * Requirements:
+ *   boost/thread
+ *
+ * Thread safe? YES (a call made while the pool is busy runs on its caller)
+ *
+ * Extendable? YES
+ */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <atomic>
+#include <functional>
+
+class workerPool
+{
+    boost::thread_group threads;
+    int nthreads;
+
+    boost::mutex callLock;          // held by the caller that owns the pool
+    boost::mutex lock;
+    boost::condition_variable wake;
+    boost::condition_variable finished;
+
+    const std::function<void(int)>* job;
+    int jobParts;
+    std::atomic<int> nextPart;
+    int done;                       // workers finished with the current generation
+    long long generation;
+    bool quit;
+
+    void worker_loop();
+    void run_parts(const std::function<void(int)>* fn, int parts);
+
+public:
+    explicit workerPool(int n_threads);
+    ~workerPool();
+
+    void parallel_for(int n, const std::function<void(int)>& fn);
+    int size() const { return nthreads; }
+};
+
+#endif // WORKERPOOL_H